@@ -0,0 +1,1086 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* Split quadtree nodes with more than this many features.
+ */
+#define ANNOTATIONS_LEAF_SIZE (64)
+#define ANNOTATIONS_MAX_DEPTH (24)
+
+/* Tiles with more than this many features get a density map.
+ */
+#define ANNOTATIONS_MAX_DRAW (20000)
+
+/* Density map cells are this many tile pixels across.
+ */
+#define ANNOTATIONS_DENSITY_CELL (4)
+
+/* Find peak density over squares at least this many pixels across.
+ */
+#define ANNOTATIONS_DENSITY_SIZE (64)
+
+/* Radius of a point, in tile pixels.
+ */
+#define ANNOTATIONS_POINT_RADIUS (3)
+
+/* Stroke or fill the path every this many features.
+ */
+#define ANNOTATIONS_PATH_LENGTH (1000)
+
+G_DEFINE_TYPE( Annotations, annotations, G_TYPE_OBJECT );
+
+static int annotations_serial = 0;
+
+static void
+annotations_dispose( GObject *object )
+{
+	Annotations *annotations = (Annotations *) object;
+
+#ifdef DEBUG
+	printf( "annotations_dispose: %p\n", object );
+#endif /*DEBUG*/
+
+	VIPS_FREE( annotations->filename );
+	VIPS_FREE( annotations->coords );
+	VIPS_FREE( annotations->features );
+	VIPS_FREE( annotations->nodes );
+	VIPS_FREE( annotations->index );
+
+	G_OBJECT_CLASS( annotations_parent_class )->dispose( object );
+}
+
+static void
+annotations_finalize( GObject *object )
+{
+	Annotations *annotations = (Annotations *) object;
+
+	g_mutex_clear( &annotations->lock );
+
+	G_OBJECT_CLASS( annotations_parent_class )->finalize( object );
+}
+
+static void
+annotations_init( Annotations *annotations )
+{
+	g_mutex_init( &annotations->lock );
+
+	/* Tiles start with an overlay serial of 0, so never use that.
+	 */
+	annotations->serial = g_atomic_int_add( &annotations_serial, 1 ) + 1;
+}
+
+static void
+annotations_class_init( AnnotationsClass *class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
+
+	gobject_class->dispose = annotations_dispose;
+	gobject_class->finalize = annotations_finalize;
+}
+
+/* Features as we parse them.
+ */
+typedef struct _AnnotationsLoad {
+	const char *filename;
+	GArray *coords;
+	GArray *features;
+} AnnotationsLoad;
+
+static void
+annotations_load_vertex( AnnotationsLoad *load, double x, double y )
+{
+	float xy[2];
+
+	xy[0] = x;
+	xy[1] = y;
+	g_array_append_vals( load->coords, xy, 2 );
+}
+
+/* End a feature that began at vertex start.
+ */
+static void
+annotations_load_feature( AnnotationsLoad *load, guint32 start )
+{
+	AnnotationsFeature feature;
+
+	feature.start = start;
+	feature.n = load->coords->len / 2 - start;
+	if( feature.n > 0 )
+		g_array_append_val( load->features, feature );
+}
+
+static const char *
+annotations_skip( const char *p )
+{
+	while( g_ascii_isspace( *p ) )
+		p += 1;
+
+	return( p );
+}
+
+static gboolean
+annotations_isnumber( const char *p )
+{
+	return( g_ascii_isdigit( *p ) ||
+		*p == '-' ||
+		*p == '+' ||
+		*p == '.' );
+}
+
+/* Parse a GeoJSON position, eg. [1.5, 2], and return a pointer to just
+ * after it, or NULL on error.
+ */
+static const char *
+annotations_geojson_position( AnnotationsLoad *load, const char *p )
+{
+	double xy[2];
+	int i;
+
+	p = annotations_skip( p );
+	if( *p != '[' )
+		return( NULL );
+	p += 1;
+
+	for( i = 0; ; i++ ) {
+		char *end;
+		double v;
+
+		p = annotations_skip( p );
+		v = g_ascii_strtod( p, &end );
+		if( end == p )
+			return( NULL );
+		if( i < 2 )
+			xy[i] = v;
+
+		p = annotations_skip( end );
+		if( *p == ']' )
+			break;
+		if( *p != ',' )
+			return( NULL );
+		p += 1;
+	}
+
+	if( i < 1 )
+		return( NULL );
+
+	annotations_load_vertex( load, xy[0], xy[1] );
+
+	return( p + 1 );
+}
+
+/* Parse an array of positions, or an array of arrays of positions, and so
+ * on. Each array of positions is a line or ring, unless points is set
+ * (for MultiPoint).
+ */
+static const char *
+annotations_geojson_array( AnnotationsLoad *load,
+	const char *p, gboolean points )
+{
+	gboolean positions;
+	guint32 start;
+
+	p = annotations_skip( p );
+	if( *p != '[' )
+		return( NULL );
+	p = annotations_skip( p + 1 );
+	if( *p == ']' )
+		return( p + 1 );
+	if( *p != '[' )
+		return( NULL );
+	positions = annotations_isnumber( annotations_skip( p + 1 ) );
+
+	start = load->coords->len / 2;
+	for(;;) {
+		if( positions ) {
+			if( points )
+				start = load->coords->len / 2;
+			if( !(p = annotations_geojson_position( load, p )) )
+				return( NULL );
+			if( points )
+				annotations_load_feature( load, start );
+		}
+		else if( !(p = annotations_geojson_array( load, p, points )) )
+			return( NULL );
+
+		p = annotations_skip( p );
+		if( *p == ']' )
+			break;
+		if( *p != ',' )
+			return( NULL );
+		p += 1;
+	}
+
+	if( positions &&
+		!points )
+		annotations_load_feature( load, start );
+
+	return( p + 1 );
+}
+
+/* TRUE if the last geometry type between from and the coordinates is
+ * MultiPoint. The type usually comes just before the coordinates, and if it
+ * comes after, we'll find the Feature type instead and draw the points as a
+ * line.
+ */
+static gboolean
+annotations_geojson_is_points( const char *from, const char *coordinates )
+{
+	const char *type;
+	const char *p;
+
+	type = NULL;
+	for( p = from;
+		(p = g_strstr_len( p, coordinates - p, "\"type\"" ));
+		p += 6 )
+		type = p;
+	if( !type )
+		return( FALSE );
+
+	p = annotations_skip( type + 6 );
+	if( *p != ':' )
+		return( FALSE );
+	p = annotations_skip( p + 1 );
+
+	return( g_str_has_prefix( p, "\"MultiPoint\"" ) );
+}
+
+/* TRUE if p starts an array which could hold GeoJSON positions, rather than
+ * eg. a list of strings.
+ */
+static gboolean
+annotations_geojson_is_coordinates( const char *p )
+{
+	if( *p != '[' )
+		return( FALSE );
+	p = annotations_skip( p + 1 );
+
+	return( *p == '[' ||
+		*p == ']' ||
+		annotations_isnumber( p ) );
+}
+
+/* We don't need a full JSON parser: every geometry has a "coordinates"
+ * member, and the nesting of the arrays tells us what's inside. The word 
+ * can also turn up as a string value or a property name, so skip any 
+ * match which isn't followed by an array of numbers.
+ */
+static int
+annotations_load_geojson( AnnotationsLoad *load,
+	const char *text, size_t length )
+{
+	const char *end = text + length;
+	const char *from;
+	const char *key;
+	const char *p;
+
+	for( from = text;
+		(key = g_strstr_len( from, end - from, "\"coordinates\"" ));
+		from = p ) {
+		gboolean points = annotations_geojson_is_points( from, key );
+
+		p = annotations_skip( key + strlen( "\"coordinates\"" ) );
+		if( *p != ':' ||
+			!annotations_geojson_is_coordinates( 
+				annotations_skip( p + 1 ) ) ) {
+			p = key + strlen( "\"coordinates\"" );
+			continue;
+		}
+		p = annotations_skip( p + 1 );
+
+		/* A Point is a bare position.
+		 */
+		if( annotations_isnumber( annotations_skip( p + 1 ) ) ) {
+			guint32 start = load->coords->len / 2;
+
+			if( (p = annotations_geojson_position( load, p )) )
+				annotations_load_feature( load, start );
+		}
+		else
+			p = annotations_geojson_array( load, p, points );
+
+		if( !p ) {
+			vips_error( "annotations",
+				_( "%s: bad GeoJSON near byte %td" ),
+				load->filename, key - text );
+			return( -1 );
+		}
+	}
+
+	return( 0 );
+}
+
+/* A CSV header names the x and y columns, for example "x", "centroid_x" or
+ * "Centroid X µm".
+ */
+static gboolean
+annotations_csv_is_column( const char *name, const char *axis )
+{
+	char **words;
+	gboolean found;
+	int i;
+
+	words = g_strsplit_set( name, " _\"\r", -1 );
+	found = FALSE;
+	for( i = 0; words[i]; i++ )
+		if( g_ascii_strcasecmp( words[i], axis ) == 0 )
+			found = TRUE;
+	g_strfreev( words );
+
+	return( found );
+}
+
+static int
+annotations_load_csv( AnnotationsLoad *load, char *text, size_t length )
+{
+	char *end = text + length;
+	int x_column = 0;
+	int y_column = 1;
+	int line_number;
+	char separator;
+	char *line;
+	char *next;
+
+	/* Sniff the separator from the first line.
+	 */
+	if( !(next = memchr( text, '\n', length )) )
+		next = end;
+	if( memchr( text, '\t', next - text ) )
+		separator = '\t';
+	else if( memchr( text, ';', next - text ) )
+		separator = ';';
+	else
+		separator = ',';
+
+	/* If the first line is a header, look for x and y columns.
+	 */
+	if( !annotations_isnumber( annotations_skip( text ) ) ) {
+		char sep[2] = { separator, '\0' };
+		char *header;
+		char **names;
+		int i;
+
+		header = g_strndup( text, next - text );
+		names = g_strsplit( header, sep, -1 );
+		x_column = -1;
+		y_column = -1;
+		for( i = 0; names[i]; i++ ) {
+			if( x_column < 0 &&
+				annotations_csv_is_column( names[i], "x" ) )
+				x_column = i;
+			if( y_column < 0 &&
+				annotations_csv_is_column( names[i], "y" ) )
+				y_column = i;
+		}
+		if( x_column < 0 ||
+			y_column < 0 ) {
+			x_column = 0;
+			y_column = 1;
+		}
+		g_strfreev( names );
+		g_free( header );
+
+		text = VIPS_MIN( next + 1, end );
+	}
+
+	line_number = 1;
+	for( line = text; line < end; line = next + 1, line_number++ ) {
+		double xy[2];
+		int found;
+		int column;
+		char *p;
+
+		if( !(next = memchr( line, '\n', end - line )) )
+			next = end;
+
+		p = (char *) annotations_skip( line );
+		if( p >= next )
+			continue;
+
+		found = 0;
+		for( column = 0; p < next; column++ ) {
+			if( column == x_column ||
+				column == y_column ) {
+				char *field_end;
+				double v;
+
+				if( *p == '"' )
+					p += 1;
+				v = g_ascii_strtod( p, &field_end );
+				if( field_end != p ) {
+					xy[column == y_column] = v;
+					found += 1;
+				}
+			}
+
+			if( !(p = memchr( p, separator, next - p )) )
+				break;
+			p += 1;
+		}
+
+		if( found < 2 ) {
+			vips_error( "annotations",
+				_( "%s: no x, y on line %d" ),
+				load->filename, line_number );
+			return( -1 );
+		}
+
+		annotations_load_vertex( load, xy[0], xy[1] );
+		annotations_load_feature( load, load->coords->len / 2 - 1 );
+	}
+
+	return( 0 );
+}
+
+/* State for building the quadtree.
+ */
+typedef struct _AnnotationsBuild {
+	Annotations *annotations;
+	GArray *nodes;
+
+	/* Bounding box of each feature as left, top, right, bottom.
+	 */
+	float *bbox;
+
+	/* Workspace for sorting features into quadrants.
+	 */
+	guint8 *code;
+	guint32 *scratch;
+} AnnotationsBuild;
+
+/* 0 if the box straddles the centre, or 1 - 4 for the quadrant it fits in,
+ * top-left first.
+ */
+static int
+annotations_quadrant( float *bbox, float mid_x, float mid_y )
+{
+	int q;
+
+	if( bbox[2] < mid_x )
+		q = 1;
+	else if( bbox[0] >= mid_x )
+		q = 2;
+	else
+		return( 0 );
+
+	if( bbox[3] < mid_y )
+		return( q );
+	else if( bbox[1] >= mid_y )
+		return( q + 2 );
+	else
+		return( 0 );
+}
+
+static void
+annotations_build_node( AnnotationsBuild *build,
+	int i, guint32 start, guint32 n, int depth )
+{
+	guint32 *index = build->annotations->index + start;
+	AnnotationsNode *node =
+		&g_array_index( build->nodes, AnnotationsNode, i );
+
+	float left;
+	float top;
+	float half;
+	guint32 counts[5];
+	guint32 offsets[5];
+	guint32 offset;
+	guint32 j;
+	int child;
+	int q;
+
+	node->start = start;
+	node->total = n;
+	node->n = n;
+	if( n <= ANNOTATIONS_LEAF_SIZE ||
+		depth >= ANNOTATIONS_MAX_DEPTH )
+		return;
+
+	left = node->left;
+	top = node->top;
+	half = node->size / 2;
+
+	memset( counts, 0, sizeof( counts ) );
+	for( j = 0; j < n; j++ ) {
+		q = annotations_quadrant( build->bbox + 4 * index[j],
+			left + half, top + half );
+		build->code[j] = q;
+		counts[q] += 1;
+	}
+
+	/* Everything straddles the centre, so splitting won't help.
+	 */
+	if( counts[0] == n )
+		return;
+
+	/* Sort into straddlers, then each quadrant.
+	 */
+	offsets[0] = 0;
+	for( q = 1; q < 5; q++ )
+		offsets[q] = offsets[q - 1] + counts[q - 1];
+	for( j = 0; j < n; j++ )
+		build->scratch[offsets[build->code[j]]++] = index[j];
+	memcpy( index, build->scratch, n * sizeof( guint32 ) );
+
+	child = build->nodes->len;
+	node->n = counts[0];
+	node->child = child;
+
+	/* This can move the nodes array, so node is invalid after here.
+	 */
+	for( q = 0; q < 4; q++ ) {
+		AnnotationsNode new_node = { 0 };
+
+		new_node.left = left + (q & 1) * half;
+		new_node.top = top + (q >> 1) * half;
+		new_node.size = half;
+		g_array_append_val( build->nodes, new_node );
+	}
+
+	offset = start + counts[0];
+	for( q = 0; q < 4; q++ ) {
+		annotations_build_node( build,
+			child + q, offset, counts[q + 1], depth + 1 );
+		offset += counts[q + 1];
+	}
+}
+
+static void
+annotations_build( Annotations *annotations )
+{
+	AnnotationsBuild build;
+	AnnotationsNode root = { 0 };
+	float min_x;
+	float min_y;
+	float max_x;
+	float max_y;
+	guint32 i;
+	int j;
+
+	build.annotations = annotations;
+	build.nodes = g_array_new( FALSE, FALSE, sizeof( AnnotationsNode ) );
+	build.bbox = g_new( float, 4 * annotations->n_features );
+	build.code = g_new( guint8, annotations->n_features );
+	build.scratch = g_new( guint32, annotations->n_features );
+
+	min_x = min_y = G_MAXFLOAT;
+	max_x = max_y = -G_MAXFLOAT;
+	for( i = 0; i < annotations->n_features; i++ ) {
+		AnnotationsFeature *feature = &annotations->features[i];
+		float *xy = annotations->coords + 2 * feature->start;
+		float *bbox = build.bbox + 4 * i;
+
+		guint32 k;
+
+		bbox[0] = bbox[2] = xy[0];
+		bbox[1] = bbox[3] = xy[1];
+		for( k = 1; k < feature->n; k++ ) {
+			bbox[0] = VIPS_MIN( bbox[0], xy[2 * k] );
+			bbox[1] = VIPS_MIN( bbox[1], xy[2 * k + 1] );
+			bbox[2] = VIPS_MAX( bbox[2], xy[2 * k] );
+			bbox[3] = VIPS_MAX( bbox[3], xy[2 * k + 1] );
+		}
+
+		min_x = VIPS_MIN( min_x, bbox[0] );
+		min_y = VIPS_MIN( min_y, bbox[1] );
+		max_x = VIPS_MAX( max_x, bbox[2] );
+		max_y = VIPS_MAX( max_y, bbox[3] );
+	}
+
+	annotations->index = g_new( guint32, annotations->n_features );
+	for( i = 0; i < annotations->n_features; i++ )
+		annotations->index[i] = i;
+
+	root.left = min_x;
+	root.top = min_y;
+	root.size = VIPS_MAX( max_x - min_x, max_y - min_y ) + 1;
+	g_array_append_val( build.nodes, root );
+	annotations_build_node( &build, 0, 0, annotations->n_features, 0 );
+
+	annotations->n_nodes = build.nodes->len;
+	annotations->nodes =
+		(AnnotationsNode *) g_array_free( build.nodes, FALSE );
+	VIPS_FREE( build.bbox );
+	VIPS_FREE( build.code );
+	VIPS_FREE( build.scratch );
+
+	/* The peak density, measured over squares large enough to not be
+	 * dominated by a few stacked detections.
+	 */
+	annotations->max_density = annotations->n_features /
+		(annotations->nodes[0].size * annotations->nodes[0].size);
+	for( j = 0; j < annotations->n_nodes; j++ ) {
+		AnnotationsNode *node = &annotations->nodes[j];
+
+		if( node->size >= ANNOTATIONS_DENSITY_SIZE )
+			annotations->max_density =
+				VIPS_MAX( annotations->max_density,
+					node->total / (node->size * node->size) );
+	}
+}
+
+Annotations *
+annotations_new_from_file( const char *filename )
+{
+	Annotations *annotations;
+	AnnotationsLoad load;
+	GError *error = NULL;
+	GTimer *timer;
+	char *text;
+	gsize length;
+	int result;
+
+	timer = g_timer_new();
+
+	if( !g_file_get_contents( filename, &text, &length, &error ) ) {
+		vips_error( "annotations", "%s", error->message );
+		g_error_free( error );
+		g_timer_destroy( timer );
+		return( NULL );
+	}
+
+	load.filename = filename;
+	load.coords = g_array_new( FALSE, FALSE, sizeof( float ) );
+	load.features = g_array_new( FALSE, FALSE,
+		sizeof( AnnotationsFeature ) );
+
+	if( vips_iscasepostfix( filename, ".csv" ) ||
+		vips_iscasepostfix( filename, ".tsv" ) ||
+		vips_iscasepostfix( filename, ".txt" ) )
+		result = annotations_load_csv( &load, text, length );
+	else
+		result = annotations_load_geojson( &load, text, length );
+	g_free( text );
+
+	if( !result &&
+		load.features->len == 0 ) {
+		vips_error( "annotations",
+			_( "%s: no features found" ), filename );
+		result = -1;
+	}
+
+	if( result ) {
+		g_array_free( load.coords, TRUE );
+		g_array_free( load.features, TRUE );
+		g_timer_destroy( timer );
+		return( NULL );
+	}
+
+	annotations = g_object_new( TYPE_ANNOTATIONS, NULL );
+	annotations->filename = g_strdup( filename );
+	annotations->n_coords = load.coords->len / 2;
+	annotations->coords = (float *) g_array_free( load.coords, FALSE );
+	annotations->n_features = load.features->len;
+	annotations->features =
+		(AnnotationsFeature *) g_array_free( load.features, FALSE );
+	annotations->load_time = g_timer_elapsed( timer, NULL );
+
+	g_timer_start( timer );
+	annotations_build( annotations );
+	annotations->index_time = g_timer_elapsed( timer, NULL );
+	g_timer_destroy( timer );
+
+#ifdef DEBUG
+	printf( "annotations_new_from_file: %s, %u features, %d nodes, "
+		"load %gs, index %gs\n",
+		filename, annotations->n_features, annotations->n_nodes,
+		annotations->load_time, annotations->index_time );
+#endif /*DEBUG*/
+
+	return( annotations );
+}
+
+static void
+annotations_new_from_file_thread( GTask *task,
+	gpointer source_object, gpointer task_data,
+	GCancellable *cancellable )
+{
+	const char *filename = (const char *) task_data;
+
+	Annotations *annotations;
+
+	if( g_task_return_error_if_cancelled( task ) )
+		return;
+
+	if( !(annotations = annotations_new_from_file( filename )) ) {
+		g_task_return_new_error( task,
+			G_IO_ERROR, G_IO_ERROR_FAILED,
+			"%s", vips_error_buffer() );
+		vips_error_clear();
+		return;
+	}
+
+	g_task_return_pointer( task, annotations, g_object_unref );
+}
+
+/* Large layers can take a few seconds to parse and index, so load in a
+ * worker thread. Call annotations_new_from_file_finish() in the callback.
+ */
+void
+annotations_new_from_file_async( const char *filename,
+	GCancellable *cancellable,
+	GAsyncReadyCallback callback, gpointer user_data )
+{
+	GTask *task;
+
+	task = g_task_new( NULL, cancellable, callback, user_data );
+	g_task_set_source_tag( task, annotations_new_from_file_async );
+	g_task_set_task_data( task, g_strdup( filename ), g_free );
+	g_task_set_return_on_cancel( task, TRUE );
+	g_task_run_in_thread( task, annotations_new_from_file_thread );
+	g_object_unref( task );
+}
+
+Annotations *
+annotations_new_from_file_finish( GAsyncResult *result, GError **error )
+{
+	g_return_val_if_fail( g_task_is_valid( result, NULL ), NULL );
+
+	return( g_task_propagate_pointer( G_TASK( result ), error ) );
+}
+
+/* State for drawing one tile.
+ */
+typedef struct _AnnotationsRender {
+	Annotations *annotations;
+
+	/* The tile, and the area we fetch features from, in level 0
+	 * coordinates. The area is larger, so points on the edge of the
+	 * next tile are drawn on this one too.
+	 */
+	VipsRect *bounds;
+	float area[4];
+
+	/* Level 0 to tile pixels.
+	 */
+	double scale;
+
+	/* Points are filled and lines are stroked, so we build them up on
+	 * separate contexts.
+	 */
+	cairo_t *points;
+	cairo_t *lines;
+	int n_points;
+	int n_lines;
+
+	/* Features per density map cell.
+	 */
+	guint32 *cells;
+	int cells_across;
+	int cells_down;
+} AnnotationsRender;
+
+static gboolean
+annotations_node_overlaps( AnnotationsNode *node, float *area )
+{
+	return( node->left <= area[2] &&
+		node->top <= area[3] &&
+		node->left + node->size >= area[0] &&
+		node->top + node->size >= area[1] );
+}
+
+static gboolean
+annotations_node_inside( AnnotationsNode *node, float *area )
+{
+	return( node->left >= area[0] &&
+		node->top >= area[1] &&
+		node->left + node->size <= area[2] &&
+		node->top + node->size <= area[3] );
+}
+
+/* An upper bound on the number of features in area, stopping once we pass
+ * limit.
+ */
+static guint32
+annotations_count( Annotations *annotations,
+	int i, float *area, guint32 limit )
+{
+	AnnotationsNode *node = &annotations->nodes[i];
+
+	guint32 count;
+	int q;
+
+	if( !annotations_node_overlaps( node, area ) )
+		return( 0 );
+	if( !node->child ||
+		annotations_node_inside( node, area ) )
+		return( node->total );
+
+	count = node->n;
+	for( q = 0; q < 4 && count <= limit; q++ )
+		count += annotations_count( annotations,
+			node->child + q, area, limit );
+
+	return( count );
+}
+
+static void
+annotations_render_flush( AnnotationsRender *render )
+{
+	if( render->n_points > 0 ) {
+		cairo_fill( render->points );
+		render->n_points = 0;
+	}
+
+	if( render->n_lines > 0 ) {
+		cairo_stroke( render->lines );
+		render->n_lines = 0;
+	}
+}
+
+static void
+annotations_render_feature( AnnotationsRender *render, guint32 i )
+{
+	Annotations *annotations = render->annotations;
+	AnnotationsFeature *feature = &annotations->features[i];
+	float *xy = annotations->coords + 2 * feature->start;
+	double left = render->bounds->left;
+	double top = render->bounds->top;
+	double scale = render->scale;
+
+	guint32 k;
+
+	if( feature->n == 1 ) {
+		if( xy[0] < render->area[0] ||
+			xy[1] < render->area[1] ||
+			xy[0] > render->area[2] ||
+			xy[1] > render->area[3] )
+			return;
+
+		cairo_new_sub_path( render->points );
+		cairo_arc( render->points,
+			(xy[0] - left) * scale, (xy[1] - top) * scale,
+			ANNOTATIONS_POINT_RADIUS, 0, 2 * G_PI );
+		render->n_points += 1;
+	}
+	else {
+		cairo_move_to( render->lines,
+			(xy[0] - left) * scale, (xy[1] - top) * scale );
+		for( k = 1; k < feature->n; k++ )
+			cairo_line_to( render->lines,
+				(xy[2 * k] - left) * scale,
+				(xy[2 * k + 1] - top) * scale );
+		render->n_lines += 1;
+	}
+
+	if( render->n_points + render->n_lines > ANNOTATIONS_PATH_LENGTH )
+		annotations_render_flush( render );
+}
+
+static void
+annotations_render_node( AnnotationsRender *render, int i )
+{
+	Annotations *annotations = render->annotations;
+	AnnotationsNode *node = &annotations->nodes[i];
+
+	guint32 j;
+	int q;
+
+	if( !annotations_node_overlaps( node, render->area ) )
+		return;
+
+	for( j = 0; j < node->n; j++ )
+		annotations_render_feature( render,
+			annotations->index[node->start + j] );
+
+	if( node->child )
+		for( q = 0; q < 4; q++ )
+			annotations_render_node( render, node->child + q );
+}
+
+static void
+annotations_render_features( AnnotationsRender *render,
+	cairo_surface_t *surface )
+{
+	render->points = cairo_create( surface );
+	cairo_set_source_rgba( render->points, 1.0, 0.8, 0.0, 0.8 );
+
+	render->lines = cairo_create( surface );
+	cairo_set_source_rgba( render->lines, 0.0, 1.0, 0.5, 0.9 );
+	cairo_set_line_width( render->lines, 1.5 );
+	cairo_set_line_join( render->lines, CAIRO_LINE_JOIN_ROUND );
+
+	annotations_render_node( render, 0 );
+	annotations_render_flush( render );
+
+	VIPS_FREEF( cairo_destroy, render->points );
+	VIPS_FREEF( cairo_destroy, render->lines );
+}
+
+static void
+annotations_density_add( AnnotationsRender *render,
+	float x, float y, guint32 count )
+{
+	int cx = (x - render->bounds->left) * render->scale /
+		ANNOTATIONS_DENSITY_CELL;
+	int cy = (y - render->bounds->top) * render->scale /
+		ANNOTATIONS_DENSITY_CELL;
+
+	if( x >= render->bounds->left &&
+		y >= render->bounds->top &&
+		cx < render->cells_across &&
+		cy < render->cells_down )
+		render->cells[cx + cy * render->cells_across] += count;
+}
+
+/* Once a node is smaller than a cell, count all of it at its centre.
+ */
+static void
+annotations_density_node( AnnotationsRender *render, int i )
+{
+	Annotations *annotations = render->annotations;
+	AnnotationsNode *node = &annotations->nodes[i];
+
+	guint32 j;
+	int q;
+
+	if( !annotations_node_overlaps( node, render->area ) )
+		return;
+
+	if( node->size * render->scale <= ANNOTATIONS_DENSITY_CELL ) {
+		annotations_density_add( render,
+			node->left + node->size / 2,
+			node->top + node->size / 2,
+			node->total );
+		return;
+	}
+
+	for( j = 0; j < node->n; j++ ) {
+		guint32 f = annotations->index[node->start + j];
+		float *xy = annotations->coords +
+			2 * annotations->features[f].start;
+
+		annotations_density_add( render, xy[0], xy[1], 1 );
+	}
+
+	if( node->child )
+		for( q = 0; q < 4; q++ )
+			annotations_density_node( render, node->child + q );
+}
+
+static void
+annotations_render_density( AnnotationsRender *render,
+	cairo_surface_t *surface, int width, int height )
+{
+	double cell_size = ANNOTATIONS_DENSITY_CELL / render->scale;
+	double cell_area = cell_size * cell_size;
+
+	cairo_t *cr;
+	int x;
+	int y;
+
+	render->cells_across = VIPS_ROUND_UP( width,
+		ANNOTATIONS_DENSITY_CELL ) / ANNOTATIONS_DENSITY_CELL;
+	render->cells_down = VIPS_ROUND_UP( height,
+		ANNOTATIONS_DENSITY_CELL ) / ANNOTATIONS_DENSITY_CELL;
+	render->cells = g_new0( guint32,
+		render->cells_across * render->cells_down );
+
+	annotations_density_node( render, 0 );
+
+	/* Blue for sparse to red for the peak density, more opaque as it
+	 * gets denser.
+	 */
+	cr = cairo_create( surface );
+	for( y = 0; y < render->cells_down; y++ )
+		for( x = 0; x < render->cells_across; x++ ) {
+			guint32 count =
+				render->cells[x + y * render->cells_across];
+
+			double t;
+
+			if( !count )
+				continue;
+
+			t = sqrt( count / cell_area /
+				render->annotations->max_density );
+			t = VIPS_CLIP( 0.0, t, 1.0 );
+			cairo_set_source_rgba( cr,
+				0.1 + 0.9 * t, 0.5 - 0.4 * t, 1.0 - t,
+				0.3 + 0.5 * t );
+			cairo_rectangle( cr,
+				x * ANNOTATIONS_DENSITY_CELL,
+				y * ANNOTATIONS_DENSITY_CELL,
+				ANNOTATIONS_DENSITY_CELL,
+				ANNOTATIONS_DENSITY_CELL );
+			cairo_fill( cr );
+		}
+	cairo_destroy( cr );
+
+	VIPS_FREE( render->cells );
+}
+
+GBytes *
+annotations_render( Annotations *annotations,
+	VipsRect *bounds, int z, int width, int height, size_t *stride )
+{
+	AnnotationsRender render = { 0 };
+	cairo_surface_t *surface;
+	GTimer *timer;
+	double margin;
+	double elapsed;
+	guchar *data;
+	int data_stride;
+
+	timer = g_timer_new();
+
+	data_stride = cairo_format_stride_for_width( CAIRO_FORMAT_ARGB32,
+		width );
+	data = g_malloc0( (size_t) data_stride * height );
+	surface = cairo_image_surface_create_for_data( data,
+		CAIRO_FORMAT_ARGB32, width, height, data_stride );
+
+	render.annotations = annotations;
+	render.bounds = bounds;
+	render.scale = 1.0 / (1 << z);
+	margin = (ANNOTATIONS_POINT_RADIUS + 2) / render.scale;
+	render.area[0] = bounds->left - margin;
+	render.area[1] = bounds->top - margin;
+	render.area[2] = VIPS_RECT_RIGHT( bounds ) + margin;
+	render.area[3] = VIPS_RECT_BOTTOM( bounds ) + margin;
+
+	if( annotations_count( annotations,
+		0, render.area, ANNOTATIONS_MAX_DRAW ) > ANNOTATIONS_MAX_DRAW )
+		annotations_render_density( &render, surface, width, height );
+	else
+		annotations_render_features( &render, surface );
+
+	cairo_surface_flush( surface );
+	cairo_surface_destroy( surface );
+
+	elapsed = g_timer_elapsed( timer, NULL );
+	g_timer_destroy( timer );
+
+	g_mutex_lock( &annotations->lock );
+	annotations->n_rendered += 1;
+	annotations->render_time += elapsed;
+	annotations->max_render_time =
+		VIPS_MAX( annotations->max_render_time, elapsed );
+	g_mutex_unlock( &annotations->lock );
+
+	*stride = data_stride;
+
+	return( g_bytes_new_take( data, (size_t) data_stride * height ) );
+}
+
+/* Add a line or two of statistics to buf for the debug display.
+ */
+void
+annotations_print_stats( Annotations *annotations, VipsBuf *buf )
+{
+	vips_buf_appendf( buf, "annotations: %u features, %d nodes, "
+		"load %.2f s, index %.2f s\n",
+		annotations->n_features, annotations->n_nodes,
+		annotations->load_time, annotations->index_time );
+
+	g_mutex_lock( &annotations->lock );
+	if( annotations->n_rendered > 0 )
+		vips_buf_appendf( buf, "annotations: %d tiles, "
+			"%.1f ms mean, %.1f ms max\n",
+			annotations->n_rendered,
+			1000 * annotations->render_time /
+				annotations->n_rendered,
+			1000 * annotations->max_render_time );
+	g_mutex_unlock( &annotations->lock );
+}
@@ -0,0 +1,119 @@
+/* A layer of vector annotations, eg. cell detections or region outlines
+ * from an analysis pipeline, indexed with a quadtree so tiles can be drawn
+ * quickly.
+ */
+
+#ifndef __ANNOTATIONS_H
+#define __ANNOTATIONS_H
+
+#define TYPE_ANNOTATIONS (annotations_get_type())
+#define ANNOTATIONS( obj ) \
+	(G_TYPE_CHECK_INSTANCE_CAST( (obj), TYPE_ANNOTATIONS, Annotations ))
+#define ANNOTATIONS_CLASS( klass ) \
+	(G_TYPE_CHECK_CLASS_CAST( (klass), TYPE_ANNOTATIONS, AnnotationsClass))
+#define IS_ANNOTATIONS( obj ) \
+	(G_TYPE_CHECK_INSTANCE_TYPE( (obj), TYPE_ANNOTATIONS ))
+#define IS_ANNOTATIONS_CLASS( klass ) \
+	(G_TYPE_CHECK_CLASS_TYPE( (klass), TYPE_ANNOTATIONS ))
+#define ANNOTATIONS_GET_CLASS( obj ) \
+	(G_TYPE_INSTANCE_GET_CLASS( (obj), TYPE_ANNOTATIONS, AnnotationsClass ))
+
+/* A point, line or polygon ring: n vertices from coords[2 * start].
+ */
+typedef struct _AnnotationsFeature {
+	guint32 start;
+	guint32 n;
+} AnnotationsFeature;
+
+/* A square in the quadtree, in level 0 coordinates. Each feature sits in
+ * the smallest square that holds all of it.
+ *
+ * A node and its children own the range index[start .. start + total), with
+ * the node's own features first, then each child's in turn.
+ */
+typedef struct _AnnotationsNode {
+	float left;
+	float top;
+	float size;
+
+	/* Index of the first of four children, or 0 for a leaf.
+	 */
+	int child;
+
+	guint32 start;
+	guint32 n;
+	guint32 total;
+} AnnotationsNode;
+
+typedef struct _Annotations {
+	GObject parent_instance;
+
+	char *filename;
+
+	/* Vertices as x, y pairs in level 0 image coordinates.
+	 */
+	float *coords;
+	guint64 n_coords;
+
+	AnnotationsFeature *features;
+	guint32 n_features;
+
+	/* The quadtree. Node 0 is the root, and index maps tree order to
+	 * features.
+	 */
+	AnnotationsNode *nodes;
+	int n_nodes;
+	guint32 *index;
+
+	/* Peak features per level 0 pixel, to scale the density map.
+	 */
+	double max_density;
+
+	/* Identifies this layer, so tiles can tell if their overlay is
+	 * current.
+	 */
+	int serial;
+
+	/* Seconds to parse the file and to build the index.
+	 */
+	double load_time;
+	double index_time;
+
+	/* Render timings, in seconds. Tiles render in parallel, so these are
+	 * behind the lock.
+	 */
+	GMutex lock;
+	int n_rendered;
+	double render_time;
+	double max_render_time;
+
+} Annotations;
+
+typedef struct _AnnotationsClass {
+	GObjectClass parent_class;
+
+} AnnotationsClass;
+
+GType annotations_get_type( void );
+
+/* Load GeoJSON (any Point, LineString, Polygon and Multi- geometry) or CSV
+ * (x and y columns, one detection per line).
+ */
+Annotations *annotations_new_from_file( const char *filename );
+void annotations_new_from_file_async( const char *filename,
+	GCancellable *cancellable,
+	GAsyncReadyCallback callback, gpointer user_data );
+Annotations *annotations_new_from_file_finish( GAsyncResult *result,
+	GError **error );
+
+/* Draw the features inside bounds (level 0 coordinates) for pyramid level z
+ * as a width x height GDK_MEMORY_DEFAULT image with the given stride. Tiles
+ * with too many features to draw get a density map instead. Safe to call
+ * from any thread.
+ */
+GBytes *annotations_render( Annotations *annotations,
+	VipsRect *bounds, int z, int width, int height, size_t *stride );
+
+void annotations_print_stats( Annotations *annotations, VipsBuf *buf );
+
+#endif /*__ANNOTATIONS_H*/
@@ -0,0 +1,485 @@
+#include "vipsdisp.h"
+
+#include <glib/gstdio.h>
+
+/*
+#define DEBUG
+ */
+
+/* Each tile file starts with one of these, followed by the compressed
+ * pixels.
+ */
+#define DISK_CACHE_MAGIC (0x43544456)
+#define DISK_CACHE_VERSION (1)
+
+typedef struct _DiskCacheHeader {
+	guint32 magic;
+	guint32 version;
+	guint32 width;
+	guint32 height;
+	guint32 bands;
+	guint32 length;
+	guint32 checksum;
+} DiskCacheHeader;
+
+typedef struct _DiskCacheRead {
+	char *view;
+	char *path;
+	Tile *tile;
+	gboolean found;
+	DiskCacheReadFn fn;
+	void *a;
+} DiskCacheRead;
+
+typedef struct _DiskCacheWrite {
+	char *path;
+	int width;
+	int height;
+	int bands;
+	VipsPel *pixels;
+} DiskCacheWrite;
+
+typedef struct _DiskCacheFile {
+	char *path;
+	gint64 size;
+	gint64 mtime;
+} DiskCacheFile;
+
+/* Everything below is set from the main thread. The counters are updated by
+ * the workers, so they are protected by the lock.
+ */
+static gboolean disk_cache_enabled = FALSE;
+static gint64 disk_cache_max_bytes = 4096 * (gint64) 1024 * 1024;
+static char *disk_cache_root = NULL;
+
+static GThreadPool *disk_cache_read_pool = NULL;
+static GThreadPool *disk_cache_write_pool = NULL;
+
+static GMutex disk_cache_lock;
+static gint64 disk_cache_bytes = 0;
+static int disk_cache_n_reads = 0;
+static int disk_cache_n_hits = 0;
+static int disk_cache_n_corrupt = 0;
+static int disk_cache_n_writes = 0;
+static int disk_cache_n_trims = 0;
+
+/* Tag for the trim job we push to the write pool.
+ */
+static DiskCacheWrite disk_cache_trim_job;
+
+/* FNV-1a, fast and good enough to spot truncated or damaged files.
+ */
+static guint32
+disk_cache_checksum( VipsPel *data, size_t length )
+{
+	guint32 hash = 2166136261u;
+	size_t i;
+
+	for( i = 0; i < length; i++ ) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return( hash );
+}
+
+const char *
+disk_cache_get_root( void )
+{
+	if( !disk_cache_root )
+		disk_cache_root = g_build_filename( g_get_user_cache_dir(),
+			"vipsdisp", NULL );
+
+	return( disk_cache_root );
+}
+
+char *
+disk_cache_file_key( const char *filename )
+{
+	GStatBuf st;
+
+	if( g_stat( filename, &st ) )
+		return( NULL );
+
+	return( g_strdup_printf( "%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+		filename, (gint64) st.st_size, (gint64) st.st_mtime ) );
+}
+
+static char *
+disk_cache_tile_path( const char *view, Tile *tile )
+{
+	char name[256];
+
+	vips_snprintf( name, 256, "%d-%d-%d.tile",
+		tile->z, tile->region->valid.left, tile->region->valid.top );
+
+	return( g_build_filename( disk_cache_get_root(),
+		"tiles", view, name, NULL ) );
+}
+
+static void
+disk_cache_file_free( DiskCacheFile *file )
+{
+	VIPS_FREE( file->path );
+}
+
+static int
+disk_cache_sort_mtime( const void *a, const void *b )
+{
+	DiskCacheFile *f1 = (DiskCacheFile *) a;
+	DiskCacheFile *f2 = (DiskCacheFile *) b;
+
+	return( f1->mtime < f2->mtime ? -1 : f1->mtime > f2->mtime ? 1 : 0 );
+}
+
+/* List all tile files, and their total size.
+ */
+static GArray *
+disk_cache_scan( gint64 *total )
+{
+	GArray *files = g_array_new( FALSE, FALSE, sizeof( DiskCacheFile ) );
+	char *tiles = g_build_filename( disk_cache_get_root(), "tiles", NULL );
+
+	GDir *dir;
+	const char *view;
+
+	g_array_set_clear_func( files, (GDestroyNotify) disk_cache_file_free );
+	*total = 0;
+
+	if( !(dir = g_dir_open( tiles, 0, NULL )) ) {
+		g_free( tiles );
+		return( files );
+	}
+
+	while( (view = g_dir_read_name( dir )) ) {
+		char *view_path = g_build_filename( tiles, view, NULL );
+
+		GDir *view_dir;
+		const char *name;
+
+		if( (view_dir = g_dir_open( view_path, 0, NULL )) ) {
+			while( (name = g_dir_read_name( view_dir )) ) {
+				DiskCacheFile file;
+				GStatBuf st;
+
+				file.path = g_build_filename( view_path,
+					name, NULL );
+				if( g_stat( file.path, &st ) ) {
+					g_free( file.path );
+					continue;
+				}
+				file.size = st.st_size;
+				file.mtime = st.st_mtime;
+				*total += file.size;
+				g_array_append_val( files, file );
+			}
+
+			g_dir_close( view_dir );
+		}
+
+		g_free( view_path );
+	}
+
+	g_dir_close( dir );
+	g_free( tiles );
+
+	return( files );
+}
+
+/* Remove the least-recently-used tiles until we are comfortably under
+ * budget. We touch files on read, so mtime gives LRU order.
+ */
+static void
+disk_cache_trim( void )
+{
+	GArray *files;
+	gint64 total;
+	gint64 target;
+	int i;
+
+	files = disk_cache_scan( &total );
+	g_array_sort( files, disk_cache_sort_mtime );
+
+	g_mutex_lock( &disk_cache_lock );
+	target = disk_cache_max_bytes * 9 / 10;
+	g_mutex_unlock( &disk_cache_lock );
+
+	for( i = 0; i < files->len && total > target; i++ ) {
+		DiskCacheFile *file = &g_array_index( files, DiskCacheFile, i );
+
+		if( !g_unlink( file->path ) ) {
+			char *dirname = g_path_get_dirname( file->path );
+
+			total -= file->size;
+
+			/* Fails harmlessly if there are other tiles in there.
+			 */
+			(void) g_rmdir( dirname );
+			g_free( dirname );
+		}
+	}
+
+	g_mutex_lock( &disk_cache_lock );
+	disk_cache_bytes = total;
+	disk_cache_n_trims += 1;
+	g_mutex_unlock( &disk_cache_lock );
+
+	g_array_free( files, TRUE );
+
+#ifdef DEBUG
+	printf( "disk_cache_trim: %" G_GINT64_FORMAT " bytes in cache\n",
+		total );
+#endif /*DEBUG*/
+}
+
+static void
+disk_cache_write_worker( void *data, void *user_data )
+{
+	DiskCacheWrite *write = (DiskCacheWrite *) data;
+
+	DiskCacheHeader header;
+	VipsPel *compressed;
+	size_t length;
+	VipsPel *buf;
+	char *dirname;
+	gboolean over;
+
+	if( write == &disk_cache_trim_job ) {
+		disk_cache_trim();
+		return;
+	}
+
+	compressed = tile_store_encode( write->pixels,
+		write->width * write->bands,
+		write->width, write->height, write->bands, &length );
+
+	header.magic = DISK_CACHE_MAGIC;
+	header.version = DISK_CACHE_VERSION;
+	header.width = write->width;
+	header.height = write->height;
+	header.bands = write->bands;
+	header.length = length;
+	header.checksum = disk_cache_checksum( compressed, length );
+
+	buf = g_malloc( sizeof( header ) + length );
+	memcpy( buf, &header, sizeof( header ) );
+	memcpy( buf + sizeof( header ), compressed, length );
+
+	/* g_file_set_contents() writes to a temp file and renames, so readers
+	 * never see a partial tile.
+	 */
+	dirname = g_path_get_dirname( write->path );
+	if( !g_mkdir_with_parents( dirname, 0700 ) &&
+		g_file_set_contents( write->path,
+			(char *) buf, sizeof( header ) + length, NULL ) ) {
+		g_mutex_lock( &disk_cache_lock );
+		disk_cache_bytes += sizeof( header ) + length;
+		disk_cache_n_writes += 1;
+		over = disk_cache_bytes > disk_cache_max_bytes;
+		g_mutex_unlock( &disk_cache_lock );
+
+		if( over )
+			disk_cache_trim();
+	}
+
+	g_free( dirname );
+	g_free( buf );
+	g_free( compressed );
+	g_free( write->pixels );
+	g_free( write->path );
+	g_free( write );
+}
+
+/* Back in the main thread, tell the caller.
+ */
+static gboolean
+disk_cache_read_done_idle( void *user_data )
+{
+	DiskCacheRead *read = (DiskCacheRead *) user_data;
+
+	read->fn( read->tile, read->view, read->found, read->a );
+
+	VIPS_UNREF( read->tile );
+	g_free( read->view );
+	g_free( read->path );
+	g_free( read );
+
+	return( FALSE );
+}
+
+static gboolean
+disk_cache_read_tile( DiskCacheRead *read )
+{
+	VipsRegion *region = read->tile->region;
+	VipsRect *valid = &region->valid;
+
+	char *contents;
+	gsize length;
+	DiskCacheHeader header;
+	VipsPel *compressed;
+	gboolean ok;
+
+	if( !g_file_get_contents( read->path, &contents, &length, NULL ) )
+		return( FALSE );
+
+	ok = FALSE;
+	if( length >= sizeof( header ) ) {
+		memcpy( &header, contents, sizeof( header ) );
+		compressed = (VipsPel *) contents + sizeof( header );
+
+		ok = header.magic == DISK_CACHE_MAGIC &&
+			header.version == DISK_CACHE_VERSION &&
+			header.width == valid->width &&
+			header.height == valid->height &&
+			header.bands == region->im->Bands &&
+			header.length == length - sizeof( header ) &&
+			header.checksum == disk_cache_checksum( compressed,
+				header.length ) &&
+			!tile_store_decode( compressed, header.length,
+				VIPS_REGION_ADDR( region,
+					valid->left, valid->top ),
+				VIPS_REGION_LSKIP( region ),
+				valid->width, valid->height,
+				region->im->Bands );
+	}
+
+	g_free( contents );
+
+	if( !ok ) {
+		/* Damaged or from an old version ... junk it.
+		 */
+		(void) g_unlink( read->path );
+
+		g_mutex_lock( &disk_cache_lock );
+		disk_cache_n_corrupt += 1;
+		g_mutex_unlock( &disk_cache_lock );
+	}
+	else
+		/* Move to the fresh end of the LRU.
+		 */
+		(void) g_utime( read->path, NULL );
+
+	return( ok );
+}
+
+static void
+disk_cache_read_worker( void *data, void *user_data )
+{
+	DiskCacheRead *read = (DiskCacheRead *) data;
+
+	read->found = disk_cache_read_tile( read );
+
+	g_mutex_lock( &disk_cache_lock );
+	disk_cache_n_reads += 1;
+	if( read->found )
+		disk_cache_n_hits += 1;
+	g_mutex_unlock( &disk_cache_lock );
+
+	g_idle_add( disk_cache_read_done_idle, read );
+}
+
+void
+disk_cache_set_enabled( gboolean enabled )
+{
+	if( enabled &&
+		!disk_cache_read_pool ) {
+		disk_cache_read_pool = g_thread_pool_new(
+			disk_cache_read_worker, NULL,
+			4, FALSE, NULL );
+
+		/* A single writer, so trims and writes don't collide.
+		 */
+		disk_cache_write_pool = g_thread_pool_new(
+			disk_cache_write_worker, NULL,
+			1, FALSE, NULL );
+	}
+
+	/* Find the size of the cache from the last session.
+	 */
+	if( enabled &&
+		!disk_cache_enabled )
+		g_thread_pool_push( disk_cache_write_pool,
+			&disk_cache_trim_job, NULL );
+
+	disk_cache_enabled = enabled;
+}
+
+gboolean
+disk_cache_get_enabled( void )
+{
+	return( disk_cache_enabled );
+}
+
+void
+disk_cache_set_max_bytes( gint64 max_bytes )
+{
+	g_mutex_lock( &disk_cache_lock );
+	disk_cache_max_bytes = max_bytes;
+	g_mutex_unlock( &disk_cache_lock );
+}
+
+/* Look for a tile on disc. fn is always called, from the main thread, once
+ * the read is done. The tile region must not be touched until then.
+ */
+void
+disk_cache_read( const char *view, Tile *tile, DiskCacheReadFn fn, void *a )
+{
+	DiskCacheRead *read = g_new0( DiskCacheRead, 1 );
+
+	read->view = g_strdup( view );
+	read->path = disk_cache_tile_path( view, tile );
+	read->tile = tile;
+	g_object_ref( tile );
+	read->fn = fn;
+	read->a = a;
+
+	g_thread_pool_push( disk_cache_read_pool, read, NULL );
+}
+
+/* Save a copy of the pixels in a valid tile. Compression and the write
+ * happen in the background.
+ */
+void
+disk_cache_write( const char *view, Tile *tile )
+{
+	VipsRegion *region = tile->region;
+	VipsRect *valid = &region->valid;
+	size_t line_size = VIPS_REGION_SIZEOF_LINE( region );
+
+	DiskCacheWrite *write;
+	int y;
+
+	g_assert( tile->valid );
+
+	write = g_new0( DiskCacheWrite, 1 );
+	write->path = disk_cache_tile_path( view, tile );
+	write->width = valid->width;
+	write->height = valid->height;
+	write->bands = region->im->Bands;
+	write->pixels = g_malloc( line_size * valid->height );
+	for( y = 0; y < valid->height; y++ )
+		memcpy( write->pixels + y * line_size,
+			VIPS_REGION_ADDR( region, valid->left, valid->top + y ),
+			line_size );
+
+	g_thread_pool_push( disk_cache_write_pool, write, NULL );
+}
+
+void
+disk_cache_print_stats( VipsBuf *buf )
+{
+	if( !disk_cache_enabled )
+		return;
+
+	g_mutex_lock( &disk_cache_lock );
+	vips_buf_appendf( buf, "disk cache: %.1f of %.1f MB, "
+		"%d reads, %d hits, %d writes, %d corrupt, %d trims\n",
+		disk_cache_bytes / (1024.0 * 1024.0),
+		disk_cache_max_bytes / (1024.0 * 1024.0),
+		disk_cache_n_reads,
+		disk_cache_n_hits,
+		disk_cache_n_writes,
+		disk_cache_n_corrupt,
+		disk_cache_n_trims );
+	g_mutex_unlock( &disk_cache_lock );
+}
@@ -0,0 +1,34 @@
+/* An optional, persistent cache of rendered tiles, shared by all windows.
+ */
+
+#ifndef __DISK_CACHE_H
+#define __DISK_CACHE_H
+
+/* Called from the main thread when a read completes. If found is TRUE, the
+ * tile region has been filled with pixels from disc for this view.
+ */
+typedef void (*DiskCacheReadFn)( Tile *tile, 
+	const char *view, gboolean found, void *a );
+
+void disk_cache_set_enabled( gboolean enabled );
+gboolean disk_cache_get_enabled( void );
+void disk_cache_set_max_bytes( gint64 max_bytes );
+
+/* Everything we cache goes in subdirectories of this.
+ */
+const char *disk_cache_get_root( void );
+
+/* Identify a file by path, size and modification time, so we notice when it
+ * changes. NULL if the file can't be found.
+ */
+char *disk_cache_file_key( const char *filename );
+
+/* view is a string naming a set of tiles, see tile_source_get_view_key().
+ */
+void disk_cache_read( const char *view, Tile *tile,
+	DiskCacheReadFn fn, void *a );
+void disk_cache_write( const char *view, Tile *tile );
+
+void disk_cache_print_stats( VipsBuf *buf );
+
+#endif /*__DISK_CACHE_H*/
@@ -14,12 +14,50 @@ struct _Displaybar {
 
 	GtkWidget *action_bar;
 	GtkWidget *gears;
+	GtkWidget *channels;
+	GtkWidget *channels_box;
 	GtkWidget *page;
+	GtkWidget *histogram;
 	GtkWidget *scale;
 	GtkWidget *offset;
 
+	/* The tile_source and number of channels we built the channel 
+	 * controls for.
+	 */
+	TileSource *channels_source;
+	int n_channels;
+
+	/* Slider changes are saved here and applied at most once a frame. 
+	 * The drag ends when the sliders have been still for a moment.
+	 */
+	guint vis_tick_handler;
+	guint drag_timeout;
+	gboolean scale_pending;
+	double pending_scale;
+	gboolean offset_pending;
+	double pending_offset;
+
+	/* The histogram of visible pixels we draw, and the timeout we use to
+	 * update it as new tiles arrive.
+	 */
+	Histogram *hist;
+	guint histogram_timeout;
+
 };
 
+/* Update the histogram at most this often, in ms.
+ */
+#define HISTOGRAM_INTERVAL (250)
+
+/* The drag is over after the sliders have been still for this long, in ms.
+ */
+#define DRAG_SETTLE (200)
+
+/* Only offer per-channel controls for images with up to this many pages.
+ * Above this, pages-as-bands shows the default channels.
+ */
+#define MAX_CHANNEL_ROWS (64)
+
 G_DEFINE_TYPE( Displaybar, displaybar, GTK_TYPE_WIDGET );
 
 enum {
@@ -29,6 +67,220 @@ enum {
 	SIG_LAST
 };
 
+/* One of the controls for a channel has changed.
+ */
+static void
+displaybar_channel_changed( GtkWidget *widget, Displaybar *displaybar )
+{
+	TileSource *tile_source = 
+		image_window_get_tile_source( displaybar->win );
+	GObject *row = G_OBJECT( gtk_widget_get_parent( widget ) );
+	int channel = GPOINTER_TO_INT( g_object_get_data( row, "channel" ) );
+
+	VisKernelChannel settings;
+	GdkRGBA rgba;
+
+	if( !tile_source )
+		return;
+
+	settings.selected = gtk_check_button_get_active( 
+		GTK_CHECK_BUTTON( g_object_get_data( row, "check" ) ) );
+	gtk_color_chooser_get_rgba( 
+		GTK_COLOR_CHOOSER( g_object_get_data( row, "tint" ) ), &rgba );
+	settings.tint[0] = rgba.red;
+	settings.tint[1] = rgba.green;
+	settings.tint[2] = rgba.blue;
+	settings.low = gtk_spin_button_get_value( 
+		GTK_SPIN_BUTTON( g_object_get_data( row, "low" ) ) );
+	settings.high = gtk_spin_button_get_value( 
+		GTK_SPIN_BUTTON( g_object_get_data( row, "high" ) ) );
+
+	tile_source_set_channel( tile_source, channel, &settings );
+}
+
+/* Make a row of controls for each channel: on/off, a tint colour, and the 
+ * low and high ends of the window. Images with very many pages get no
+ * controls, since four widgets a page would be far too many.
+ */
+static void
+displaybar_channels_update( Displaybar *displaybar, TileSource *tile_source )
+{
+	gboolean visible = 
+		tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS &&
+		tile_source->channels &&
+		tile_source->n_pages <= MAX_CHANNEL_ROWS;
+
+	double max;
+	GtkWidget *child;
+	int i;
+
+	gtk_widget_set_visible( displaybar->channels, visible );
+	if( !visible ||
+		(displaybar->channels_source == tile_source &&
+		 displaybar->n_channels == tile_source->n_pages) )
+		return;
+
+	while( (child = gtk_widget_get_first_child( displaybar->channels_box )) )
+		gtk_box_remove( GTK_BOX( displaybar->channels_box ), child );
+
+	max = vis_kernel_format_max( tile_source->image->BandFmt );
+
+	for( i = 0; i < tile_source->n_pages; i++ ) {
+		VisKernelChannel *channel = &tile_source->channels[i];
+		GdkRGBA rgba = { 
+			channel->tint[0], channel->tint[1], channel->tint[2], 1.0
+		};
+
+		GtkWidget *row;
+		GtkWidget *widget;
+		char label[256];
+
+		row = gtk_box_new( GTK_ORIENTATION_HORIZONTAL, 5 );
+		g_object_set_data( G_OBJECT( row ), 
+			"channel", GINT_TO_POINTER( i ) );
+
+		g_snprintf( label, 256, _( "Channel %d" ), i );
+		widget = gtk_check_button_new_with_label( label );
+		gtk_widget_set_hexpand( widget, TRUE );
+		gtk_check_button_set_active( GTK_CHECK_BUTTON( widget ), 
+			channel->selected );
+		g_signal_connect( widget, "toggled",
+			G_CALLBACK( displaybar_channel_changed ), displaybar );
+		gtk_box_append( GTK_BOX( row ), widget );
+		g_object_set_data( G_OBJECT( row ), "check", widget );
+
+		widget = gtk_color_button_new_with_rgba( &rgba );
+		set_tooltip( widget, _( "Channel colour" ) );
+		g_signal_connect( widget, "color-set",
+			G_CALLBACK( displaybar_channel_changed ), displaybar );
+		gtk_box_append( GTK_BOX( row ), widget );
+		g_object_set_data( G_OBJECT( row ), "tint", widget );
+
+		widget = gtk_spin_button_new_with_range( -max, max, max / 100 );
+		gtk_spin_button_set_value( GTK_SPIN_BUTTON( widget ), 
+			channel->low );
+		set_tooltip( widget, _( "Channel black point" ) );
+		g_signal_connect( widget, "value-changed",
+			G_CALLBACK( displaybar_channel_changed ), displaybar );
+		gtk_box_append( GTK_BOX( row ), widget );
+		g_object_set_data( G_OBJECT( row ), "low", widget );
+
+		widget = gtk_spin_button_new_with_range( -max, max, max / 100 );
+		gtk_spin_button_set_value( GTK_SPIN_BUTTON( widget ), 
+			channel->high );
+		set_tooltip( widget, _( "Channel white point" ) );
+		g_signal_connect( widget, "value-changed",
+			G_CALLBACK( displaybar_channel_changed ), displaybar );
+		gtk_box_append( GTK_BOX( row ), widget );
+		g_object_set_data( G_OBJECT( row ), "high", widget );
+
+		gtk_box_append( GTK_BOX( displaybar->channels_box ), row );
+	}
+
+	displaybar->channels_source = tile_source;
+	displaybar->n_channels = tile_source->n_pages;
+}
+
+static gboolean
+displaybar_histogram_timeout( void *user_data )
+{
+	Displaybar *displaybar = DISPLAYBAR( user_data );
+	TileCache *tile_cache = image_window_get_tile_cache( displaybar->win );
+
+	displaybar->histogram_timeout = 0;
+
+	VIPS_FREEF( histogram_free, displaybar->hist );
+	if( tile_cache &&
+		!(displaybar->hist = tile_cache_histogram( tile_cache )) )
+		vips_error_clear();
+
+	gtk_widget_queue_draw( displaybar->histogram );
+
+	return( G_SOURCE_REMOVE );
+}
+
+static void
+displaybar_histogram_queue( Displaybar *displaybar )
+{
+	if( !displaybar->histogram_timeout &&
+		gtk_action_bar_get_revealed( 
+			GTK_ACTION_BAR( displaybar->action_bar ) ) )
+		displaybar->histogram_timeout = g_timeout_add( 
+			HISTOGRAM_INTERVAL, 
+			displaybar_histogram_timeout, displaybar );
+}
+
+static void
+displaybar_tile_cache_tiles_changed( TileCache *tile_cache, 
+	Displaybar *displaybar )
+{
+	displaybar_histogram_queue( displaybar );
+}
+
+static void
+displaybar_tile_cache_area_changed( TileCache *tile_cache, 
+	VipsRect *dirty, int z, Displaybar *displaybar )
+{
+	displaybar_histogram_queue( displaybar );
+}
+
+/* Draw the histogram with log counts, and shade the values outside the 
+ * current scale and offset.
+ */
+static void
+displaybar_histogram_draw( GtkDrawingArea *area, 
+	cairo_t *cr, int width, int height, gpointer user_data )
+{
+	Displaybar *displaybar = DISPLAYBAR( user_data );
+	Histogram *hist = displaybar->hist;
+	TileSource *tile_source = 
+		image_window_get_tile_source( displaybar->win );
+
+	double log_peak;
+	double range;
+	double low, high;
+	int x;
+
+	if( !hist ||
+		hist->peak == 0 ||
+		!tile_source )
+		return;
+
+	log_peak = log( 1.0 + hist->peak );
+	range = hist->n_bins * hist->bin_width;
+
+	cairo_set_source_rgba( cr, 0.5, 0.5, 0.5, 1.0 );
+	for( x = 0; x < width; x++ ) {
+		int first = (guint64) x * hist->n_bins / width;
+		int last = VIPS_MAX( first + 1, 
+			(guint64) (x + 1) * hist->n_bins / width );
+
+		guint64 count;
+		double h;
+		int i;
+
+		count = 0;
+		for( i = first; i < last; i++ )
+			count = VIPS_MAX( count, hist->bins[i] );
+		h = height * log( 1.0 + count ) / log_peak;
+		cairo_rectangle( cr, x, height - h, 1, h );
+	}
+	cairo_fill( cr );
+
+	histogram_window( hist, tile_source->scale, tile_source->offset, 
+		tile_source->log, &low, &high );
+	low = width * (low - hist->min) / range;
+	high = width * (high - hist->min) / range;
+
+	cairo_set_source_rgba( cr, 0.0, 0.0, 0.0, 0.4 );
+	if( low > 0 ) 
+		cairo_rectangle( cr, 0, 0, VIPS_MIN( low, width ), height );
+	if( high < width ) 
+		cairo_rectangle( cr, VIPS_MAX( 0, high ), 0, 
+			width - VIPS_MAX( 0, high ), height );
+	cairo_fill( cr );
+}
+
 static void
 displaybar_tile_source_changed( TileSource *tile_source, 
 	Displaybar *displaybar ) 
@@ -53,6 +305,8 @@ displaybar_tile_source_changed( TileSource *tile_source,
 	gtk_widget_set_sensitive( displaybar->page, 
 		tile_source->n_pages > 1 && 
 		tile_source->mode == TILE_SOURCE_MODE_MULTIPAGE );
+
+	displaybar_channels_update( displaybar, tile_source );
 }
 
 static void
@@ -76,6 +330,10 @@ displaybar_image_window_changed( ImageWindow *win,
 {
 	TileSource *tile_source = image_window_get_tile_source( win );
 
+	/* Channel controls must be rebuilt for the new image.
+	 */
+	displaybar->channels_source = NULL;
+
 	g_signal_connect_object( tile_source, "changed", 
 		G_CALLBACK( displaybar_tile_source_changed ), 
 		displaybar, 0 );
@@ -85,6 +343,18 @@ displaybar_image_window_changed( ImageWindow *win,
 	g_signal_connect_object( tile_source, "page-changed",
 		G_CALLBACK( displaybar_page_changed ), 
 		displaybar, 0 );
+
+	g_signal_connect_object( image_window_get_tile_cache( win ), 
+		"tiles-changed", 
+		G_CALLBACK( displaybar_tile_cache_tiles_changed ), 
+		displaybar, 0 );
+	g_signal_connect_object( image_window_get_tile_cache( win ), 
+		"area-changed", 
+		G_CALLBACK( displaybar_tile_cache_area_changed ), 
+		displaybar, 0 );
+
+	VIPS_FREEF( histogram_free, displaybar->hist );
+	displaybar_histogram_queue( displaybar );
 }
 
 static void
@@ -116,6 +386,7 @@ displaybar_set_property( GObject *object,
 		gtk_action_bar_set_revealed( 
 			GTK_ACTION_BAR( displaybar->action_bar ), 
 			g_value_get_boolean( value ) );
+		displaybar_histogram_queue( displaybar );
 		break;
 
 	default:
@@ -155,6 +426,15 @@ displaybar_dispose( GObject *object )
 	printf( "displaybar_dispose:\n" ); 
 #endif /*DEBUG*/
 
+	if( displaybar->vis_tick_handler ) {
+		gtk_widget_remove_tick_callback( GTK_WIDGET( displaybar ), 
+			displaybar->vis_tick_handler );
+		displaybar->vis_tick_handler = 0;
+	}
+	VIPS_FREEF( g_source_remove, displaybar->drag_timeout );
+	VIPS_FREEF( g_source_remove, displaybar->histogram_timeout );
+	VIPS_FREEF( histogram_free, displaybar->hist );
+
 	VIPS_FREEF( gtk_widget_unparent, displaybar->action_bar );
 
 	G_OBJECT_CLASS( displaybar_parent_class )->dispose( object );
@@ -178,6 +458,96 @@ displaybar_page_value_changed( GtkSpinButton *spin_button,
 			NULL );
 }
 
+/* Send any pending slider values to the tile_source.
+ */
+static void
+displaybar_vis_apply( Displaybar *displaybar )
+{
+	TileSource *tile_source = 
+		image_window_get_tile_source( displaybar->win );
+
+	if( tile_source ) {
+		tile_source_set_dragging( tile_source, TRUE );
+
+		if( displaybar->scale_pending )
+			g_object_set( tile_source,
+				"scale", displaybar->pending_scale,
+				NULL );
+		if( displaybar->offset_pending )
+			g_object_set( tile_source,
+				"offset", displaybar->pending_offset,
+				NULL );
+	}
+
+	displaybar->scale_pending = FALSE;
+	displaybar->offset_pending = FALSE;
+}
+
+static gboolean
+displaybar_vis_tick( GtkWidget *widget, 
+	GdkFrameClock *frame_clock, gpointer user_data )
+{
+	Displaybar *displaybar = DISPLAYBAR( widget );
+
+	displaybar->vis_tick_handler = 0;
+	displaybar_vis_apply( displaybar );
+
+	return( G_SOURCE_REMOVE );
+}
+
+/* The sliders have stopped, so apply any last change and refine the view.
+ */
+static gboolean
+displaybar_drag_timeout( void *user_data )
+{
+	Displaybar *displaybar = DISPLAYBAR( user_data );
+	TileSource *tile_source = 
+		image_window_get_tile_source( displaybar->win );
+
+	displaybar->drag_timeout = 0;
+
+	if( displaybar->vis_tick_handler ) {
+		gtk_widget_remove_tick_callback( GTK_WIDGET( displaybar ), 
+			displaybar->vis_tick_handler );
+		displaybar->vis_tick_handler = 0;
+		displaybar_vis_apply( displaybar );
+	}
+
+	if( tile_source )
+		tile_source_set_dragging( tile_source, FALSE );
+
+	return( G_SOURCE_REMOVE );
+}
+
+/* Apply slider changes on the next frame, so a drag makes at most one update
+ * per frame.
+ */
+static void
+displaybar_vis_queue( Displaybar *displaybar )
+{
+	/* Not mapped, so no frame clock ... just set directly.
+	 */
+	if( !gtk_widget_get_mapped( GTK_WIDGET( displaybar ) ) ) {
+		TileSource *tile_source = 
+			image_window_get_tile_source( displaybar->win );
+
+		displaybar_vis_apply( displaybar );
+		if( tile_source )
+			tile_source_set_dragging( tile_source, FALSE );
+
+		return;
+	}
+
+	if( !displaybar->vis_tick_handler )
+		displaybar->vis_tick_handler = gtk_widget_add_tick_callback( 
+			GTK_WIDGET( displaybar ),
+			displaybar_vis_tick, NULL, NULL );
+
+	VIPS_FREEF( g_source_remove, displaybar->drag_timeout );
+	displaybar->drag_timeout = g_timeout_add( DRAG_SETTLE, 
+		displaybar_drag_timeout, displaybar );
+}
+
 static void
 displaybar_scale_value_changed( Tslider *slider, 
 	Displaybar *displaybar )
@@ -185,10 +555,14 @@ displaybar_scale_value_changed( Tslider *slider,
 	TileSource *tile_source = 
 		image_window_get_tile_source( displaybar->win );
 
-	if( tile_source )
-		g_object_set( tile_source,
-			"scale", slider->value,
-			NULL );
+	/* Ignore updates from tile_source itself.
+	 */
+	if( tile_source &&
+		tile_source->scale != slider->value ) {
+		displaybar->pending_scale = slider->value;
+		displaybar->scale_pending = TRUE;
+		displaybar_vis_queue( displaybar );
+	}
 }
 
 static void
@@ -198,10 +572,12 @@ displaybar_offset_value_changed( Tslider *slider,
 	TileSource *tile_source = 
 		image_window_get_tile_source( displaybar->win );
 
-	if( tile_source )
-		g_object_set( tile_source,
-			"offset", slider->value,
-			NULL );
+	if( tile_source &&
+		tile_source->offset != slider->value ) {
+		displaybar->pending_offset = slider->value;
+		displaybar->offset_pending = TRUE;
+		displaybar_vis_queue( displaybar );
+	}
 }
 
 static void
@@ -216,6 +592,13 @@ displaybar_init( Displaybar *displaybar )
 	gtk_widget_init_template( GTK_WIDGET( displaybar ) );
 
 	set_tooltip( GTK_WIDGET( displaybar->page ), _( "Page select" ) );
+	set_tooltip( GTK_WIDGET( displaybar->channels ), 
+		_( "Pages as bands channels" ) );
+	set_tooltip( displaybar->histogram, 
+		_( "Histogram of visible pixels" ) );
+	gtk_drawing_area_set_draw_func( 
+		GTK_DRAWING_AREA( displaybar->histogram ),
+		displaybar_histogram_draw, displaybar, NULL );
 
 	tslider = TSLIDER( displaybar->scale );
 	tslider_set_conversions( tslider,
@@ -271,7 +654,10 @@ displaybar_class_init( DisplaybarClass *class )
 
 	BIND( action_bar );
 	BIND( gears );
+	BIND( channels );
+	BIND( channels_box );
 	BIND( page );
+	BIND( histogram );
 	BIND( scale );
 	BIND( offset );
 
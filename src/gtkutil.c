@@ -143,6 +143,17 @@ get_state( GtkWidget *widget, const char *name )
 	return( g_action_get_state( action ) );
 }
 
+void
+set_enabled( GtkWidget *widget, const char *name, gboolean enabled )
+{
+	GAction *action;
+
+	action = g_action_map_lookup_action( G_ACTION_MAP( widget ), name );
+	if( action )
+		g_simple_action_set_enabled( G_SIMPLE_ACTION( action ), 
+			enabled );
+}
+
 void
 copy_state( GtkWidget *to, GtkWidget *from, const char *name )
 {
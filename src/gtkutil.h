@@ -9,6 +9,7 @@ void copy_adj( GtkAdjustment *to, GtkAdjustment *from );
 
 void change_state( GtkWidget *widget, const char *name, GVariant *state );
 GVariant *get_state( GtkWidget *widget, const char *name );
+void set_enabled( GtkWidget *widget, const char *name, gboolean enabled );
 void copy_state( GtkWidget *to, GtkWidget *from, const char *name );
 
 void process_events( void );
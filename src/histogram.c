@@ -0,0 +1,337 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* Number of bins for int and float formats, where we can't have one bin per 
+ * value.
+ */
+#define HISTOGRAM_BINS (1024)
+
+void
+histogram_free( Histogram *histogram )
+{
+	VIPS_FREE( histogram->bins );
+	g_free( histogram );
+}
+
+static int
+histogram_n_colour( VipsImage *image )
+{
+	return( vips_image_hasalpha( image ) ? 
+		image->Bands - 1 : image->Bands );
+}
+
+/* Find the range of finite colour values.
+ */
+#define RANGE( TYPE ) { \
+	TYPE *p = (TYPE *) VIPS_IMAGE_ADDR( image, 0, 0 ); \
+	\
+	for( x = 0; x < n_pels; x++ ) { \
+		for( b = 0; b < n_colour; b++ ) { \
+			double v = p[b]; \
+			\
+			if( isfinite( v ) ) { \
+				*min = VIPS_MIN( *min, v ); \
+				*max = VIPS_MAX( *max, v ); \
+			} \
+		} \
+		\
+		p += image->Bands; \
+	} \
+}
+
+static void
+histogram_range( VipsImage *image, double *min, double *max )
+{
+	int n_colour = histogram_n_colour( image );
+	size_t n_pels = VIPS_IMAGE_N_PELS( image );
+
+	size_t x;
+	int b;
+
+	switch( image->BandFmt ) {
+	case VIPS_FORMAT_UINT:
+		RANGE( unsigned int );
+		break;
+
+	case VIPS_FORMAT_INT:
+		RANGE( signed int );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		RANGE( float );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		RANGE( double );
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* 8- and 16-bit values index bins directly.
+ */
+#define COUNT_DIRECT( TYPE ) { \
+	TYPE *p = (TYPE *) VIPS_IMAGE_ADDR( image, 0, 0 ); \
+	\
+	for( x = 0; x < n_pels; x++ ) { \
+		for( b = 0; b < n_colour; b++ ) \
+			bins[(int) p[b] - min] += 1; \
+		\
+		p += image->Bands; \
+	} \
+}
+
+#define COUNT_SCALED( TYPE ) { \
+	TYPE *p = (TYPE *) VIPS_IMAGE_ADDR( image, 0, 0 ); \
+	\
+	for( x = 0; x < n_pels; x++ ) { \
+		for( b = 0; b < n_colour; b++ ) { \
+			double v = (p[b] - histogram->min) / \
+				histogram->bin_width; \
+			\
+			if( isfinite( v ) ) \
+				bins[VIPS_CLIP( 0, (int) v, n_bins - 1 )] += 1; \
+		} \
+		\
+		p += image->Bands; \
+	} \
+}
+
+static void
+histogram_count( Histogram *histogram, VipsImage *image )
+{
+	int n_colour = histogram_n_colour( image );
+	size_t n_pels = VIPS_IMAGE_N_PELS( image );
+	guint64 *bins = histogram->bins;
+	int n_bins = histogram->n_bins;
+	int min = histogram->min;
+
+	size_t x;
+	int b;
+
+	switch( image->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		COUNT_DIRECT( unsigned char );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		COUNT_DIRECT( signed char );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		COUNT_DIRECT( unsigned short );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		COUNT_DIRECT( signed short );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		COUNT_SCALED( unsigned int );
+		break;
+
+	case VIPS_FORMAT_INT:
+		COUNT_SCALED( signed int );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		COUNT_SCALED( float );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		COUNT_SCALED( double );
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+Histogram *
+histogram_new_empty( VipsImage *image, double min, double max )
+{
+	Histogram *histogram;
+
+	if( vips_image_get_coding( image ) != VIPS_CODING_NONE ||
+		vips_band_format_iscomplex( image->BandFmt ) ) {
+		vips_error( "Histogram", "%s", 
+			_( "Image must be uncoded and real" ) );
+		return( NULL );
+	}
+
+	histogram = g_new0( Histogram, 1 );
+	histogram->type = image->Type;
+
+	switch( image->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		histogram->min = 0;
+		histogram->n_bins = G_MAXUINT8 + 1;
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		histogram->min = G_MININT8;
+		histogram->n_bins = G_MAXUINT8 + 1;
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		histogram->min = 0;
+		histogram->n_bins = G_MAXUINT16 + 1;
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		histogram->min = G_MININT16;
+		histogram->n_bins = G_MAXUINT16 + 1;
+		break;
+
+	default:
+		break;
+	}
+
+	if( histogram->n_bins ) 
+		histogram->bin_width = 1.0;
+	else {
+		histogram->min = min;
+		histogram->n_bins = HISTOGRAM_BINS;
+		histogram->bin_width = max > min ? 
+			(max - min) / HISTOGRAM_BINS : 1.0;
+	}
+
+	histogram->bins = g_new0( guint64, histogram->n_bins );
+
+	return( histogram );
+}
+
+void
+histogram_update( Histogram *histogram )
+{
+	int i;
+
+	histogram->total = 0;
+	histogram->peak = 0;
+	for( i = 0; i < histogram->n_bins; i++ ) {
+		histogram->total += histogram->bins[i];
+		histogram->peak = VIPS_MAX( histogram->peak, 
+			histogram->bins[i] );
+	}
+}
+
+Histogram *
+histogram_new( VipsImage **images, int n )
+{
+	VipsImage *first;
+	Histogram *histogram;
+	double min;
+	double max;
+	int i;
+
+	if( n < 1 ) {
+		vips_error( "Histogram", "%s", _( "No pixels" ) );
+		return( NULL );
+	}
+	first = images[0];
+
+	min = G_MAXDOUBLE;
+	max = -G_MAXDOUBLE;
+	if( !vips_band_format_iscomplex( first->BandFmt ) &&
+		!vips_band_format_is8bit( first->BandFmt ) &&
+		first->BandFmt != VIPS_FORMAT_USHORT &&
+		first->BandFmt != VIPS_FORMAT_SHORT ) {
+		for( i = 0; i < n; i++ )
+			if( images[i]->BandFmt == first->BandFmt &&
+				images[i]->Bands == first->Bands )
+				histogram_range( images[i], &min, &max );
+
+		if( max < min ) {
+			vips_error( "Histogram", "%s", _( "No pixels" ) );
+			return( NULL );
+		}
+	}
+
+	if( !(histogram = histogram_new_empty( first, min, max )) )
+		return( NULL );
+
+	for( i = 0; i < n; i++ )
+		if( images[i]->BandFmt == first->BandFmt &&
+			images[i]->Bands == first->Bands )
+			histogram_count( histogram, images[i] );
+	histogram_update( histogram );
+
+#ifdef DEBUG
+	printf( "histogram_new: %d images, %d bins, %" G_GUINT64_FORMAT 
+		" values\n", n, histogram->n_bins, histogram->total );
+#endif /*DEBUG*/
+
+	return( histogram );
+}
+
+double
+histogram_percentile( Histogram *histogram, double percent )
+{
+	guint64 target = histogram->total * VIPS_CLIP( 0, percent, 100 ) / 100;
+
+	guint64 sum;
+	int i;
+
+	sum = 0;
+	for( i = 0; i < histogram->n_bins - 1; i++ ) {
+		sum += histogram->bins[i];
+		if( sum > target )
+			break;
+	}
+
+	return( histogram->min + i * histogram->bin_width );
+}
+
+/* The value which displays as white. 16-bit images are shifted down to 8 
+ * bits after scale and offset.
+ */
+static double
+histogram_white( Histogram *histogram )
+{
+	return( histogram->type == VIPS_INTERPRETATION_GREY16 ||
+		histogram->type == VIPS_INTERPRETATION_RGB16 ? 
+			255.0 * 256.0 : 255.0 );
+}
+
+int
+histogram_find_scale( Histogram *histogram, 
+	double low, double high, gboolean log, double *scale, double *offset )
+{
+	double min = histogram_percentile( histogram, low );
+	double max = histogram_percentile( histogram, high );
+
+	/* Scale and offset apply after the log mapping.
+	 */
+	if( log ) {
+		min = vis_kernel_log( VIPS_MAX( 0.0, min ) );
+		max = vis_kernel_log( VIPS_MAX( 0.0, max ) );
+	}
+
+	if( max <= min ) {
+		vips_error( "Find scale", "%s", _( "Min and max are equal" ) );
+		return( -1 );
+	}
+
+	*scale = histogram_white( histogram ) / (max - min);
+	*offset = -(min * *scale) + 0.5;
+
+	return( 0 );
+}
+
+void
+histogram_window( Histogram *histogram, 
+	double scale, double offset, gboolean log, double *low, double *high )
+{
+	*low = -offset / scale;
+	*high = (histogram_white( histogram ) - offset) / scale;
+
+	if( log ) {
+		*low = vis_kernel_log_invert( *low );
+		*high = vis_kernel_log_invert( *high );
+	}
+}
@@ -0,0 +1,57 @@
+/* Histograms of display values (before scale, falsecolour, etc.) for 
+ * auto-contrast and the display bar.
+ */
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+typedef struct _Histogram {
+	/* The interpretation of the values, so we know how they will be 
+	 * displayed.
+	 */
+	VipsInterpretation type;
+
+	/* Bin i counts values from min + i * bin_width. 8- and 16-bit 
+	 * formats have one bin per value.
+	 */
+	double min;
+	double bin_width;
+	int n_bins;
+	guint64 *bins;
+
+	/* Sum of all bins, and the largest bin.
+	 */
+	guint64 total;
+	guint64 peak;
+} Histogram;
+
+/* Count all the colour values (not alpha) in a set of memory images, 
+ * perhaps tiles from the tile cache. Images must all have the same format.
+ */
+Histogram *histogram_new( VipsImage **images, int n );
+void histogram_free( Histogram *histogram );
+
+/* An empty histogram for values in this image's format. Int and float 
+ * formats get bins from min to max. Fill bins, clipping values outside the 
+ * range to the end bins, then call histogram_update() to set total and peak.
+ */
+Histogram *histogram_new_empty( VipsImage *image, double min, double max );
+void histogram_update( Histogram *histogram );
+
+/* The value below which this percentage of values fall.
+ */
+double histogram_percentile( Histogram *histogram, double percent );
+
+/* Find a scale and offset which maps low and high percentiles to black and
+ * white. With log set, the scale and offset are for after the log mapping.
+ */
+int histogram_find_scale( Histogram *histogram, 
+	double low, double high, gboolean log, double *scale, double *offset );
+
+/* The reverse: the range of values that a scale and offset display as 
+ * black to white.
+ */
+void histogram_window( Histogram *histogram, 
+	double scale, double offset, gboolean log, double *low, double *high );
+
+#endif /*__HISTOGRAM_H*/
@@ -79,9 +79,15 @@ enum {
 	 */
 	PROP_DEBUG,
 
+	/* Draw things over the image.
+	 */
+	SIG_OVERLAY,
+
 	SIG_LAST
 };
 
+static guint imagedisplay_signals[SIG_LAST] = { 0 };
+
 static void
 imagedisplay_dispose( GObject *object )
 {
@@ -106,9 +112,9 @@ imagedisplay_set_transform( Imagedisplay *imagedisplay,
 		scale < (1.0 / 100000) )
 		return;
 	if( x < -1000 ||
-		x > 2 * VIPS_MAX_COORD ||
+		x / scale > G_MAXINT ||
 		y < -1000 ||
-		y > 2 * VIPS_MAX_COORD )
+		y / scale > G_MAXINT )
 		return;
 
 #ifdef DEBUG
@@ -520,6 +526,11 @@ imagedisplay_snapshot( GtkWidget *widget, GtkSnapshot *snapshot )
 			&imagedisplay->paint_rect,
 			imagedisplay->debug );
 
+	/* Regions of interest and so on, in widget coordinates.
+	 */
+	g_signal_emit( imagedisplay, 
+		imagedisplay_signals[SIG_OVERLAY], 0, snapshot );
+
 	gtk_snapshot_pop( snapshot );
 
 	 /* I wasn't able to get gtk_snapshot_render_focus() working. Draw
@@ -640,14 +651,14 @@ imagedisplay_class_init( ImagedisplayClass *class )
 		g_param_spec_double( "x",
 			_( "x" ),
 			_( "Horizontal position of viewport" ),
-			-VIPS_MAX_COORD, VIPS_MAX_COORD, 0,
+			-G_MAXDOUBLE, G_MAXDOUBLE, 0,
 			G_PARAM_READWRITE ) );
 
 	g_object_class_install_property( gobject_class, PROP_Y,
 		g_param_spec_double( "y",
 			_( "y" ),
 			_( "Vertical position of viewport" ),
-			-VIPS_MAX_COORD, VIPS_MAX_COORD, 0,
+			-G_MAXDOUBLE, G_MAXDOUBLE, 0,
 			G_PARAM_READWRITE ) );
 
 	g_object_class_install_property( gobject_class, PROP_DEBUG,
@@ -665,6 +676,14 @@ imagedisplay_class_init( ImagedisplayClass *class )
 		PROP_HSCROLL_POLICY, "hscroll-policy" );
 	g_object_class_override_property( gobject_class, 
 		PROP_VSCROLL_POLICY, "vscroll-policy" );
+
+	imagedisplay_signals[SIG_OVERLAY] = g_signal_new( "overlay",
+		G_TYPE_FROM_CLASS( class ),
+		G_SIGNAL_RUN_LAST,
+		0, NULL, NULL,
+		g_cclosure_marshal_VOID__POINTER,
+		G_TYPE_NONE, 1,
+		G_TYPE_POINTER ); 
 }
 
 Imagedisplay *
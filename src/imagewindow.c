@@ -8,6 +8,24 @@
  */
 #define SCALE_STEP (1.1)
 
+/* Auto-contrast clips this percentage of values at each end.
+ */
+#define AUTO_CONTRAST_LOW (0.5)
+#define AUTO_CONTRAST_HIGH (99.5)
+
+/* If the visible tiles have no display values, auto-contrast looks at a
+ * pyramid level about this many pixels across instead.
+ */
+#define AUTO_CONTRAST_LEVEL_SIZE (512)
+
+/* What a drag or click on the image does.
+ */
+typedef enum _ImageWindowRoiTool {
+	IMAGE_WINDOW_ROI_NONE,
+	IMAGE_WINDOW_ROI_RECTANGLE,
+	IMAGE_WINDOW_ROI_POLYGON
+} ImageWindowRoiTool;
+
 struct _ImageWindow
 {
 	GtkApplicationWindow parent;
@@ -26,6 +44,17 @@ struct _ImageWindow
 	int drag_start_x;
 	int drag_start_y;
 
+	/* Regions of interest, newest first. drawing_roi is the one being
+	 * drawn, roi_points the polygon outline so far, and roi_start_x/y
+	 * the corner a rectangle drag started from, in image coordinates.
+	 */
+	ImageWindowRoiTool roi_tool;
+	GSList *rois;
+	Roi *drawing_roi;
+	GArray *roi_points;
+	double roi_start_x;
+	double roi_start_y;
+
 	/* For pinch zoom, zoom position that we started.
 	 */
 	double last_scale;
@@ -38,10 +67,20 @@ struct _ImageWindow
 	double scale_rate;
 	double scale_target;
 
+	/* For animated images, the page flip is driven from the frame clock.
+	 */
+	guint page_tick_handler;
+
 	GtkWidget *right_click_menu;
 	GtkWidget *title;
 	GtkWidget *subtitle;
 	GtkWidget *gears;
+	GtkWidget *spinner;
+
+	/* The image open and the annotations load share the spinner, so
+	 * count the loads in progress.
+	 */
+	int n_loading;
 	GtkWidget *progress_bar;
 	GtkWidget *progress;
 	GtkWidget *progress_cancel;
@@ -51,6 +90,7 @@ struct _ImageWindow
 	GtkWidget *imagedisplay;
 	GtkWidget *display_bar;
 	GtkWidget *info_bar;
+	GtkWidget *navigator;
 
 	/* Throttle progress bar updates to a few per second with this.
 	 */
@@ -59,6 +99,15 @@ struct _ImageWindow
 
 	gint64 last_frame_time;
 
+	/* Cancel any file open in progress with this.
+	 */
+	GCancellable *open_cancellable;
+
+	/* Annotations drawn over the image, and any load in progress.
+	 */
+	Annotations *annotations;
+	GCancellable *annotations_cancellable;
+
 	GSettings *settings;
 };
 
@@ -69,11 +118,28 @@ G_DEFINE_TYPE( ImageWindow, image_window, GTK_TYPE_APPLICATION_WINDOW );
 enum {
 	SIG_CHANGED,			/* A new tile_source */
 	SIG_STATUS_CHANGED,		/* New mouse position */
+	SIG_VIEW_CHANGED,		/* Scrolled or zoomed */
 	SIG_LAST
 };
 
 static guint image_window_signals[SIG_LAST] = { 0 };
 
+/* Drop all regions of interest, and stop any stats they are computing.
+ */
+static void
+image_window_free_rois( ImageWindow *win )
+{
+	GSList *p;
+
+	for( p = win->rois; p; p = p->next ) {
+		Roi *roi = ROI( p->data );
+
+		roi_cancel( roi );
+		g_object_unref( roi );
+	}
+	VIPS_FREEF( g_slist_free, win->rois );
+}
+
 static void
 image_window_dispose( GObject *object )
 {
@@ -83,6 +149,31 @@ image_window_dispose( GObject *object )
 	printf( "image_window_dispose:\n" ); 
 #endif /*DEBUG*/
 
+	if( win->open_cancellable ) {
+		g_cancellable_cancel( win->open_cancellable );
+		VIPS_UNREF( win->open_cancellable );
+	}
+
+	/* No point finishing a load no one will see.
+	 */
+	if( win->tile_source )
+		tile_source_cancel_load( win->tile_source );
+
+	if( win->page_tick_handler ) {
+		gtk_widget_remove_tick_callback( GTK_WIDGET( win ), 
+			win->page_tick_handler );
+		win->page_tick_handler = 0;
+	}
+
+	image_window_free_rois( win );
+	VIPS_UNREF( win->drawing_roi );
+	VIPS_FREEF( g_array_unref, win->roi_points );
+
+	if( win->annotations_cancellable ) 
+		g_cancellable_cancel( win->annotations_cancellable );
+	VIPS_UNREF( win->annotations_cancellable );
+	VIPS_UNREF( win->annotations );
+
 	VIPS_UNREF( win->tile_source );
 	VIPS_UNREF( win->tile_cache );
 	VIPS_FREEF( gtk_widget_unparent, win->right_click_menu );
@@ -98,6 +189,15 @@ image_window_status_changed( ImageWindow *win )
 		image_window_signals[SIG_STATUS_CHANGED], 0 );
 }
 
+/* The part of the image in the window has moved.
+ */
+static void
+image_window_view_changed( GtkAdjustment *adjustment, ImageWindow *win )
+{
+	g_signal_emit( win, 
+		image_window_signals[SIG_VIEW_CHANGED], 0 );
+}
+
 static void
 image_window_changed( ImageWindow *win )
 {
@@ -105,6 +205,84 @@ image_window_changed( ImageWindow *win )
 		image_window_signals[SIG_CHANGED], 0 );
 }
 
+/* New stats for a region, so update the overlay and the info bar.
+ */
+static void
+image_window_roi_changed( Roi *roi, ImageWindow *win )
+{
+	gtk_widget_queue_draw( win->imagedisplay );
+	image_window_status_changed( win );
+}
+
+/* Recompute stats for all regions, eg. after a page flip.
+ */
+static void
+image_window_restart_rois( ImageWindow *win )
+{
+	GSList *p;
+
+	if( !win->tile_source )
+		return;
+
+	for( p = win->rois; p; p = p->next )
+		roi_start( ROI( p->data ), win->tile_source );
+}
+
+static void
+image_window_add_roi( ImageWindow *win, Roi *roi )
+{
+	win->rois = g_slist_prepend( win->rois, roi );
+	g_object_ref( roi );
+	g_signal_connect_object( roi, "changed", 
+		G_CALLBACK( image_window_roi_changed ), win, 0 );
+
+	if( win->tile_source )
+		roi_start( roi, win->tile_source );
+
+	image_window_roi_changed( roi, win );
+}
+
+/* Stop drawing a region, perhaps half way through.
+ */
+static void
+image_window_roi_reset( ImageWindow *win )
+{
+	VIPS_UNREF( win->drawing_roi );
+	if( win->roi_points )
+		g_array_set_size( win->roi_points, 0 );
+
+	gtk_widget_queue_draw( win->imagedisplay );
+}
+
+static void
+image_window_overlay( Imagedisplay *imagedisplay, 
+	GtkSnapshot *snapshot, ImageWindow *win )
+{
+	GtkWidget *widget = GTK_WIDGET( imagedisplay );
+
+	cairo_t *cr;
+	GSList *p;
+
+	if( !win->rois &&
+		!win->drawing_roi )
+		return;
+
+	cr = gtk_snapshot_append_cairo( snapshot, &GRAPHENE_RECT_INIT(
+		0, 
+		0, 
+		gtk_widget_get_width( widget ),
+		gtk_widget_get_height( widget ) ) );
+
+	/* The newest region is the one the info bar shows.
+	 */
+	for( p = win->rois; p; p = p->next )
+		roi_draw( ROI( p->data ), cr, imagedisplay, p == win->rois );
+	if( win->drawing_roi )
+		roi_draw( win->drawing_roi, cr, imagedisplay, TRUE );
+
+	cairo_destroy( cr );
+}
+
 static void
 image_window_set_position( ImageWindow *win, double x, double y )
 {
@@ -378,12 +556,121 @@ image_window_error( ImageWindow *win )
 	gtk_info_bar_set_revealed( GTK_INFO_BAR( win->error_bar ), TRUE );
 }
 
+static void
+image_window_gerror( ImageWindow *win, GError *error )
+{
+	gtk_label_set_text( GTK_LABEL( win->error_label ), error->message );
+	gtk_info_bar_set_revealed( GTK_INFO_BAR( win->error_bar ), TRUE );
+}
+
+static TileSourcePriority
+image_window_get_priority( ImageWindow *win )
+{
+	GdkSurface *surface;
+
+	if( !gtk_widget_get_mapped( GTK_WIDGET( win ) ) )
+		return( TILE_SOURCE_PRIORITY_HIDDEN );
+
+	if( (surface = gtk_native_get_surface( GTK_NATIVE( win ) )) &&
+		GDK_IS_TOPLEVEL( surface ) &&
+		(gdk_toplevel_get_state( GDK_TOPLEVEL( surface ) ) & 
+			GDK_TOPLEVEL_STATE_MINIMIZED) )
+		return( TILE_SOURCE_PRIORITY_HIDDEN );
+
+	if( gtk_window_is_active( GTK_WINDOW( win ) ) )
+		return( TILE_SOURCE_PRIORITY_FOCUSED );
+
+	return( TILE_SOURCE_PRIORITY_VISIBLE );
+}
+
+/* The focused window renders and loads first, and hidden windows stop
+ * rendering.
+ */
+static void
+image_window_update_priority( ImageWindow *win )
+{
+	if( win->tile_source ) {
+		TileSourcePriority priority = image_window_get_priority( win );
+
+		tile_source_set_priority( win->tile_source, priority );
+		tile_source_set_load_priority( win->tile_source, priority );
+	}
+}
+
+static void
+image_window_is_active_changed( GObject *object, 
+	GParamSpec *pspec, gpointer user_data )
+{
+	image_window_update_priority( VIPSDISP_IMAGE_WINDOW( object ) );
+}
+
+static void
+image_window_surface_state_changed( GObject *object, 
+	GParamSpec *pspec, gpointer user_data )
+{
+	image_window_update_priority( VIPSDISP_IMAGE_WINDOW( user_data ) );
+}
+
+static void
+image_window_map_changed( GtkWidget *widget, gpointer user_data )
+{
+	image_window_update_priority( VIPSDISP_IMAGE_WINDOW( widget ) );
+}
+
+static void
+image_window_realize( GtkWidget *widget, gpointer user_data )
+{
+	GdkSurface *surface = gtk_native_get_surface( GTK_NATIVE( widget ) );
+
+	/* We need to watch for minimise.
+	 */
+	g_signal_connect_object( surface, "notify::state", 
+		G_CALLBACK( image_window_surface_state_changed ), widget, 0 );
+}
+
 static void
 image_window_error_hide( ImageWindow *win )
 {
 	gtk_info_bar_set_revealed( GTK_INFO_BAR( win->error_bar ), FALSE );
 }
 
+static gboolean
+image_window_page_tick( GtkWidget *widget, 
+	GdkFrameClock *frame_clock, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	if( win->tile_source &&
+		win->tile_cache )
+		tile_source_animation_tick( win->tile_source, 
+			gdk_frame_clock_get_frame_time( frame_clock ),
+			tile_cache_is_complete( win->tile_cache ) );
+
+	return( G_SOURCE_CONTINUE );
+}
+
+/* Run the frame clock tick for animations, if we need it.
+ */
+static void
+image_window_update_page_tick( ImageWindow *win )
+{
+	gboolean animated = win->tile_source &&
+		win->tile_source->mode == TILE_SOURCE_MODE_ANIMATED &&
+		win->tile_source->n_pages > 1;
+
+	if( animated &&
+		!win->page_tick_handler ) 
+		win->page_tick_handler = gtk_widget_add_tick_callback( 
+			GTK_WIDGET( win ),
+			image_window_page_tick, win, NULL );
+	else if( !animated &&
+		win->page_tick_handler ) {
+		gtk_widget_remove_tick_callback( GTK_WIDGET( win ), 
+			win->page_tick_handler );
+		win->page_tick_handler = 0;
+	}
+}
+
 static void
 image_window_tile_source_changed( TileSource *tile_source, ImageWindow *win )
 {
@@ -411,6 +698,8 @@ image_window_tile_source_changed( TileSource *tile_source, ImageWindow *win )
 		str_mode = "animated";
 	else if( tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS )
 		str_mode = "pages-as-bands";
+	else if( tile_source->mode == TILE_SOURCE_MODE_GRID )
+		str_mode = "grid";
 	else
 		str_mode = NULL;
 
@@ -418,6 +707,33 @@ image_window_tile_source_changed( TileSource *tile_source, ImageWindow *win )
 		state = g_variant_new_string( str_mode );
 		change_state( GTK_WIDGET( win ), "mode", state );
 	}
+
+	image_window_update_page_tick( win );
+
+	/* ROI stats must be in image units, so there are no regions in 
+	 * modes which lay out pages.
+	 */
+	if( !tile_source_has_source_units( tile_source ) ) {
+		image_window_free_rois( win );
+		image_window_roi_reset( win );
+		change_state( GTK_WIDGET( win ), "roi", 
+			g_variant_new_string( "none" ) );
+		image_window_status_changed( win );
+	}
+	set_enabled( GTK_WIDGET( win ), "roi", 
+		tile_source_has_source_units( tile_source ) );
+
+	image_window_restart_rois( win );
+}
+
+/* Pages of the same size flip without a "changed", so restart the regions 
+ * here too.
+ */
+static void
+image_window_tile_source_page_changed( TileSource *tile_source, 
+	ImageWindow *win )
+{
+	image_window_restart_rois( win );
 }
 
 static void
@@ -575,6 +891,150 @@ image_window_replace_action( GSimpleAction *action,
 	gtk_widget_show( dialog );
 }
 
+static void
+image_window_loading_start( ImageWindow *win )
+{
+	if( win->n_loading++ == 0 )
+		gtk_spinner_start( GTK_SPINNER( win->spinner ) );
+}
+
+static void
+image_window_loading_stop( ImageWindow *win )
+{
+	if( win->n_loading > 0 &&
+		--win->n_loading == 0 )
+		gtk_spinner_stop( GTK_SPINNER( win->spinner ) );
+}
+
+/* The background annotation load has finished, or been cancelled.
+ */
+static void
+image_window_annotations_done( GObject *source_object, 
+	GAsyncResult *result, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+	GCancellable *cancellable = g_task_get_cancellable( G_TASK( result ) );
+
+	Annotations *annotations;
+	GError *error = NULL;
+
+	annotations = annotations_new_from_file_finish( result, &error );
+
+	if( win->annotations_cancellable &&
+		cancellable == win->annotations_cancellable ) {
+		VIPS_UNREF( win->annotations_cancellable );
+		image_window_loading_stop( win );
+
+		if( annotations ) {
+			VIPS_UNREF( win->annotations );
+			win->annotations = annotations;
+			g_object_ref( annotations );
+
+			if( win->tile_cache )
+				tile_cache_set_annotations( win->tile_cache, 
+					win->annotations );
+		}
+		else 
+			image_window_gerror( win, error );
+	}
+
+	VIPS_UNREF( annotations );
+	g_clear_error( &error );
+
+	/* Matches the ref in image_window_annotations_response().
+	 */
+	g_object_unref( win );
+}
+
+static void
+image_window_annotations_response( GtkDialog *dialog, 
+	gint response_id, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	if( response_id == GTK_RESPONSE_ACCEPT ) {
+		GFile *file;
+		char *path;
+
+		file = gtk_file_chooser_get_file( GTK_FILE_CHOOSER( dialog ) );
+		path = g_file_get_path( file );
+		image_window_error_hide( win ); 
+
+		if( win->annotations_cancellable ) {
+			g_cancellable_cancel( win->annotations_cancellable );
+			VIPS_UNREF( win->annotations_cancellable );
+			image_window_loading_stop( win );
+		}
+
+		/* Millions of features can take a while to parse and index, 
+		 * so load in the background.
+		 */
+		image_window_loading_start( win );
+		win->annotations_cancellable = g_cancellable_new();
+		g_object_ref( win );
+		annotations_new_from_file_async( path, 
+			win->annotations_cancellable,
+			image_window_annotations_done, win );
+
+		g_free( path );
+		VIPS_UNREF( file ); 
+	}
+
+	gtk_window_destroy( GTK_WINDOW( dialog ) );
+}
+
+static void
+image_window_annotations_action( GSimpleAction *action, 
+	GVariant *parameter, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	GtkWidget *dialog;
+	GtkFileFilter *filter;
+
+	dialog = gtk_file_chooser_dialog_new( "Load annotations",
+		GTK_WINDOW( win ) , 
+		GTK_FILE_CHOOSER_ACTION_OPEN,
+		"_Cancel", GTK_RESPONSE_CANCEL,
+		"_Load", GTK_RESPONSE_ACCEPT,
+		NULL );
+	gtk_window_set_modal( GTK_WINDOW( dialog ), TRUE );
+
+	filter = gtk_file_filter_new();
+	gtk_file_filter_set_name( filter, "GeoJSON and CSV" );
+	gtk_file_filter_add_pattern( filter, "*.geojson" );
+	gtk_file_filter_add_pattern( filter, "*.json" );
+	gtk_file_filter_add_pattern( filter, "*.csv" );
+	gtk_file_filter_add_pattern( filter, "*.tsv" );
+	gtk_file_filter_add_pattern( filter, "*.txt" );
+	gtk_file_chooser_add_filter( GTK_FILE_CHOOSER( dialog ), filter );
+	g_object_unref( filter );
+
+	g_signal_connect( dialog, "response", 
+		G_CALLBACK( image_window_annotations_response ), win );
+
+	gtk_widget_show( dialog );
+}
+
+static void
+image_window_annotations_clear( GSimpleAction *action, 
+	GVariant *parameter, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	/* Stop any load in progress too, or it'll put them back.
+	 */
+	if( win->annotations_cancellable ) {
+		g_cancellable_cancel( win->annotations_cancellable );
+		VIPS_UNREF( win->annotations_cancellable );
+		image_window_loading_stop( win );
+	}
+
+	VIPS_UNREF( win->annotations );
+	if( win->tile_cache )
+		tile_cache_set_annotations( win->tile_cache, NULL );
+}
+
 static void
 image_window_saveas_options_response( GtkDialog *dialog, 
 	gint response, gpointer user_data )
@@ -880,6 +1340,13 @@ image_window_key_pressed( GtkEventControllerKey *self,
 		image_window_toggle_debug( win );
 		break;
 
+	case GDK_KEY_Escape:
+		if( win->drawing_roi ) {
+			image_window_roi_reset( win );
+			handled = TRUE;
+		}
+		break;
+
 	default:
 		break;
 	}
@@ -1008,6 +1475,16 @@ image_window_drag_begin( GtkEventControllerMotion *self,
 	int window_width;
 	int window_height;
 
+	/* Drag out a rectangle rather than pan.
+	 */
+	if( win->roi_tool == IMAGE_WINDOW_ROI_RECTANGLE ) {
+		imagedisplay_gtk_to_image( 
+			VIPSDISP_IMAGEDISPLAY( win->imagedisplay ),
+			start_x, start_y, 
+			&win->roi_start_x, &win->roi_start_y );
+		return;
+	}
+
 	image_window_get_position( win, 
 		&window_left, &window_top, &window_width, &window_height );
 
@@ -1015,17 +1492,124 @@ image_window_drag_begin( GtkEventControllerMotion *self,
 	win->drag_start_y = window_top;
 }
 
+static void
+image_window_drag_rect( ImageWindow *win, GtkGestureDrag *drag,
+	double offset_x, double offset_y )
+{
+	double start_x;
+	double start_y;
+	double x_image;
+	double y_image;
+	VipsRect rect;
+
+	gtk_gesture_drag_get_start_point( drag, &start_x, &start_y );
+	imagedisplay_gtk_to_image( VIPSDISP_IMAGEDISPLAY( win->imagedisplay ),
+		start_x + offset_x, start_y + offset_y, &x_image, &y_image );
+
+	rect.left = VIPS_FLOOR( VIPS_MIN( win->roi_start_x, x_image ) );
+	rect.top = VIPS_FLOOR( VIPS_MIN( win->roi_start_y, y_image ) );
+	rect.width = VIPS_CEIL( VIPS_MAX( win->roi_start_x, x_image ) ) - 
+		rect.left;
+	rect.height = VIPS_CEIL( VIPS_MAX( win->roi_start_y, y_image ) ) - 
+		rect.top;
+
+	VIPS_UNREF( win->drawing_roi );
+	win->drawing_roi = roi_new_rect( &rect );
+	gtk_widget_queue_draw( win->imagedisplay );
+}
+
 static void
 image_window_drag_update( GtkEventControllerMotion *self,
 	gdouble offset_x, gdouble offset_y, gpointer user_data )
 {
 	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
 
+	if( win->roi_tool == IMAGE_WINDOW_ROI_RECTANGLE ) {
+		image_window_drag_rect( win, 
+			GTK_GESTURE_DRAG( self ), offset_x, offset_y );
+		return;
+	}
+
 	image_window_set_position( win, 
 		win->drag_start_x - offset_x,
 		win->drag_start_y - offset_y );
 }
 
+static void
+image_window_drag_end( GtkGestureDrag *self,
+	gdouble offset_x, gdouble offset_y, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	if( win->roi_tool == IMAGE_WINDOW_ROI_RECTANGLE &&
+		win->drawing_roi ) {
+		if( win->drawing_roi->bounds.width > 0 &&
+			win->drawing_roi->bounds.height > 0 )
+			image_window_add_roi( win, win->drawing_roi );
+		image_window_roi_reset( win );
+	}
+}
+
+/* Click to add a point to a polygon, double-click to finish it.
+ */
+static void
+image_window_polygon_click( ImageWindow *win, 
+	int n_press, double x, double y )
+{
+	double point[2];
+
+	if( !win->roi_points )
+		win->roi_points = g_array_new( FALSE, FALSE, sizeof( double ) );
+
+	if( n_press == 2 ) {
+		if( win->drawing_roi &&
+			win->drawing_roi->n_points >= 3 )
+			image_window_add_roi( win, win->drawing_roi );
+		image_window_roi_reset( win );
+		return;
+	}
+
+	imagedisplay_gtk_to_image( VIPSDISP_IMAGEDISPLAY( win->imagedisplay ),
+		x, y, &point[0], &point[1] );
+	g_array_append_vals( win->roi_points, point, 2 );
+
+	VIPS_UNREF( win->drawing_roi );
+	win->drawing_roi = roi_new_polygon( (double *) win->roi_points->data, 
+		win->roi_points->len / 2 );
+	gtk_widget_queue_draw( win->imagedisplay );
+}
+
+static void
+image_window_click_released( GtkGestureClick *gesture,
+	int n_press, double x, double y, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	double x_image;
+	double y_image;
+	int page;
+
+	if( win->roi_tool == IMAGE_WINDOW_ROI_POLYGON ) {
+		if( n_press <= 2 )
+			image_window_polygon_click( win, n_press, x, y );
+		return;
+	}
+
+	if( !win->tile_source ||
+		win->tile_source->mode != TILE_SOURCE_MODE_GRID ||
+		n_press != 1 )
+		return;
+
+	imagedisplay_gtk_to_image( VIPSDISP_IMAGEDISPLAY( win->imagedisplay ), 
+		x, y, &x_image, &y_image );
+	if( (page = tile_source_grid_page( win->tile_source, 
+		x_image, y_image )) >= 0 ) 
+		g_object_set( win->tile_source,
+			"mode", TILE_SOURCE_MODE_MULTIPAGE,
+			"page", page,
+			NULL );
+}
+
 static void
 image_window_toggle( GSimpleAction *action, 
 	GVariant *parameter, gpointer user_data )
@@ -1085,6 +1669,53 @@ image_window_info( GSimpleAction *action,
 	g_simple_action_set_state( action, state );
 }
 
+static void
+image_window_navigator( GSimpleAction *action, 
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	gtk_widget_set_visible( win->navigator, 
+		g_variant_get_boolean( state ) );
+
+	g_simple_action_set_state( action, state );
+}
+
+static void
+image_window_disk_cache( GSimpleAction *action, 
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+	gboolean enabled = g_variant_get_boolean( state );
+
+	/* The disc cache is shared by all windows.
+	 */
+	g_settings_set_boolean( win->settings, "disk-cache", enabled );
+	disk_cache_set_max_bytes( 1024 * 1024 *
+		(gint64) g_settings_get_int( win->settings, "disk-cache-size" ) );
+	disk_cache_set_enabled( enabled );
+
+	g_simple_action_set_state( action, state );
+}
+
+static void
+image_window_pyramid_cache( GSimpleAction *action, 
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+	gboolean enabled = g_variant_get_boolean( state );
+
+	/* Also shared by all windows. Only affects images opened after this.
+	 */
+	g_settings_set_boolean( win->settings, "pyramid-cache", enabled );
+	tile_source_set_pyramids_max_bytes( 1024 * 1024 *
+		(gint64) g_settings_get_int( win->settings, 
+			"pyramid-cache-size" ) );
+	tile_source_set_pyramids_enabled( enabled );
+
+	g_simple_action_set_state( action, state );
+}
+
 static void
 image_window_next( GSimpleAction *action, GVariant *state, gpointer user_data )
 {
@@ -1115,37 +1746,65 @@ image_window_prev( GSimpleAction *action, GVariant *state, gpointer user_data )
 	}
 }
 
-static int
-image_window_find_scale( ImageWindow *win, VipsObject *context, 
-	VipsImage *image,
-	int left, int top, int width, int height,
-	double *scale, double *offset )
+/* A histogram of the visible area from a small pyramid level, for when the
+ * tiles on screen have not kept their display values.
+ */
+static Histogram *
+image_window_level_histogram( ImageWindow *win )
 {
-	VipsImage **t = (VipsImage **) vips_object_local_array( context, 7 );
+	TileSource *tile_source = win->tile_source;
 
-	double min, max;
+	double scale;
+	int left, top, width, height;
+	VipsRect area;
+	VipsRect bounds;
+	int z;
+	VipsImage *level;
+	VipsImage *x;
+	Histogram *histogram;
 
+	z = 0;
+	while( VIPS_MAX( tile_source->display_width >> z, 
+		tile_source->display_height >> z ) > AUTO_CONTRAST_LEVEL_SIZE )
+		z += 1;
 
-	/* FIXME ... this should only look at visible tile_cache pixels ...
-	 * don't render any new pixels.
-	 */
+	if( !(level = tile_source_get_level( tile_source, z )) )
+		return( NULL );
 
-	if( vips_extract_area( image, &t[0], 
-		left, top, width, height, NULL ) ||
-		vips_stats( t[0], &t[1], NULL ) )
-		return( -1 );
+	g_object_get( win->imagedisplay, 
+		"scale", &scale,
+		NULL );
+	image_window_get_position( win, &left, &top, &width, &height );
+	area.left = left / scale / (1 << z);
+	area.top = top / scale / (1 << z);
+	area.width = VIPS_MAX( 1, width / scale / (1 << z) );
+	area.height = VIPS_MAX( 1, height / scale / (1 << z) );
+	bounds.left = 0;
+	bounds.top = 0;
+	bounds.width = level->Xsize;
+	bounds.height = level->Ysize;
+	vips_rect_intersectrect( &area, &bounds, &area );
+	if( vips_rect_isempty( &area ) )
+		area = bounds;
+
+	if( vips_extract_area( level, &x, 
+		area.left, area.top, area.width, area.height, NULL ) ) {
+		VIPS_UNREF( level );
+		return( NULL );
+	}
+	VIPS_UNREF( level );
+	level = x;
 
-	min = *VIPS_MATRIX( t[1], 0, 0 );
-	max = *VIPS_MATRIX( t[1], 1, 0 );
-	if( max == min ) {
-		vips_error( "Find scale", _( "Min and max are equal" ) );
-		return( -1 );
+	if( !(x = vips_image_copy_memory( level )) ) {
+		VIPS_UNREF( level );
+		return( NULL );
 	}
+	VIPS_UNREF( level );
 
-	*scale = 255.0 / (max - min);
-	*offset = -(min * *scale) + 0.5;
+	histogram = histogram_new( &x, 1 );
+	VIPS_UNREF( x );
 
-	return( 0 );
+	return( histogram );
 }
 
 static void
@@ -1154,35 +1813,28 @@ image_window_scale( GSimpleAction *action,
 {
 	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
 
-	VipsImage *image;
-
-	if( win->tile_source &&
-		(image = tile_source_get_image( win->tile_source )) ) {
-		double image_scale;
-		int left, top, width, height;
-		VipsImage *context;
+	if( win->tile_cache ) {
+		Histogram *histogram;
 		double scale, offset;
 
-		image_scale = image_window_get_scale( win );
-		image_window_get_position( win, &left, &top, &width, &height );
-		left /= image_scale;
-		top /= image_scale;
-		width /= image_scale;
-		height /= image_scale;
-
-		/* FIXME ... this will be incredibly slow, esp. for large 
-		 * images. Instead, it would be better to just search the 
-		 * cached tiles we have.
+		/* Only look at the pixels we are showing, so this is quick 
+		 * at any zoom. Tiles which didn't keep their display values 
+		 * (eg. after ICC) need a small level computing instead.
 		 */
+		if( !(histogram = tile_cache_histogram( win->tile_cache )) ) {
+			vips_error_clear();
+			histogram = image_window_level_histogram( win );
+		}
 
-		context = vips_image_new();
-		if( image_window_find_scale( win, VIPS_OBJECT( context ), image,
-			left, top, width, height, &scale, &offset ) ) {
+		if( !histogram ||
+			histogram_find_scale( histogram, 
+				AUTO_CONTRAST_LOW, AUTO_CONTRAST_HIGH,
+				win->tile_source->log, &scale, &offset ) ) {
+			VIPS_FREEF( histogram_free, histogram );
 			image_window_error( win );
-			g_object_unref( context );
 			return;
 		}
-		g_object_unref( context );
+		histogram_free( histogram );
 
 		g_object_set( win->tile_source,
 			"scale", scale,
@@ -1217,6 +1869,45 @@ image_window_icc( GSimpleAction *action, GVariant *state, gpointer user_data )
 	g_simple_action_set_state( action, state );
 }
 
+/* The display profile filename, or NULL for sRGB.
+ */
+static char *
+image_window_get_display_profile( ImageWindow *win )
+{
+	char *filename;
+
+	if( !g_settings_get_boolean( win->settings, "display-profile" ) )
+		return( NULL );
+
+	filename = g_settings_get_string( win->settings, 
+		"display-profile-file" );
+	if( !filename[0] ) 
+		VIPS_FREE( filename );
+
+	return( filename );
+}
+
+static void
+image_window_display_profile( GSimpleAction *action, 
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	g_settings_set_boolean( win->settings, "display-profile", 
+		g_variant_get_boolean( state ) );
+
+	if( win->tile_source ) {
+		char *filename = image_window_get_display_profile( win );
+
+		g_object_set( win->tile_source,
+			"display-profile", filename,
+			NULL );
+		g_free( filename );
+	}
+
+	g_simple_action_set_state( action, state );
+}
+
 static void
 image_window_falsecolour( GSimpleAction *action, 
 	GVariant *state, gpointer user_data )
@@ -1238,6 +1929,38 @@ image_window_radio( GSimpleAction *action,
 	g_action_change_state( G_ACTION( action ), parameter );
 }
 
+/* Fit the contact sheet to a display width.
+ */
+static void
+image_window_set_grid_width( ImageWindow *win, int width )
+{
+	if( win->tile_source &&
+		width > 0 )
+		tile_source_set_grid_columns( win->tile_source, 
+			width / GRID_CELL_SIZE );
+}
+
+/* Fit the contact sheet to the width of the window.
+ */
+static void
+image_window_update_grid( ImageWindow *win )
+{
+	image_window_set_grid_width( win, 
+		gtk_widget_get_width( win->imagedisplay ) );
+}
+
+/* The display area has a new size, perhaps from a drag, maximise or
+ * fullscreen.
+ */
+static void
+image_window_imagedisplay_resize( GtkDrawingArea *area, 
+	int width, int height, ImageWindow *win )
+{
+	if( win->tile_source &&
+		win->tile_source->mode == TILE_SOURCE_MODE_GRID )
+		image_window_set_grid_width( win, width );
+}
+
 static void
 image_window_mode( GSimpleAction *action,
 	GVariant *state, gpointer user_data )
@@ -1256,15 +1979,21 @@ image_window_mode( GSimpleAction *action,
 		mode = TILE_SOURCE_MODE_ANIMATED;
 	else if( g_str_equal( str, "pages-as-bands" ) ) 
 		mode = TILE_SOURCE_MODE_PAGES_AS_BANDS;
+	else if( g_str_equal( str, "grid" ) ) 
+		mode = TILE_SOURCE_MODE_GRID;
 	else
 		/* Ignore attempted change.
 		 */
 		return;
 
-	if( win->tile_source )
+	if( win->tile_source ) {
+		if( mode == TILE_SOURCE_MODE_GRID )
+			image_window_update_grid( win );
+
 		g_object_set( win->tile_source,
 			"mode", mode,
 			NULL );
+	}
 
 	g_simple_action_set_state( action, state );
 }
@@ -1302,6 +2031,44 @@ image_window_background( GSimpleAction *action,
 	g_simple_action_set_state( action, state );
 }
 
+static void
+image_window_roi( GSimpleAction *action,
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	const gchar *str;
+	ImageWindowRoiTool roi_tool;
+
+	str = g_variant_get_string( state, NULL );
+	if( g_str_equal( str, "none" ) ) 
+		roi_tool = IMAGE_WINDOW_ROI_NONE;
+	else if( g_str_equal( str, "rectangle" ) ) 
+		roi_tool = IMAGE_WINDOW_ROI_RECTANGLE;
+	else if( g_str_equal( str, "polygon" ) ) 
+		roi_tool = IMAGE_WINDOW_ROI_POLYGON;
+	else
+		/* Ignore attempted change.
+		 */
+		return;
+
+	win->roi_tool = roi_tool;
+	image_window_roi_reset( win );
+
+	g_simple_action_set_state( action, state );
+}
+
+static void
+image_window_roi_clear( GSimpleAction *action, 
+	GVariant *state, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+
+	image_window_free_rois( win );
+	image_window_roi_reset( win );
+	image_window_status_changed( win );
+}
+
 static void
 image_window_reset( GSimpleAction *action, 
 	GVariant *state, gpointer user_data )
@@ -1340,17 +2107,29 @@ static GActionEntry image_window_entries[] = {
 		image_window_control },
 	{ "info", image_window_toggle, NULL, "false", 
 		image_window_info },
+	{ "navigator", image_window_toggle, NULL, "false", 
+		image_window_navigator },
+	{ "disk-cache", image_window_toggle, NULL, "false", 
+		image_window_disk_cache },
+	{ "pyramid-cache", image_window_toggle, NULL, "false", 
+		image_window_pyramid_cache },
 
 	{ "next", image_window_next },
 	{ "prev", image_window_prev },
 	{ "scale", image_window_scale },
 	{ "log", image_window_toggle, NULL, "false", image_window_log },
 	{ "icc", image_window_toggle, NULL, "false", image_window_icc },
+	{ "display-profile", image_window_toggle, NULL, "false", 
+		image_window_display_profile },
 	{ "falsecolour",
 		image_window_toggle, NULL, "false", image_window_falsecolour },
 	{ "mode", image_window_radio, "s", "'multipage'", image_window_mode },
 	{ "background", image_window_radio, "s", 
 		"'checkerboard'", image_window_background },
+	{ "roi", image_window_radio, "s", "'none'", image_window_roi },
+	{ "roi-clear", image_window_roi_clear },
+	{ "annotations", image_window_annotations_action },
+	{ "annotations-clear", image_window_annotations_clear },
 
 	{ "reset", image_window_reset },
 };
@@ -1373,6 +2152,28 @@ image_window_init( ImageWindow *win )
 	g_object_set( win->info_bar,
 		"image-window", win,
 		NULL );
+	g_object_set( win->navigator,
+		"image-window", win,
+		NULL );
+
+	/* The navigator tracks the view through these.
+	 */
+	g_signal_connect_object( gtk_scrolled_window_get_hadjustment( 
+			GTK_SCROLLED_WINDOW( win->scrolled_window ) ), 
+		"value-changed", 
+		G_CALLBACK( image_window_view_changed ), win, 0 );
+	g_signal_connect_object( gtk_scrolled_window_get_vadjustment( 
+			GTK_SCROLLED_WINDOW( win->scrolled_window ) ), 
+		"value-changed", 
+		G_CALLBACK( image_window_view_changed ), win, 0 );
+	g_signal_connect_object( gtk_scrolled_window_get_hadjustment( 
+			GTK_SCROLLED_WINDOW( win->scrolled_window ) ), 
+		"changed", 
+		G_CALLBACK( image_window_view_changed ), win, 0 );
+	g_signal_connect_object( gtk_scrolled_window_get_vadjustment( 
+			GTK_SCROLLED_WINDOW( win->scrolled_window ) ), 
+		"changed", 
+		G_CALLBACK( image_window_view_changed ), win, 0 );
 
 	g_signal_connect_object( win->progress_cancel, "clicked", 
 		G_CALLBACK( image_window_cancel_clicked ), win, 0 );
@@ -1380,6 +2181,15 @@ image_window_init( ImageWindow *win )
 	g_signal_connect_object( win->error_bar, "response", 
 		G_CALLBACK( image_window_error_response ), win, 0 );
 
+	g_signal_connect( win, "notify::is-active", 
+		G_CALLBACK( image_window_is_active_changed ), NULL );
+	g_signal_connect( win, "map", 
+		G_CALLBACK( image_window_map_changed ), NULL );
+	g_signal_connect( win, "unmap", 
+		G_CALLBACK( image_window_map_changed ), NULL );
+	g_signal_connect( win, "realize", 
+		G_CALLBACK( image_window_realize ), NULL );
+
 	g_action_map_add_action_entries( G_ACTION_MAP( win ),
 		image_window_entries, G_N_ELEMENTS( image_window_entries ),
 		win );
@@ -1418,13 +2228,37 @@ image_window_init( ImageWindow *win )
 		G_CALLBACK( image_window_drag_begin ), win );
 	g_signal_connect( controller, "drag-update", 
 		G_CALLBACK( image_window_drag_update ), win );
+	g_signal_connect( controller, "drag-end", 
+		G_CALLBACK( image_window_drag_end ), win );
+	gtk_widget_add_controller( win->imagedisplay, controller );
+
+	/* Click on a contact sheet to open that page.
+	 */
+	controller = GTK_EVENT_CONTROLLER( gtk_gesture_click_new() );
+	gtk_gesture_single_set_button( GTK_GESTURE_SINGLE( controller ), 
+		GDK_BUTTON_PRIMARY );
+	g_signal_connect( controller, "released", 
+		G_CALLBACK( image_window_click_released ), win );
 	gtk_widget_add_controller( win->imagedisplay, controller );
 
+	/* Draw regions of interest over the image.
+	 */
+	g_signal_connect_object( win->imagedisplay, "overlay", 
+		G_CALLBACK( image_window_overlay ), win, 0 );
+
+	g_signal_connect_object( win->imagedisplay, "resize", 
+		G_CALLBACK( image_window_imagedisplay_resize ), win, 0 );
+
 	g_settings_bind( win->settings, "control",
 		G_OBJECT( win->display_bar ),
 		"revealed", 
 		G_SETTINGS_BIND_DEFAULT );
 
+	g_settings_bind( win->settings, "navigator",
+		G_OBJECT( win->navigator ),
+		"visible", 
+		G_SETTINGS_BIND_DEFAULT );
+
 	g_settings_bind( win->settings, "info",
 		G_OBJECT( win->info_bar ),
 		"revealed", 
@@ -1436,6 +2270,14 @@ image_window_init( ImageWindow *win )
 		g_settings_get_value( win->settings, "control" ) );
 	change_state( GTK_WIDGET( win ), "info", 
 		g_settings_get_value( win->settings, "info" ) );
+	change_state( GTK_WIDGET( win ), "navigator", 
+		g_settings_get_value( win->settings, "navigator" ) );
+	change_state( GTK_WIDGET( win ), "disk-cache", 
+		g_settings_get_value( win->settings, "disk-cache" ) );
+	change_state( GTK_WIDGET( win ), "pyramid-cache", 
+		g_settings_get_value( win->settings, "pyramid-cache" ) );
+	change_state( GTK_WIDGET( win ), "display-profile", 
+		g_settings_get_value( win->settings, "display-profile" ) );
 }
 
 static void
@@ -1468,6 +2310,7 @@ image_window_class_init( ImageWindowClass *class )
 	BIND( title );
 	BIND( subtitle );
 	BIND( gears );
+	BIND( spinner );
 	BIND( progress_bar );
 	BIND( progress );
 	BIND( progress_cancel );
@@ -1477,6 +2320,7 @@ image_window_class_init( ImageWindowClass *class )
 	BIND( imagedisplay );
 	BIND( display_bar );
 	BIND( info_bar );
+	BIND( navigator );
 
 	gtk_widget_class_bind_template_callback( GTK_WIDGET_CLASS( class ),
 		image_window_pressed_cb );
@@ -1489,6 +2333,14 @@ image_window_class_init( ImageWindowClass *class )
 		g_cclosure_marshal_VOID__VOID,
 		G_TYPE_NONE, 0 ); 
 
+	image_window_signals[SIG_VIEW_CHANGED] = g_signal_new( 
+		"view-changed",
+		G_TYPE_FROM_CLASS( class ),
+		G_SIGNAL_RUN_LAST,
+		0, NULL, NULL,
+		g_cclosure_marshal_VOID__VOID,
+		G_TYPE_NONE, 0 ); 
+
 	image_window_signals[SIG_CHANGED] = g_signal_new( "changed",
 		G_TYPE_FROM_CLASS( class ),
 		G_SIGNAL_RUN_LAST,
@@ -1511,9 +2363,26 @@ image_window_set_tile_source( ImageWindow *win, TileSource *tile_source )
 	VipsImage *image;
 	char *title;
 
+	/* Stop any load of the image we are replacing. 
+	 */
+	if( win->tile_source &&
+		win->tile_source != tile_source )
+		tile_source_cancel_load( win->tile_source );
+
 	VIPS_UNREF( win->tile_source );
 	VIPS_UNREF( win->tile_cache );
 
+	/* Regions and annotations belong to the old image.
+	 */
+	image_window_free_rois( win );
+	image_window_roi_reset( win );
+	if( win->annotations_cancellable ) {
+		g_cancellable_cancel( win->annotations_cancellable );
+		VIPS_UNREF( win->annotations_cancellable );
+		image_window_loading_stop( win );
+	}
+	VIPS_UNREF( win->annotations );
+
 	win->tile_source = tile_source;
 	g_object_ref( tile_source );
 	win->tile_cache = tile_cache_new( win->tile_source );
@@ -1531,6 +2400,10 @@ image_window_set_tile_source( ImageWindow *win, TileSource *tile_source )
 
 	g_signal_connect_object( win->tile_source, "changed", 
 		G_CALLBACK( image_window_tile_source_changed ), win, 0 );
+	g_signal_connect_object( win->tile_source, "page-changed", 
+		G_CALLBACK( image_window_tile_source_page_changed ), win, 0 );
+
+	image_window_update_page_tick( win );
 
 	if( !(title = (char *) tile_source_get_path( tile_source )) ) 
 		title = "Untitled";
@@ -1570,9 +2443,13 @@ image_window_set_tile_source( ImageWindow *win, TileSource *tile_source )
 	 */
 	tile_source->active = 
 		g_settings_get_boolean( win->settings, "control" );
+	VIPS_FREE( tile_source->display_profile );
+	tile_source->display_profile = image_window_get_display_profile( win );
 
-	/* Everything is set up ... start loading the image.
+	/* Everything is set up ... start loading the image. Loads for the 
+	 * focused window go first.
 	 */
+	image_window_update_priority( win );
 	tile_source_background_load( tile_source );
 
 	image_window_changed( win );
@@ -1584,23 +2461,82 @@ image_window_get_tile_source( ImageWindow *win )
 	return( win->tile_source );
 }
 
+TileCache *
+image_window_get_tile_cache( ImageWindow *win )
+{
+	return( win->tile_cache );
+}
+
+/* The most recent region of interest, or NULL.
+ */
+Roi *
+image_window_get_roi( ImageWindow *win )
+{
+	return( win->rois ? ROI( win->rois->data ) : NULL );
+}
+
+/* The background open has finished, or been cancelled.
+ */
+static void
+image_window_open_done( GObject *source_object, 
+	GAsyncResult *result, gpointer user_data )
+{
+	ImageWindow *win = VIPSDISP_IMAGE_WINDOW( user_data );
+	GCancellable *cancellable = g_task_get_cancellable( G_TASK( result ) );
+
+	TileSource *tile_source;
+	GError *error = NULL;
+
+	tile_source = tile_source_new_from_file_finish( result, &error );
+
+	/* Only act on the most recent open. This will also be false for 
+	 * cancelled opens.
+	 */
+	if( win->open_cancellable &&
+		cancellable == win->open_cancellable ) {
+		VIPS_UNREF( win->open_cancellable );
+		image_window_loading_stop( win );
+
+		if( tile_source ) 
+			image_window_set_tile_source( win, tile_source );
+		else 
+			image_window_gerror( win, error );
+	}
+
+	VIPS_UNREF( tile_source );
+	g_clear_error( &error );
+
+	/* Matches the ref in image_window_open().
+	 */
+	g_object_unref( win );
+}
+
 void
 image_window_open( ImageWindow *win, GFile *file )
 {
 	char *path;
-	TileSource *tile_source;
 
-	path = g_file_get_path( file );
-
-	if( !(tile_source = tile_source_new_from_file( path )) ) {
-		image_window_error( win ); 
-		g_free( path );
-		return;
+	/* Cancel any open that's in progress.
+	 */
+	if( win->open_cancellable ) {
+		g_cancellable_cancel( win->open_cancellable );
+		VIPS_UNREF( win->open_cancellable );
+		image_window_loading_stop( win );
 	}
 
-	image_window_set_tile_source( win, tile_source );
+	path = g_file_get_path( file );
+	gtk_label_set_text( GTK_LABEL( win->title ), path );
+	gtk_label_set_text( GTK_LABEL( win->subtitle ), "" );
+	image_window_loading_start( win );
+
+	/* Sniffing can be slow, so do it in the background. We keep a ref
+	 * to the window until the callback runs.
+	 */
+	win->open_cancellable = g_cancellable_new();
+	g_object_ref( win );
+	tile_source_new_from_file_async( path, win->open_cancellable,
+		image_window_open_done, win );
 
-	VIPS_UNREF( tile_source );
 	g_free( path );
 }
 
@@ -1612,3 +2548,49 @@ image_window_get_mouse_position( ImageWindow *win,
 		win->last_x_gtk, win->last_y_gtk, x_image, y_image );
 }
 
+/* The part of the image we can see, in level 0 image coordinates.
+ */
+void
+image_window_get_viewport( ImageWindow *win, VipsRect *viewport )
+{
+	Imagedisplay *imagedisplay = VIPSDISP_IMAGEDISPLAY( win->imagedisplay );
+
+	double left;
+	double top;
+	double right;
+	double bottom;
+
+	imagedisplay_gtk_to_image( imagedisplay, 0, 0, &left, &top );
+	imagedisplay_gtk_to_image( imagedisplay, 
+		gtk_widget_get_width( win->imagedisplay ),
+		gtk_widget_get_height( win->imagedisplay ),
+		&right, &bottom );
+
+	viewport->left = left;
+	viewport->top = top;
+	viewport->width = right - left + 1;
+	viewport->height = bottom - top + 1;
+}
+
+/* Scroll so that a point in the image is in the centre of the window.
+ */
+void
+image_window_centre( ImageWindow *win, double x_image, double y_image )
+{
+	int window_left;
+	int window_top;
+	int window_width;
+	int window_height;
+	double x_gtk;
+	double y_gtk;
+
+	image_window_get_position( win, 
+		&window_left, &window_top, &window_width, &window_height );
+	imagedisplay_image_to_gtk( VIPSDISP_IMAGEDISPLAY( win->imagedisplay ), 
+		x_image, y_image, &x_gtk, &y_gtk );
+
+	image_window_set_position( win, 
+		window_left + x_gtk - window_width / 2,
+		window_top + y_gtk - window_height / 2 );
+}
+
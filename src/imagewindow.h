@@ -10,9 +10,13 @@ ImageWindow *image_window_new( VipsdispApp *app );
 void image_window_open( ImageWindow *win, GFile *file );
 double image_window_get_scale( ImageWindow *win );
 TileSource *image_window_get_tile_source( ImageWindow *win );
+TileCache *image_window_get_tile_cache( ImageWindow *win );
+Roi *image_window_get_roi( ImageWindow *win );
 void image_window_set_tile_source( ImageWindow *win, TileSource *tile_source );
 void image_window_get_mouse_position( ImageWindow *win, 
 	double *image_x, double *image_y );
+void image_window_get_viewport( ImageWindow *win, VipsRect *viewport );
+void image_window_centre( ImageWindow *win, double x_image, double y_image );
 
 #endif /* __IMAGE_WINDOW_H */
 
@@ -17,11 +17,26 @@ struct _Infobar {
 	GtkWidget *y;
 	GtkWidget *values;
 	GtkWidget *mag;
+	GtkWidget *roi;
 
 	GSList *value_widgets;
 
+	/* For the pixel-probe-size setting.
+	 */
+	GSettings *settings;
+
 	// a background pixel value fetch is in progress
 	gboolean updating;
+
+	// the mouse has moved to a pixel we don't have cached, so fetch it in
+	// the background on the next frame
+	gboolean pending;
+	guint tick_handler;
+
+	// number each position we show, so a slow background fetch can't 
+	// overwrite a later value
+	int serial;
+	int shown_serial;
 };
 
 G_DEFINE_TYPE( Infobar, infobar, GTK_TYPE_WIDGET );
@@ -43,6 +58,12 @@ infobar_dispose( GObject *object )
 #endif /*DEBUG*/
 
 	VIPS_FREEF( gtk_widget_unparent, infobar->action_bar );
+	if( infobar->tick_handler ) {
+		gtk_widget_remove_tick_callback( GTK_WIDGET( infobar ), 
+			infobar->tick_handler );
+		infobar->tick_handler = 0;
+	}
+	VIPS_UNREF( infobar->settings );
 
 	G_OBJECT_CLASS( infobar_parent_class )->dispose( object );
 }
@@ -140,6 +161,15 @@ infobar_status_value_set_array( Infobar *infobar, double *d )
 	}
 }
 
+/* The probe radius from the pixel-probe-size setting, so 1 for 3x3.
+ */
+static int
+infobar_probe_radius( Infobar *infobar )
+{
+	return( g_settings_get_int( infobar->settings, 
+		"pixel-probe-size" ) / 2 );
+}
+
 /* Asynchronous update of the pixel value ... we need this off the main thread
  * or we get awful hitching for some formats.
  */
@@ -151,6 +181,8 @@ typedef struct _PixelUpdate {
 	// fetch params
 	int image_x;
 	int image_y;
+	int radius;
+	int serial;
 	double *vector;
 	int n;
 	gboolean result;
@@ -172,9 +204,13 @@ static gboolean
 infobar_update_pixel_cb( void *a )
 {
 	PixelUpdate *update = (PixelUpdate *) a;
+	Infobar *infobar = update->infobar;
 
-	if( update->result )
-		infobar_status_value_set_array( update->infobar, update->vector );
+	if( update->result &&
+		update->serial > infobar->shown_serial ) {
+		infobar_status_value_set_array( infobar, update->vector );
+		infobar->shown_serial = update->serial;
+	}
 
 	infobar_update_free( update );
 
@@ -188,37 +224,99 @@ infobar_get_pixel( void *a, void *b )
 	PixelUpdate *update = (PixelUpdate *) a;
 
 	update->result = tile_source_get_pixel( update->tile_source, 
-		update->image_x, update->image_y, &update->vector, &update->n ); 
+		update->image_x, update->image_y, update->radius,
+		&update->vector, &update->n ); 
 
 	g_idle_add( infobar_update_pixel_cb, update );
 }
 
 // fetch the mouse position pixel and update the screen in a bg thread
 static void
+infobar_fetch_pixel( Infobar *infobar )
+{
+	ImageWindow *win = infobar->win;
+	PixelUpdate *update = g_new0( PixelUpdate, 1 );
+
+	double x_image;
+	double y_image;
+
+	update->infobar = infobar;
+	update->tile_source = image_window_get_tile_source( win );
+	image_window_get_mouse_position( infobar->win, &x_image, &y_image );
+	update->image_x = (int) x_image;
+	update->image_y = (int) y_image;
+	update->radius = infobar_probe_radius( infobar );
+	update->serial = infobar->serial;
+	infobar->updating = TRUE;
+
+	// must stay valid until we are done
+	g_object_ref( update->infobar );
+	g_object_ref( update->tile_source );
+
+	if( vips_thread_execute( "pixel", infobar_get_pixel, update ) )
+		// if we can't run a bg task, we must free the update
+		infobar_update_free( update );
+}
+
+/* Once a frame, start a background fetch for the latest mouse position if 
+ * the last one has finished. Intermediate positions are skipped, but we
+ * always end up showing the pixel under the mouse.
+ */
+static gboolean
+infobar_tick( GtkWidget *widget, 
+	GdkFrameClock *frame_clock, gpointer user_data )
+{
+	Infobar *infobar = INFOBAR( user_data );
+
+	if( infobar->updating )
+		return( G_SOURCE_CONTINUE );
+
+	if( infobar->pending &&
+		image_window_get_tile_source( infobar->win ) ) {
+		infobar->pending = FALSE;
+		infobar_fetch_pixel( infobar );
+
+		return( G_SOURCE_CONTINUE );
+	}
+
+	infobar->tick_handler = 0;
+
+	return( G_SOURCE_REMOVE );
+}
+
+/* Show the pixel under the mouse. We read from the display values held by 
+ * the tile cache if we can, so we can keep up with the mouse even on huge
+ * images, and only go to the image for pixels we don't have.
+ */
+static void
 infobar_update_pixel( Infobar *infobar )
 {
-	if( !infobar->updating ) {
-		ImageWindow *win = infobar->win;
-		PixelUpdate *update = g_new0( PixelUpdate, 1 );
-
-		double x_image;
-		double y_image;
-
-		update->infobar = infobar;
-		update->tile_source = image_window_get_tile_source( win );
-		image_window_get_mouse_position( infobar->win, &x_image, &y_image );
-		update->image_x = (int) x_image;
-		update->image_y = (int) y_image;
-		infobar->updating = TRUE;
-
-		// must stay valid until we are done
-		g_object_ref( update->infobar );
-		g_object_ref( update->tile_source );
-
-		if( vips_thread_execute( "pixel", infobar_get_pixel, update ) )
-			// if we can't run a bg task, we must free the update
-			infobar_update_free( update );
+	TileCache *tile_cache = image_window_get_tile_cache( infobar->win );
+
+	double x_image;
+	double y_image;
+	double *vector;
+	int n;
+
+	infobar->serial += 1;
+
+	image_window_get_mouse_position( infobar->win, &x_image, &y_image );
+	if( tile_cache &&
+		tile_cache_get_pixel( tile_cache, 
+			(int) x_image, (int) y_image, 
+			infobar_probe_radius( infobar ), &vector, &n ) ) {
+		infobar_status_value_set_array( infobar, vector );
+		infobar->shown_serial = infobar->serial;
+		infobar->pending = FALSE;
+		g_free( vector );
+
+		return;
 	}
+
+	infobar->pending = TRUE;
+	if( !infobar->tick_handler )
+		infobar->tick_handler = gtk_widget_add_tick_callback( 
+			GTK_WIDGET( infobar ), infobar_tick, infobar, NULL );
 }
 
 void
@@ -230,6 +328,7 @@ infobar_status_update( Infobar *infobar )
 	VipsBuf buf = VIPS_BUF_STATIC( str );
 	double image_x;
 	double image_y;
+	Roi *roi;
 
 #ifdef DEBUG
 	printf( "infobar_status_update:\n" ); 
@@ -255,6 +354,16 @@ infobar_status_update( Infobar *infobar )
 	gtk_label_set_text( GTK_LABEL( infobar->mag ), 
 		vips_buf_all( &buf ) ); 
 
+	if( (roi = image_window_get_roi( infobar->win )) ) {
+		char txt[256];
+		VipsBuf roi_buf = VIPS_BUF_STATIC( txt );
+
+		roi_describe( roi, &roi_buf );
+		gtk_label_set_text( GTK_LABEL( infobar->roi ), 
+			vips_buf_all( &roi_buf ) ); 
+	}
+	gtk_widget_set_visible( infobar->roi, roi != NULL );
+
 	// queue bg update of pixel value
 	infobar_update_pixel( infobar );
 }
@@ -363,6 +472,7 @@ infobar_init( Infobar *infobar )
 
 	gtk_widget_init_template( GTK_WIDGET( infobar ) );
 
+	infobar->settings = g_settings_new( APPLICATION_ID );
 }
 
 #define BIND( field ) \
@@ -391,6 +501,7 @@ infobar_class_init( InfobarClass *class )
 	BIND( y );
 	BIND( values );
 	BIND( mag );
+	BIND( roi );
 
 	gobject_class->set_property = infobar_set_property;
 	gobject_class->get_property = infobar_get_property;
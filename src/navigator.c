@@ -0,0 +1,363 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* The longest side of the overview, in pixels.
+ */
+#define NAVIGATOR_SIZE (200)
+
+struct _Navigator {
+	GtkWidget parent_instance;
+
+	/* The imagewindow we navigate.
+	 */
+	ImageWindow *win;
+
+	/* Level 0 image pixels to widget pixels, and the position of the 
+	 * image in the widget, as last drawn.
+	 */
+	double scale;
+	double left;
+	double top;
+};
+
+G_DEFINE_TYPE( Navigator, navigator, GTK_TYPE_WIDGET );
+
+enum {
+	PROP_IMAGE_WINDOW = 1,
+
+	SIG_LAST
+};
+
+static TileSource *
+navigator_get_tile_source( Navigator *navigator )
+{
+	TileSource *tile_source;
+
+	if( !navigator->win ||
+		!(tile_source = image_window_get_tile_source( navigator->win )) ||
+		tile_source->display_width <= 0 ||
+		tile_source->display_height <= 0 )
+		return( NULL );
+
+	return( tile_source );
+}
+
+/* Compute the coarsest level in the background, if we're on screen, so we
+ * have something to draw. This does nothing if it's been fetched already for
+ * the current pixels.
+ */
+static void
+navigator_fetch_overview( Navigator *navigator )
+{
+	TileCache *tile_cache;
+
+	if( navigator->win &&
+		gtk_widget_get_mapped( GTK_WIDGET( navigator ) ) &&
+		(tile_cache = image_window_get_tile_cache( navigator->win )) )
+		tile_cache_fetch_overview( tile_cache );
+}
+
+/* Size to the aspect ratio of the image.
+ */
+static void
+navigator_measure( GtkWidget *widget, 
+	GtkOrientation orientation, int for_size,
+	int *minimum, int *natural, 
+	int *minimum_baseline, int *natural_baseline )
+{
+	Navigator *navigator = NAVIGATOR( widget );
+	TileSource *tile_source = navigator_get_tile_source( navigator );
+
+	int size;
+
+	size = NAVIGATOR_SIZE;
+	if( tile_source ) {
+		int width = tile_source->display_width;
+		int height = tile_source->display_height;
+		double scale = (double) NAVIGATOR_SIZE / VIPS_MAX( width, height );
+
+		if( orientation == GTK_ORIENTATION_HORIZONTAL )
+			size = VIPS_MAX( 1, width * scale );
+		else
+			size = VIPS_MAX( 1, height * scale );
+	}
+
+	*minimum = size;
+	*natural = size;
+}
+
+static void
+navigator_snapshot( GtkWidget *widget, GtkSnapshot *snapshot )
+{
+	#define BORDER ((GdkRGBA) { 1, 0, 0, 1 })
+
+	Navigator *navigator = NAVIGATOR( widget );
+	int width = gtk_widget_get_width( widget );
+	int height = gtk_widget_get_height( widget );
+
+	TileSource *tile_source;
+	TileCache *tile_cache;
+	VipsRect viewport;
+	GskRoundedRect outline;
+
+	if( !(tile_source = navigator_get_tile_source( navigator )) ||
+		!(tile_cache = image_window_get_tile_cache( navigator->win )) )
+		return;
+
+	navigator->scale = VIPS_MIN( 
+		(double) width / tile_source->display_width,
+		(double) height / tile_source->display_height );
+	navigator->left = 
+		(width - tile_source->display_width * navigator->scale) / 2;
+	navigator->top = 
+		(height - tile_source->display_height * navigator->scale) / 2;
+
+	gtk_snapshot_push_clip( snapshot, 
+		&GRAPHENE_RECT_INIT( 0, 0, width, height ) );
+
+	/* A backdrop, in case the coarse levels have not been computed yet.
+	 */
+	gtk_snapshot_append_color( snapshot, 
+		&((GdkRGBA) { 0, 0, 0, 0.6 }),
+		&GRAPHENE_RECT_INIT( 0, 0, width, height ) );
+
+	gtk_snapshot_save( snapshot );
+	gtk_snapshot_translate( snapshot, 
+		&GRAPHENE_POINT_INIT( navigator->left, navigator->top ) );
+	tile_cache_snapshot_overview( tile_cache, snapshot, navigator->scale );
+	gtk_snapshot_restore( snapshot );
+
+	image_window_get_viewport( navigator->win, &viewport );
+	gsk_rounded_rect_init_from_rect( &outline, 
+		&GRAPHENE_RECT_INIT(
+			navigator->left + viewport.left * navigator->scale,
+			navigator->top + viewport.top * navigator->scale,
+			VIPS_MAX( 2, viewport.width * navigator->scale ),
+			VIPS_MAX( 2, viewport.height * navigator->scale )
+		), 
+		0 );
+	gtk_snapshot_append_border( snapshot, 
+		&outline, 
+		(float[4]) { 2, 2, 2, 2 },
+		(GdkRGBA [4]) { BORDER, BORDER, BORDER, BORDER } );
+
+	gtk_snapshot_pop( snapshot );
+}
+
+/* We don't fetch while we're hidden, so fetch now.
+ */
+static void
+navigator_map( GtkWidget *widget )
+{
+	GTK_WIDGET_CLASS( navigator_parent_class )->map( widget );
+
+	navigator_fetch_overview( NAVIGATOR( widget ) );
+}
+
+/* Centre the view on a point in the overview.
+ */
+static void
+navigator_centre( Navigator *navigator, double x, double y )
+{
+	if( navigator->win &&
+		navigator->scale > 0 )
+		image_window_centre( navigator->win, 
+			(x - navigator->left) / navigator->scale,
+			(y - navigator->top) / navigator->scale );
+}
+
+static void
+navigator_drag_begin( GtkGestureDrag *self,
+	gdouble start_x, gdouble start_y, gpointer user_data )
+{
+	Navigator *navigator = NAVIGATOR( user_data );
+
+	navigator_centre( navigator, start_x, start_y );
+}
+
+static void
+navigator_drag_update( GtkGestureDrag *self,
+	gdouble offset_x, gdouble offset_y, gpointer user_data )
+{
+	Navigator *navigator = NAVIGATOR( user_data );
+
+	double start_x;
+	double start_y;
+
+	gtk_gesture_drag_get_start_point( self, &start_x, &start_y );
+	navigator_centre( navigator, start_x + offset_x, start_y + offset_y );
+}
+
+/* The view has moved.
+ */
+static void
+navigator_view_changed( ImageWindow *win, Navigator *navigator )
+{
+	gtk_widget_queue_draw( GTK_WIDGET( navigator ) );
+}
+
+/* New pixels, perhaps for the levels we draw. After a change to the display
+ * settings, the overview must be fetched again.
+ */
+static void
+navigator_tile_cache_tiles_changed( TileCache *tile_cache, 
+	Navigator *navigator )
+{
+	navigator_fetch_overview( navigator );
+	gtk_widget_queue_draw( GTK_WIDGET( navigator ) );
+}
+
+/* New geometry, perhaps a page flip.
+ */
+static void
+navigator_tile_cache_changed( TileCache *tile_cache, Navigator *navigator )
+{
+	navigator_fetch_overview( navigator );
+	gtk_widget_queue_resize( GTK_WIDGET( navigator ) );
+}
+
+static void
+navigator_tile_cache_area_changed( TileCache *tile_cache, 
+	VipsRect *dirty, int z, Navigator *navigator )
+{
+	if( z >= tile_cache->n_levels - TILE_CACHE_KEEP_LEVELS )
+		gtk_widget_queue_draw( GTK_WIDGET( navigator ) );
+}
+
+/* Imagewindow has a new tile_source.
+ */
+static void
+navigator_image_window_changed( ImageWindow *win, Navigator *navigator )
+{
+	TileCache *tile_cache = image_window_get_tile_cache( win );
+
+	if( tile_cache ) {
+		g_signal_connect_object( tile_cache, "changed", 
+			G_CALLBACK( navigator_tile_cache_changed ), 
+			navigator, 0 );
+		g_signal_connect_object( tile_cache, "tiles-changed", 
+			G_CALLBACK( navigator_tile_cache_tiles_changed ), 
+			navigator, 0 );
+		g_signal_connect_object( tile_cache, "area-changed", 
+			G_CALLBACK( navigator_tile_cache_area_changed ), 
+			navigator, 0 );
+	}
+
+	navigator_fetch_overview( navigator );
+	gtk_widget_queue_resize( GTK_WIDGET( navigator ) );
+}
+
+static void
+navigator_set_image_window( Navigator *navigator, ImageWindow *win )
+{
+	/* No need to ref ... win holds a ref to us.
+	 */
+	navigator->win = win;
+
+	g_signal_connect_object( win, "changed", 
+		G_CALLBACK( navigator_image_window_changed ), 
+		navigator, 0 );
+
+	g_signal_connect_object( win, "view-changed", 
+		G_CALLBACK( navigator_view_changed ), 
+		navigator, 0 );
+}
+
+static void
+navigator_set_property( GObject *object, 
+	guint prop_id, const GValue *value, GParamSpec *pspec )
+{
+	Navigator *navigator = (Navigator *) object;
+
+	switch( prop_id ) {
+	case PROP_IMAGE_WINDOW:
+		navigator_set_image_window( navigator, 
+			VIPSDISP_IMAGE_WINDOW( g_value_get_object( value ) ) );
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID( object, prop_id, pspec );
+		break;
+	}
+}
+
+static void
+navigator_get_property( GObject *object, 
+	guint prop_id, GValue *value, GParamSpec *pspec )
+{
+	Navigator *navigator = (Navigator *) object;
+
+	switch( prop_id ) {
+	case PROP_IMAGE_WINDOW:
+		g_value_set_object( value, navigator->win );
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID( object, prop_id, pspec );
+		break;
+	}
+}
+
+static void
+navigator_init( Navigator *navigator )
+{
+	GtkEventController *controller;
+
+#ifdef DEBUG
+	printf( "navigator_init:\n" ); 
+#endif /*DEBUG*/
+
+	controller = GTK_EVENT_CONTROLLER( gtk_gesture_drag_new() );
+	g_signal_connect( controller, "drag-begin", 
+		G_CALLBACK( navigator_drag_begin ), navigator );
+	g_signal_connect( controller, "drag-update", 
+		G_CALLBACK( navigator_drag_update ), navigator );
+	gtk_widget_add_controller( GTK_WIDGET( navigator ), controller );
+
+	gtk_widget_set_cursor_from_name( GTK_WIDGET( navigator ), "crosshair" );
+}
+
+static void
+navigator_class_init( NavigatorClass *class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
+	GtkWidgetClass *widget_class = GTK_WIDGET_CLASS( class );
+
+#ifdef DEBUG
+	printf( "navigator_class_init:\n" ); 
+#endif /*DEBUG*/
+
+	widget_class->measure = navigator_measure;
+	widget_class->snapshot = navigator_snapshot;
+	widget_class->map = navigator_map;
+
+	gobject_class->set_property = navigator_set_property;
+	gobject_class->get_property = navigator_get_property;
+
+	g_object_class_install_property( gobject_class, PROP_IMAGE_WINDOW,
+		g_param_spec_object( "image-window",
+			_( "Image window" ),
+			_( "The image window we navigate" ),
+			IMAGE_WINDOW_TYPE,
+			G_PARAM_READWRITE ) );
+
+}
+
+Navigator *
+navigator_new( ImageWindow *win ) 
+{
+	Navigator *navigator;
+
+#ifdef DEBUG
+	printf( "navigator_new:\n" ); 
+#endif /*DEBUG*/
+
+	navigator = g_object_new( navigator_get_type(), 
+		"image-window", win,
+		NULL );
+
+	return( navigator ); 
+}
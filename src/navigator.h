@@ -0,0 +1,18 @@
+/* A small overview of the whole image, drawn from the coarse pyramid levels
+ * the tile cache always keeps, with a box for the part in the window. Click
+ * or drag to move the view.
+ */
+
+#ifndef __NAVIGATOR_H
+#define __NAVIGATOR_H
+
+#define NAVIGATOR_TYPE (navigator_get_type())
+
+G_DECLARE_FINAL_TYPE( Navigator, navigator, VIPSDISP, NAVIGATOR, GtkWidget )
+
+#define NAVIGATOR( obj ) \
+	(G_TYPE_CHECK_INSTANCE_CAST( (obj), NAVIGATOR_TYPE, Navigator ))
+
+Navigator *navigator_new( ImageWindow *win );
+
+#endif /* __NAVIGATOR_H */
@@ -0,0 +1,807 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* The first answer comes from the coarsest level with at least this many
+ * pixels inside the roi's bounding box.
+ */
+#define ROI_COARSE_PIXELS (65536)
+
+/* Skip this many levels at a time as we refine, so each answer has 16
+ * times as many pixels as the one before.
+ */
+#define ROI_LEVEL_STEP (2)
+
+#define ROI_MAX_LEVELS (32)
+
+/* Scan levels in strips this high, checking for cancel between strips.
+ */
+#define ROI_STRIP_HEIGHT (64)
+
+/* Report progress on a full resolution scan this often, in seconds.
+ */
+#define ROI_PROGRESS_INTERVAL (0.25)
+
+/* Size of the histogram we draw next to the outline, in pixels.
+ */
+#define ROI_HISTOGRAM_WIDTH (100)
+#define ROI_HISTOGRAM_HEIGHT (40)
+
+G_DEFINE_TYPE( Roi, roi, G_TYPE_OBJECT );
+
+enum {
+	SIG_CHANGED,
+
+	SIG_LAST
+};
+
+static guint roi_signals[SIG_LAST] = { 0 };
+
+static void
+roi_stats_free( RoiStats *stats )
+{
+	VIPS_FREE( stats->mean );
+	VIPS_FREEF( histogram_free, stats->histogram );
+	g_free( stats );
+}
+
+static void
+roi_dispose( GObject *object )
+{
+	Roi *roi = (Roi *) object;
+
+#ifdef DEBUG
+	printf( "roi_dispose: %p\n", object );
+#endif /*DEBUG*/
+
+	VIPS_FREE( roi->points );
+	VIPS_FREEF( roi_stats_free, roi->stats );
+
+	G_OBJECT_CLASS( roi_parent_class )->dispose( object );
+}
+
+static void
+roi_init( Roi *roi )
+{
+}
+
+static void
+roi_class_init( RoiClass *class )
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS( class );
+
+	gobject_class->dispose = roi_dispose;
+
+	roi_signals[SIG_CHANGED] = g_signal_new( "changed",
+		G_TYPE_FROM_CLASS( class ),
+		G_SIGNAL_RUN_LAST,
+		G_STRUCT_OFFSET( RoiClass, changed ),
+		NULL, NULL,
+		g_cclosure_marshal_VOID__VOID,
+		G_TYPE_NONE, 0 );
+}
+
+Roi *
+roi_new_polygon( double *points, int n_points )
+{
+	Roi *roi = g_object_new( TYPE_ROI, NULL );
+
+	double left;
+	double top;
+	double right;
+	double bottom;
+	int i;
+
+	roi->points = g_new( double, 2 * n_points );
+	memcpy( roi->points, points, 2 * n_points * sizeof( double ) );
+	roi->n_points = n_points;
+
+	left = G_MAXDOUBLE;
+	top = G_MAXDOUBLE;
+	right = -G_MAXDOUBLE;
+	bottom = -G_MAXDOUBLE;
+	for( i = 0; i < n_points; i++ ) {
+		left = VIPS_MIN( left, points[2 * i] );
+		top = VIPS_MIN( top, points[2 * i + 1] );
+		right = VIPS_MAX( right, points[2 * i] );
+		bottom = VIPS_MAX( bottom, points[2 * i + 1] );
+	}
+
+	if( n_points > 0 ) {
+		roi->bounds.left = VIPS_FLOOR( left );
+		roi->bounds.top = VIPS_FLOOR( top );
+		roi->bounds.width = VIPS_CEIL( right ) - roi->bounds.left;
+		roi->bounds.height = VIPS_CEIL( bottom ) - roi->bounds.top;
+	}
+
+	return( roi );
+}
+
+Roi *
+roi_new_rect( VipsRect *rect )
+{
+	double points[8] = {
+		rect->left, rect->top,
+		VIPS_RECT_RIGHT( rect ), rect->top,
+		VIPS_RECT_RIGHT( rect ), VIPS_RECT_BOTTOM( rect ),
+		rect->left, VIPS_RECT_BOTTOM( rect )
+	};
+
+	return( roi_new_polygon( points, 4 ) );
+}
+
+/* A background job computing stats for an roi.
+ */
+typedef struct _RoiJob {
+	Roi *roi;
+	int serial;
+
+	/* Opens the levels in the background, so big images don't stall the
+	 * main thread.
+	 */
+	TileSourceLevels *source;
+
+	/* The levels to count, coarsest first, and their z.
+	 */
+	VipsImage *levels[ROI_MAX_LEVELS];
+	int z[ROI_MAX_LEVELS];
+	int n_levels;
+
+	/* Edge crossings for a row.
+	 */
+	int *xs;
+
+	GTimer *timer;
+	double last_progress_time;
+} RoiJob;
+
+static void
+roi_job_free( RoiJob *job )
+{
+	int i;
+
+	for( i = 0; i < job->n_levels; i++ )
+		VIPS_UNREF( job->levels[i] );
+	VIPS_FREEF( tile_source_levels_free, job->source );
+	VIPS_UNREF( job->roi );
+	VIPS_FREE( job->xs );
+	VIPS_FREEF( g_timer_destroy, job->timer );
+	g_free( job );
+}
+
+/* Sent from the job back to the main thread.
+ */
+typedef struct _RoiUpdate {
+	Roi *roi;
+	int serial;
+
+	/* New stats, or NULL for just progress.
+	 */
+	RoiStats *stats;
+	double progress;
+
+	/* On the last update, the job to free.
+	 */
+	RoiJob *job;
+} RoiUpdate;
+
+static gboolean
+roi_update_idle( void *user_data )
+{
+	RoiUpdate *update = (RoiUpdate *) user_data;
+	Roi *roi = update->roi;
+
+	/* Ignore updates from jobs which have been cancelled.
+	 */
+	if( update->serial == roi->serial ) {
+		if( update->stats ) {
+			VIPS_FREEF( roi_stats_free, roi->stats );
+			roi->stats = update->stats;
+			update->stats = NULL;
+		}
+		roi->progress = update->progress;
+		if( update->job )
+			roi->computing = FALSE;
+
+		g_signal_emit( roi, roi_signals[SIG_CHANGED], 0 );
+	}
+
+	VIPS_FREEF( roi_stats_free, update->stats );
+	VIPS_FREEF( roi_job_free, update->job );
+	VIPS_UNREF( update->roi );
+	g_free( update );
+
+	return( FALSE );
+}
+
+static void
+roi_job_post( RoiJob *job, RoiStats *stats, double progress, gboolean last )
+{
+	RoiUpdate *update = g_new0( RoiUpdate, 1 );
+
+	update->roi = job->roi;
+	g_object_ref( update->roi );
+	update->serial = job->serial;
+	update->stats = stats;
+	update->progress = progress;
+	if( last )
+		update->job = job;
+
+	g_idle_add( roi_update_idle, update );
+}
+
+static gboolean
+roi_job_cancelled( RoiJob *job )
+{
+	return( g_atomic_int_get( &job->roi->serial ) != job->serial );
+}
+
+static int
+roi_compare_int( const void *a, const void *b )
+{
+	return( *((int *) a) - *((int *) b) );
+}
+
+/* The parts of row y at level z inside the outline, as pairs of start and
+ * end (exclusive) x. We test pixel centres with the even-odd rule.
+ */
+static int
+roi_spans( Roi *roi, int z, int y, int *xs )
+{
+	double scale = 1 << z;
+	double yc = (y + 0.5) * scale;
+
+	int i;
+	int n;
+
+	n = 0;
+	for( i = 0; i < roi->n_points; i++ ) {
+		double *p0 = roi->points + 2 * i;
+		double *p1 = roi->points + 2 * ((i + 1) % roi->n_points);
+
+		if( (p0[1] <= yc && p1[1] > yc) ||
+			(p1[1] <= yc && p0[1] > yc) ) {
+			double xc = p0[0] +
+				(yc - p0[1]) * (p1[0] - p0[0]) / (p1[1] - p0[1]);
+
+			xs[n++] = ceil( xc / scale - 0.5 );
+		}
+	}
+
+	qsort( xs, n, sizeof( int ), roi_compare_int );
+
+	return( n );
+}
+
+/* Running totals for a level.
+ */
+typedef struct _RoiSums {
+	int bands;
+	int n_colour;
+	guint64 n;
+	double *sum;
+	double *sum2;
+	double *min;
+	double *max;
+
+	/* Optional.
+	 */
+	Histogram *histogram;
+} RoiSums;
+
+#define ROI_ACCUMULATE( TYPE ) { \
+	TYPE *p = (TYPE *) VIPS_REGION_ADDR( region, left, y ); \
+	\
+	for( x = left; x < right; x++ ) { \
+		for( b = 0; b < sums->bands; b++ ) { \
+			double v = p[b]; \
+			\
+			sums->sum[b] += v; \
+			sums->sum2[b] += v * v; \
+			sums->min[b] = VIPS_MIN( sums->min[b], v ); \
+			sums->max[b] = VIPS_MAX( sums->max[b], v ); \
+		} \
+		\
+		if( histogram ) \
+			for( b = 0; b < sums->n_colour; b++ ) { \
+				double i = (p[b] - histogram->min) / \
+					histogram->bin_width; \
+				\
+				if( isfinite( i ) ) \
+					histogram->bins[VIPS_CLIP( 0, \
+						(int) i, \
+						histogram->n_bins - 1 )] += 1; \
+			} \
+		\
+		p += sums->bands; \
+	} \
+	\
+	sums->n += right - left; \
+}
+
+/* Add one span of a prepared region.
+ */
+static void
+roi_sums_add( RoiSums *sums, VipsRegion *region, int left, int right, int y )
+{
+	Histogram *histogram = sums->histogram;
+
+	int x, b;
+
+	switch( region->im->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		ROI_ACCUMULATE( unsigned char );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		ROI_ACCUMULATE( signed char );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		ROI_ACCUMULATE( unsigned short );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		ROI_ACCUMULATE( signed short );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		ROI_ACCUMULATE( unsigned int );
+		break;
+
+	case VIPS_FORMAT_INT:
+		ROI_ACCUMULATE( signed int );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		ROI_ACCUMULATE( float );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		ROI_ACCUMULATE( double );
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Scan the roi on level i. -1 for error or cancel.
+ */
+static int
+roi_job_scan( RoiJob *job, int i, RoiSums *sums, gboolean final )
+{
+	Roi *roi = job->roi;
+	VipsImage *image = job->levels[i];
+	int z = job->z[i];
+
+	VipsRect image_rect;
+	VipsRect bounds;
+	VipsRegion *region;
+	int top;
+
+	image_rect.left = 0;
+	image_rect.top = 0;
+	image_rect.width = image->Xsize;
+	image_rect.height = image->Ysize;
+	bounds.left = roi->bounds.left >> z;
+	bounds.top = roi->bounds.top >> z;
+	bounds.width = (VIPS_RECT_RIGHT( &roi->bounds ) >> z) + 1 - bounds.left;
+	bounds.height = (VIPS_RECT_BOTTOM( &roi->bounds ) >> z) + 1 -
+		bounds.top;
+	vips_rect_intersectrect( &bounds, &image_rect, &bounds );
+
+	region = vips_region_new( image );
+	for( top = bounds.top;
+		top < VIPS_RECT_BOTTOM( &bounds );
+		top += ROI_STRIP_HEIGHT ) {
+		VipsRect strip;
+		int y;
+
+		if( roi_job_cancelled( job ) ) {
+			VIPS_UNREF( region );
+			return( -1 );
+		}
+
+		strip.left = bounds.left;
+		strip.top = top;
+		strip.width = bounds.width;
+		strip.height = VIPS_MIN( ROI_STRIP_HEIGHT,
+			VIPS_RECT_BOTTOM( &bounds ) - top );
+		if( vips_region_prepare( region, &strip ) ) {
+			VIPS_UNREF( region );
+			return( -1 );
+		}
+
+		for( y = strip.top; y < VIPS_RECT_BOTTOM( &strip ); y++ ) {
+			int n = roi_spans( roi, z, y, job->xs );
+			int j;
+
+			for( j = 0; j + 1 < n; j += 2 ) {
+				int left = VIPS_MAX( job->xs[j], strip.left );
+				int right = VIPS_MIN( job->xs[j + 1],
+					VIPS_RECT_RIGHT( &strip ) );
+
+				if( right > left )
+					roi_sums_add( sums, region,
+						left, right, y );
+			}
+		}
+
+		/* Full resolution can take a while, so report progress.
+		 */
+		if( final &&
+			g_timer_elapsed( job->timer, NULL ) -
+				job->last_progress_time >
+				ROI_PROGRESS_INTERVAL ) {
+			job->last_progress_time =
+				g_timer_elapsed( job->timer, NULL );
+			roi_job_post( job, NULL,
+				(double) (VIPS_RECT_BOTTOM( &strip ) -
+					bounds.top) / bounds.height,
+				FALSE );
+		}
+	}
+	VIPS_UNREF( region );
+
+	return( 0 );
+}
+
+static void
+roi_sums_init( RoiSums *sums, VipsImage *image, double *values )
+{
+	int b;
+
+	sums->bands = image->Bands;
+	sums->n_colour = vips_image_hasalpha( image ) ?
+		image->Bands - 1 : image->Bands;
+	sums->n = 0;
+	sums->sum = values;
+	sums->sum2 = values + image->Bands;
+	sums->min = values + 2 * image->Bands;
+	sums->max = values + 3 * image->Bands;
+	sums->histogram = NULL;
+
+	for( b = 0; b < image->Bands; b++ ) {
+		sums->sum[b] = 0.0;
+		sums->sum2[b] = 0.0;
+		sums->min[b] = G_MAXDOUBLE;
+		sums->max[b] = -G_MAXDOUBLE;
+	}
+}
+
+/* Compute stats for level i. range is the range of colour values, if we
+ * know it, and is updated for the next level.
+ */
+static RoiStats *
+roi_job_level( RoiJob *job, int i, double range[2] )
+{
+	VipsImage *image = job->levels[i];
+	gboolean final = i == job->n_levels - 1;
+
+	RoiSums sums;
+	RoiStats *stats;
+	int b;
+
+	stats = g_new0( RoiStats, 1 );
+	stats->z = job->z[i];
+	stats->bands = image->Bands;
+	stats->mean = g_new( double, 4 * image->Bands );
+	stats->sd = stats->mean + image->Bands;
+	stats->min = stats->mean + 2 * image->Bands;
+	stats->max = stats->mean + 3 * image->Bands;
+	stats->complete = final;
+
+	roi_sums_init( &sums, image, stats->mean );
+
+	/* We need a range for int and float histograms. Values from later
+	 * levels which fall outside it go in the end bins.
+	 */
+	if( range[1] < range[0] &&
+		image->BandFmt != VIPS_FORMAT_UCHAR &&
+		image->BandFmt != VIPS_FORMAT_CHAR &&
+		image->BandFmt != VIPS_FORMAT_USHORT &&
+		image->BandFmt != VIPS_FORMAT_SHORT ) {
+		if( roi_job_scan( job, i, &sums, FALSE ) ) {
+			roi_stats_free( stats );
+			return( NULL );
+		}
+
+		for( b = 0; b < sums.n_colour; b++ ) {
+			range[0] = VIPS_MIN( range[0], sums.min[b] );
+			range[1] = VIPS_MAX( range[1], sums.max[b] );
+		}
+		roi_sums_init( &sums, image, stats->mean );
+	}
+
+	if( !(stats->histogram =
+		histogram_new_empty( image, range[0], range[1] )) ) {
+		roi_stats_free( stats );
+		return( NULL );
+	}
+	sums.histogram = stats->histogram;
+
+	if( roi_job_scan( job, i, &sums, final ) ) {
+		roi_stats_free( stats );
+		return( NULL );
+	}
+	histogram_update( stats->histogram );
+
+	stats->n_pixels = sums.n;
+	stats->n_pixels_full = ldexp( sums.n, 2 * stats->z );
+
+	/* sums was using our arrays, so turn them into mean and sd in place.
+	 */
+	for( b = 0; b < image->Bands; b++ )
+		if( sums.n > 0 ) {
+			double mean = sums.sum[b] / sums.n;
+			double var = sums.sum2[b] / sums.n - mean * mean;
+
+			stats->mean[b] = mean;
+			stats->sd[b] = sqrt( VIPS_MAX( 0.0, var ) );
+		}
+		else {
+			stats->mean[b] = 0.0;
+			stats->sd[b] = 0.0;
+			stats->min[b] = 0.0;
+			stats->max[b] = 0.0;
+		}
+
+	if( range[1] < range[0] )
+		for( b = 0; b < sums.n_colour; b++ ) {
+			range[0] = VIPS_MIN( range[0], stats->min[b] );
+			range[1] = VIPS_MAX( range[1], stats->max[b] );
+		}
+
+#ifdef DEBUG
+	printf( "roi_job_level: z = %d, %" G_GUINT64_FORMAT " pixels\n",
+		stats->z, stats->n_pixels );
+#endif /*DEBUG*/
+
+	return( stats );
+}
+
+/* Open the levels we will count. Skip any we can't use, but we must have 
+ * full resolution. FALSE if there's nothing to count.
+ */
+static gboolean
+roi_job_open( RoiJob *job )
+{
+	int i;
+	int n;
+
+	n = 0;
+	for( i = 0; i < job->n_levels; i++ ) {
+		VipsImage *level;
+
+		if( !(level = tile_source_levels_get( job->source, 
+			job->z[i] )) ||
+			vips_band_format_iscomplex( level->BandFmt ) ) {
+			VIPS_UNREF( level );
+			vips_error_clear();
+			continue;
+		}
+
+		job->levels[n] = level;
+		job->z[n] = job->z[i];
+		n += 1;
+	}
+	job->n_levels = n;
+
+	return( n > 0 && 
+		job->z[n - 1] == 0 );
+}
+
+/* Runs in a background thread.
+ */
+static void
+roi_job_run( void *a, void *b )
+{
+	RoiJob *job = (RoiJob *) a;
+	double range[2] = { G_MAXDOUBLE, -G_MAXDOUBLE };
+
+	int i;
+
+	if( !roi_job_open( job ) ) {
+		roi_job_post( job, NULL, 1.0, TRUE );
+		return;
+	}
+
+	for( i = 0; i < job->n_levels; i++ ) {
+		RoiStats *stats;
+
+		if( !(stats = roi_job_level( job, i, range )) )
+			break;
+
+		roi_job_post( job, stats,
+			i == job->n_levels - 1 ? 1.0 : 0.0, FALSE );
+	}
+
+	if( i < job->n_levels )
+		vips_error_clear();
+
+	/* The final post frees the job back in the main thread.
+	 */
+	roi_job_post( job, NULL, 1.0, TRUE );
+}
+
+void
+roi_cancel( Roi *roi )
+{
+	g_atomic_int_inc( &roi->serial );
+	roi->computing = FALSE;
+}
+
+void
+roi_start( Roi *roi, TileSource *tile_source )
+{
+	TileSourceLevels *source;
+	RoiJob *job;
+	int z0;
+	int z;
+
+	roi_cancel( roi );
+
+	if( !(source = tile_source_levels_new( tile_source )) ) {
+		vips_error_clear();
+		return;
+	}
+
+	job = g_new0( RoiJob, 1 );
+	job->roi = roi;
+	g_object_ref( roi );
+	job->serial = roi->serial;
+	job->source = source;
+	job->xs = g_new( int, roi->n_points + 1 );
+	job->timer = g_timer_new();
+
+	/* The coarsest level with enough pixels for a useful first answer.
+	 */
+	z0 = 0;
+	while( z0 < 30 &&
+		(tile_source->display_width >> (z0 + 1)) > 0 &&
+		(tile_source->display_height >> (z0 + 1)) > 0 &&
+		(double) (roi->bounds.width >> (z0 + 1)) *
+			(roi->bounds.height >> (z0 + 1)) >=
+			ROI_COARSE_PIXELS )
+		z0 += 1;
+
+	for( z = z0; z >= 0; z -= ROI_LEVEL_STEP ) {
+		/* Always finish on full resolution.
+		 */
+		if( z < ROI_LEVEL_STEP )
+			z = 0;
+
+		job->z[job->n_levels] = z;
+		job->n_levels += 1;
+	}
+
+	/* The levels are opened by the job.
+	 */
+	roi->progress = 0.0;
+	roi->computing = TRUE;
+	if( vips_thread_execute( "roi", roi_job_run, job ) ) {
+		roi->computing = FALSE;
+		roi_job_free( job );
+	}
+}
+
+void
+roi_describe( Roi *roi, VipsBuf *buf )
+{
+	RoiStats *stats = roi->stats;
+
+	int b;
+
+	if( !stats ) {
+		vips_buf_appendf( buf, "%s",
+			roi->computing ? _( "ROI: computing" ) : _( "ROI" ) );
+		return;
+	}
+
+	vips_buf_appendf( buf, "ROI %s%.0f px, mean",
+		stats->complete ? "" : "~", stats->n_pixels_full );
+	for( b = 0; b < stats->bands; b++ )
+		vips_buf_appendf( buf, "%s%.4g", b ? "/" : " ",
+			stats->mean[b] );
+	vips_buf_appendf( buf, ", sd" );
+	for( b = 0; b < stats->bands; b++ )
+		vips_buf_appendf( buf, "%s%.4g", b ? "/" : " ",
+			stats->sd[b] );
+	vips_buf_appendf( buf, ", min" );
+	for( b = 0; b < stats->bands; b++ )
+		vips_buf_appendf( buf, "%s%.4g", b ? "/" : " ",
+			stats->min[b] );
+	vips_buf_appendf( buf, ", max" );
+	for( b = 0; b < stats->bands; b++ )
+		vips_buf_appendf( buf, "%s%.4g", b ? "/" : " ",
+			stats->max[b] );
+
+	if( roi->computing )
+		vips_buf_appendf( buf, " (level %d, refining %.0f%%)",
+			stats->z, 100.0 * roi->progress );
+}
+
+static void
+roi_draw_histogram( Histogram *histogram, cairo_t *cr, double x, double y )
+{
+	int i;
+
+	cairo_set_source_rgba( cr, 0, 0, 0, 0.6 );
+	cairo_rectangle( cr, x, y, ROI_HISTOGRAM_WIDTH, ROI_HISTOGRAM_HEIGHT );
+	cairo_fill( cr );
+
+	if( histogram->peak == 0 )
+		return;
+
+	/* Each column shows the largest bin it covers.
+	 */
+	cairo_set_source_rgba( cr, 1, 1, 1, 0.9 );
+	for( i = 0; i < ROI_HISTOGRAM_WIDTH; i++ ) {
+		int first = (guint64) i * histogram->n_bins /
+			ROI_HISTOGRAM_WIDTH;
+		int last = (guint64) (i + 1) * histogram->n_bins /
+			ROI_HISTOGRAM_WIDTH;
+
+		guint64 count;
+		double height;
+		int j;
+
+		count = 0;
+		for( j = first; j < VIPS_MAX( last, first + 1 ); j++ )
+			count = VIPS_MAX( count, histogram->bins[j] );
+		height = (double) ROI_HISTOGRAM_HEIGHT *
+			count / histogram->peak;
+
+		cairo_rectangle( cr,
+			x + i, y + ROI_HISTOGRAM_HEIGHT - height, 1, height );
+	}
+	cairo_fill( cr );
+}
+
+void
+roi_draw( Roi *roi, cairo_t *cr,
+	Imagedisplay *imagedisplay, gboolean selected )
+{
+	double right;
+	double bottom;
+	int i;
+
+	if( roi->n_points < 2 )
+		return;
+
+	cairo_new_path( cr );
+	for( i = 0; i < roi->n_points; i++ ) {
+		double x;
+		double y;
+
+		imagedisplay_image_to_gtk( imagedisplay,
+			roi->points[2 * i], roi->points[2 * i + 1], &x, &y );
+		cairo_line_to( cr, x, y );
+	}
+	cairo_close_path( cr );
+
+	/* A dark line under a light one, so it shows on any image.
+	 */
+	cairo_set_line_width( cr, 3 );
+	cairo_set_source_rgba( cr, 0, 0, 0, 0.7 );
+	cairo_stroke_preserve( cr );
+	cairo_set_line_width( cr, 1.5 );
+	if( selected )
+		cairo_set_source_rgb( cr, 1, 0.9, 0.2 );
+	else
+		cairo_set_source_rgb( cr, 0.3, 0.8, 1 );
+	cairo_stroke( cr );
+
+	if( roi->stats &&
+		roi->stats->histogram ) {
+		imagedisplay_image_to_gtk( imagedisplay,
+			VIPS_RECT_RIGHT( &roi->bounds ),
+			VIPS_RECT_BOTTOM( &roi->bounds ),
+			&right, &bottom );
+		roi_draw_histogram( roi->stats->histogram, cr,
+			right + 4, bottom - ROI_HISTOGRAM_HEIGHT );
+	}
+}
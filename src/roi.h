@@ -0,0 +1,115 @@
+/* A region of interest on an image, plus statistics for the pixels inside
+ * it, computed progressively in the background.
+ */
+
+#ifndef __ROI_H
+#define __ROI_H
+
+#define TYPE_ROI (roi_get_type())
+#define ROI( obj ) \
+	(G_TYPE_CHECK_INSTANCE_CAST( (obj), TYPE_ROI, Roi ))
+#define ROI_CLASS( klass ) \
+	(G_TYPE_CHECK_CLASS_CAST( (klass), TYPE_ROI, RoiClass))
+#define IS_ROI( obj ) \
+	(G_TYPE_CHECK_INSTANCE_TYPE( (obj), TYPE_ROI ))
+#define IS_ROI_CLASS( klass ) \
+	(G_TYPE_CHECK_CLASS_TYPE( (klass), TYPE_ROI ))
+#define ROI_GET_CLASS( obj ) \
+	(G_TYPE_INSTANCE_GET_CLASS( (obj), TYPE_ROI, RoiClass ))
+
+/* Statistics for the pixels inside an roi, in source units.
+ */
+typedef struct _RoiStats {
+	/* The pyramid level we counted, 0 for full resolution. Each level
+	 * halves the size, so each pixel stands for 4 ** z at level 0.
+	 */
+	int z;
+
+	/* Pixels inside the roi at level z, and the estimated number at
+	 * full resolution.
+	 */
+	guint64 n_pixels;
+	double n_pixels_full;
+
+	/* Per band.
+	 */
+	int bands;
+	double *mean;
+	double *sd;
+	double *min;
+	double *max;
+
+	/* All colour values.
+	 */
+	Histogram *histogram;
+
+	/* TRUE for the full resolution result.
+	 */
+	gboolean complete;
+} RoiStats;
+
+typedef struct _Roi {
+	GObject parent_instance;
+
+	/* The outline, as n_points x, y pairs in level 0 coordinates. A
+	 * rectangle is just a polygon with four points.
+	 */
+	double *points;
+	int n_points;
+
+	/* The bounding box, in level 0 coordinates.
+	 */
+	VipsRect bounds;
+
+	/* The best stats we have so far, or NULL.
+	 */
+	RoiStats *stats;
+
+	/* How far the current background job has got with full resolution,
+	 * 0 - 1.
+	 */
+	double progress;
+
+	/* Changes each time we start or cancel a job, so old jobs can spot
+	 * that they are no longer wanted.
+	 */
+	int serial;
+
+	/* TRUE while a job is running.
+	 */
+	gboolean computing;
+
+} Roi;
+
+typedef struct _RoiClass {
+	GObjectClass parent_class;
+
+	/* New stats, or progress.
+	 */
+	void (*changed)( Roi *roi );
+
+} RoiClass;
+
+GType roi_get_type( void );
+
+Roi *roi_new_rect( VipsRect *rect );
+Roi *roi_new_polygon( double *points, int n_points );
+
+/* Start computing stats in the background, cancelling any previous job.
+ * Coarse results arrive in a fraction of a second and are refined until we
+ * have an exact answer from full resolution. Watch for "changed".
+ */
+void roi_start( Roi *roi, TileSource *tile_source );
+void roi_cancel( Roi *roi );
+
+/* A line of text for the info bar.
+ */
+void roi_describe( Roi *roi, VipsBuf *buf );
+
+/* Draw the outline, and a small histogram of the values once we have one,
+ * in imagedisplay widget coordinates.
+ */
+void roi_draw( Roi *roi, cairo_t *cr,
+	Imagedisplay *imagedisplay, gboolean selected );
+
+#endif /*__ROI_H*/
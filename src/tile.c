@@ -22,8 +22,10 @@ tile_dispose( GObject *object )
 
 	VIPS_UNREF( tile->texture );
 	VIPS_UNREF( tile->pixbuf );
+	VIPS_UNREF( tile->overlay );
 	VIPS_FREE( tile->data_copy );
 	VIPS_UNREF( tile->region );
+	VIPS_UNREF( tile->source );
 
 	G_OBJECT_CLASS( tile_parent_class )->dispose( object );
 }
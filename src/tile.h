@@ -42,6 +42,21 @@ typedef struct _Tile {
 	 */
 	gboolean valid;
 
+	/* TRUE while we wait for the disc cache to look for this tile. Don't
+	 * fetch from libvips or touch the region until it's done.
+	 */
+	gboolean reading;
+
+	/* The display values (before scale, falsecolour, etc.) for this tile,
+	 * if the tile cache had room to keep them. A memory image.
+	 */
+	VipsImage *source;
+
+	/* TRUE if we've put off remapping source for the current display 
+	 * settings during a drag. We draw a coarser tile instead, if we can.
+	 */
+	gboolean stale;
+
 	/* Pixels going out to the scene graph. 
 	 *
 	 * pixbuf and texture won't make a copy of the data, so we must make a 
@@ -52,6 +67,13 @@ typedef struct _Tile {
 	GdkPixbuf *pixbuf;
 	GdkTexture *texture;
 
+	/* Annotations drawn over the tile, and the serial of the layer they
+	 * came from. overlay_pending is set while a render is queued.
+	 */
+	GdkTexture *overlay;
+	int overlay_serial;
+	gboolean overlay_pending;
+
 } Tile;
 
 typedef struct _TileClass {
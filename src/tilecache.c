@@ -22,6 +22,13 @@ enum {
 
 static guint tile_cache_signals[SIG_LAST] = { 0 };
 
+/* Keep at most this many bytes of tile display values for remapping, 
+ * counted over all windows. Tile caches are only used from the main thread.
+ */
+#define MAX_SOURCE_BYTES (256 * 1024 * 1024)
+
+static size_t tile_cache_total_source_bytes = 0;
+
 G_DEFINE_TYPE( TileCache, tile_cache, G_TYPE_OBJECT );
 
 static void
@@ -51,6 +58,9 @@ tile_cache_free_pyramid( TileCache *tile_cache )
 	VIPS_FREE( tile_cache->free );
 
 	tile_cache->n_levels = 0;
+	tile_cache_total_source_bytes -= tile_cache->source_bytes;
+	tile_cache->source_bytes = 0;
+	tile_cache->overview_serial += 1;
 }
 
 static void
@@ -66,6 +76,9 @@ tile_cache_dispose( GObject *object )
 
 	VIPS_UNREF( tile_cache->tile_source );
 	VIPS_UNREF( tile_cache->background_texture );
+	VIPS_FREEF( tile_store_free, tile_cache->tile_store );
+	VIPS_FREE( tile_cache->view_key );
+	VIPS_UNREF( tile_cache->annotations );
 
 	G_OBJECT_CLASS( tile_cache_parent_class )->dispose( object );
 }
@@ -91,6 +104,69 @@ tile_cache_area_changed( TileCache *tile_cache, VipsRect *dirty, int z )
 		tile_cache_signals[SIG_AREA_CHANGED], 0, dirty, z );
 }
 
+static void
+tile_cache_drop_source( TileCache *tile_cache, Tile *tile )
+{
+	if( tile->source ) {
+		size_t bytes = VIPS_IMAGE_SIZEOF_IMAGE( tile->source );
+
+		tile_cache->source_bytes -= bytes;
+		tile_cache_total_source_bytes -= bytes;
+		VIPS_UNREF( tile->source );
+	}
+}
+
+/* A tile has come back from the tile store with its display values. Keep 
+ * them if we have room.
+ */
+static void
+tile_cache_adopt_source( TileCache *tile_cache, Tile *tile )
+{
+	size_t bytes;
+
+	if( !tile->source )
+		return;
+
+	bytes = VIPS_IMAGE_SIZEOF_IMAGE( tile->source );
+	if( !tile_cache->tile_source->remap ||
+		tile_cache_total_source_bytes + bytes > MAX_SOURCE_BYTES ) 
+		VIPS_UNREF( tile->source );
+	else {
+		tile_cache->source_bytes += bytes;
+		tile_cache_total_source_bytes += bytes;
+	}
+}
+
+/* Keep the display values for a freshly filled tile, if we have room, so a 
+ * change to scale etc. can remap it without going back to the image.
+ */
+static void
+tile_cache_keep_source( TileCache *tile_cache, Tile *tile )
+{
+	VipsImage *source;
+
+	tile_cache_drop_source( tile_cache, tile );
+
+	/* New pixels, so they must be for the current settings.
+	 */
+	tile->stale = FALSE;
+
+	if( tile_cache->tile_source->remap &&
+		(source = tile_source_capture_tile( tile_cache->tile_source, 
+		tile )) ) {
+		size_t bytes = VIPS_IMAGE_SIZEOF_IMAGE( source );
+
+		if( tile_cache_total_source_bytes + bytes > 
+			MAX_SOURCE_BYTES ) 
+			VIPS_UNREF( source );
+		else {
+			tile->source = source;
+			tile_cache->source_bytes += bytes;
+			tile_cache_total_source_bytes += bytes;
+		}
+	}
+}
+
 static void
 tile_cache_checkerboard_destroy_notify( guchar* pixels, gpointer data )
 {
@@ -151,6 +227,8 @@ tile_cache_init( TileCache *tile_cache )
 	tile_cache->background = TILE_CACHE_BACKGROUND_CHECKERBOARD;
 	tile_cache->background_texture = 
 		tile_cache_texture( tile_cache->background );
+	tile_cache->tile_store = tile_store_new( MAX_STORE_BYTES );
+	tile_cache->overview_fetched = -1;
 }
 
 static void
@@ -339,8 +417,10 @@ tile_cache_tiles_for_rect( TileCache *tile_cache, VipsRect *rect, int z,
 static void
 tile_cache_fill_hole( TileCache *tile_cache, VipsRect *bounds, int z )
 {
+	Tile *stale;
 	int i;
 
+	stale = NULL;
 	for( i = z; i < tile_cache->n_levels; i++ ) {
 		GSList *p;
 
@@ -360,12 +440,32 @@ tile_cache_fill_hole( TileCache *tile_cache, VipsRect *bounds, int z )
 				continue;
 
 			if( vips_rect_overlapsrect( &tile->bounds, bounds ) ) {
+				/* Prefer a coarser tile with the current
+				 * display settings. Touch stale tiles anyway, 
+				 * so they keep their display values for
+				 * tile_cache_remap().
+				 */
+				if( tile->stale ) {
+					tile_touch( tile );
+					if( !stale )
+						stale = tile;
+					continue;
+				}
+
 				tile_touch( tile );
 				*visible = g_slist_prepend( *visible, tile );
 				return;
 			}
 		}
 	}
+
+	/* Nothing coarser, so show the old pixels.
+	 */
+	if( stale ) {
+		tile_touch( stale );
+		tile_cache->visible[stale->z] = 
+			g_slist_prepend( tile_cache->visible[stale->z], stale );
+	}
 }
 
 static int
@@ -400,6 +500,13 @@ tile_cache_free_oldest( TileCache *tile_cache, int z )
 				g_slist_remove( tile_cache->visible[z], tile );
 			tile_cache->free[z] = 
 				g_slist_remove( tile_cache->free[z], tile );
+
+			/* Keep a compressed copy, in case we come back 
+			 * here.
+			 */
+			tile_store_put( tile_cache->tile_store, tile );
+
+			tile_cache_drop_source( tile_cache, tile );
 			VIPS_UNREF( tile );
 		}
 	}
@@ -491,10 +598,15 @@ tile_cache_compute_visibility( TileCache *tile_cache,
 		for( p = tile_cache->tiles[i]; p; p = p->next ) {
 			Tile *tile = TILE( p->data );
 
-			if( tile->time < start_time ) 
+			if( tile->time < start_time ) {
 				tile_cache->free[i] = 
 					g_slist_prepend( tile_cache->free[i], 
 						tile );
+
+				/* Only visible tiles keep display values.
+				 */
+				tile_cache_drop_source( tile_cache, tile );
+			}
 		}
 	}
 
@@ -503,7 +615,7 @@ tile_cache_compute_visibility( TileCache *tile_cache,
 	 * Never free tiles in the lowest-res few levels. They are useful for 
 	 * filling in holes and take little memory.
 	 */
-	for( i = 0; i < tile_cache->n_levels - 3; i++ ) 
+	for( i = 0; i < tile_cache->n_levels - TILE_CACHE_KEEP_LEVELS; i++ ) 
 		tile_cache_free_oldest( tile_cache, i );
 
 #ifdef DEBUG_VERBOSE
@@ -527,6 +639,61 @@ tile_cache_find( TileCache *tile_cache, VipsRect *tile_rect, int z )
 	return( NULL );
 }
 
+/* The pixels we make depend on the source settings, so we must update the 
+ * disc cache key after any change.
+ */
+static void
+tile_cache_update_view_key( TileCache *tile_cache )
+{
+	VIPS_FREE( tile_cache->view_key );
+	if( disk_cache_get_enabled() )
+		tile_cache->view_key = 
+			tile_source_get_view_key( tile_cache->tile_source );
+}
+
+static gboolean
+tile_cache_has_tile( TileCache *tile_cache, Tile *tile )
+{
+	return( tile->z < tile_cache->n_levels &&
+		g_slist_find( tile_cache->tiles[tile->z], tile ) );
+}
+
+/* A disc cache read has finished.
+ */
+static void
+tile_cache_read_done( Tile *tile, 
+	const char *view, gboolean found, void *a )
+{
+	TileCache *tile_cache = TILE_CACHE( a );
+
+	tile->reading = FALSE;
+
+	/* The tile might have been dropped, or the pixels changed, while we 
+	 * were waiting.
+	 */
+	if( tile_cache_has_tile( tile_cache, tile ) ) {
+		if( found &&
+			!tile->valid &&
+			g_strcmp0( view, tile_cache->view_key ) == 0 ) {
+			tile->valid = TRUE;
+			tile_cache_area_changed( tile_cache, 
+				&tile->region->valid, tile->z );
+		}
+		else if( !tile->valid ) {
+			tile_source_fill_tile( tile_cache->tile_source, tile );
+			if( tile->valid ) {
+				tile_cache_keep_source( tile_cache, tile );
+				tile_cache_area_changed( tile_cache, 
+					&tile->region->valid, tile->z );
+			}
+		}
+	}
+
+	/* Matches the ref in tile_cache_get().
+	 */
+	g_object_unref( tile_cache );
+}
+
 /* Fetch a single tile. If we have this tile already, refresh if there are new
  * pixels available.
  */
@@ -547,9 +714,31 @@ tile_cache_get( TileCache *tile_cache, VipsRect *tile_rect, int z )
 
 		tile_cache->tiles[z] = 
 			g_slist_prepend( tile_cache->tiles[z], tile );
+
+		/* We might have a copy of the pixels from a previous visit.
+		 *
+		 * Tiles from the disc cache have no display values, so 
+		 * remap refetches them, and the histogram and pixel probe
+		 * fall back to computing from the image.
+		 */
+		if( tile_store_get( tile_cache->tile_store, tile ) ) {
+			tile->valid = TRUE;
+			tile_cache_adopt_source( tile_cache, tile );
+		}
+		else if( tile_cache->view_key &&
+			tile_cache->tile_source->loaded ) {
+			/* Try the disc cache. We carry on in 
+			 * tile_cache_read_done().
+			 */
+			tile->reading = TRUE;
+			g_object_ref( tile_cache );
+			disk_cache_read( tile_cache->view_key, tile, 
+				tile_cache_read_done, tile_cache );
+		}
 	}
 
-	if( !tile->valid ) {
+	if( !tile->valid &&
+		!tile->reading ) {
 		/* The tile might have no pixels, or might need refreshing
 		 * because the bg render has finished with it.
 		 */
@@ -562,7 +751,19 @@ tile_cache_get( TileCache *tile_cache, VipsRect *tile_rect, int z )
 #endif /*DEBUG_VERBOSE*/
 
 		tile_source_fill_tile( tile_cache->tile_source, tile );
+		if( tile->valid )
+			tile_cache_keep_source( tile_cache, tile );
+
+		/* Freshly computed pixels? Save for next time.
+		 */
+		if( tile->valid &&
+			tile_cache->view_key &&
+			tile_cache->tile_source->loaded ) 
+			disk_cache_write( tile_cache->view_key, tile );
 	}
+
+	if( !tile->valid )
+		tile_cache->n_missing += 1;
 }
 
 /* Fetch the tiles in an area.
@@ -662,6 +863,8 @@ tile_cache_source_changed( TileSource *tile_source, TileCache *tile_cache )
 	/* This will junk all tiles.
 	 */
 	tile_cache_build_pyramid( tile_cache );
+	tile_store_clear( tile_cache->tile_store );
+	tile_cache_update_view_key( tile_cache );
 
 	tile_cache_changed( tile_cache );
 }
@@ -688,9 +891,82 @@ tile_cache_source_tiles_changed( TileSource *tile_source,
 			/* We must refetch.
 			 */
 			tile->valid = FALSE;
+			tile->stale = FALSE;
+			tile_cache_drop_source( tile_cache, tile );
 		}
 	}
 
+	/* Stored pixels are now stale too.
+	 */
+	tile_store_clear( tile_cache->tile_store );
+	tile_cache_update_view_key( tile_cache );
+	tile_cache->overview_serial += 1;
+
+	tile_cache_tiles_changed( tile_cache );
+}
+
+/* Remap a tile for the current display settings, or mark it for refetching.
+ */
+static void
+tile_cache_remap( TileCache *tile_cache, Tile *tile )
+{
+	tile->stale = FALSE;
+
+	if( !tile->valid ||
+		!tile_source_remap_tile( tile_cache->tile_source, tile ) ) {
+		tile->valid = FALSE;
+		tile_cache_drop_source( tile_cache, tile );
+	}
+}
+
+/* Scale, falsecolour, etc. have changed. Remap the tiles which kept their
+ * display values, refetch the rest.
+ *
+ * During a drag, only remap tiles coarser than the level we are drawing, 
+ * so the whole view updates quickly. The rest are marked stale and we show
+ * the coarse tiles in their place until the drag ends and we are called 
+ * again to refine.
+ */
+static void
+tile_cache_source_vis_changed( TileSource *tile_source, 
+	TileCache *tile_cache )
+{
+	gboolean changed = tile_cache->vis_serial != tile_source->vis_serial;
+
+	int i;
+
+#ifdef DEBUG
+	printf( "tile_cache_source_vis_changed: changed = %d, "
+		"dragging = %d\n", changed, tile_source->dragging );
+#endif /*DEBUG*/
+
+	for( i = 0; i < tile_cache->n_levels; i++ ) {
+		GSList *p;
+
+		for( p = tile_cache->tiles[i]; p; p = p->next ) {
+			Tile *tile = TILE( p->data );
+
+			if( tile_source->dragging &&
+				tile->z <= tile_cache->z &&
+				tile->valid &&
+				tile->source ) {
+				if( changed )
+					tile->stale = TRUE;
+			}
+			else if( changed || 
+				tile->stale )
+				tile_cache_remap( tile_cache, tile );
+		}
+	}
+
+	tile_cache->vis_serial = tile_source->vis_serial;
+
+	if( changed ) {
+		tile_store_clear( tile_cache->tile_store );
+		tile_cache_update_view_key( tile_cache );
+		tile_cache->overview_serial += 1;
+	}
+
 	tile_cache_tiles_changed( tile_cache );
 }
 
@@ -727,6 +1003,8 @@ tile_cache_new( TileSource *tile_source )
 		G_CALLBACK( tile_cache_source_changed ), tile_cache, 0 );
 	g_signal_connect_object( tile_source, "tiles-changed",
 		G_CALLBACK( tile_cache_source_tiles_changed ), tile_cache, 0 );
+	g_signal_connect_object( tile_source, "vis-changed",
+		G_CALLBACK( tile_cache_source_vis_changed ), tile_cache, 0 );
 	g_signal_connect_object( tile_source, "area-changed",
 		G_CALLBACK( tile_cache_source_area_changed ), tile_cache, 0 );
 
@@ -737,6 +1015,30 @@ tile_cache_new( TileSource *tile_source )
 	return( tile_cache ); 
 }
 
+/* Draw annotations over the image, or NULL to remove them.
+ */
+void
+tile_cache_set_annotations( TileCache *tile_cache, Annotations *annotations )
+{
+	int i;
+
+	if( annotations )
+		g_object_ref( annotations );
+	VIPS_UNREF( tile_cache->annotations );
+	tile_cache->annotations = annotations;
+
+	/* Overlays for the old layer are useless now.
+	 */
+	for( i = 0; i < tile_cache->n_levels; i++ ) {
+		GSList *p;
+
+		for( p = tile_cache->tiles[i]; p; p = p->next ) 
+			VIPS_UNREF( TILE( p->data )->overlay );
+	}
+
+	tile_cache_tiles_changed( tile_cache );
+}
+
 static void
 tile_cache_draw_bounds( GtkSnapshot *snapshot, 
 	Tile *tile, graphene_rect_t *bounds )
@@ -789,6 +1091,368 @@ tile_cache_draw_bounds( GtkSnapshot *snapshot,
 	}
 }
 
+/* A histogram of the display values for the tiles we drew last time, so we
+ * never compute any new pixels. Tiles which didn't keep their display values
+ * are skipped, since fetching them now would just queue renders and give us
+ * zeros.
+ */
+Histogram *
+tile_cache_histogram( TileCache *tile_cache )
+{
+	VipsImage **images;
+	int n_images;
+	int n_visible;
+	Histogram *histogram;
+	int i;
+
+	n_visible = 0;
+	for( i = 0; i < tile_cache->n_levels; i++ )
+		n_visible += g_slist_length( tile_cache->visible[i] );
+
+	images = VIPS_ARRAY( NULL, n_visible + 1, VipsImage * );
+	n_images = 0;
+	for( i = 0; i < tile_cache->n_levels; i++ ) {
+		GSList *p;
+
+		for( p = tile_cache->visible[i]; p; p = p->next ) {
+			Tile *tile = TILE( p->data );
+
+			if( tile->source ) {
+				images[n_images++] = tile->source;
+				g_object_ref( tile->source );
+			}
+		}
+	}
+
+	histogram = histogram_new( images, n_images );
+
+	for( i = 0; i < n_images; i++ )
+		VIPS_UNREF( images[i] );
+	g_free( images );
+
+	return( histogram );
+}
+
+#define SUM_AREA( TYPE ) { \
+	for( y = 0; y < area->height; y++ ) { \
+		TYPE *p = (TYPE *) VIPS_IMAGE_ADDR( source, \
+			area->left, area->top + y ); \
+		\
+		for( x = 0; x < area->width; x++ ) \
+			for( b = 0; b < source->Bands; b++ ) \
+				sum[b] += *p++; \
+	} \
+}
+
+/* Add up an area of a tile's display values, in tile coordinates.
+ */
+static gboolean
+tile_cache_sum_area( VipsImage *source, VipsRect *area, double *sum )
+{
+	int x, y, b;
+
+	switch( source->BandFmt ) {
+	case VIPS_FORMAT_UCHAR:
+		SUM_AREA( unsigned char );
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		SUM_AREA( signed char );
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		SUM_AREA( unsigned short );
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		SUM_AREA( signed short );
+		break;
+
+	case VIPS_FORMAT_UINT:
+		SUM_AREA( unsigned int );
+		break;
+
+	case VIPS_FORMAT_INT:
+		SUM_AREA( signed int );
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		SUM_AREA( float );
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		SUM_AREA( double );
+		break;
+
+	default:
+		return( FALSE );
+	}
+
+	return( TRUE );
+}
+
+/* The mean display value in a (2 * radius + 1) square around a point in 
+ * base image coordinates, from the display values our tiles kept, so we 
+ * never compute any pixels. FALSE if we don't hold all of the square, or if
+ * we are still showing the preview.
+ */
+gboolean
+tile_cache_get_pixel( TileCache *tile_cache, 
+	int image_x, int image_y, int radius, double **vector, int *n )
+{
+	VipsImage *display = tile_cache->tile_source->display;
+	int z = tile_cache->tile_source->current_z;
+
+	VipsRect image;
+	VipsRect area;
+	double *sum;
+	int covered;
+	GSList *p;
+	int b;
+
+	if( !tile_cache->tile_source->loaded ||
+		!display ||
+		vips_image_get_coding( display ) != VIPS_CODING_NONE ||
+		z >= tile_cache->n_levels )
+		return( FALSE );
+
+	image_x /= 1 << z;
+	image_y /= 1 << z;
+	if( image_x < 0 || 
+		image_y < 0 || 
+		image_x >= display->Xsize ||
+		image_y >= display->Ysize )
+		return( FALSE );
+
+	image.left = 0;
+	image.top = 0;
+	image.width = display->Xsize;
+	image.height = display->Ysize;
+	area.left = image_x - radius;
+	area.top = image_y - radius;
+	area.width = 2 * radius + 1;
+	area.height = 2 * radius + 1;
+	vips_rect_intersectrect( &area, &image, &area );
+
+	/* The square can span several tiles.
+	 */
+	sum = g_new0( double, display->Bands );
+	covered = 0;
+	for( p = tile_cache->tiles[z]; p; p = p->next ) {
+		Tile *tile = TILE( p->data );
+		VipsRect *valid = &tile->region->valid;
+
+		VipsRect overlap;
+
+		if( !tile->source ||
+			tile->source->Bands != display->Bands ||
+			tile->source->BandFmt != display->BandFmt )
+			continue;
+
+		vips_rect_intersectrect( valid, &area, &overlap );
+		if( vips_rect_isempty( &overlap ) )
+			continue;
+
+		overlap.left -= valid->left;
+		overlap.top -= valid->top;
+		if( !tile_cache_sum_area( tile->source, &overlap, sum ) ) {
+			g_free( sum );
+			return( FALSE );
+		}
+		covered += overlap.width * overlap.height;
+	}
+
+	if( covered != area.width * area.height ) {
+		g_free( sum );
+		return( FALSE );
+	}
+
+	for( b = 0; b < display->Bands; b++ )
+		sum[b] /= covered;
+	*vector = sum;
+	*n = display->Bands;
+
+	return( TRUE );
+}
+
+/* An annotation overlay being drawn for a tile in the background.
+ */
+typedef struct _TileCacheOverlay {
+	TileCache *tile_cache;
+	Tile *tile;
+	Annotations *annotations;
+
+	VipsRect bounds;
+	int z;
+	int width;
+	int height;
+
+	GBytes *bytes;
+	size_t stride;
+} TileCacheOverlay;
+
+static void
+tile_cache_overlay_free( TileCacheOverlay *overlay )
+{
+	VIPS_UNREF( overlay->tile_cache );
+	VIPS_UNREF( overlay->tile );
+	VIPS_UNREF( overlay->annotations );
+	VIPS_FREEF( g_bytes_unref, overlay->bytes );
+	g_free( overlay );
+}
+
+/* Back in the main thread, attach the overlay to the tile, unless the
+ * layer has changed while we were drawing.
+ */
+static gboolean
+tile_cache_overlay_done( void *user_data )
+{
+	TileCacheOverlay *overlay = (TileCacheOverlay *) user_data;
+	TileCache *tile_cache = overlay->tile_cache;
+	Tile *tile = overlay->tile;
+
+	tile->overlay_pending = FALSE;
+
+	if( overlay->bytes &&
+		tile_cache->annotations == overlay->annotations ) {
+		VIPS_UNREF( tile->overlay );
+		tile->overlay = gdk_memory_texture_new( 
+			overlay->width, overlay->height,
+			GDK_MEMORY_DEFAULT, overlay->bytes, overlay->stride );
+		tile->overlay_serial = overlay->annotations->serial;
+
+		tile_cache_tiles_changed( tile_cache );
+	}
+
+	tile_cache_overlay_free( overlay );
+
+	return( FALSE );
+}
+
+static void
+tile_cache_overlay_work( void *a, void *b )
+{
+	TileCacheOverlay *overlay = (TileCacheOverlay *) a;
+
+	overlay->bytes = annotations_render( overlay->annotations, 
+		&overlay->bounds, overlay->z, 
+		overlay->width, overlay->height, &overlay->stride );
+
+	g_idle_add( tile_cache_overlay_done, overlay );
+}
+
+/* Draw the annotations for a tile in a worker, at the tile's z.
+ */
+static void
+tile_cache_overlay_start( TileCache *tile_cache, Tile *tile )
+{
+	TileCacheOverlay *overlay;
+
+	overlay = g_new0( TileCacheOverlay, 1 );
+	overlay->tile_cache = tile_cache;
+	g_object_ref( tile_cache );
+	overlay->tile = tile;
+	g_object_ref( tile );
+	overlay->annotations = tile_cache->annotations;
+	g_object_ref( overlay->annotations );
+	overlay->bounds = tile->bounds;
+	overlay->z = tile->z;
+	overlay->width = tile->region->valid.width;
+	overlay->height = tile->region->valid.height;
+
+	tile->overlay_pending = TRUE;
+	if( vips_thread_execute( "overlay", 
+		tile_cache_overlay_work, overlay ) ) {
+		tile->overlay_pending = FALSE;
+		tile_cache_overlay_free( overlay );
+	}
+}
+
+/* Draw the tile's annotations on top of it, or start making them.
+ */
+static void
+tile_cache_snapshot_overlay( TileCache *tile_cache, GtkSnapshot *snapshot,
+	Tile *tile, graphene_rect_t *bounds )
+{
+	Annotations *annotations = tile_cache->annotations;
+
+	if( tile->overlay_serial != annotations->serial &&
+		!tile->overlay_pending )
+		tile_cache_overlay_start( tile_cache, tile );
+
+	if( tile->overlay &&
+		tile->overlay_serial == annotations->serial )
+		gtk_snapshot_append_texture( snapshot, tile->overlay, bounds );
+}
+
+/* Add a line or two of statistics to buf for the debug display.
+ */
+static void
+tile_cache_print_stats( TileCache *tile_cache, VipsBuf *buf )
+{
+	int n_tiles;
+	int i;
+
+	n_tiles = 0;
+	for( i = 0; i < tile_cache->n_levels; i++ )
+		n_tiles += g_slist_length( tile_cache->tiles[i] );
+	vips_buf_appendf( buf, "tile cache: %d levels, %d tiles, "
+		"%.1f MB display values (%.1f MB all windows)\n",
+		tile_cache->n_levels, n_tiles,
+		tile_cache->source_bytes / (1024.0 * 1024.0),
+		tile_cache_total_source_bytes / (1024.0 * 1024.0) );
+
+	tile_source_print_stats( tile_cache->tile_source, buf );
+	tile_store_print_stats( tile_cache->tile_store, buf );
+	disk_cache_print_stats( buf );
+	vis_kernel_print_stats( buf );
+	if( tile_cache->annotations )
+		annotations_print_stats( tile_cache->annotations, buf );
+}
+
+/* In debug mode, show our statistics in the top-left corner of the view.
+ */
+static void
+tile_cache_draw_stats( TileCache *tile_cache, GtkSnapshot *snapshot,
+	VipsRect *paint_rect )
+{
+	char str[4096];
+	VipsBuf buf = VIPS_BUF_STATIC( str );
+	char **lines;
+	int n_lines;
+	graphene_rect_t bounds;
+	cairo_t *cr;
+	int i;
+
+	tile_cache_print_stats( tile_cache, &buf );
+	lines = g_strsplit( vips_buf_all( &buf ), "\n", -1 );
+	n_lines = g_strv_length( lines );
+
+	bounds.origin.x = paint_rect->left;
+	bounds.origin.y = paint_rect->top;
+	bounds.size.width = 500;
+	bounds.size.height = n_lines * 14 + 8;
+
+	cr = gtk_snapshot_append_cairo( snapshot, &bounds );
+
+	cairo_set_source_rgba( cr, 0, 0, 0, 0.7 );
+	cairo_rectangle( cr, bounds.origin.x, bounds.origin.y,
+		bounds.size.width, bounds.size.height );
+	cairo_fill( cr );
+
+	cairo_set_source_rgb( cr, 0, 1, 0 );
+	cairo_set_font_size( cr, 12 );
+	for( i = 0; i < n_lines; i++ ) {
+		cairo_move_to( cr, 
+			bounds.origin.x + 4, 
+			bounds.origin.y + 4 + (i + 1) * 14 - 3 );
+		cairo_show_text( cr, lines[i] );
+	}
+
+	cairo_destroy( cr );
+	g_strfreev( lines );
+}
+
 /* Scale is how much the level0 image has been scaled, x/y is the position of
  * the top-left corner of the paint_rect area in the scaled image.
  *
@@ -850,10 +1514,18 @@ tile_cache_snapshot( TileCache *tile_cache, GtkSnapshot *snapshot,
 	viewport.width = VIPS_MAX( 1, paint_rect->width / scale );
 	viewport.height = VIPS_MAX( 1, paint_rect->height / scale );
 
+	/* The disc cache might have been switched on or off.
+	 */
+	if( disk_cache_get_enabled() != (tile_cache->view_key != NULL) )
+		tile_cache_update_view_key( tile_cache );
+
 	/* Fetch any tiles we are missing, update any tiles we have that have
 	 * been flagged as having pixels ready for fetching.
 	 */
+	tile_cache->z = z;
+	tile_cache->n_missing = 0;
 	tile_cache_fetch_area( tile_cache, &viewport, z );
+	tile_source_set_viewport( tile_cache->tile_source, &viewport );
 
 	/* Find the set of visible tiles, sorted back to front.
 	 *
@@ -924,6 +1596,17 @@ tile_cache_snapshot( TileCache *tile_cache, GtkSnapshot *snapshot,
 				 tile_get_texture( tile ), &bounds );
 #endif
 
+			/* Annotations go over each tile, so finer tiles in
+			 * front hide the coarse overlay too.
+			 */
+			if( tile_cache->annotations ) {
+				bounds.size.width = tile->bounds.width * scale;
+				bounds.size.height = 
+					tile->bounds.height * scale;
+				tile_cache_snapshot_overlay( tile_cache, 
+					snapshot, tile, &bounds );
+			}
+
 			/* In debug mode, draw the edges and add text for the 
 			 * tile pointer and age.
 			 */
@@ -953,6 +1636,8 @@ tile_cache_snapshot( TileCache *tile_cache, GtkSnapshot *snapshot,
 			&outline, 
 			(float[4]) { 2, 2, 2, 2 },
 			(GdkRGBA [4]) { BORDER, BORDER, BORDER, BORDER } );
+
+		tile_cache_draw_stats( tile_cache, snapshot, paint_rect );
 	}
 
 #ifdef DEBUG_RENDER_TIME
@@ -961,3 +1646,211 @@ tile_cache_snapshot( TileCache *tile_cache, GtkSnapshot *snapshot,
 	g_timer_destroy( snapshot_timer );
 #endif /*DEBUG_RENDER_TIME*/
 }
+
+/* Only fetch the overview for levels of up to this many tiles, eg. not for
+ * very long toilet rolls.
+ */
+#define MAX_OVERVIEW_TILES (16)
+
+typedef struct _TileCacheOverview {
+	TileCache *tile_cache;
+	int serial;
+	int z;
+
+	VipsImage *rgb;
+	VipsImage *pixels;
+} TileCacheOverview;
+
+static void
+tile_cache_overview_free( TileCacheOverview *overview )
+{
+	VIPS_UNREF( overview->tile_cache );
+	VIPS_UNREF( overview->rgb );
+	VIPS_UNREF( overview->pixels );
+	g_free( overview );
+}
+
+/* Copy the overview pixels into a tile on the coarsest level, unless it 
+ * already has pixels of its own.
+ */
+static void
+tile_cache_overview_fill( TileCache *tile_cache, 
+	VipsRegion *region, int x, int y, int z )
+{
+	VipsImage *level = tile_cache->levels[z];
+	VipsRect image = { 0, 0, region->im->Xsize, region->im->Ysize };
+
+	VipsRect tile_rect;
+	VipsRect *valid;
+	Tile *tile;
+
+	tile_rect.left = x << z;
+	tile_rect.top = y << z;
+	tile_rect.width = TILE_SIZE << z;
+	tile_rect.height = TILE_SIZE << z;
+	if( !(tile = tile_cache_find( tile_cache, &tile_rect, z )) ) {
+		if( !(tile = tile_new( level, x, y, z )) )
+			return;
+
+		tile_cache->tiles[z] = 
+			g_slist_prepend( tile_cache->tiles[z], tile );
+	}
+
+	valid = &tile->region->valid;
+	if( tile->valid ||
+		tile->reading ||
+		!vips_rect_includesrect( &image, valid ) ||
+		vips_region_prepare_to( region, tile->region, 
+			valid, valid->left, valid->top ) )
+		return;
+
+	tile->valid = TRUE;
+	tile->stale = FALSE;
+	tile_free_texture( tile );
+}
+
+/* Back in the main thread, fill the coarsest level, unless the pixels have
+ * changed while we were computing.
+ */
+static gboolean
+tile_cache_overview_done( void *user_data )
+{
+	TileCacheOverview *overview = (TileCacheOverview *) user_data;
+	TileCache *tile_cache = overview->tile_cache;
+	int z = overview->z;
+
+	tile_cache->overview_pending = FALSE;
+
+	if( overview->pixels &&
+		overview->serial == tile_cache->overview_serial &&
+		z < tile_cache->n_levels ) {
+		VipsImage *level = tile_cache->levels[z];
+		VipsRegion *region = vips_region_new( overview->pixels );
+
+		int x, y;
+
+		for( y = 0; y < level->Ysize; y += TILE_SIZE )
+			for( x = 0; x < level->Xsize; x += TILE_SIZE )
+				tile_cache_overview_fill( tile_cache, 
+					region, x, y, z );
+
+		VIPS_UNREF( region );
+	}
+
+	/* Redraw, and if the pixels have changed, the navigator will ask 
+	 * again.
+	 */
+	tile_cache_tiles_changed( tile_cache );
+
+	tile_cache_overview_free( overview );
+
+	return( FALSE );
+}
+
+static void
+tile_cache_overview_work( void *a, void *b )
+{
+	TileCacheOverview *overview = (TileCacheOverview *) a;
+
+	if( !(overview->pixels = vips_image_copy_memory( overview->rgb )) )
+		vips_error_clear();
+
+	g_idle_add( tile_cache_overview_done, overview );
+}
+
+/* Compute the coarsest level in the background, so the overview has 
+ * something to draw even if we've never shown the image at that size. This
+ * is done once, and again after a change to the pixels.
+ */
+void
+tile_cache_fetch_overview( TileCache *tile_cache )
+{
+	TileSource *tile_source = tile_cache->tile_source;
+	int z = tile_cache->n_levels - 1;
+
+	VipsImage *level;
+	VipsImage *rgb;
+	TileCacheOverview *overview;
+	int n_tiles;
+
+	if( tile_cache->overview_pending ||
+		tile_cache->overview_fetched == tile_cache->overview_serial ||
+		z < 0 ||
+		!tile_source->loaded )
+		return;
+	tile_cache->overview_fetched = tile_cache->overview_serial;
+
+	level = tile_cache->levels[z];
+	n_tiles = VIPS_ROUND_UP( level->Xsize, TILE_SIZE ) / TILE_SIZE *
+		(VIPS_ROUND_UP( level->Ysize, TILE_SIZE ) / TILE_SIZE);
+	if( n_tiles > MAX_OVERVIEW_TILES )
+		return;
+
+	if( !(rgb = tile_source_get_level_rgb( tile_source, z )) ) {
+		vips_error_clear();
+		return;
+	}
+	if( rgb->Bands != level->Bands ||
+		rgb->BandFmt != level->BandFmt ) {
+		VIPS_UNREF( rgb );
+		return;
+	}
+
+	overview = g_new0( TileCacheOverview, 1 );
+	overview->tile_cache = tile_cache;
+	g_object_ref( tile_cache );
+	overview->serial = tile_cache->overview_serial;
+	overview->z = z;
+	overview->rgb = rgb;
+
+	tile_cache->overview_pending = TRUE;
+	if( vips_thread_execute( "overview", 
+		tile_cache_overview_work, overview ) ) {
+		tile_cache->overview_pending = FALSE;
+		tile_cache_overview_free( overview );
+	}
+}
+
+/* Draw the whole image from the lowest-res levels, which are never freed, 
+ * for an overview. Scale is level 0 pixels to snapshot pixels.
+ *
+ * We only draw tiles we already have, so this never starts a render. Use
+ * tile_cache_fetch_overview() to fill the coarsest level.
+ */
+void
+tile_cache_snapshot_overview( TileCache *tile_cache, 
+	GtkSnapshot *snapshot, double scale )
+{
+	int i;
+
+	for( i = tile_cache->n_levels - 1; 
+		i >= VIPS_MAX( 0, tile_cache->n_levels - TILE_CACHE_KEEP_LEVELS );
+		i-- ) {
+		GSList *p;
+
+		for( p = tile_cache->tiles[i]; p; p = p->next ) {
+			Tile *tile = TILE( p->data );
+
+			graphene_rect_t bounds;
+
+			if( !tile->valid &&
+				!tile->texture )
+				continue;
+
+			bounds.origin.x = tile->bounds.left * scale;
+			bounds.origin.y = tile->bounds.top * scale;
+			bounds.size.width = tile->bounds.width * scale;
+			bounds.size.height = tile->bounds.height * scale;
+			gtk_snapshot_append_texture( snapshot, 
+				tile_get_texture( tile ), &bounds );
+		}
+	}
+}
+
+/* TRUE if every tile in the last snapshot had pixels for the current view. 
+ */
+gboolean
+tile_cache_is_complete( TileCache *tile_cache )
+{
+	return( tile_cache->n_missing == 0 );
+}
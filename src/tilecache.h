@@ -1,6 +1,10 @@
 #ifndef __TILE_CACHE_H
 #define __TILE_CACHE_H
 
+/* We never free tiles in this many of the lowest-res levels.
+ */
+#define TILE_CACHE_KEEP_LEVELS (3)
+
 /* The background modes we support.
  */
 typedef enum _TileCacheBackground {
@@ -59,6 +63,42 @@ typedef struct _TileCache {
 	 */
 	GdkTexture *background_texture;
 
+	/* Tiles we've had to drop from the pyramid, compressed.
+	 */
+	TileStore *tile_store;
+
+	/* Identifies the current set of pixels in the disc cache, or NULL
+	 * for no disc cache.
+	 */
+	char *view_key;
+
+	/* The number of visible tiles still waiting for pixels at the last 
+	 * snapshot.
+	 */
+	int n_missing;
+
+	/* Bytes of tile display values we are keeping for remapping. The
+	 * budget for these is shared by all tile caches.
+	 */
+	size_t source_bytes;
+
+	/* The level we last drew at, and the display settings we last 
+	 * remapped for, see TileSource::vis_serial.
+	 */
+	int z;
+	int vis_serial;
+
+	/* Draw these over the image, or NULL.
+	 */
+	Annotations *annotations;
+
+	/* Bumped whenever the overview must be fetched again, the serial we
+	 * last fetched for, and set while a fetch is running.
+	 */
+	int overview_serial;
+	int overview_fetched;
+	gboolean overview_pending;
+
 } TileCache;
 
 typedef struct _TileCacheClass {
@@ -69,6 +109,12 @@ typedef struct _TileCacheClass {
 GType tile_cache_get_type( void );
 
 TileCache *tile_cache_new( TileSource *tile_source );
+void tile_cache_set_annotations( TileCache *tile_cache, 
+	Annotations *annotations );
+
+Histogram *tile_cache_histogram( TileCache *tile_cache );
+gboolean tile_cache_get_pixel( TileCache *tile_cache, 
+	int image_x, int image_y, int radius, double **vector, int *n );
 
 /* Render the tiles to a snapshot.
  */
@@ -77,4 +123,10 @@ void tile_cache_snapshot( TileCache *tile_cache, GtkSnapshot *snapshot,
 	VipsRect *paint_rect,
 	gboolean debug );
 
+void tile_cache_fetch_overview( TileCache *tile_cache );
+void tile_cache_snapshot_overview( TileCache *tile_cache, 
+	GtkSnapshot *snapshot, double scale );
+
+gboolean tile_cache_is_complete( TileCache *tile_cache );
+
 #endif /*__TILE_CACHE_H*/
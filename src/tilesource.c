@@ -5,10 +5,72 @@
 
 #include "vipsdisp.h"
 
+#include <glib/gstdio.h>
+
 /* Use this threadpool to do background loads of images.
  */
 static GThreadPool *tile_source_background_load_pool = NULL;
 
+/* Run at most this many loads at once. Each load is threaded anyway, so 
+ * more than this just fights over disc and cores.
+ */
+#define MAX_BACKGROUND_LOADS (2)
+
+/* Load stats, protected by the lock.
+ */
+static GMutex tile_source_load_lock;
+static int tile_source_loads_running = 0;
+static int tile_source_loads_done = 0;
+static int tile_source_loads_cancelled = 0;
+static double tile_source_load_wait_time = 0.0;
+static double tile_source_load_run_time = 0.0;
+
+/* Queued loads are numbered, so loads at the same priority run in order.
+ */
+static gint64 tile_source_load_serial = 0;
+
+/* Build pyramids for large, flat images one at a time with this.
+ */
+static GThreadPool *tile_source_pyramid_pool = NULL;
+
+/* Images with more pixels than this and no pyramid get one built.
+ */
+#define PYRAMID_MIN_PIXELS (8192 * 8192)
+
+/* Building pyramids is optional, since they can be large, and they share a
+ * disc budget. Set from the main thread.
+ */
+static gboolean tile_source_pyramids_enabled = FALSE;
+static gint64 tile_source_pyramids_max_bytes = 4096 * (gint64) 1024 * 1024;
+
+/* Pyramids in use by any window, path -> number of users, so trimming the 
+ * cache never removes one which is open.
+ */
+static GMutex tile_source_pyramids_lock;
+static GHashTable *tile_source_pyramids_open = NULL;
+
+/* Render animation frames ahead of the playhead with this.
+ */
+static GThreadPool *tile_source_frame_pool = NULL;
+
+/* Memory budget for rendered animation frames, per image.
+ */
+#define MAX_FRAME_BYTES (256 * 1024 * 1024)
+
+/* Give up waiting for an incomplete animation frame after this many frame
+ * delays.
+ */
+#define FRAME_TIMEOUT (3)
+
+/* Above this many pages, don't try to open all pages as one tall image, lay
+ * them out virtually instead.
+ */
+#define MAX_TOILET_ROLL_PAGES (10000)
+
+/* The number of page images we keep open for a virtual toilet roll.
+ */
+#define MAX_VIRTUAL_PAGES (64)
+
 G_DEFINE_TYPE( TileSource, tile_source, G_TYPE_OBJECT );
 
 enum {
@@ -21,6 +83,7 @@ enum {
 	PROP_FALSECOLOUR,
 	PROP_LOG,
 	PROP_ICC,
+	PROP_DISPLAY_PROFILE,
 	PROP_ACTIVE,
 	PROP_LOADED,
 
@@ -31,6 +94,7 @@ enum {
 	SIG_POSTEVAL,
 	SIG_CHANGED,		
 	SIG_TILES_CHANGED,	      
+	SIG_VIS_CHANGED,	      
 	SIG_AREA_CHANGED,	     
 	SIG_PAGE_CHANGED,	     
 
@@ -39,6 +103,80 @@ enum {
 
 static guint tile_source_signals[SIG_LAST] = { 0 };
 
+/* Throw away all rendered frames.
+ */
+/* Note that a pyramid file is in use, or no longer in use.
+ */
+static void
+tile_source_pyramid_acquire( const char *path )
+{
+	int n;
+
+	g_mutex_lock( &tile_source_pyramids_lock );
+
+	if( !tile_source_pyramids_open )
+		tile_source_pyramids_open = g_hash_table_new_full( 
+			g_str_hash, g_str_equal, g_free, NULL );
+
+	n = GPOINTER_TO_INT( g_hash_table_lookup( 
+		tile_source_pyramids_open, path ) );
+	g_hash_table_replace( tile_source_pyramids_open, 
+		g_strdup( path ), GINT_TO_POINTER( n + 1 ) );
+
+	g_mutex_unlock( &tile_source_pyramids_lock );
+}
+
+static void
+tile_source_pyramid_release( const char *path )
+{
+	int n;
+
+	g_mutex_lock( &tile_source_pyramids_lock );
+
+	n = GPOINTER_TO_INT( g_hash_table_lookup( 
+		tile_source_pyramids_open, path ) );
+	if( n > 1 )
+		g_hash_table_replace( tile_source_pyramids_open, 
+			g_strdup( path ), GINT_TO_POINTER( n - 1 ) );
+	else
+		g_hash_table_remove( tile_source_pyramids_open, path );
+
+	g_mutex_unlock( &tile_source_pyramids_lock );
+}
+
+static void
+tile_source_frames_free( TileSource *tile_source )
+{
+	if( tile_source->frames ) {
+		int i;
+
+		for( i = 0; i < tile_source->n_pages; i++ )
+			VIPS_UNREF( tile_source->frames[i] );
+		VIPS_FREE( tile_source->frames );
+	}
+	VIPS_FREE( tile_source->frame_requested );
+	VIPS_FREE( tile_source->frame_key );
+	VIPS_UNREF( tile_source->frame_base );
+	VIPS_UNREF( tile_source->frame_mask );
+	tile_source->frame_bytes = 0;
+
+	/* Any renders in progress are now stale.
+	 */
+	g_atomic_int_inc( &tile_source->frame_generation );
+}
+
+static void
+tile_source_warm_free( TileSource *tile_source )
+{
+	int i;
+
+	for( i = 0; i < MAX_WARM; i++ ) {
+		VIPS_UNREF( tile_source->warm[i].display );
+		VIPS_UNREF( tile_source->warm[i].mask );
+	}
+	VIPS_FREE( tile_source->warm_key );
+}
+
 static void
 tile_source_dispose( GObject *object )
 {
@@ -48,9 +186,25 @@ tile_source_dispose( GObject *object )
 	printf( "tile_source_dispose:\n" ); 
 #endif /*DEBUG*/
 
-	VIPS_FREEF( g_source_remove, tile_source->page_flip_id );
+	tile_source_frames_free( tile_source );
+	VIPS_FREEF( g_source_remove, tile_source->warm_id );
+	tile_source_warm_free( tile_source );
+
+	/* Stop any pyramid build.
+	 */
+	if( tile_source->pyramid_build ) {
+		vips_image_set_kill( tile_source->pyramid_build, TRUE );
+		VIPS_UNREF( tile_source->pyramid_build );
+	}
+	if( tile_source->pyramid_filename )
+		tile_source_pyramid_release( tile_source->pyramid_filename );
+	VIPS_FREE( tile_source->pyramid_filename );
+
+	VIPS_UNREF( tile_source->preview );
+	VIPS_FREEF( g_timer_destroy, tile_source->load_timer );
 
 	VIPS_FREE( tile_source->filename );
+	VIPS_FREE( tile_source->display_profile );
 	VIPS_UNREF( tile_source->base );
 	VIPS_UNREF( tile_source->image );
 	VIPS_UNREF( tile_source->image_region );
@@ -58,9 +212,11 @@ tile_source_dispose( GObject *object )
 	VIPS_UNREF( tile_source->mask );
 	VIPS_UNREF( tile_source->rgb );
 	VIPS_UNREF( tile_source->rgb_region );
+	VIPS_FREEF( vis_kernel_rgb_free, tile_source->remap );
 	VIPS_UNREF( tile_source->mask_region );
 
 	VIPS_FREE( tile_source->delay );
+	VIPS_FREE( tile_source->channels );
 
 	G_OBJECT_CLASS( tile_source_parent_class )->dispose( object );
 }
@@ -79,6 +235,23 @@ tile_source_tiles_changed( TileSource *tile_source )
 		tile_source_signals[SIG_TILES_CHANGED], 0 );
 }
 
+/* Only the visualisation has changed. If the tile cache can remap the values 
+ * it holds, it'll do that, otherwise all tiles must be fetched again.
+ */
+static void
+tile_source_vis_changed( TileSource *tile_source )
+{
+	tile_source->vis_serial += 1;
+	if( tile_source->dragging )
+		tile_source->n_drag_updates += 1;
+
+	if( tile_source->remap )
+		g_signal_emit( tile_source, 
+			tile_source_signals[SIG_VIS_CHANGED], 0 );
+	else
+		tile_source_tiles_changed( tile_source );
+}
+
 static void
 tile_source_area_changed( TileSource *tile_source, VipsRect *dirty, int z )
 {
@@ -100,25 +273,68 @@ typedef struct _TileSourceUpdate {
 	int z;
 } TileSourceUpdate;
 
-/* Open a specified level. Take page (if relevant) from the tile_source.
+/* Open a specified level of a page. Only reads fields which are fixed once
+ * the image has loaded, plus the pyramid file we've built, if any, so it's 
+ * safe from any thread.
  */
 static VipsImage *
-tile_source_open( TileSource *tile_source, int level )
+tile_source_open_level( TileSource *tile_source, 
+	const char *pyramid_filename, int level, int page )
 {
 	/* In toilet-roll and pages-as-bands modes, we open all pages
 	 * together.
 	 */
 	gboolean all_pages = tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL;
 	int n = all_pages ? -1 : 1;
-	int page = all_pages ? 0 : tile_source->page;
 
 	VipsImage *image;
 
+	if( all_pages )
+		page = 0;
+
 	/* Only for tiles_source which have something you can reopen.
 	 */
 	g_assert( tile_source->filename );
 
-	if( vips_isprefix( "openslide", tile_source->loader ) ) {
+	if( pyramid_filename ) {
+		/* We've built a pyramid. The main image in the pyramid file 
+		 * is level 1, and the subifds are levels 2 and up.
+		 */
+		if( level == 0 ) {
+			image = tile_source->image;
+			g_object_ref( image );
+		}
+		else
+			image = vips_image_new_from_file( pyramid_filename,
+				"subifd", level - 2,
+				NULL );
+	}
+	else if( tile_source->shrink_pyramid &&
+		level == 0 &&
+		tile_source->base ) {
+		/* Level 0 of a shrink-on-load pyramid is just the plain 
+		 * open, so there's no need to decode the header again.
+		 */
+		image = tile_source->base;
+		g_object_ref( image );
+	}
+	else if( tile_source->shrink_pyramid &&
+		vips_isprefix( "jpeg", tile_source->loader ) ) {
+		/* libjpeg can shrink by 1, 2, 4 or 8 during decode.
+		 */
+		image = vips_image_new_from_file( tile_source->filename, 
+			"shrink", 1 << level,
+			NULL );
+	}
+	else if( tile_source->shrink_pyramid &&
+		vips_isprefix( "webp", tile_source->loader ) ) {
+		/* libwebp can scale during decode.
+		 */
+		image = vips_image_new_from_file( tile_source->filename, 
+			"scale", 1.0 / (1 << level),
+			NULL );
+	}
+	else if( vips_isprefix( "openslide", tile_source->loader ) ) {
 		/* These only have a "level" dimension.
 		 */
 		image = vips_image_new_from_file( tile_source->filename, 
@@ -182,6 +398,24 @@ tile_source_open( TileSource *tile_source, int level )
 	return( image );
 }
 
+/* Open a specified level of a page. Main thread only.
+ */
+static VipsImage *
+tile_source_open_page( TileSource *tile_source, int level, int page )
+{
+	return( tile_source_open_level( tile_source, 
+		tile_source->pyramid_filename, level, page ) );
+}
+
+/* Open a specified level. Take page (if relevant) from the tile_source.
+ */
+static VipsImage *
+tile_source_open( TileSource *tile_source, int level )
+{
+	return( tile_source_open_page( tile_source, 
+		level, tile_source->page ) );
+}
+
 /* Run by the main GUI thread when a notify comes in from libvips that a tile 
  * we requested is now available.
  */
@@ -223,211 +457,857 @@ tile_source_render_notify( VipsImage *image, VipsRect *rect, void *client )
 	new_update->rect = *rect;
 	new_update->z = update->z;
 
+	g_atomic_int_inc( &update->tile_source->n_tiles_rendered );
+
 	g_idle_add( tile_source_render_notify_idle, new_update );
 }
 
-/* Build the first half of the render pipeline. This ends in the sink_screen
- * which will issue any repaints.
+/* Scale the preview to the size of the current level.
  */
 static VipsImage *
-tile_source_display_image( TileSource *tile_source, VipsImage **mask_out )
+tile_source_preview_level( TileSource *tile_source, int z )
 {
-	VipsImage *image;
-	VipsImage *x;
-	VipsImage *mask;
-	TileSourceUpdate *update;
+	int width = tile_source->display_width >> z;
+	int height = tile_source->display_height >> z;
+	VipsImage *preview = tile_source->preview;
 
-	g_assert( mask_out ); 
+	VipsImage *x;
+	VipsImage *image;
 
-	if( tile_source->level_count ) {
-		/* There's a pyramid ... compute the size of image we need,
-		 * then find the layer which is one larger.
-		 */
-		int required_width = 
-			tile_source->display_width >> tile_source->current_z;
+	if( vips_resize( preview, &x, (double) width / preview->Xsize,
+		"vscale", (double) height / preview->Ysize,
+		"kernel", VIPS_KERNEL_LINEAR,
+		NULL ) )
+		return( NULL );
 
-		int i;
-		int level;
+	/* Rounding in resize can leave us a pixel out.
+	 */
+	if( vips_embed( x, &image, 0, 0, width, height,
+		"extend", VIPS_EXTEND_COPY,
+		NULL ) ) {
+		VIPS_UNREF( x );
+		return( NULL );
+	}
+	VIPS_UNREF( x );
 
-		for( i = 0; i < tile_source->level_count; i++ ) 
-			if( tile_source->level_width[i] < required_width )
-				break;
-		level = VIPS_CLIP( 0, i - 1, tile_source->level_count - 1 );
+	return( image );
+}
 
-#ifdef DEBUG
-		printf( "tile_source_display_image: loading level %d\n", 
-			level ); 
-#endif /*DEBUG*/
+/* A virtual image made of pages, opened on demand. We only open the pages 
+ * we need, through a small LRU shared by the render threads. We make one of 
+ * these for each z.
+ *
+ * With columns == 0, this is a virtual toilet roll, for images with too 
+ * many pages to open as one tall image. Page p starts at row 
+ * floor(p * page_height / 2^z), so pages stay aligned at every level. Pages
+ * are subsampled, then cropped or padded to fit their slot.
+ *
+ * Otherwise it's a contact sheet, with a thumbnail of each page centred in a 
+ * square cell.
+ */
+typedef struct _TileSourceVirtual {
+	char *filename;
+	int n_pages;
+	int page_width;
+	int page_height;
+	int z;
 
-		if( !(image = tile_source_open( tile_source, level )) )
-			return( NULL );
-	}
-	else if( tile_source->type == TILE_SOURCE_TYPE_MULTIPAGE ) {
-#ifdef DEBUG
-		printf( "tile_source_display_image: loading page %d\n", 
-			tile_source->page ); 
-#endif /*DEBUG*/
+	/* Grid layout, if any.
+	 */
+	int columns;
+	int cell;
 
-		if( !(image = tile_source_open( tile_source, 
-			tile_source->page )) )
-			return( NULL );
-	}
-	else {
-		image = tile_source->image;
-		g_object_ref( image ); 
-	}
+	/* Every page must match the format of the first.
+	 */
+	int bands;
+	VipsBandFormat format;
+	VipsCoding coding;
 
-	/* In multipage display mode, crop out the page we want. 
-	 *
-	 * We need to crop using the page size on image, since it might have 
-	 * been shrunk by shrink-on-load above ^^
+	/* Page number to VipsImage, and page numbers, most recently used 
+	 * first.
 	 */
-	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
-		(tile_source->mode == TILE_SOURCE_MODE_MULTIPAGE ||
-		 tile_source->mode == TILE_SOURCE_MODE_ANIMATED) ) {
-		int page_width = image->Xsize;
-		int page_height = vips_image_get_page_height( image );
+	GMutex lock;
+	GHashTable *pages;
+	GQueue *lru;
+} TileSourceVirtual;
 
-		VipsImage *x;
+/* Each render thread keeps a region on the page it last used.
+ */
+typedef struct _TileSourceVirtualSeq {
+	int page;
+	VipsRegion *region;
+} TileSourceVirtualSeq;
 
-		if( vips_crop( image, &x, 
-			0, tile_source->page * page_height, 
-			page_width, page_height, NULL ) ) {
-			VIPS_UNREF( image );
-			return( NULL );
-		}
-		VIPS_UNREF( image );
-		image = x;
-	}
+static void
+tile_source_virtual_free( VipsImage *image, TileSourceVirtual *virtual )
+{
+	g_mutex_clear( &virtual->lock );
+	VIPS_FREEF( g_hash_table_destroy, virtual->pages );
+	VIPS_FREEF( g_queue_free, virtual->lru );
+	VIPS_FREE( virtual->filename );
+	g_free( virtual );
+}
 
-	/* In pages-as-bands mode, crop out all pages and join band-wise. 
-	 * 
-	 * We need to crop using the page size on image, since it might 
-	 * have been shrunk by shrink-on-load above ^^
-	 */
-	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
-		tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS ) {
-		int page_width = image->Xsize;
-		int page_height = vips_image_get_page_height( image );
-		// not too many pages or we can have terrible performance problems
-		// more than 3 for the info bar
-		int n_pages = VIPS_MIN( 10, tile_source->n_pages );
+static int
+tile_source_virtual_slot_top( TileSourceVirtual *virtual, int page )
+{
+	return( ((gint64) page * virtual->page_height) >> virtual->z );
+}
 
-		VipsObject *context = VIPS_OBJECT( vips_image_new() );
-		VipsImage **t = (VipsImage **) 
-			vips_object_local_array( context, n_pages );
+/* The page containing display row y.
+ */
+static int
+tile_source_virtual_page_at( TileSourceVirtual *virtual, int y )
+{
+	int page = ((gint64) y << virtual->z) / virtual->page_height;
 
-		int page;
-		VipsImage *x;
+	page = VIPS_CLIP( 0, page, virtual->n_pages - 1 );
+	while( page > 0 &&
+		tile_source_virtual_slot_top( virtual, page ) > y )
+		page -= 1;
+	while( page < virtual->n_pages - 1 &&
+		tile_source_virtual_slot_top( virtual, page + 1 ) <= y )
+		page += 1;
 
-		for( page = 0; page < n_pages; page++ ) 
-			if( vips_crop( image, &t[page], 
-				0, page * page_height, page_width, page_height, 
-				NULL ) ) {
-				VIPS_UNREF( context );
-				VIPS_UNREF( image );
-				return( NULL );
-			}
-		if( vips_bandjoin( t, &x, n_pages, NULL ) ) {
+	return( page );
+}
+
+/* Thumbnail a page and centre it in a grid cell. Cells are always 
+ * uchar sRGB.
+ */
+static VipsImage *
+tile_source_virtual_thumbnail( TileSourceVirtual *virtual, int page )
+{
+	int cell = virtual->cell;
+	int size = VIPS_MAX( 1, cell - 2 * (cell / 16) );
+	VipsImage *context = vips_image_new();
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( context ), 5 );
+
+	char *filename;
+	VipsImage *x;
+	VipsImage *image;
+
+	/* Thumbnail will use shrink-on-load, or the smallest pyramid level,
+	 * if it can.
+	 */
+	filename = g_strdup_printf( "%s[page=%d]", virtual->filename, page );
+	if( vips_thumbnail( filename, &t[0], size, 
+		"height", size,
+		NULL ) ) {
+		g_free( filename );
+		VIPS_UNREF( context );
+		return( NULL );
+	}
+	g_free( filename );
+	x = t[0];
+
+	if( vips_image_hasalpha( x ) ) {
+		if( vips_flatten( x, &t[1], NULL ) ) {
 			VIPS_UNREF( context );
-			VIPS_UNREF( image );
 			return( NULL );
 		}
-		VIPS_UNREF( image );
-		VIPS_UNREF( context );
-		image = x;
+		x = t[1];
+	}
 
-		/* Pick an interpretation ... one of the RGB types, if we
-		 * can.
-		 */
-		if( image->Bands < 3 )
-			image->Type = image->BandFmt == VIPS_FORMAT_USHORT ? 
-				VIPS_INTERPRETATION_GREY16 :
-				VIPS_INTERPRETATION_B_W;
-		else
-			image->Type = image->BandFmt == VIPS_FORMAT_USHORT ? 
-				VIPS_INTERPRETATION_RGB16 :
-				VIPS_INTERPRETATION_sRGB;
+	if( vips_colourspace( x, &t[2], VIPS_INTERPRETATION_sRGB, NULL ) ||
+		vips_cast_uchar( t[2], &t[3], NULL ) ||
+		vips_embed( t[3], &t[4], 
+			(cell - t[3]->Xsize) / 2, (cell - t[3]->Ysize) / 2, 
+			cell, cell, NULL ) ) {
+		VIPS_UNREF( context );
+		return( NULL );
 	}
 
-	/* Histogram type ... plot the histogram. 
+	/* Thumbnails are small, so keep the pixels.
 	 */
-	if( image->Type == VIPS_INTERPRETATION_HISTOGRAM &&
-		(image->Xsize == 1 || image->Ysize == 1) ) {
-		VipsImage *context = vips_image_new();
-		VipsImage **t = (VipsImage **) 
-			vips_object_local_array( VIPS_OBJECT( context ), 7 );
-
-		/* So image will be unreffed when we unref context.
-		 */
-		t[0] = image;
-		x = t[0];
+	image = vips_image_copy_memory( t[4] );
+	VIPS_UNREF( context );
 
-		if( x->Coding == VIPS_CODING_LABQ ) {
-			if( vips_LabQ2Lab( x, &t[1], NULL ) ) {
-				VIPS_UNREF( context );
-				return( NULL );
-			}
-			x = t[1];
-		}
+	return( image );
+}
 
-		if( x->Coding == VIPS_CODING_RAD ) {
-			if( vips_rad2float( x, &t[2], NULL ) ) {
-				VIPS_UNREF( context );
-				return( NULL );
-			}
-			x = t[2];
-		}
+/* Open a page and shape it to fit its slot. 
+ */
+static VipsImage *
+tile_source_virtual_open( TileSourceVirtual *virtual, int page )
+{
+	int shrink = 1 << virtual->z;
+	int slot_height = tile_source_virtual_slot_top( virtual, page + 1 ) -
+		tile_source_virtual_slot_top( virtual, page );
 
-		if( vips_hist_norm( x, &t[3], NULL ) ||
-			vips_hist_plot( t[3], &t[4], NULL ) ) {
-			VIPS_UNREF( context );
-			return( NULL );
-		}
-		x = t[4];
+	VipsImage *image;
+	VipsImage *x;
 
-		image = x;
-		g_object_ref( image ); 
-		VIPS_UNREF( context );
-	}
+	if( virtual->columns )
+		return( tile_source_virtual_thumbnail( virtual, page ) );
 
-	if( tile_source->current_z > 0 ) {
-		/* We may have already zoomed out a bit because we've loaded
-		 * some layer other than the base one. Calculate the
-		 * subsample as (current_width / required_width).
-		 */
-		int subsample = image->Xsize / 
-			(tile_source->display_width >> tile_source->current_z);
+	if( !(image = vips_image_new_from_file( virtual->filename, 
+		"page", page,
+		NULL )) )
+		return( NULL );
 
-		if( vips_subsample( image, &x, subsample, subsample, NULL ) ) {
+	if( shrink > 1 ) {
+		if( vips_subsample( image, &x, 
+			VIPS_MIN( shrink, image->Xsize ), 
+			VIPS_MIN( shrink, image->Ysize ), 
+			NULL ) ) {
 			VIPS_UNREF( image );
-			return( NULL ); 
+			return( NULL );
 		}
 		VIPS_UNREF( image );
 		image = x;
 	}
 
-	/* A slow operation, handy for checking rendering order.
-	 *
-	if( vips_gaussblur( image, &x, 100, NULL ) ) {
+	if( vips_embed( image, &x, 0, 0, 
+		virtual->page_width >> virtual->z, slot_height, NULL ) ) {
 		VIPS_UNREF( image );
-		return( NULL ); 
+		return( NULL );
 	}
 	VIPS_UNREF( image );
 	image = x;
-	 *
-	 */
 
-	/* Need something to track the z at which we made this sink_screen.
-	 */
-	update = VIPS_NEW( image, TileSourceUpdate );
-	update->tile_source = tile_source;
-	update->z = tile_source->current_z;
+	if( image->Bands != virtual->bands ||
+		image->BandFmt != virtual->format ||
+		image->Coding != virtual->coding ) {
+		vips_error( "vipsdisp", "page %d does not match page 0", page );
+		VIPS_UNREF( image );
+		return( NULL );
+	}
 
-	x = vips_image_new();
-	mask = vips_image_new();
+	return( image );
+}
+
+/* Fetch a page from the LRU, opening it if necessary. Returns a new ref.
+ */
+static VipsImage *
+tile_source_virtual_get( TileSourceVirtual *virtual, int page )
+{
+	gpointer key = GINT_TO_POINTER( page );
+
+	VipsImage *image;
+	VipsImage *old;
+
+	g_mutex_lock( &virtual->lock );
+	if( (image = g_hash_table_lookup( virtual->pages, key )) ) {
+		g_object_ref( image );
+		g_queue_remove( virtual->lru, key );
+		g_queue_push_head( virtual->lru, key );
+	}
+	g_mutex_unlock( &virtual->lock );
+
+	if( image )
+		return( image );
+
+	/* Open outside the lock, it can be slow.
+	 */
+	if( !(image = tile_source_virtual_open( virtual, page )) ) 
+		return( NULL );
+
+	g_mutex_lock( &virtual->lock );
+
+	/* Another thread might have opened this page while we were busy.
+	 */
+	if( (old = g_hash_table_lookup( virtual->pages, key )) ) {
+		VIPS_UNREF( image );
+		image = old;
+	}
+	else {
+		g_hash_table_insert( virtual->pages, key, image );
+		g_queue_push_head( virtual->lru, key );
+
+		while( g_queue_get_length( virtual->lru ) > MAX_VIRTUAL_PAGES )
+			g_hash_table_remove( virtual->pages, 
+				g_queue_pop_tail( virtual->lru ) );
+	}
+	g_object_ref( image );
+
+	g_mutex_unlock( &virtual->lock );
+
+	return( image );
+}
+
+static void *
+tile_source_virtual_start( VipsImage *out, void *a, void *b )
+{
+	TileSourceVirtualSeq *seq = g_new0( TileSourceVirtualSeq, 1 );
+
+	seq->page = -1;
+
+	return( seq );
+}
+
+/* Paint the part of a page's slot that falls within the output region.
+ */
+static void
+tile_source_virtual_paint( TileSourceVirtual *virtual, 
+	TileSourceVirtualSeq *seq, VipsRegion *out_region, 
+	int page, VipsRect *slot )
+{
+	VipsRect area;
+	VipsRect need;
+
+	vips_rect_intersectrect( &out_region->valid, slot, &area );
+	if( vips_rect_isempty( &area ) )
+		return;
+
+	if( seq->page != page ) {
+		VipsImage *image;
+
+		VIPS_UNREF( seq->region );
+		seq->page = page;
+		if( (image = tile_source_virtual_get( virtual, page )) ) {
+			seq->region = vips_region_new( image );
+			VIPS_UNREF( image );
+		}
+	}
+
+	/* A page we can't read shows as black, rather than stopping the 
+	 * whole render.
+	 */
+	need = area;
+	need.left -= slot->left;
+	need.top -= slot->top;
+	if( !seq->region ||
+		vips_region_prepare_to( seq->region, out_region, 
+			&need, area.left, area.top ) ) {
+		vips_error_clear();
+		vips_region_paint( out_region, &area, 0 );
+	}
+}
+
+static int
+tile_source_virtual_generate( VipsRegion *out_region, 
+	void *vseq, void *a, void *b, gboolean *stop )
+{
+	TileSourceVirtualSeq *seq = (TileSourceVirtualSeq *) vseq;
+	TileSourceVirtual *virtual = (TileSourceVirtual *) a;
+	VipsRect *r = &out_region->valid;
+
+	VipsRect slot;
+
+	if( virtual->columns ) {
+		int cell = virtual->cell;
+		int first_row = r->top / cell;
+		int last_row = (VIPS_RECT_BOTTOM( r ) - 1) / cell;
+		int first_column = r->left / cell;
+		int last_column = (VIPS_RECT_RIGHT( r ) - 1) / cell;
+
+		int row, column;
+
+		for( row = first_row; row <= last_row; row++ )
+			for( column = first_column; 
+				column <= last_column; column++ ) {
+				int page = row * virtual->columns + column;
+
+				slot.left = column * cell;
+				slot.top = row * cell;
+				slot.width = cell;
+				slot.height = cell;
+
+				/* The last row can be partly empty.
+				 */
+				if( page < virtual->n_pages ) 
+					tile_source_virtual_paint( virtual, 
+						seq, out_region, page, &slot );
+				else {
+					VipsRect area;
+
+					vips_rect_intersectrect( r, 
+						&slot, &area );
+					vips_region_paint( out_region, 
+						&area, 0 );
+				}
+			}
+	}
+	else {
+		int first = tile_source_virtual_page_at( virtual, r->top );
+		int last = tile_source_virtual_page_at( virtual, 
+			VIPS_RECT_BOTTOM( r ) - 1 );
+
+		int page;
+
+		for( page = first; page <= last; page++ ) {
+			int top = tile_source_virtual_slot_top( virtual, page );
+
+			slot.left = 0;
+			slot.top = top;
+			slot.width = out_region->im->Xsize;
+			slot.height = tile_source_virtual_slot_top( virtual, 
+				page + 1 ) - top;
+			tile_source_virtual_paint( virtual, 
+				seq, out_region, page, &slot );
+		}
+	}
+
+	return( 0 );
+}
+
+static int
+tile_source_virtual_stop( void *vseq, void *a, void *b )
+{
+	TileSourceVirtualSeq *seq = (TileSourceVirtualSeq *) vseq;
+
+	VIPS_UNREF( seq->region );
+	g_free( seq );
+
+	return( 0 );
+}
+
+static VipsImage *
+tile_source_virtual_new( TileSource *tile_source, int z )
+{
+	VipsImage *first = tile_source->image;
+
+	TileSourceVirtual *virtual;
+	VipsImage *image;
+	int width;
+	int height;
+
+	virtual = g_new0( TileSourceVirtual, 1 );
+	virtual->filename = g_strdup( tile_source->filename );
+	virtual->n_pages = tile_source->n_pages;
+	virtual->page_width = tile_source->width;
+	virtual->page_height = tile_source->height;
+	virtual->z = z;
+	virtual->bands = first->Bands;
+	virtual->format = first->BandFmt;
+	virtual->coding = first->Coding;
+	if( tile_source->mode == TILE_SOURCE_MODE_GRID ) {
+		virtual->columns = tile_source->grid_columns;
+		virtual->cell = VIPS_MAX( 1, GRID_CELL_SIZE >> z );
+		virtual->bands = 3;
+		virtual->format = VIPS_FORMAT_UCHAR;
+		virtual->coding = VIPS_CODING_NONE;
+	}
+	g_mutex_init( &virtual->lock );
+	virtual->pages = g_hash_table_new_full( g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_object_unref );
+	virtual->lru = g_queue_new();
+
+	image = vips_image_new();
+	g_signal_connect( image, "close", 
+		G_CALLBACK( tile_source_virtual_free ), virtual );
+
+	if( virtual->columns ) {
+		width = tile_source->display_width >> z;
+		height = tile_source->display_height >> z;
+	}
+	else {
+		width = tile_source->width >> z;
+		height = tile_source_virtual_slot_top( virtual, 
+			virtual->n_pages );
+	}
+
+	vips_image_init_fields( image, width, height,
+		virtual->bands, virtual->format, virtual->coding, 
+		virtual->columns ? VIPS_INTERPRETATION_sRGB : first->Type,
+		first->Xres, first->Yres );
+	if( vips_image_pipelinev( image, VIPS_DEMAND_STYLE_SMALLTILE, NULL ) ||
+		vips_image_generate( image,
+			tile_source_virtual_start,
+			tile_source_virtual_generate,
+			tile_source_virtual_stop,
+			virtual, NULL ) ) {
+		VIPS_UNREF( image );
+		return( NULL );
+	}
+
+	return( image );
+}
+
+/* TRUE if we display a virtual image made of pages opened on demand.
+ */
+static gboolean
+tile_source_is_virtual( TileSource *tile_source )
+{
+	return( tile_source->mode == TILE_SOURCE_MODE_GRID ||
+		(tile_source->virtual_roll &&
+		 tile_source->mode == TILE_SOURCE_MODE_TOILET_ROLL) );
+}
+
+/* The pages shown in pages-as-bands mode, in order, and their settings.
+ * With nothing selected we show the first page in black. Free both with 
+ * g_free().
+ */
+static int
+tile_source_selected_channels( TileSource *tile_source, 
+	int **pages_out, VisKernelChannel **channels_out )
+{
+	int n_pages = VIPS_MAX( 1, tile_source->n_pages );
+	int *pages = g_new( int, n_pages );
+	VisKernelChannel *channels = g_new( VisKernelChannel, n_pages );
+
+	int page;
+	int n;
+
+	n = 0;
+	if( tile_source->channels )
+		for( page = 0; page < tile_source->n_pages; page++ ) 
+			if( tile_source->channels[page].selected ) {
+				pages[n] = page;
+				channels[n] = tile_source->channels[page];
+				n += 1;
+			}
+
+	if( n == 0 ) {
+		pages[0] = 0;
+		if( tile_source->channels )
+			channels[0] = tile_source->channels[0];
+		else {
+			memset( &channels[0], 0, sizeof( VisKernelChannel ) );
+			channels[0].high = 1.0;
+		}
+		channels[0].tint[0] = 0.0;
+		channels[0].tint[1] = 0.0;
+		channels[0].tint[2] = 0.0;
+		n = 1;
+	}
+
+	if( pages_out )
+		*pages_out = pages;
+	else
+		g_free( pages );
+	if( channels_out )
+		*channels_out = channels;
+	else
+		g_free( channels );
+
+	return( n );
+}
+
+/* The pyramid level which is one larger than we need for this width.
+ */
+static int
+tile_source_pick_level( const int *level_width, int level_count, 
+	int required_width )
+{
+	int i;
+
+	for( i = 0; i < level_count; i++ ) 
+		if( level_width[i] < required_width )
+			break;
+
+	return( VIPS_CLIP( 0, i - 1, level_count - 1 ) );
+}
+
+/* Everything we need to open the levels of a page. The tile_source is only
+ * used for fields which are fixed once it has loaded, so a copy made on the
+ * main thread can be used from any thread.
+ */
+struct _TileSourceLevels {
+	TileSource *tile_source;
+	char *pyramid_filename;
+	int level_count;
+	int level_width[MAX_LEVELS];
+	int display_width;
+	int display_height;
+	TileSourceMode mode;
+	int page;
+
+	/* In pages-as-bands mode, the pages we bandjoin.
+	 */
+	int *pages;
+	int n_pages;
+};
+
+static void
+tile_source_levels_init( TileSource *tile_source, 
+	TileSourceLevels *levels, int page )
+{
+	levels->tile_source = tile_source;
+	g_object_ref( tile_source );
+	levels->pyramid_filename = g_strdup( tile_source->pyramid_filename );
+	levels->level_count = tile_source->level_count;
+	memcpy( levels->level_width, tile_source->level_width, 
+		sizeof( tile_source->level_width ) );
+	levels->display_width = tile_source->display_width;
+	levels->display_height = tile_source->display_height;
+	levels->mode = tile_source->mode;
+	levels->page = page;
+	levels->pages = NULL;
+	levels->n_pages = 0;
+	if( tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS )
+		levels->n_pages = tile_source_selected_channels( tile_source,
+			&levels->pages, NULL );
+}
+
+static void
+tile_source_levels_clear( TileSourceLevels *levels )
+{
+	VIPS_UNREF( levels->tile_source );
+	VIPS_FREE( levels->pyramid_filename );
+	VIPS_FREE( levels->pages );
+}
+
+/* Open the level we need for z and crop out the page. Safe from any thread.
+ */
+static VipsImage *
+tile_source_levels_open( TileSourceLevels *levels, int z )
+{
+	TileSource *tile_source = levels->tile_source;
+	int page = levels->page;
+
+	VipsImage *image;
+
+	if( levels->level_count ) {
+		/* There's a pyramid ... compute the size of image we need,
+		 * then find the layer which is one larger.
+		 */
+		int level = tile_source_pick_level( levels->level_width, 
+			levels->level_count, levels->display_width >> z );
+
+#ifdef DEBUG
+		printf( "tile_source_levels_open: loading level %d\n", 
+			level ); 
+#endif /*DEBUG*/
+
+		if( !(image = tile_source_open_level( tile_source, 
+			levels->pyramid_filename, level, page )) )
+			return( NULL );
+	}
+	else if( tile_source->type == TILE_SOURCE_TYPE_MULTIPAGE ) {
+#ifdef DEBUG
+		printf( "tile_source_levels_open: loading page %d\n", 
+			page ); 
+#endif /*DEBUG*/
+
+		if( !(image = tile_source_open_level( tile_source, 
+			levels->pyramid_filename, page, page )) )
+			return( NULL );
+	}
+	else {
+		image = tile_source->image;
+		g_object_ref( image ); 
+	}
+
+	/* In multipage display mode, crop out the page we want. 
+	 *
+	 * We need to crop using the page size on image, since it might have 
+	 * been shrunk by shrink-on-load above ^^
+	 */
+	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
+		(levels->mode == TILE_SOURCE_MODE_MULTIPAGE ||
+		 levels->mode == TILE_SOURCE_MODE_ANIMATED) ) {
+		int page_width = image->Xsize;
+		int page_height = vips_image_get_page_height( image );
+
+		VipsImage *x;
+
+		if( vips_crop( image, &x, 
+			0, page * page_height, 
+			page_width, page_height, NULL ) ) {
+			VIPS_UNREF( image );
+			return( NULL );
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	/* In pages-as-bands mode, crop out the selected pages and bandjoin 
+	 * them. Unselected pages are never computed, so we can have many 
+	 * channels.
+	 *
+	 * We need to crop using the page size on image, since it might 
+	 * have been shrunk by shrink-on-load above ^^
+	 */
+	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
+		levels->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS ) {
+		int page_width = image->Xsize;
+		int page_height = vips_image_get_page_height( image );
+
+		VipsObject *context = VIPS_OBJECT( vips_image_new() );
+		VipsImage **t = (VipsImage **) 
+			vips_object_local_array( context, levels->n_pages );
+
+		int i;
+		VipsImage *x;
+
+		for( i = 0; i < levels->n_pages; i++ ) 
+			if( vips_crop( image, &t[i], 
+				0, levels->pages[i] * page_height, 
+				page_width, page_height, 
+				NULL ) ) {
+				VIPS_UNREF( context );
+				VIPS_UNREF( image );
+				return( NULL );
+			}
+
+		if( vips_bandjoin( t, &x, levels->n_pages, NULL ) ) {
+			VIPS_UNREF( context );
+			VIPS_UNREF( image );
+			return( NULL );
+		}
+		VIPS_UNREF( image );
+		VIPS_UNREF( context );
+		image = x;
+
+		/* One band per channel, so don't let anything guess a 
+		 * colour space.
+		 */
+		image->Type = VIPS_INTERPRETATION_MULTIBAND;
+	}
+
+	return( image );
+}
+
+/* Histogram type ... plot the histogram. 
+ */
+static VipsImage *
+tile_source_plot_histogram( VipsImage *image )
+{
+	VipsImage *context = vips_image_new();
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( context ), 7 );
+
+	VipsImage *x;
+
+	x = image;
+
+	if( x->Coding == VIPS_CODING_LABQ ) {
+		if( vips_LabQ2Lab( x, &t[1], NULL ) ) {
+			VIPS_UNREF( context );
+			return( NULL );
+		}
+		x = t[1];
+	}
+
+	if( x->Coding == VIPS_CODING_RAD ) {
+		if( vips_rad2float( x, &t[2], NULL ) ) {
+			VIPS_UNREF( context );
+			return( NULL );
+		}
+		x = t[2];
+	}
+
+	if( vips_hist_norm( x, &t[3], NULL ) ||
+		vips_hist_plot( t[3], &t[4], NULL ) ) {
+		VIPS_UNREF( context );
+		return( NULL );
+	}
+	x = t[4];
+
+	g_object_ref( x ); 
+	VIPS_UNREF( context );
+
+	return( x );
+}
+
+/* Shrink an image to the size of level z. We may have already zoomed out a 
+ * bit because we've loaded some layer other than the base one. Calculate 
+ * the subsample as (current_width / required_width).
+ */
+static VipsImage *
+tile_source_subsample( VipsImage *image, int display_width, int z )
+{
+	int subsample = VIPS_MAX( 1, image->Xsize / 
+		VIPS_MAX( 1, display_width >> z ) );
+
+	VipsImage *x;
+
+	if( vips_subsample( image, &x, subsample, subsample, NULL ) ) 
+		return( NULL ); 
+
+	return( x );
+}
+
+/* Build the display image for a page at a pyramid level. This is the first 
+ * part of the render pipeline, before the sink_screen.
+ */
+static VipsImage *
+tile_source_build_display( TileSource *tile_source, int page, int z )
+{
+	VipsImage *image;
+	VipsImage *x;
+
+	if( tile_source_is_virtual( tile_source ) ) {
+		/* Pages open on demand, so there's no need to wait for the 
+		 * load, and each z is built directly.
+		 */
+		if( !(image = tile_source_virtual_new( tile_source, z )) )
+			return( NULL );
+	}
+	else if( !tile_source->loaded ) {
+		/* Still loading, so we must be showing the preview.
+		 */
+		if( !(image = tile_source_preview_level( tile_source, z )) )
+			return( NULL );
+	}
+	else {
+		TileSourceLevels levels;
+
+		tile_source_levels_init( tile_source, &levels, page );
+		image = tile_source_levels_open( &levels, z );
+		tile_source_levels_clear( &levels );
+		if( !image )
+			return( NULL );
+	}
+
+	if( image->Type == VIPS_INTERPRETATION_HISTOGRAM &&
+		(image->Xsize == 1 || image->Ysize == 1) ) {
+		if( !(x = tile_source_plot_histogram( image )) ) {
+			VIPS_UNREF( image );
+			return( NULL ); 
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	/* Virtual toilet rolls are built at the right size for z.
+	 */
+	if( z > 0 &&
+		!tile_source_is_virtual( tile_source ) ) {
+		if( !(x = tile_source_subsample( image, 
+			tile_source->display_width, z )) ) {
+			VIPS_UNREF( image );
+			return( NULL ); 
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	return( image );
+}
+
+/* Build the first half of the render pipeline for a page. This ends in the 
+ * sink_screen which will issue any repaints.
+ */
+static VipsImage *
+tile_source_display_image( TileSource *tile_source, 
+	int page, int priority, VipsImage **mask_out )
+{
+	VipsImage *image;
+	VipsImage *x;
+	VipsImage *mask;
+	TileSourceUpdate *update;
+
+	g_assert( mask_out ); 
+
+	if( !(image = tile_source_build_display( tile_source, 
+		page, tile_source->current_z )) )
+		return( NULL );
+
+	/* A slow operation, handy for checking rendering order.
+	 *
+	if( vips_gaussblur( image, &x, 100, NULL ) ) {
+		VIPS_UNREF( image );
+		return( NULL ); 
+	}
+	VIPS_UNREF( image );
+	image = x;
+	 *
+	 */
+
+	/* Need something to track the z at which we made this sink_screen.
+	 */
+	update = VIPS_NEW( image, TileSourceUpdate );
+	update->tile_source = tile_source;
+	update->z = tile_source->current_z;
+
+	x = vips_image_new();
+	mask = vips_image_new();
 	if( vips_sink_screen( image, x, mask, 
-		TILE_SIZE, TILE_SIZE, MAX_TILES, 0, 
+		TILE_SIZE, TILE_SIZE, MAX_TILES, priority, 
 		tile_source_render_notify, update ) ) {
 		VIPS_UNREF( x );
 		VIPS_UNREF( mask );
@@ -502,11 +1382,104 @@ tile_source_n_colour(VipsImage *image)
     }
 }
 
-/* Build the second half of the image pipeline. This ends with an rgb image we
- * can make textures from.
+/* The profile we colour manage to.
+ */
+static const char *
+tile_source_display_profile( TileSource *tile_source )
+{
+	return( tile_source->display_profile ? 
+		tile_source->display_profile : "srgb" );
+}
+
+/* The display settings for the fused vis kernel.
+ */
+static void
+tile_source_vis_map( TileSource *tile_source, VisKernelMap *map )
+{
+	map->scale = 1.0;
+	map->offset = 0.0;
+	map->log = FALSE;
+	map->falsecolour = FALSE;
+
+	if( tile_source->active ) {
+		map->scale = tile_source->scale;
+		map->offset = tile_source->offset;
+		map->log = tile_source->log;
+		map->falsecolour = tile_source->falsecolour;
+	}
+}
+
+/* A copy of the display settings the second half of the pipeline uses. 
+ * Animation frames are built in the background from one of these, so they
+ * never look at the live tile_source.
+ */
+typedef struct _TileSourceVis {
+	gboolean active;
+	VisKernelMap map;
+	gboolean icc;
+	char *profile;
+
+	/* In pages-as-bands mode, how to show each band of the display 
+	 * image.
+	 */
+	VisKernelChannel *channels;
+	int n_channels;
+} TileSourceVis;
+
+static void
+tile_source_vis_get( TileSource *tile_source, TileSourceVis *vis )
+{
+	vis->active = tile_source->active;
+	tile_source_vis_map( tile_source, &vis->map );
+	vis->icc = tile_source->active && tile_source->icc;
+	vis->profile = g_strdup( tile_source_display_profile( tile_source ) );
+	vis->channels = NULL;
+	vis->n_channels = 0;
+	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
+		tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS )
+		vis->n_channels = tile_source_selected_channels( tile_source,
+			NULL, &vis->channels );
+}
+
+static void
+tile_source_vis_clear( TileSourceVis *vis )
+{
+	VIPS_FREE( vis->profile );
+	VIPS_FREE( vis->channels );
+}
+
+/* Composite the bands of a pages-as-bands display image to sRGB.
  */
 static VipsImage *
-tile_source_rgb_image( TileSource *tile_source, VipsImage *in ) 
+tile_source_rgb_composite( TileSourceVis *vis, VipsImage *in )
+{
+	int n = VIPS_MIN( in->Bands, vis->n_channels );
+	VipsObject *context = VIPS_OBJECT( vips_image_new() );
+	VipsImage **t = (VipsImage **) vips_object_local_array( context, n );
+
+	int i;
+	VipsImage *x;
+
+	for( i = 0; i < n; i++ ) 
+		if( vips_extract_band( in, &t[i], i, NULL ) ) {
+			VIPS_UNREF( context );
+			return( NULL );
+		}
+
+	if( vis_kernel_composite( t, vis->channels, n, &x ) ) {
+		VIPS_UNREF( context );
+		return( NULL );
+	}
+	VIPS_UNREF( context );
+
+	return( x );
+}
+
+/* Build the second half of the image pipeline as a chain of libvips
+ * operations. This ends with an rgb image we can make textures from.
+ */
+static VipsImage *
+tile_source_rgb_image_chain( TileSourceVis *vis, VipsImage *in ) 
 {
 	VipsImage *image;
 	VipsImage *x;
@@ -545,13 +1518,13 @@ tile_source_rgb_image( TileSource *tile_source, VipsImage *in )
 	/* Visualisation controls ... the scale and offset values must be applied
 	 * in terms of the original image values, so we can't go to RGB first.
 	 */
-	if( tile_source->active &&
-		(tile_source->scale != 1.0 ||
-		 tile_source->offset != 0.0 ||
-		 tile_source->falsecolour ||
-		 tile_source->log ||
+	if( vis->active &&
+		(vis->map.scale != 1.0 ||
+		 vis->map.offset != 0.0 ||
+		 vis->map.falsecolour ||
+		 vis->map.log ||
 		 image->Type == VIPS_INTERPRETATION_FOURIER) ) {
-		if( tile_source->log ||
+		if( vis->map.log ||
 			image->Type == VIPS_INTERPRETATION_FOURIER ) { 
 			if( !(x = tile_source_image_log( image )) ) {
 				VIPS_UNREF( image );
@@ -562,10 +1535,10 @@ tile_source_rgb_image( TileSource *tile_source, VipsImage *in )
 			image = x;
 		}
 
-		if( tile_source->scale != 1.0 ||
-			tile_source->offset != 0.0 ) {
+		if( vis->map.scale != 1.0 ||
+			vis->map.offset != 0.0 ) {
 			if( vips_linear1( image, &x, 
-				tile_source->scale, tile_source->offset, 
+				vis->map.scale, vis->map.offset, 
 				NULL ) ) {
 				VIPS_UNREF( image );
 				VIPS_UNREF( alpha );
@@ -576,11 +1549,10 @@ tile_source_rgb_image( TileSource *tile_source, VipsImage *in )
 		}
 	}
 
-	/* Colour management to srgb.
+	/* Colour management to srgb, or the display profile.
 	 */
-	if( tile_source->active &&
-		tile_source->icc) {
-		if( vips_icc_transform( image, &x, "srgb", NULL ) ) {
+	if( vis->icc ) {
+		if( vips_icc_transform( image, &x, vis->profile, NULL ) ) {
 			VIPS_UNREF( image );
 			VIPS_UNREF( alpha );
 			return( NULL ); 
@@ -614,8 +1586,7 @@ tile_source_rgb_image( TileSource *tile_source, VipsImage *in )
 
 	/* This must be after conversion to sRGB.
 	 */
-	if( tile_source->active &&
-		tile_source->falsecolour ) {
+	if( vis->map.falsecolour ) {
 		if( vips_falsecolour( image, &x, NULL ) ) {
 			VIPS_UNREF( image );
 			VIPS_UNREF( alpha );
@@ -649,15 +1620,231 @@ tile_source_rgb_image( TileSource *tile_source, VipsImage *in )
 	return( image );
 }
 
+/* TRUE if we can make the rgb image with the fused vis kernel.
+ */
+static gboolean
+tile_source_rgb_fusable( TileSourceVis *vis, VipsImage *in )
+{
+	return( !vis->icc &&
+		vis_kernel_rgb_supported( in ) );
+}
+
+/* TRUE if we can colour manage with the cached ICC LUT. The other display
+ * settings must be at their defaults, since they apply before the transform.
+ */
+static gboolean
+tile_source_icc_lut_usable( TileSourceVis *vis, VipsImage *in )
+{
+	return( vis->icc &&
+		vis->map.scale == 1.0 &&
+		vis->map.offset == 0.0 &&
+		!vis->map.log &&
+		!vis->map.falsecolour &&
+		vis_kernel_icc_supported( in ) );
+}
+
+/* Build the second half of the image pipeline from a set of display 
+ * settings. This ends with an rgb image we can make textures from. Safe to 
+ * call from any thread.
+ *
+ * The common cases go through the fused vis kernel in a single pass, 
+ * uchar RGB and CMYK with just colour management go through a cached ICC
+ * LUT, everything else (complex, LAB, etc.) uses the full chain.
+ */
+static VipsImage *
+tile_source_rgb_build( TileSourceVis *vis, VipsImage *in, 
+	gboolean *fused, gboolean *icc_lut ) 
+{
+	VipsImage *composite;
+	VipsImage *x;
+
+	*fused = FALSE;
+	*icc_lut = FALSE;
+
+	/* In pages-as-bands mode the display image has the values of the 
+	 * selected pages as bands. Tint and sum them first, then carry on 
+	 * with the composite. The fused flag says the rgb pixels are a 
+	 * function of the display pixels under the scale and offset, and 
+	 * that's not true here, so we never remap.
+	 */
+	if( vis->n_channels > 0 ) {
+		TileSourceVis rgb_vis = *vis;
+		gboolean ignore;
+
+		if( !(composite = tile_source_rgb_composite( vis, in )) )
+			return( NULL );
+		rgb_vis.channels = NULL;
+		rgb_vis.n_channels = 0;
+		x = tile_source_rgb_build( &rgb_vis, composite, 
+			&ignore, &ignore );
+		VIPS_UNREF( composite );
+
+		return( x );
+	}
+
+	/* The image interpretation might be crazy (eg. a mono image tagged as
+	 * srgb) and that'll mess up our rules for display.
+	 */
+	in->Type = vips_image_guess_interpretation( in );
+
+	if( tile_source_rgb_fusable( vis, in ) ) {
+		if( vis_kernel_rgb( in, &vis->map, &x ) )
+			return( NULL );
+		*fused = TRUE;
+	}
+	else if( tile_source_icc_lut_usable( vis, in ) ) {
+		if( vis_kernel_icc( in, vis->profile, &x ) )
+			return( NULL );
+		*icc_lut = TRUE;
+	}
+	else {
+		if( !(x = tile_source_rgb_image_chain( vis, in )) )
+			return( NULL );
+	}
+
+	return( x );
+}
+
+/* Build the second half of the image pipeline with the current display
+ * settings.
+ */
+static VipsImage *
+tile_source_rgb_image( TileSource *tile_source, VipsImage *in ) 
+{
+	TileSourceVis vis;
+	VipsImage *x;
+
+	tile_source_vis_get( tile_source, &vis );
+	x = tile_source_rgb_build( &vis, in, 
+		&tile_source->rgb_fused, &tile_source->rgb_icc_lut );
+	tile_source_vis_clear( &vis );
+
+	return( x );
+}
+
+#ifdef DEBUG
+/* Tiles per second for an image of a single tile.
+ */
+static double
+tile_source_rgb_rate( VipsImage *image )
+{
+	VipsRect rect = { 0, 0, image->Xsize, image->Ysize };
+	GTimer *timer;
+	double elapsed;
+	int n;
+
+	timer = g_timer_new();
+	n = 0;
+	do {
+		VipsRegion *region = vips_region_new( image );
+
+		if( vips_region_prepare( region, &rect ) ) {
+			g_object_unref( region );
+			g_timer_destroy( timer );
+			return( 0.0 );
+		}
+		g_object_unref( region );
+		n += 1;
+	} while( (elapsed = g_timer_elapsed( timer, NULL )) < 0.1 );
+	g_timer_destroy( timer );
+
+	return( n / elapsed );
+}
+
+/* Time the fused kernel against the operation chain on a tile from the 
+ * centre of the display image. The tile is copied to memory first so we 
+ * only time the visualisation.
+ */
+static void
+tile_source_rgb_benchmark( TileSource *tile_source )
+{
+	VipsImage *display = tile_source->display;
+	VipsImage *context = vips_image_new();
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( context ), 4 );
+	int width = VIPS_MIN( TILE_SIZE, display->Xsize );
+	int height = VIPS_MIN( TILE_SIZE, display->Ysize );
+
+	TileSourceVis vis;
+
+	if( !(tile_source->rgb_fused || tile_source->rgb_icc_lut) ||
+		vips_crop( display, &t[0], 
+			(display->Xsize - width) / 2, 
+			(display->Ysize - height) / 2, 
+			width, height, NULL ) ||
+		!(t[1] = vips_image_copy_memory( t[0] )) ) {
+		g_object_unref( context );
+		vips_error_clear();
+		return;
+	}
+
+	tile_source_vis_get( tile_source, &vis );
+	if( !(t[2] = tile_source_rgb_image( tile_source, t[1] )) ||
+		!(t[3] = tile_source_rgb_image_chain( &vis, t[1] )) ) {
+		tile_source_vis_clear( &vis );
+		g_object_unref( context );
+		vips_error_clear();
+		return;
+	}
+	tile_source_vis_clear( &vis );
+	tile_source->rgb_fused_rate = tile_source_rgb_rate( t[2] );
+	tile_source->rgb_chain_rate = tile_source_rgb_rate( t[3] );
+	g_object_unref( context );
+
+	printf( "tile_source_rgb_benchmark: fused %g tiles/s, "
+		"chain %g tiles/s\n",
+		tile_source->rgb_fused_rate, tile_source->rgb_chain_rate );
+}
+#endif /*DEBUG*/
+
+/* Rebuild the first half of the image pipeline for the current page, ending
+ * in a sink_screen.
+ */
+static int
+tile_source_update_sink( TileSource *tile_source )
+{
+	VipsImage *display;
+	VipsImage *mask;
+
+	if( !(display = tile_source_display_image( tile_source, 
+		tile_source->page, tile_source->priority, &mask )) ) {
+#ifdef DEBUG
+		printf( "tile_source_update_sink: build failed\n" );
+#endif /*DEBUG*/
+		return( -1 ); 
+	}
+
+	VIPS_UNREF( tile_source->display );
+	VIPS_UNREF( tile_source->mask );
+	tile_source->display = display;
+	tile_source->mask = mask;
+	tile_source->frame_shown = FALSE;
+
+	VIPS_UNREF( tile_source->mask_region );
+	tile_source->mask_region = vips_region_new( tile_source->mask );
+
+	return( 0 );
+}
+
 /* Rebuild just the second half of the image pipeline, eg. after a change to
  * falsecolour, or if current_z changes.
  */
 static int
 tile_source_update_rgb( TileSource *tile_source )
 {
+	/* A frame's display image has no sink_screen, so go back to a full
+	 * pipeline before making a new rgb from it.
+	 */
+	if( tile_source->frame_shown &&
+		tile_source_update_sink( tile_source ) )
+		return( -1 );
+
 	if( tile_source->display ) { 
 		VipsImage *rgb;
 
+		if( tile_source->dragging )
+			tile_source->n_drag_rebuilds += 1;
+
 		if( !(rgb = tile_source_rgb_image( tile_source, 
 			tile_source->display )) ) {
 			printf( "tile_source_rgb_image failed!\n" );
@@ -668,6 +1855,19 @@ tile_source_update_rgb( TileSource *tile_source )
 
 		VIPS_UNREF( tile_source->rgb_region );
 		tile_source->rgb_region = vips_region_new( tile_source->rgb );
+
+		VIPS_FREEF( vis_kernel_rgb_free, tile_source->remap );
+		if( tile_source->rgb_fused ) {
+			VisKernelMap map;
+
+			tile_source_vis_map( tile_source, &map );
+			tile_source->remap = vis_kernel_rgb_new( 
+				tile_source->display, &map );
+		}
+
+#ifdef DEBUG
+		tile_source_rgb_benchmark( tile_source );
+#endif /*DEBUG*/
 	}
 
 	return( 0 );
@@ -679,38 +1879,304 @@ tile_source_update_rgb( TileSource *tile_source )
 static int
 tile_source_update_display( TileSource *tile_source )
 {
-	VipsImage *display;
-	VipsImage *mask;
-
 #ifdef DEBUG
 	printf( "tile_source_update_display:\n" );
 #endif /*DEBUG*/
 
-	/* Don't update if we're still loading.
+	/* Don't update if we're still loading, unless we have a preview.
 	 */
-	if( !tile_source->loaded ||
+	if( (!tile_source->loaded && !tile_source->preview) ||
 		!tile_source->image )
 		return( 0 );
 
-	if( !(display = tile_source_display_image( tile_source, &mask )) ) {
-#ifdef DEBUG
-		printf( "tile_source_update_display: build failed\n" );
-#endif /*DEBUG*/
-		return( -1 ); 
+	if( tile_source_update_sink( tile_source ) ||
+		tile_source_update_rgb( tile_source ) )
+		return( -1 );
+
+	return( 0 );
+}
+
+/* Check that the warm pipelines match the display settings, and clear them 
+ * if not. FALSE if we shouldn't be keeping warm pipelines at all.
+ */
+static gboolean
+tile_source_warm_check( TileSource *tile_source )
+{
+	char *key;
+
+	/* Only for paging through multipage images. Animations have the 
+	 * frame cache.
+	 */
+	if( tile_source->mode != TILE_SOURCE_MODE_MULTIPAGE ||
+		tile_source->type == TILE_SOURCE_TYPE_PAGE_PYRAMID ||
+		tile_source->n_pages < 2 ||
+		!tile_source->loaded ||
+		!tile_source->display ||
+		tile_source->priority == TILE_SOURCE_PRIORITY_HIDDEN ) {
+		if( tile_source->warm_key )
+			tile_source_warm_free( tile_source );
+		return( FALSE );
 	}
 
-	VIPS_UNREF( tile_source->display );
-	VIPS_UNREF( tile_source->mask );
-	tile_source->display = display;
-	tile_source->mask = mask;
+	key = g_strdup_printf( "%d:%d:%d",
+		tile_source->current_z,
+		tile_source->level_count,
+		tile_source->priority );
+	if( !tile_source->warm_key ||
+		!g_str_equal( key, tile_source->warm_key ) ) {
+		tile_source_warm_free( tile_source );
+		tile_source->warm_key = key;
+	}
+	else
+		g_free( key );
 
-	VIPS_UNREF( tile_source->mask_region );
-	tile_source->mask_region = vips_region_new( tile_source->mask );
+	return( TRUE );
+}
 
-	if( tile_source_update_rgb( tile_source ) )
-		return( -1 );
+/* If we have a warm pipeline for the current page, swap it in, and keep the
+ * pipeline we were showing in its place, since we might well go back.
+ */
+static gboolean
+tile_source_warm_adopt( TileSource *tile_source, int old_page )
+{
+	int i;
 
-	return( 0 );
+	if( !tile_source_warm_check( tile_source ) )
+		return( FALSE );
+
+	for( i = 0; i < MAX_WARM; i++ ) {
+		TileSourceWarm *warm = &tile_source->warm[i];
+
+		if( warm->display &&
+			warm->page == tile_source->page ) {
+			VipsImage *display = warm->display;
+			VipsImage *mask = warm->mask;
+
+			warm->page = old_page;
+			warm->display = tile_source->display;
+			warm->mask = tile_source->mask;
+			tile_source->display = display;
+			tile_source->mask = mask;
+			tile_source->frame_shown = FALSE;
+
+			VIPS_UNREF( tile_source->mask_region );
+			tile_source->mask_region = 
+				vips_region_new( tile_source->mask );
+
+			if( tile_source_update_rgb( tile_source ) )
+				return( FALSE );
+
+			tile_source->n_warm_hits += 1;
+
+			return( TRUE );
+		}
+	}
+
+	tile_source->n_warm_misses += 1;
+
+	return( FALSE );
+}
+
+/* Start rendering the last painted area of a warm pipeline. sink_screen 
+ * queues any tiles it doesn't have and returns immediately.
+ */
+static void
+tile_source_warm_render( TileSource *tile_source, TileSourceWarm *warm )
+{
+	int z = tile_source->current_z;
+
+	VipsRect image;
+	VipsRect area;
+	VipsRegion *region;
+
+	image.left = 0;
+	image.top = 0;
+	image.width = warm->display->Xsize;
+	image.height = warm->display->Ysize;
+	area.left = tile_source->viewport.left >> z;
+	area.top = tile_source->viewport.top >> z;
+	area.width = (tile_source->viewport.width >> z) + 1;
+	area.height = (tile_source->viewport.height >> z) + 1;
+	vips_rect_intersectrect( &image, &area, &area );
+	if( vips_rect_isempty( &area ) )
+		return;
+
+	region = vips_region_new( warm->display );
+	if( vips_region_prepare( region, &area ) )
+		vips_error_clear();
+	VIPS_UNREF( region );
+}
+
+/* Make sure we have pipelines for the pages we are likely to visit next: the
+ * next one in the direction we're moving, then the one behind us, then two 
+ * ahead.
+ */
+static void
+tile_source_warm_prefetch( TileSource *tile_source )
+{
+	int direction = tile_source->page_direction >= 0 ? 1 : -1;
+	int wanted[MAX_WARM] = {
+		tile_source->page + direction,
+		tile_source->page - direction,
+		tile_source->page + 2 * direction
+	};
+
+	int i, j;
+
+	if( !tile_source_warm_check( tile_source ) )
+		return;
+
+	/* Drop pipelines for pages we no longer want.
+	 */
+	for( i = 0; i < MAX_WARM; i++ ) {
+		TileSourceWarm *warm = &tile_source->warm[i];
+
+		if( !warm->display )
+			continue;
+
+		for( j = 0; j < MAX_WARM; j++ )
+			if( warm->page == wanted[j] )
+				break;
+		if( j == MAX_WARM ) {
+			VIPS_UNREF( warm->display );
+			VIPS_UNREF( warm->mask );
+		}
+	}
+
+	for( j = 0; j < MAX_WARM; j++ ) {
+		int page = wanted[j];
+
+		TileSourceWarm *free_slot;
+
+		if( page < 0 ||
+			page >= tile_source->n_pages )
+			continue;
+
+		free_slot = NULL;
+		for( i = 0; i < MAX_WARM; i++ ) {
+			TileSourceWarm *warm = &tile_source->warm[i];
+
+			if( warm->display &&
+				warm->page == page )
+				break;
+			if( !warm->display &&
+				!free_slot )
+				free_slot = warm;
+		}
+		if( i < MAX_WARM ||
+			!free_slot )
+			continue;
+
+		/* Below any page on screen, so we never hold up what the 
+		 * user is looking at.
+		 */
+		if( !(free_slot->display = tile_source_display_image( 
+			tile_source, page, TILE_SOURCE_PRIORITY_PREFETCH, 
+			&free_slot->mask )) ) {
+			vips_error_clear();
+			continue;
+		}
+		free_slot->page = page;
+
+		tile_source_warm_render( tile_source, free_slot );
+	}
+}
+
+/* Build warm pipelines once the main loop is idle, so we don't slow down
+ * the page flip that triggered us.
+ */
+static gboolean
+tile_source_warm_idle( void *user_data )
+{
+	TileSource *tile_source = TILE_SOURCE( user_data );
+
+	tile_source->warm_id = 0;
+	tile_source_warm_prefetch( tile_source );
+
+	return( FALSE );
+}
+
+static void
+tile_source_warm_queue( TileSource *tile_source )
+{
+	if( !tile_source->warm_id &&
+		tile_source_warm_check( tile_source ) )
+		tile_source->warm_id = g_idle_add( tile_source_warm_idle, 
+			tile_source );
+}
+
+/* Default pages-as-bands settings: the first three channels as red, green 
+ * and blue, and a window over the whole range of the pixel format.
+ */
+static void
+tile_source_channels_init( TileSource *tile_source )
+{
+	static const double tints[][3] = {
+		{ 1, 0, 0 },
+		{ 0, 1, 0 },
+		{ 0, 0, 1 },
+		{ 0, 1, 1 },
+		{ 1, 0, 1 },
+		{ 1, 1, 0 },
+		{ 1, 1, 1 }
+	};
+
+	int n = VIPS_MAX( 1, tile_source->n_pages );
+	double max = tile_source->image ?
+		vis_kernel_format_max( tile_source->image->BandFmt ) : 255.0;
+
+	int i;
+
+	if( tile_source->channels )
+		return;
+
+	tile_source->channels = VIPS_ARRAY( NULL, n, VisKernelChannel );
+	for( i = 0; i < n; i++ ) {
+		VisKernelChannel *channel = &tile_source->channels[i];
+		const double *tint = tints[i % VIPS_NUMBER( tints )];
+
+		channel->selected = i < 3;
+		channel->tint[0] = tint[0];
+		channel->tint[1] = tint[1];
+		channel->tint[2] = tint[2];
+		channel->low = 0.0;
+		channel->high = max;
+	}
+
+	/* A single channel is best in grey.
+	 */
+	if( n == 1 ) {
+		tile_source->channels[0].tint[1] = 1.0;
+		tile_source->channels[0].tint[2] = 1.0;
+	}
+}
+
+/* The size of the display image depends on the mode.
+ */
+static void
+tile_source_set_display_size( TileSource *tile_source )
+{
+	tile_source->display_width = tile_source->width;
+	tile_source->display_height = tile_source->height;
+	if( tile_source->mode == TILE_SOURCE_MODE_TOILET_ROLL )
+		tile_source->display_height *= tile_source->n_pages;
+	else if( tile_source->mode == TILE_SOURCE_MODE_GRID ) {
+		int rows;
+
+		/* Roughly square, if we've not been told how wide to be.
+		 */
+		if( tile_source->grid_columns < 1 )
+			tile_source->grid_columns = 
+				ceil( sqrt( tile_source->n_pages ) );
+		tile_source->grid_columns = VIPS_CLIP( 1, 
+			tile_source->grid_columns, tile_source->n_pages );
+		rows = VIPS_ROUND_UP( tile_source->n_pages, 
+			tile_source->grid_columns ) / tile_source->grid_columns;
+
+		tile_source->display_width = 
+			tile_source->grid_columns * GRID_CELL_SIZE;
+		tile_source->display_height = rows * GRID_CELL_SIZE;
+	}
 }
 
 #ifdef DEBUG
@@ -746,6 +2212,10 @@ tile_source_property_name( guint prop_id )
 		return( "ICC" );
 		break;
 
+	case PROP_DISPLAY_PROFILE:
+		return( "DISPLAY_PROFILE" );
+		break;
+
 	case PROP_ACTIVE:
 		return( "ACTIVE" );
 		break;
@@ -760,49 +2230,347 @@ tile_source_property_name( guint prop_id )
 }
 #endif /*DEBUG*/
 
-/* Each timeout fires once, sets the next timeout, and flips the page.
+/* Check that the frame cache matches the display settings, and clear it if
+ * not. FALSE if we shouldn't be caching frames at all.
  */
 static gboolean
-tile_source_page_flip( void *user_data )
+tile_source_frames_check( TileSource *tile_source )
 {
-	TileSource *tile_source = (TileSource *) user_data;
-	int page = VIPS_CLIP( 0, tile_source->page, tile_source->n_pages - 1 );
+	char *key;
+
+	/* Only for toilet-roll animations, where every frame is the same 
+	 * size.
+	 */
+	if( tile_source->mode != TILE_SOURCE_MODE_ANIMATED ||
+		tile_source->type != TILE_SOURCE_TYPE_TOILET_ROLL ||
+		tile_source->n_pages < 2 ||
+		!tile_source->loaded ||
+		!tile_source->rgb ||
+		tile_source->priority == TILE_SOURCE_PRIORITY_HIDDEN ) {
+		if( tile_source->frames )
+			tile_source_frames_free( tile_source );
+		return( FALSE );
+	}
 
-	int timeout;
+	key = g_strdup_printf( "%d:%d:%d:%g:%g:%d:%d:%d:%d:%s",
+		tile_source->current_z,
+		tile_source->level_count,
+		tile_source->rgb->Bands,
+		tile_source->scale,
+		tile_source->offset,
+		tile_source->falsecolour,
+		tile_source->log,
+		tile_source->icc,
+		tile_source->active,
+		tile_source_display_profile( tile_source ) );
+	if( !tile_source->frame_key ||
+		!g_str_equal( key, tile_source->frame_key ) ) {
+		int required_width = 
+			tile_source->display_width >> tile_source->current_z;
 
-	/* By convention, GIFs default to 10fps.
+		tile_source_frames_free( tile_source );
+
+		if( tile_source->level_count ) {
+			int level = tile_source_pick_level( 
+				tile_source->level_width, 
+				tile_source->level_count, required_width );
+
+			if( !(tile_source->frame_base = 
+				tile_source_open_page( tile_source, 
+					level, 0 )) ) {
+				vips_error_clear();
+				g_free( key );
+				return( FALSE );
+			}
+		}
+		else {
+			tile_source->frame_base = tile_source->image;
+			g_object_ref( tile_source->frame_base );
+		}
+		tile_source->frame_width = required_width;
+
+		tile_source->frames = 
+			VIPS_ARRAY( NULL, tile_source->n_pages, VipsImage * );
+		tile_source->frame_requested = 
+			VIPS_ARRAY( NULL, tile_source->n_pages, gboolean );
+		memset( tile_source->frames, 0, 
+			tile_source->n_pages * sizeof( VipsImage * ) );
+		memset( tile_source->frame_requested, 0, 
+			tile_source->n_pages * sizeof( gboolean ) );
+		tile_source->frame_key = key;
+	}
+	else
+		g_free( key );
+
+	return( TRUE );
+}
+
+/* Everything a frame render needs, copied from the tile_source on the main 
+ * thread.
+ */
+typedef struct _TileSourceFrame {
+	TileSource *tile_source;
+	int page;
+	int generation;
+
+	/* Crop the frame from this, then subsample to width.
 	 */
-	timeout = 100;
+	VipsImage *base;
+	int width;
 
-	if( tile_source->delay ) {
-		int i = VIPS_MIN( page, tile_source->n_delay - 1 );
+	TileSourceVis vis;
 
-		/* By GIF convention, timeout 0 means unset.
+	VipsImage *image;
+} TileSourceFrame;
+
+/* A frame has been rendered. Keep it if it's still useful.
+ */
+static gboolean
+tile_source_frame_done_idle( void *user_data )
+{
+	TileSourceFrame *frame = (TileSourceFrame *) user_data;
+	TileSource *tile_source = frame->tile_source;
+
+	if( frame->generation == tile_source->frame_generation &&
+		tile_source->frames ) {
+		tile_source->frame_requested[frame->page] = FALSE;
+		if( frame->image &&
+			!tile_source->frames[frame->page] ) {
+			tile_source->frames[frame->page] = frame->image;
+			tile_source->frame_bytes += 
+				VIPS_IMAGE_SIZEOF_IMAGE( frame->image );
+			frame->image = NULL;
+		}
+	}
+
+	VIPS_UNREF( frame->image );
+	VIPS_UNREF( frame->base );
+	tile_source_vis_clear( &frame->vis );
+	VIPS_UNREF( frame->tile_source );
+	g_free( frame );
+
+	return( FALSE );
+}
+
+/* Build the display image for a frame: crop the page out of the toilet roll, 
+ * then shrink to the current z. Safe to call from any thread.
+ */
+static VipsImage *
+tile_source_frame_display( VipsImage *base, int page, int width )
+{
+	VipsImage *image;
+	VipsImage *x;
+	int page_height;
+	int subsample;
+
+	page_height = vips_image_get_page_height( base );
+	if( vips_crop( base, &x, 
+		0, page * page_height, 
+		base->Xsize, page_height, NULL ) ) 
+		return( NULL );
+	image = x;
+
+	subsample = VIPS_MAX( 1, image->Xsize / VIPS_MAX( 1, width ) );
+	if( subsample > 1 ) {
+		if( vips_subsample( image, &x, subsample, subsample, NULL ) ) {
+			VIPS_UNREF( image );
+			return( NULL ); 
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	return( image );
+}
+
+/* Run by the frame threadpool. Render a complete frame to memory. This must
+ * only use the frame, never the live tile_source.
+ */
+static void
+tile_source_frame_worker( void *data, void *user_data )
+{
+	TileSourceFrame *frame = (TileSourceFrame *) data;
+
+	VipsImage *display;
+	VipsImage *rgb;
+	gboolean fused;
+	gboolean icc_lut;
+
+	if( frame->generation == 
+		g_atomic_int_get( &frame->tile_source->frame_generation ) &&
+		(display = tile_source_frame_display( frame->base, 
+			frame->page, frame->width )) ) {
+		if( (rgb = tile_source_rgb_build( &frame->vis, display,
+			&fused, &icc_lut )) ) {
+			frame->image = vips_image_copy_memory( rgb );
+			VIPS_UNREF( rgb );
+		}
+		VIPS_UNREF( display );
+	}
+
+	if( !frame->image )
+		vips_error_clear();
+
+	g_idle_add( tile_source_frame_done_idle, frame );
+}
+
+/* Make a frame render request with a copy of everything it will need.
+ */
+static TileSourceFrame *
+tile_source_frame_new( TileSource *tile_source, int page )
+{
+	TileSourceFrame *frame = g_new0( TileSourceFrame, 1 );
+
+	frame->tile_source = tile_source;
+	g_object_ref( tile_source );
+	frame->page = page;
+	frame->generation = tile_source->frame_generation;
+	frame->base = tile_source->frame_base;
+	g_object_ref( frame->base );
+	frame->width = tile_source->frame_width;
+
+	tile_source_vis_get( tile_source, &frame->vis );
+
+	return( frame );
+}
+
+/* Queue renders for the frames just ahead of the playhead, and drop frames
+ * that have fallen outside the window we can afford to keep. If the whole
+ * animation fits, nothing is dropped and later loops never rerender.
+ */
+static void
+tile_source_frames_prefetch( TileSource *tile_source )
+{
+	int n_pages = tile_source->n_pages;
+
+	size_t size;
+	int n_ahead;
+	int i;
+
+	if( !tile_source_frames_check( tile_source ) )
+		return;
+
+	size = (size_t) (tile_source->display_width >> 
+		tile_source->current_z) *
+		(tile_source->display_height >> tile_source->current_z) *
+		tile_source->rgb->Bands;
+	n_ahead = VIPS_CLIP( 0, MAX_FRAME_BYTES / VIPS_MAX( 1, size ), 
+		n_pages - 1 );
+
+	for( i = 0; i < n_pages; i++ ) {
+		/* How far ahead of the playhead is this page.
 		 */
-		if( tile_source->delay[i] )
-			timeout = tile_source->delay[i];
+		int ahead = (i - tile_source->page + n_pages) % n_pages;
+
+		if( ahead > n_ahead &&
+			tile_source->frames[i] ) {
+			tile_source->frame_bytes -= 
+				VIPS_IMAGE_SIZEOF_IMAGE( tile_source->frames[i] );
+			VIPS_UNREF( tile_source->frames[i] );
+		}
+	}
+
+	for( i = 1; i <= n_ahead; i++ ) {
+		int page = (tile_source->page + i) % n_pages;
+
+		if( !tile_source->frames[page] &&
+			!tile_source->frame_requested[page] ) {
+			TileSourceFrame *frame = 
+				tile_source_frame_new( tile_source, page );
+
+			tile_source->frame_requested[page] = TRUE;
+			g_thread_pool_push( tile_source_frame_pool, 
+				frame, NULL );
+		}
+	}
+}
+
+/* If we have a rendered frame for the current page, paint from that
+ * rather than from a new sink_screen. The display image is swapped for the 
+ * one the frame was made from, so the pixel probe and tile capture see this 
+ * page too. FALSE if there's no frame and the caller must rebuild the 
+ * display.
+ */
+static gboolean
+tile_source_frames_adopt( TileSource *tile_source )
+{
+	VipsImage *frame;
+	VipsImage *display;
+
+	if( !tile_source_frames_check( tile_source ) )
+		return( FALSE );
+
+	if( !(frame = tile_source->frames[tile_source->page]) ) {
+		tile_source->n_frame_misses += 1;
+		return( FALSE );
 	}
 
-	/* vipsdisp can struggle at more than 30fps.
+	/* Every pixel in a frame is valid, so the mask is just 255.
 	 */
-	timeout = VIPS_CLIP( 33, timeout, 100000 );
+	if( !tile_source->frame_mask ||
+		tile_source->frame_mask->Xsize != frame->Xsize ||
+		tile_source->frame_mask->Ysize != frame->Ysize ) {
+		VipsImage *x;
+
+		VIPS_UNREF( tile_source->frame_mask );
+		if( vips_black( &x, frame->Xsize, frame->Ysize, NULL ) )
+			return( FALSE );
+		if( vips_linear1( x, &tile_source->frame_mask, 1.0, 255.0,
+			"uchar", TRUE,
+			NULL ) ) {
+			VIPS_UNREF( x );
+			return( FALSE );
+		}
+		VIPS_UNREF( x );
+	}
 
-	tile_source->page_flip_id = 
-		g_timeout_add( timeout, tile_source_page_flip, tile_source );
+	if( !(display = tile_source_frame_display( tile_source->frame_base, 
+		tile_source->page, tile_source->frame_width )) )
+		return( FALSE );
 
-#ifdef DEBUG
-	printf(  "tile_source_page_flip: timeout %d ms\n", timeout ); 
-#endif /*DEBUG*/
+	VIPS_UNREF( tile_source->display );
+	VIPS_UNREF( tile_source->mask );
+	VIPS_UNREF( tile_source->rgb );
+	VIPS_UNREF( tile_source->rgb_region );
+	VIPS_UNREF( tile_source->mask_region );
+	VIPS_FREEF( vis_kernel_rgb_free, tile_source->remap );
+	tile_source->display = display;
+	tile_source->mask = tile_source->frame_mask;
+	g_object_ref( tile_source->mask );
+	tile_source->rgb = frame;
+	g_object_ref( frame );
+	tile_source->rgb_region = vips_region_new( tile_source->rgb );
+	tile_source->mask_region = vips_region_new( tile_source->mask );
+	tile_source->frame_shown = TRUE;
+
+	tile_source->n_frame_hits += 1;
+
+	return( TRUE );
+}
+
+/* The display time for a page, in microseconds.
+ */
+static gint64
+tile_source_get_delay( TileSource *tile_source, int page )
+{
+	int delay;
 
-	/* Only flip the page if everything has loaded.
+	/* By convention, GIFs default to 10fps.
 	 */
-	if( tile_source->rgb ) {
-		g_object_set( tile_source,
-			"page", (page + 1) % tile_source->n_pages,
-			NULL );
+	delay = 100;
+
+	if( tile_source->delay ) {
+		int i = VIPS_CLIP( 0, page, tile_source->n_delay - 1 );
+
+		/* By GIF convention, timeout 0 means unset.
+		 */
+		if( tile_source->delay[i] )
+			delay = tile_source->delay[i];
 	}
 
-	return( FALSE );
+	delay = VIPS_CLIP( 10, delay, 100000 );
+
+	return( (gint64) delay * 1000 );
 }
 
 static void
@@ -814,6 +2582,7 @@ tile_source_set_property( GObject *object,
 	int i;
 	double d;
 	gboolean b;
+	const char *str;
 
 #ifdef DEBUG
 {
@@ -833,25 +2602,18 @@ tile_source_set_property( GObject *object,
 			i < TILE_SOURCE_MODE_LAST &&
 			tile_source->mode != i ) {
 			tile_source->mode = i;
-			tile_source->display_width = tile_source->width;
-			tile_source->display_height = tile_source->height;
-			if( tile_source->mode == TILE_SOURCE_MODE_TOILET_ROLL )
-				tile_source->display_height *= 
-					tile_source->n_pages;
+			tile_source_set_display_size( tile_source );
+			if( tile_source->mode == 
+				TILE_SOURCE_MODE_PAGES_AS_BANDS )
+				tile_source_channels_init( tile_source );
 
 			tile_source_update_display( tile_source );
 
-			tile_source_changed( tile_source );
-
-			/* In animation mode, create the page flip timeout.
+			/* Animations restart timing from the next tick.
 			 */
-			if( tile_source->page_flip_id )
-				VIPS_FREEF( g_source_remove, 
-					tile_source->page_flip_id );
-			if( tile_source->mode == TILE_SOURCE_MODE_ANIMATED &&
-				tile_source->n_pages > 1 )
-				tile_source->page_flip_id = g_timeout_add( 100, 
-					tile_source_page_flip, tile_source );
+			tile_source->frame_due = 0;
+
+			tile_source_changed( tile_source );
 		}
 		break;
 
@@ -863,7 +2625,7 @@ tile_source_set_property( GObject *object,
 			tile_source->scale = d;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
 		}
 		break;
 
@@ -875,7 +2637,7 @@ tile_source_set_property( GObject *object,
 			tile_source->offset = d;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
 		}
 		break;
 
@@ -884,8 +2646,21 @@ tile_source_set_property( GObject *object,
 		if( i >= 0 &&
 			i <= 1000000 &&
 			tile_source->page != i ) {
+			int old_page = tile_source->page;
+
+			tile_source->page_direction = i > old_page ? 1 : -1;
 			tile_source->page = i;
-			tile_source_update_display( tile_source );
+
+			/* For animations, use a prerendered frame if we 
+			 * can, and start rendering the next few. In 
+			 * multipage mode, we might have a warm pipeline for 
+			 * the new page.
+			 */
+			if( !tile_source_frames_adopt( tile_source ) &&
+				!tile_source_warm_adopt( tile_source, old_page ) )
+				tile_source_update_display( tile_source );
+			tile_source_warm_queue( tile_source );
+			tile_source_frames_prefetch( tile_source );
 
 			/* If all pages have the same size, we can flip pages
 			 * without rebuilding the pyramid.
@@ -905,7 +2680,7 @@ tile_source_set_property( GObject *object,
 			tile_source->falsecolour = b;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
 		}
 		break;
 
@@ -915,7 +2690,7 @@ tile_source_set_property( GObject *object,
 			tile_source->log = b;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
 		}
 		break;
 
@@ -925,7 +2700,23 @@ tile_source_set_property( GObject *object,
 			tile_source->icc = b;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
+		}
+		break;
+
+	case PROP_DISPLAY_PROFILE:
+		str = g_value_get_string( value );
+		if( str && 
+			!str[0] )
+			str = NULL;
+		if( g_strcmp0( tile_source->display_profile, str ) ) { 
+			VIPS_FREE( tile_source->display_profile );
+			tile_source->display_profile = g_strdup( str );
+			if( tile_source->icc ) {
+				tile_source_update_rgb( tile_source );
+
+				tile_source_vis_changed( tile_source );
+			}
 		}
 		break;
 
@@ -935,17 +2726,30 @@ tile_source_set_property( GObject *object,
 			tile_source->active = b;
 			tile_source_update_rgb( tile_source );
 
-			tile_source_tiles_changed( tile_source );
+			tile_source_vis_changed( tile_source );
 		}
 		break;
 
 	case PROP_LOADED:
 		b = g_value_get_boolean( value );
 		if( tile_source->loaded != b ) { 
+			/* If we were showing a preview and the pixel format 
+			 * is the same, we can just swap in the new tiles and 
+			 * keep the view.
+			 */
+			int bands = tile_source->rgb ? 
+				tile_source->rgb->Bands : 0;
+
 			tile_source->loaded = b;
 			tile_source_update_display( tile_source );
 
-			tile_source_changed( tile_source );
+			if( b &&
+				tile_source->preview &&
+				tile_source->rgb &&
+				tile_source->rgb->Bands == bands )
+				tile_source_tiles_changed( tile_source );
+			else
+				tile_source_changed( tile_source );
 		}
 		break;
 
@@ -955,86 +2759,568 @@ tile_source_set_property( GObject *object,
 	}
 }
 
-static void
-tile_source_get_property( GObject *object, 
-	guint prop_id, GValue *value, GParamSpec *pspec )
+static void
+tile_source_get_property( GObject *object, 
+	guint prop_id, GValue *value, GParamSpec *pspec )
+{
+	TileSource *tile_source = (TileSource *) object;
+
+	switch( prop_id ) {
+	case PROP_MODE:
+		g_value_set_int( value, tile_source->mode );
+		break;
+
+	case PROP_SCALE:
+		g_value_set_double( value, tile_source->scale );
+		break;
+
+	case PROP_OFFSET:
+		g_value_set_double( value, tile_source->offset );
+		break;
+
+	case PROP_PAGE:
+		g_value_set_int( value, tile_source->page );
+		break;
+
+	case PROP_FALSECOLOUR:
+		g_value_set_boolean( value, tile_source->falsecolour );
+		break;
+
+	case PROP_LOG:
+		g_value_set_boolean( value, tile_source->log );
+		break;
+
+	case PROP_ICC:
+		g_value_set_boolean( value, tile_source->icc );
+		break;
+
+	case PROP_DISPLAY_PROFILE:
+		g_value_set_string( value, tile_source->display_profile );
+		break;
+
+	case PROP_ACTIVE:
+		g_value_set_boolean( value, tile_source->active );
+		break;
+
+	case PROP_LOADED:
+		g_value_set_boolean( value, tile_source->loaded );
+		break;
+
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID( object, prop_id, pspec );
+		break;
+	}
+
+#ifdef DEBUG
+{
+	char *str;
+
+	str = g_strdup_value_contents( value );
+	printf( "tile_source_get_property: %s %s\n", 
+		tile_source_property_name( prop_id ), str ); 
+	g_free( str );
+}
+#endif /*DEBUG*/
+}
+
+static void
+tile_source_init( TileSource *tile_source )
+{
+	tile_source->scale = 1.0;
+	tile_source->zoom = 1.0;
+
+	tile_source->priority = TILE_SOURCE_PRIORITY_VISIBLE;
+
+	tile_source->load_timer = g_timer_new();
+	tile_source->preview_time = -1.0;
+	tile_source->first_pixel_time = -1.0;
+	tile_source->loaded_time = -1.0;
+}
+
+static void
+tile_source_force_load( TileSource *tile_source )
+{
+	if( tile_source->image_region &&
+		!tile_source->loaded ) { 
+		VipsRect rect;
+
+		rect.left = 0;
+		rect.top = 0;
+		rect.width = 1;
+		rect.height = 1;
+		(void) vips_region_prepare( tile_source->image_region, &rect );
+	}
+}
+
+/* Where we keep the pyramid for this file. NULL if the file can't be
+ * identified.
+ */
+static char *
+tile_source_pyramid_path( TileSource *tile_source )
+{
+	char *file_key;
+	char *name;
+	char *path;
+
+	if( !(file_key = disk_cache_file_key( tile_source->filename )) )
+		return( NULL );
+	name = g_compute_checksum_for_string( G_CHECKSUM_SHA1, file_key, -1 );
+	path = g_strdup_printf( "%s" G_DIR_SEPARATOR_S 
+		"pyramids" G_DIR_SEPARATOR_S "%s.tif",
+		disk_cache_get_root(), name );
+	g_free( name );
+	g_free( file_key );
+
+	return( path );
+}
+
+/* Switch to the levels in a built pyramid.
+ */
+static int
+tile_source_use_pyramid( TileSource *tile_source, const char *path )
+{
+	VipsImage *image;
+	int n_subifds;
+	int level;
+
+	/* Mark it as in use before we open it, so a trim in another thread 
+	 * can't remove it under us.
+	 */
+	tile_source_pyramid_acquire( path );
+
+	if( !(image = vips_image_new_from_file( path, NULL )) ) {
+		tile_source_pyramid_release( path );
+		return( -1 );
+	}
+	n_subifds = vips_image_get_n_subifds( image );
+	VIPS_UNREF( image );
+
+	tile_source->level_width[0] = tile_source->width;
+	tile_source->level_height[0] = tile_source->height;
+	for( level = 1; level < VIPS_MIN( MAX_LEVELS, n_subifds + 2 ); 
+		level++ ) {
+		if( !(image = vips_image_new_from_file( path, 
+			"subifd", level - 2,
+			NULL )) ) {
+			tile_source_pyramid_release( path );
+			return( -1 );
+		}
+		tile_source->level_width[level] = image->Xsize;
+		tile_source->level_height[level] = image->Ysize;
+		VIPS_UNREF( image );
+	}
+
+	tile_source->pyramid_filename = g_strdup( path );
+	tile_source->level_count = level;
+
+	/* Touch, so this pyramid is the last to be removed.
+	 */
+	(void) g_utime( path, NULL );
+
+	return( 0 );
+}
+
+typedef struct _TileSourcePyramid {
+	GWeakRef tile_source;
+	VipsImage *image;
+	char *path;
+	gint64 max_bytes;
+	gboolean ok;
+	GTimer *timer;
+} TileSourcePyramid;
+
+/* A file in the pyramid cache.
+ */
+typedef struct _TileSourcePyramidFile {
+	char *path;
+	time_t mtime;
+	gint64 size;
+} TileSourcePyramidFile;
+
+static void
+tile_source_pyramid_file_clear( void *data )
+{
+	TileSourcePyramidFile *file = (TileSourcePyramidFile *) data;
+
+	VIPS_FREE( file->path );
+}
+
+static int
+tile_source_sort_mtime( const void *a, const void *b )
+{
+	TileSourcePyramidFile *f1 = (TileSourcePyramidFile *) a;
+	TileSourcePyramidFile *f2 = (TileSourcePyramidFile *) b;
+
+	return( f1->mtime < f2->mtime ? 
+		-1 : f1->mtime > f2->mtime ? 1 : 0 );
+}
+
+/* Remove the least recently used pyramids until we're under budget. Using a
+ * pyramid touches it. The newest is always kept, so we can switch to it,
+ * and so are any which are open in a window.
+ */
+static void
+tile_source_trim_pyramids( const char *dirname, gint64 max_bytes )
+{
+	GDir *dir;
+	const char *name;
+	GArray *files;
+	gint64 total;
+	int i;
+
+	if( !(dir = g_dir_open( dirname, 0, NULL )) )
+		return;
+
+	files = g_array_new( FALSE, FALSE, sizeof( TileSourcePyramidFile ) );
+	g_array_set_clear_func( files, tile_source_pyramid_file_clear );
+	total = 0;
+	while( (name = g_dir_read_name( dir )) ) 
+		if( g_str_has_suffix( name, ".tif" ) ) {
+			TileSourcePyramidFile file;
+			GStatBuf st;
+
+			/* Build the path as tile_source_pyramid_path() 
+			 * does, so we can look it up in the open set.
+			 */
+			file.path = g_strdup_printf( "%s" G_DIR_SEPARATOR_S "%s",
+				dirname, name );
+			if( !g_stat( file.path, &st ) ) {
+				file.mtime = st.st_mtime;
+				file.size = st.st_size;
+				g_array_append_val( files, file );
+				total += file.size;
+			}
+			else
+				g_free( file.path );
+		}
+	g_dir_close( dir );
+
+	g_array_sort( files, tile_source_sort_mtime );
+
+	g_mutex_lock( &tile_source_pyramids_lock );
+	for( i = 0; i < (int) files->len - 1 && total > max_bytes; i++ ) {
+		TileSourcePyramidFile *file = 
+			&g_array_index( files, TileSourcePyramidFile, i );
+
+		if( tile_source_pyramids_open &&
+			g_hash_table_contains( tile_source_pyramids_open, 
+				file->path ) )
+			continue;
+
+		if( !g_unlink( file->path ) )
+			total -= file->size;
+	}
+	g_mutex_unlock( &tile_source_pyramids_lock );
+
+	g_array_free( files, TRUE );
+}
+
+static void
+tile_source_pyramid_free( TileSourcePyramid *pyramid )
+{
+	g_weak_ref_clear( &pyramid->tile_source );
+	VIPS_UNREF( pyramid->image );
+	VIPS_FREE( pyramid->path );
+	VIPS_FREEF( g_timer_destroy, pyramid->timer );
+	g_free( pyramid );
+}
+
+/* Back in the main thread, switch to the new pyramid, if our tile_source
+ * is still alive.
+ */
+static gboolean
+tile_source_pyramid_done_idle( void *user_data )
+{
+	TileSourcePyramid *pyramid = (TileSourcePyramid *) user_data;
+
+	TileSource *tile_source;
+
+	if( (tile_source = g_weak_ref_get( &pyramid->tile_source )) ) {
+		VIPS_UNREF( tile_source->pyramid_build );
+		tile_source->pyramid_build_time = 
+			g_timer_elapsed( pyramid->timer, NULL );
+
+#ifdef DEBUG
+		printf( "tile_source_pyramid_done_idle: %s in %gs\n", 
+			pyramid->ok ? "built" : "failed",
+			tile_source->pyramid_build_time );
+#endif /*DEBUG*/
+
+		if( pyramid->ok &&
+			!tile_source_use_pyramid( tile_source, 
+				pyramid->path ) ) {
+			tile_source_update_display( tile_source );
+			tile_source_tiles_changed( tile_source );
+		}
+
+		g_object_unref( tile_source );
+	}
+
+	tile_source_pyramid_free( pyramid );
+
+	return( FALSE );
+}
+
+/* Run by the pyramid threadpool. Write to a temp file and rename, so we
+ * never see a partial pyramid.
+ */
+static void
+tile_source_pyramid_worker( void *data, void *user_data )
+{
+	TileSourcePyramid *pyramid = (TileSourcePyramid *) data;
+	char *dirname = g_path_get_dirname( pyramid->path );
+	char *temp = g_strdup_printf( "%s.partial", pyramid->path );
+
+	if( !g_mkdir_with_parents( dirname, 0700 ) &&
+		!vips_tiffsave( pyramid->image, temp,
+			"tile", TRUE,
+			"tile_width", TILE_SIZE,
+			"tile_height", TILE_SIZE,
+			"pyramid", TRUE,
+			"subifd", TRUE,
+			"bigtiff", TRUE,
+			"compression", VIPS_FOREIGN_TIFF_COMPRESSION_DEFLATE,
+			NULL ) &&
+		!g_rename( temp, pyramid->path ) ) {
+		pyramid->ok = TRUE;
+		tile_source_trim_pyramids( dirname, pyramid->max_bytes );
+	}
+	else {
+		(void) g_unlink( temp );
+		vips_error_clear();
+	}
+
+	g_free( temp );
+	g_free( dirname );
+
+	g_idle_add( tile_source_pyramid_done_idle, pyramid );
+}
+
+void
+tile_source_set_pyramids_enabled( gboolean enabled )
+{
+	tile_source_pyramids_enabled = enabled;
+}
+
+void
+tile_source_set_pyramids_max_bytes( gint64 max_bytes )
+{
+	tile_source_pyramids_max_bytes = max_bytes;
+}
+
+/* Large flat images are very slow to view zoomed out, since we must
+ * subsample the whole thing. Build a pyramid in the background and switch to
+ * it when it's done. We reuse pyramids from previous sessions. Only if the
+ * pyramid cache is enabled.
+ */
+static void
+tile_source_build_pyramid( TileSource *tile_source )
+{
+	char *path;
+	VipsImage *x;
+	TileSourcePyramid *pyramid;
+
+	if( !tile_source_pyramids_enabled ||
+		!tile_source->filename ||
+		!tile_source->image ||
+		tile_source->level_count ||
+		tile_source->n_pages != 1 ||
+		tile_source->pyramid_build ||
+		tile_source->pyramid_filename ||
+		tile_source->image->Coding != VIPS_CODING_NONE ||
+		vips_band_format_iscomplex( tile_source->image->BandFmt ) ||
+		(double) tile_source->width * tile_source->height < 
+			PYRAMID_MIN_PIXELS ||
+		!(path = tile_source_pyramid_path( tile_source )) )
+		return;
+
+	if( g_file_test( path, G_FILE_TEST_EXISTS ) ) {
+		if( !tile_source_use_pyramid( tile_source, path ) ) {
+			tile_source_update_display( tile_source );
+			tile_source_tiles_changed( tile_source );
+			g_free( path );
+			return;
+		}
+
+		/* Damaged, perhaps ... rebuild.
+		 */
+		vips_error_clear();
+		(void) g_unlink( path );
+	}
+
+	/* Level 0 is always the original image, so the pyramid starts at
+	 * level 1. The loaded image is either decoded to memory or 
+	 * random-access, so this is reasonably quick.
+	 */
+	if( vips_shrink( tile_source->image, &x, 2, 2, NULL ) ) {
+		vips_error_clear();
+		g_free( path );
+		return;
+	}
+
+	pyramid = g_new0( TileSourcePyramid, 1 );
+	g_weak_ref_init( &pyramid->tile_source, tile_source );
+	pyramid->image = x;
+	pyramid->path = path;
+	pyramid->max_bytes = tile_source_pyramids_max_bytes;
+	pyramid->timer = g_timer_new();
+
+	/* Keep a ref so dispose can kill the build.
+	 */
+	tile_source->pyramid_build = x;
+	g_object_ref( x );
+
+	g_thread_pool_push( tile_source_pyramid_pool, pyramid, NULL );
+}
+
+/* Decode an embedded thumbnail, if there is one.
+ */
+static VipsImage *
+tile_source_thumbnail( TileSource *tile_source )
+{
+	VipsImage *image;
+	const void *data;
+	size_t length;
+
+	image = NULL;
+	if( vips_isprefix( "openslide", tile_source->loader ) ) 
+		image = vips_image_new_from_file( tile_source->filename,
+			"associated", "thumbnail",
+			NULL );
+	else if( vips_isprefix( "heif", tile_source->loader ) ) 
+		image = vips_image_new_from_file( tile_source->filename,
+			"thumbnail", TRUE,
+			NULL );
+	else if( tile_source->base &&
+		vips_image_get_typeof( tile_source->base, 
+			"jpeg-thumbnail-data" ) &&
+		!vips_image_get_blob( tile_source->base, "jpeg-thumbnail-data",
+			&data, &length ) ) 
+		/* The EXIF thumbnail.
+		 */
+		image = vips_image_new_from_buffer( data, length, "", NULL );
+
+	return( image );
+}
+
+/* Make a small preview image, in memory. This runs in the bg load thread. 
+ * Use an embedded thumbnail if we can, or failing that the smallest level 
+ * of the pyramid, which might be from shrink-on-load.
+ */
+static VipsImage *
+tile_source_make_preview( TileSource *tile_source )
 {
-	TileSource *tile_source = (TileSource *) object;
+	VipsImage *image;
+	VipsImage *x;
 
-	switch( prop_id ) {
-	case PROP_MODE:
-		g_value_set_int( value, tile_source->mode );
-		break;
+	/* Only for simple single-page images, and only when the load
+	 * might take a while.
+	 */
+	if( !tile_source->filename ||
+		tile_source->n_pages != 1 ||
+		tile_source->mode != TILE_SOURCE_MODE_MULTIPAGE )
+		return( NULL );
 
-	case PROP_SCALE:
-		g_value_set_double( value, tile_source->scale );
-		break;
+	vips_error_freeze();
 
-	case PROP_OFFSET:
-		g_value_set_double( value, tile_source->offset );
-		break;
+	if( !(image = tile_source_thumbnail( tile_source )) &&
+		tile_source->level_count > 1 )
+		image = tile_source_open( tile_source, 
+			tile_source->level_count - 1 );
 
-	case PROP_PAGE:
-		g_value_set_int( value, tile_source->page );
-		break;
+	/* Thumbnails must have the same aspect ratio as the image, or 
+	 * they are probably for something else.
+	 */
+	if( image &&
+		fabs( (double) image->Xsize / image->Ysize - 
+			(double) tile_source->width / tile_source->height ) > 
+			0.05 ) 
+		VIPS_UNREF( image );
 
-	case PROP_FALSECOLOUR:
-		g_value_set_boolean( value, tile_source->falsecolour );
-		break;
+	if( image ) {
+		x = vips_image_copy_memory( image );
+		VIPS_UNREF( image );
+		image = x;
+	}
 
-	case PROP_LOG:
-		g_value_set_boolean( value, tile_source->log );
-		break;
+	vips_error_thaw();
 
-	case PROP_ICC:
-		g_value_set_boolean( value, tile_source->icc );
-		break;
+	return( image );
+}
 
-	case PROP_ACTIVE:
-		g_value_set_boolean( value, tile_source->active );
-		break;
+typedef struct _TileSourcePreview {
+	TileSource *tile_source;
+	VipsImage *image;
+} TileSourcePreview;
 
-	case PROP_LOADED:
-		g_value_set_boolean( value, tile_source->loaded );
-		break;
+/* The preview is ready. Show it, unless the full load beat us to it.
+ *
+ * We don't need to ref tile_source, the ref for the background load 
+ * is still held.
+ */
+static gboolean
+tile_source_preview_idle( void *user_data )
+{
+	TileSourcePreview *preview = (TileSourcePreview *) user_data;
+	TileSource *tile_source = preview->tile_source;
 
-	default:
-		G_OBJECT_WARN_INVALID_PROPERTY_ID( object, prop_id, pspec );
-		break;
-	}
+	if( !tile_source->loaded ) {
+		VIPS_UNREF( tile_source->preview );
+		tile_source->preview = preview->image;
+		preview->image = NULL;
+		tile_source->preview_time = 
+			g_timer_elapsed( tile_source->load_timer, NULL );
 
 #ifdef DEBUG
-{
-	char *str;
-
-	str = g_strdup_value_contents( value );
-	printf( "tile_source_get_property: %s %s\n", 
-		tile_source_property_name( prop_id ), str ); 
-	g_free( str );
-}
+		printf( "tile_source_preview_idle: %d x %d preview "
+			"after %gs\n", 
+			tile_source->preview->Xsize, 
+			tile_source->preview->Ysize,
+			tile_source->preview_time );
 #endif /*DEBUG*/
+
+		if( !tile_source_update_display( tile_source ) )
+			tile_source_changed( tile_source );
+	}
+
+	VIPS_UNREF( preview->image );
+	g_free( preview );
+
+	return( FALSE );
 }
 
+/* Update the load stats.
+ */
 static void
-tile_source_init( TileSource *tile_source )
+tile_source_load_finished( TileSource *tile_source, double start )
 {
-	tile_source->scale = 1.0;
-	tile_source->zoom = 1.0;
+	double now = g_timer_elapsed( tile_source->load_timer, NULL );
+
+	g_mutex_lock( &tile_source_load_lock );
+	tile_source_loads_running -= 1;
+	if( tile_source->load_cancelled )
+		tile_source_loads_cancelled += 1;
+	else {
+		tile_source_loads_done += 1;
+		tile_source_load_run_time += now - start;
+	}
+	g_mutex_unlock( &tile_source_load_lock );
 }
 
-static void
-tile_source_force_load( TileSource *tile_source )
+/* Order the load queue: highest priority first, then oldest first. 
+ */
+static gint
+tile_source_background_load_sort( gconstpointer a, gconstpointer b, 
+	gpointer user_data )
 {
-	if( tile_source->image_region &&
-		!tile_source->loaded ) { 
-		VipsRect rect;
+	TileSource *t1 = (TileSource *) a;
+	TileSource *t2 = (TileSource *) b;
 
-		rect.left = 0;
-		rect.top = 0;
-		rect.width = 1;
-		rect.height = 1;
-		(void) vips_region_prepare( tile_source->image_region, &rect );
-	}
+	if( t1->load_priority != t2->load_priority )
+		return( t2->load_priority - t1->load_priority );
+
+	return( t1->load_serial < t2->load_serial ? -1 : 
+		t1->load_serial > t2->load_serial ? 1 : 0 );
 }
 
 /* This runs in the main thread when the bg load is done. We can't use
@@ -1050,9 +3336,24 @@ tile_source_background_load_done_idle( void *user_data )
 	printf( "tile_source_background_load_done_cb:\n" );
 #endif /*DEBUG*/
 
-	/* You can now fetch pixels.
+	/* Cancelled loads have no pixels, and no one is waiting for them.
 	 */
-	g_object_set( tile_source, "loaded", TRUE, NULL );
+	if( !tile_source->load_cancelled ) {
+		/* You can now fetch pixels.
+		 */
+		tile_source->loaded_time = 
+			g_timer_elapsed( tile_source->load_timer, NULL );
+		g_object_set( tile_source, "loaded", TRUE, NULL );
+
+		/* The display no longer uses the preview.
+		 */
+		VIPS_UNREF( tile_source->preview );
+
+		/* If this is a large image with no pyramid, start building 
+		 * one.
+		 */
+		tile_source_build_pyramid( tile_source );
+	}
 
 	/* Drop the ref that kept this tile_source alive during load.
 	 */
@@ -1068,14 +3369,42 @@ tile_source_background_load_worker( void *data, void *user_data )
 {
 	TileSource *tile_source = (TileSource *) data;
 
+	VipsImage *image;
+	double start;
+
 #ifdef DEBUG
 	printf( "tile_source_background_load_worker: starting ..\n" );
 #endif /*DEBUG*/
 
 	g_assert( tile_source->image_region ); 
 
+	start = g_timer_elapsed( tile_source->load_timer, NULL );
+	g_mutex_lock( &tile_source_load_lock );
+	tile_source_loads_running += 1;
+	tile_source_load_wait_time += start - tile_source->load_queue_time;
+	g_mutex_unlock( &tile_source_load_lock );
+
+	/* The window might have gone while we were in the queue.
+	 */
+	if( tile_source->load_cancelled ) {
+		g_idle_add( tile_source_background_load_done_idle, tile_source );
+		tile_source_load_finished( tile_source, start );
+		return;
+	}
+
+	/* Try to make something to look at while we load.
+	 */
+	if( (image = tile_source_make_preview( tile_source )) ) {
+		TileSourcePreview *preview = g_new0( TileSourcePreview, 1 );
+
+		preview->tile_source = tile_source;
+		preview->image = image;
+		g_idle_add( tile_source_preview_idle, preview );
+	}
+
 	tile_source_force_load( tile_source );
 
+	tile_source_load_finished( tile_source, start );
 	g_idle_add( tile_source_background_load_done_idle, tile_source );
 
 #ifdef DEBUG
@@ -1142,6 +3471,13 @@ tile_source_class_init( TileSourceClass *class )
 			FALSE,
 			G_PARAM_READWRITE ) );
 
+	g_object_class_install_property( gobject_class, PROP_DISPLAY_PROFILE,
+		g_param_spec_string( "display-profile",
+			_( "Display profile" ),
+			_( "Colour manage to this profile, or NULL for sRGB" ),
+			NULL,
+			G_PARAM_READWRITE ) );
+
 	g_object_class_install_property( gobject_class, PROP_ACTIVE,
 		g_param_spec_boolean( "active",
 			_( "Active" ),
@@ -1199,6 +3535,14 @@ tile_source_class_init( TileSourceClass *class )
 		g_cclosure_marshal_VOID__VOID,
 		G_TYPE_NONE, 0 ); 
 
+	tile_source_signals[SIG_VIS_CHANGED] = g_signal_new( "vis-changed",
+		G_TYPE_FROM_CLASS( class ),
+		G_SIGNAL_RUN_LAST,
+		G_STRUCT_OFFSET( TileSourceClass, vis_changed ), 
+		NULL, NULL,
+		g_cclosure_marshal_VOID__VOID,
+		G_TYPE_NONE, 0 ); 
+
 	tile_source_signals[SIG_AREA_CHANGED] = g_signal_new( "area-changed",
 		G_TYPE_FROM_CLASS( class ),
 		G_SIGNAL_RUN_LAST,
@@ -1220,7 +3564,19 @@ tile_source_class_init( TileSourceClass *class )
 	g_assert( !tile_source_background_load_pool );
 	tile_source_background_load_pool = g_thread_pool_new(
 		tile_source_background_load_worker,
-		NULL, -1, FALSE, NULL );
+		NULL, MAX_BACKGROUND_LOADS, FALSE, NULL );
+	g_thread_pool_set_sort_function( tile_source_background_load_pool,
+		tile_source_background_load_sort, NULL );
+
+	g_assert( !tile_source_frame_pool );
+	tile_source_frame_pool = g_thread_pool_new(
+		tile_source_frame_worker,
+		NULL, 2, FALSE, NULL );
+
+	g_assert( !tile_source_pyramid_pool );
+	tile_source_pyramid_pool = g_thread_pool_new(
+		tile_source_pyramid_worker,
+		NULL, 1, FALSE, NULL );
 
 }
 
@@ -1252,6 +3608,8 @@ mode_name( TileSourceMode mode )
 		return( "animated" );
 	case TILE_SOURCE_MODE_PAGES_AS_BANDS:
 		return( "pages-as-bands" );
+	case TILE_SOURCE_MODE_GRID:
+		return( "grid" );
 	default:
 		return( "<unknown>" );
 	}
@@ -1270,6 +3628,7 @@ tile_source_print( TileSource *tile_source )
 	printf( "\tn_subifds = %d\n", tile_source->n_subifds );
 	printf( "\tsubifd_pyramid = %d\n", tile_source->subifd_pyramid );
 	printf( "\tpage_pyramid = %d\n", tile_source->page_pyramid );
+	printf( "\tshrink_pyramid = %d\n", tile_source->shrink_pyramid );
 	printf( "\tlevel_count = %d\n", tile_source->level_count );
 
 	for( i = 0; i < tile_source->level_count; i++ )
@@ -1280,6 +3639,7 @@ tile_source_print( TileSource *tile_source )
 
 	printf( "\tpages_same_size = %d\n", tile_source->pages_same_size );
 	printf( "\tall_mono = %d\n", tile_source->all_mono );
+	printf( "\tvirtual_roll = %d\n", tile_source->virtual_roll );
 	printf( "\ttype = %s\n", type_name( tile_source->type ) );
 	printf( "\tmode = %s\n", mode_name( tile_source->mode ) );
 	printf( "\tdelay = %p\n", tile_source->delay );
@@ -1358,58 +3718,170 @@ tile_source_new_from_image( VipsImage *image )
 	return( tile_source );
 }
 
-/* Detect a TIFF pyramid made of subifds following a roughly /2 shrink.
+/* Record the time for a phase of sniffing.
  */
 static void
-tile_source_get_pyramid_subifd( TileSource *tile_source )
+tile_source_sniff_phase( TileSource *tile_source, double *phase, double *start )
+{
+	double now = g_timer_elapsed( tile_source->load_timer, NULL );
+
+	*phase = now - *start;
+	*start = now;
+}
+
+typedef struct _TileSourceProbe {
+	TileSource *tile_source;
+	int level;
+	int width;
+	int height;
+} TileSourceProbe;
+
+static void
+tile_source_probe_worker( void *data, void *user_data )
+{
+	TileSourceProbe *probe = (TileSourceProbe *) data;
+
+	VipsImage *image;
+
+	if( (image = tile_source_open( probe->tile_source, probe->level )) ) {
+		probe->width = image->Xsize;
+		probe->height = image->Ysize;
+		VIPS_UNREF( image );
+	}
+}
+
+/* Open levels 0 to n - 1 in parallel and get their sizes. Failed opens
+ * give -1. Header parsing is mostly waiting for IO, so this is a lot quicker
+ * than opening them one by one.
+ */
+static void
+tile_source_probe_levels( TileSource *tile_source, 
+	int n, int *width, int *height )
+{
+	TileSourceProbe *probe;
+	GThreadPool *pool;
+	int i;
+
+	probe = VIPS_ARRAY( NULL, n, TileSourceProbe );
+	pool = g_thread_pool_new( tile_source_probe_worker, 
+		NULL, VIPS_MIN( n, 8 ), FALSE, NULL );
+
+	vips_error_freeze();
+	for( i = 0; i < n; i++ ) {
+		probe[i].tile_source = tile_source;
+		probe[i].level = i;
+		probe[i].width = -1;
+		probe[i].height = -1;
+		g_thread_pool_push( pool, &probe[i], NULL );
+	}
+
+	/* Wait for all jobs to finish.
+	 */
+	g_thread_pool_free( pool, FALSE, TRUE );
+	vips_error_thaw();
+
+	for( i = 0; i < n; i++ ) {
+		width[i] = probe[i].width;
+		height[i] = probe[i].height;
+	}
+
+	g_free( probe );
+}
+
+/* Make a fake pyramid from shrink-on-load. Only opens headers, so it's quick.
+ */
+static void
+tile_source_get_pyramid_shrink( TileSource *tile_source )
 {
+	int width[MAX_LEVELS];
+	int height[MAX_LEVELS];
+	int max_levels;
+	int n;
 	int i;
 
 #ifdef DEBUG
-	printf( "tile_source_get_pyramid_subifd:\n" );
+	printf( "tile_source_get_pyramid_shrink:\n" );
 #endif /*DEBUG*/
 
-	for( i = 0; i < tile_source->n_subifds; i++ ) {
-		VipsImage *level;
-		int level_width;
-		int level_height;
-		int expected_level_width;
-		int expected_level_height;
+	/* libjpeg can only shrink by up to 8.
+	 */
+	if( vips_isprefix( "jpeg", tile_source->loader ) )
+		max_levels = 4;
+	else if( vips_isprefix( "webp", tile_source->loader ) )
+		max_levels = MAX_LEVELS;
+	else
+		return;
 
-		/* Just bail out if there are too many levels.
-		 */
-		if( i >= MAX_LEVELS )
+	/* No point going much smaller than a tile.
+	 */
+	for( n = 1; n < max_levels; n++ )
+		if( tile_source->width >> (n - 1) < TILE_SIZE &&
+			tile_source->height >> (n - 1) < TILE_SIZE )
 			break;
 
-		if( !(level = tile_source_open( tile_source, i )) )
-			return;
-		level_width = level->Xsize;
-		level_height = level->Ysize;
-		VIPS_UNREF( level );
+	tile_source->shrink_pyramid = TRUE;
+	tile_source_probe_levels( tile_source, n, width, height );
+
+	for( i = 0; i < n; i++ ) {
+		if( width[i] < 0 )
+			break;
+		tile_source->level_width[i] = width[i];
+		tile_source->level_height[i] = height[i];
+	}
+
+	/* Only worth it if we have at least one reduced level.
+	 */
+	if( i > 1 ) 
+		tile_source->level_count = i;
+	else
+		tile_source->shrink_pyramid = FALSE;
+}
+
+/* Detect a TIFF pyramid made of subifds following a roughly /2 shrink.
+ */
+static void
+tile_source_get_pyramid_subifd( TileSource *tile_source )
+{
+	int width[MAX_LEVELS];
+	int height[MAX_LEVELS];
+	int n;
+	int i;
+
+#ifdef DEBUG
+	printf( "tile_source_get_pyramid_subifd:\n" );
+#endif /*DEBUG*/
+
+	/* Just bail out if there are too many levels.
+	 */
+	n = VIPS_MIN( tile_source->n_subifds, MAX_LEVELS );
+	if( n <= 0 )
+		return;
+	tile_source_probe_levels( tile_source, n, width, height );
 
-		expected_level_width = tile_source->width / (1 << i);
-		expected_level_height = tile_source->height / (1 << i);
+	for( i = 0; i < n; i++ ) {
+		int expected_level_width = tile_source->width / (1 << i);
+		int expected_level_height = tile_source->height / (1 << i);
 
 		/* This won't be exact due to rounding etc.
 		 */
-		if( abs( level_width - expected_level_width ) > 5 ||
-			level_width < 2 ||
-			abs( level_height - expected_level_height ) > 5 ||
-			level_height < 2 ) {
+		if( abs( width[i] - expected_level_width ) > 5 ||
+			width[i] < 2 ||
+			abs( height[i] - expected_level_height ) > 5 ||
+			height[i] < 2 ) {
 #ifdef DEBUG
 			printf( "  bad subifd level %d\n", i );
 #endif /*DEBUG*/
 			return;
 		}
 
-		tile_source->level_width[i] = level_width;
-		tile_source->level_height[i] = level_height;
+		tile_source->level_width[i] = width[i];
+		tile_source->level_height[i] = height[i];
 	}
 
 	/* Tag as a subifd pyramid.
 	 */
 	tile_source->subifd_pyramid = TRUE;
-	tile_source->level_count = tile_source->n_subifds;
+	tile_source->level_count = n;
 }
 
 /* Detect a pyramid made of pages following a roughly /2 shrink. Can be eg.
@@ -1418,6 +3890,9 @@ tile_source_get_pyramid_subifd( TileSource *tile_source )
 static void
 tile_source_get_pyramid_page( TileSource *tile_source )
 {
+	int width[MAX_LEVELS];
+	int height[MAX_LEVELS];
+	int n;
 	int i;
 
 #ifdef DEBUG
@@ -1429,52 +3904,37 @@ tile_source_get_pyramid_page( TileSource *tile_source )
 	if( tile_source->n_pages < 2 )
 		return;
 
-	for( i = 0; i < tile_source->n_pages; i++ ) {
-		VipsImage *level;
-		int level_width;
-		int level_height;
-		int expected_level_width;
-		int expected_level_height;
-
-		/* Stop checking if there are too many levels.
-		 */
-		if( i >= MAX_LEVELS )
+	/* Stop checking if there are too many levels, or once we've found 
+	 * enough levels and the levels have become very small.
+	 */
+	for( n = 0; n < VIPS_MIN( tile_source->n_pages, MAX_LEVELS ); n++ )
+		if( n > 2 && 
+			(tile_source->width / (1 << n) < 32 ||
+			 tile_source->height / (1 << n) < 32) )
 			break;
+	tile_source_probe_levels( tile_source, n, width, height );
 
-		if( !(level = tile_source_open( tile_source, i )) )
-			return;
-		level_width = level->Xsize;
-		level_height = level->Ysize;
-		VIPS_UNREF( level );
-
-		expected_level_width = tile_source->width / (1 << i);
-		expected_level_height = tile_source->height / (1 << i);
-
-		/* We've found enough levels, and the levels have become very
-		 * small.
-		 */
-		if( i > 2 && 
-			(expected_level_width < 32 ||
-			 expected_level_height < 32) )
-			break;
+	for( i = 0; i < n; i++ ) {
+		int expected_level_width = tile_source->width / (1 << i);
+		int expected_level_height = tile_source->height / (1 << i);
 
 		/* This won't be exact due to rounding etc.
 		 */
-		if( abs( level_width - expected_level_width ) > 5 ||
-			level_width < 2 )
+		if( abs( width[i] - expected_level_width ) > 5 ||
+			width[i] < 2 )
 			return;
-		if( abs( level_height - expected_level_height ) > 5 ||
-			level_height < 2 )
+		if( abs( height[i] - expected_level_height ) > 5 ||
+			height[i] < 2 )
 			return;
 
-		tile_source->level_width[i] = level_width;
-		tile_source->level_height[i] = level_height;
+		tile_source->level_width[i] = width[i];
+		tile_source->level_height[i] = height[i];
 	}
 
 	/* Tag as a page pyramid.
 	 */
 	tile_source->page_pyramid = TRUE;
-	tile_source->level_count = i;
+	tile_source->level_count = n;
 }
 
 static void
@@ -1501,78 +3961,362 @@ tile_source_posteval( VipsImage *image,
 		tile_source_signals[SIG_POSTEVAL], 0, progress );
 }
 
-static void
-tile_source_attach_progress( TileSource *tile_source )
+static void
+tile_source_attach_progress( TileSource *tile_source )
+{
+#ifdef DEBUG
+	printf( "tile_source_attach_progress:\n" ); 
+#endif /*DEBUG*/
+
+	vips_image_set_progress( tile_source->image, TRUE ); 
+	g_signal_connect_object( tile_source->image, "preeval", 
+		G_CALLBACK( tile_source_preeval ), tile_source, 0 );
+	g_signal_connect_object( tile_source->image, "eval",
+		G_CALLBACK( tile_source_eval ), tile_source, 0 );
+	g_signal_connect_object( tile_source->image, "posteval",
+		G_CALLBACK( tile_source_posteval ), tile_source, 0 );
+}
+
+/* Fetch a string-encoded int image header field, eg. from openslide. These
+ * are all represented as strings. Return the default value if there's any
+ * problem.
+ */
+static int
+get_int( VipsImage *image, const char *field, int default_value )
+{
+	const char *str;
+
+	if( vips_image_get_typeof( image, field ) &&
+		!vips_image_get_string( image, field, &str ) )
+		return( atoi( str ) );
+
+	return( default_value );
+}
+
+/* Remember sniff results in this file in the cache directory.
+ */
+#define SNIFF_CACHE_FILENAME "sniff.ini"
+
+/* Bump this if the meaning of sniff results changes.
+ */
+#define SNIFF_CACHE_VERSION (2)
+
+/* Keep the cache file small.
+ */
+#define MAX_SNIFF_CACHE_ENTRIES (1000)
+
+/* Hits only update the last use time, so we write them back in one go this
+ * many seconds later.
+ */
+#define SNIFF_CACHE_FLUSH_DELAY (5)
+
+/* Files can be opened from several threads. dirty is set when there are
+ * changes which have not been written back yet, and flush_id is the timeout
+ * which will write them.
+ */
+static GMutex tile_source_sniff_cache_lock;
+static GKeyFile *tile_source_sniff_cache = NULL;
+static gboolean tile_source_sniff_cache_dirty = FALSE;
+static guint tile_source_sniff_cache_flush_id = 0;
+
+/* Call with the lock held.
+ */
+static GKeyFile *
+tile_source_sniff_cache_load( void )
+{
+	if( !tile_source_sniff_cache ) {
+		char *path = g_build_filename( disk_cache_get_root(), 
+			SNIFF_CACHE_FILENAME, NULL );
+
+		tile_source_sniff_cache = g_key_file_new();
+		(void) g_key_file_load_from_file( tile_source_sniff_cache,
+			path, G_KEY_FILE_NONE, NULL );
+		g_free( path );
+	}
+
+	return( tile_source_sniff_cache );
+}
+
+/* The group we use for this file, or NULL if we can't identify it.
+ */
+static char *
+tile_source_sniff_cache_group( TileSource *tile_source )
+{
+	char *file_key;
+	char *group;
+
+	if( !tile_source->filename ||
+		!(file_key = disk_cache_file_key( tile_source->filename )) )
+		return( NULL );
+	group = g_compute_checksum_for_string( G_CHECKSUM_SHA1, file_key, -1 );
+	g_free( file_key );
+
+	return( group );
+}
+
+/* Call with the lock held. Write the cache back to disc.
+ */
+static void
+tile_source_sniff_cache_save( GKeyFile *cache )
+{
+	char *path;
+
+	path = g_build_filename( disk_cache_get_root(), 
+		SNIFF_CACHE_FILENAME, NULL );
+	if( g_mkdir_with_parents( disk_cache_get_root(), 0700 ) ||
+		!g_key_file_save_to_file( cache, path, NULL ) ) {
+#ifdef DEBUG
+		printf( "tile_source_sniff_cache_save: unable to save %s\n", 
+			path );
+#endif /*DEBUG*/
+	}
+	g_free( path );
+
+	tile_source_sniff_cache_dirty = FALSE;
+}
+
+/* Write any pending changes back to disc, eg. on exit.
+ */
+void
+tile_source_sniff_cache_flush( void )
+{
+	g_mutex_lock( &tile_source_sniff_cache_lock );
+
+	if( tile_source_sniff_cache &&
+		tile_source_sniff_cache_dirty )
+		tile_source_sniff_cache_save( tile_source_sniff_cache );
+	tile_source_sniff_cache_flush_id = 0;
+
+	g_mutex_unlock( &tile_source_sniff_cache_lock );
+}
+
+static gboolean
+tile_source_sniff_cache_flush_timeout( void *user_data )
 {
-#ifdef DEBUG
-	printf( "tile_source_attach_progress:\n" ); 
-#endif /*DEBUG*/
+	tile_source_sniff_cache_flush();
 
-	vips_image_set_progress( tile_source->image, TRUE ); 
-	g_signal_connect_object( tile_source->image, "preeval", 
-		G_CALLBACK( tile_source_preeval ), tile_source, 0 );
-	g_signal_connect_object( tile_source->image, "eval",
-		G_CALLBACK( tile_source_eval ), tile_source, 0 );
-	g_signal_connect_object( tile_source->image, "posteval",
-		G_CALLBACK( tile_source_posteval ), tile_source, 0 );
+	return( FALSE );
 }
 
-/* Fetch a string-encoded int image header field, eg. from openslide. These
- * are all represented as strings. Return the default value if there's any
- * problem.
+/* Fill out the sniff results from the cache, if we can. A hit counts as a
+ * use, so the trim drops the least recently opened files. The new use time 
+ * is written back later with any others, so hits don't rewrite the file.
  */
-static int
-get_int( VipsImage *image, const char *field, int default_value )
+static gboolean
+tile_source_sniff_cache_get( TileSource *tile_source )
 {
-	const char *str;
+	GKeyFile *cache;
+	char *group;
+	int level_count;
+	int *level_width;
+	int *level_height;
+	gsize n_width;
+	gsize n_height;
+	char *libvips;
+	gboolean found;
+
+	if( !(group = tile_source_sniff_cache_group( tile_source )) )
+		return( FALSE );
 
-	if( vips_image_get_typeof( image, field ) &&
-		!vips_image_get_string( image, field, &str ) )
-		return( atoi( str ) );
+	g_mutex_lock( &tile_source_sniff_cache_lock );
+
+	cache = tile_source_sniff_cache_load();
+	found = FALSE;
+	level_width = NULL;
+	level_height = NULL;
+	libvips = NULL;
+	if( g_key_file_has_group( cache, group ) &&
+		g_key_file_get_integer( cache, group, "version", NULL ) == 
+			SNIFF_CACHE_VERSION &&
+		(libvips = g_key_file_get_string( cache, group, 
+			"libvips", NULL )) &&
+		g_str_equal( libvips, vips_version_string() ) &&
+		(level_count = g_key_file_get_integer( cache, group, 
+			"level-count", NULL )) >= 0 &&
+		level_count <= MAX_LEVELS &&
+		(level_count == 0 ||
+		 ((level_width = g_key_file_get_integer_list( cache, group, 
+			"level-width", &n_width, NULL )) &&
+		  (level_height = g_key_file_get_integer_list( cache, group, 
+			"level-height", &n_height, NULL )) &&
+		  n_width == level_count &&
+		  n_height == level_count)) ) {
+		int n_pages = g_key_file_get_integer( cache, group, 
+			"n-pages", NULL );
+		int i;
 
-	return( default_value );
-}
+		tile_source->width = 
+			g_key_file_get_integer( cache, group, "width", NULL );
+		tile_source->height = 
+			g_key_file_get_integer( cache, group, "height", NULL );
+		tile_source->zoom = 
+			g_key_file_get_double( cache, group, "zoom", NULL );
+		tile_source->pages_same_size = g_key_file_get_boolean( cache, 
+			group, "pages-same-size", NULL );
+		tile_source->all_mono = g_key_file_get_boolean( cache, 
+			group, "all-mono", NULL );
+		tile_source->subifd_pyramid = g_key_file_get_boolean( cache, 
+			group, "subifd-pyramid", NULL );
+		tile_source->page_pyramid = g_key_file_get_boolean( cache, 
+			group, "page-pyramid", NULL );
+		tile_source->shrink_pyramid = g_key_file_get_boolean( cache, 
+			group, "shrink-pyramid", NULL );
+		tile_source->virtual_roll = g_key_file_get_boolean( cache, 
+			group, "virtual-roll", NULL );
 
-TileSource *
-tile_source_new_from_file( const char *filename )
-{
-	TileSource *tile_source = g_object_new( TILE_SOURCE_TYPE, NULL );
+		tile_source->level_count = level_count;
+		for( i = 0; i < tile_source->level_count; i++ ) {
+			tile_source->level_width[i] = level_width[i];
+			tile_source->level_height[i] = level_height[i];
+		}
 
-	const char *loader;
-	VipsImage *image;
-	VipsImage *x;
-	TileSourceMode mode;
+		/* The sniff found a bad page layout and fell back to a 
+		 * single page.
+		 */
+		if( n_pages < tile_source->n_pages ) {
+			tile_source->n_pages = n_pages;
+			VIPS_FREE( tile_source->delay );
+			tile_source->n_delay = 0;
+		}
+
+		found = tile_source->width > 0 &&
+			tile_source->height > 0 &&
+			tile_source->zoom > 0 &&
+			n_pages > 0;
+
+		if( found ) {
+			g_key_file_set_int64( cache, group, 
+				"time", g_get_real_time() );
+			tile_source_sniff_cache_dirty = TRUE;
+			if( !tile_source_sniff_cache_flush_id )
+				tile_source_sniff_cache_flush_id = 
+					g_timeout_add_seconds( 
+						SNIFF_CACHE_FLUSH_DELAY,
+						tile_source_sniff_cache_flush_timeout,
+						NULL );
+		}
+	}
+
+	g_mutex_unlock( &tile_source_sniff_cache_lock );
+
+	g_free( libvips );
+	g_free( level_width );
+	g_free( level_height );
+	g_free( group );
 
 #ifdef DEBUG
-	printf( "tile_source_new_from_file: %s\n", filename );
+	printf( "tile_source_sniff_cache_get: found = %d\n", found );
 #endif /*DEBUG*/
 
-	tile_source->filename = g_strdup( filename ); 
+	return( found );
+}
 
-	if( !(loader = vips_foreign_find_load( filename )) ) {
-		VIPS_UNREF( tile_source );
-		return( NULL );
+/* Call with the lock held. Drop the least recently used entries until we're
+ * under the limit.
+ */
+static void
+tile_source_sniff_cache_trim( GKeyFile *cache )
+{
+	char **groups;
+	gsize n_groups;
+
+	groups = g_key_file_get_groups( cache, &n_groups );
+	while( n_groups > MAX_SNIFF_CACHE_ENTRIES ) {
+		gint64 oldest_time;
+		int oldest;
+		gsize i;
+
+		oldest = -1;
+		oldest_time = G_MAXINT64;
+		for( i = 0; i < n_groups; i++ ) {
+			gint64 time = g_key_file_get_int64( cache, 
+				groups[i], "time", NULL );
+
+			if( time < oldest_time ) {
+				oldest_time = time;
+				oldest = i;
+			}
+		}
+
+		(void) g_key_file_remove_group( cache, groups[oldest], NULL );
+		g_free( groups[oldest] );
+		groups[oldest] = groups[n_groups - 1];
+		groups[n_groups - 1] = NULL;
+		n_groups -= 1;
 	}
+	g_strfreev( groups );
+}
 
-	/* vips_foreign_find_load() gives us eg.
-	 * "VipsForeignLoadNsgifFile", but we need "gifload", the
-	 * generic name.
-	 */
-	tile_source->loader = vips_nickname_find( g_type_from_name( loader ) );
+/* Save the sniff results for next time.
+ */
+static void
+tile_source_sniff_cache_set( TileSource *tile_source )
+{
+	GKeyFile *cache;
+	char *group;
 
-	/* A very basic open to fetch metadata. 
-	 */
-	if( !(image = vips_image_new_from_file( filename, NULL )) ) {
-		VIPS_UNREF( tile_source );
-		return( NULL );
-	}
+	if( !(group = tile_source_sniff_cache_group( tile_source )) )
+		return;
 
-	if( tile_source_set_image( tile_source, image ) ) {
-		VIPS_UNREF( image );
-		VIPS_UNREF( tile_source );
-		return( NULL );
+	g_mutex_lock( &tile_source_sniff_cache_lock );
+
+	cache = tile_source_sniff_cache_load();
+
+	g_key_file_set_integer( cache, group, "version", SNIFF_CACHE_VERSION );
+	g_key_file_set_string( cache, group, 
+		"libvips", vips_version_string() );
+	g_key_file_set_int64( cache, group, "time", g_get_real_time() );
+	g_key_file_set_integer( cache, group, "width", tile_source->width );
+	g_key_file_set_integer( cache, group, "height", tile_source->height );
+	g_key_file_set_integer( cache, group, "n-pages", tile_source->n_pages );
+	g_key_file_set_double( cache, group, "zoom", tile_source->zoom );
+	g_key_file_set_boolean( cache, group, 
+		"pages-same-size", tile_source->pages_same_size );
+	g_key_file_set_boolean( cache, group, 
+		"all-mono", tile_source->all_mono );
+	g_key_file_set_boolean( cache, group, 
+		"subifd-pyramid", tile_source->subifd_pyramid );
+	g_key_file_set_boolean( cache, group, 
+		"page-pyramid", tile_source->page_pyramid );
+	g_key_file_set_boolean( cache, group, 
+		"shrink-pyramid", tile_source->shrink_pyramid );
+	g_key_file_set_boolean( cache, group, 
+		"virtual-roll", tile_source->virtual_roll );
+	g_key_file_set_integer( cache, group, 
+		"level-count", tile_source->level_count );
+	if( tile_source->level_count > 0 ) {
+		g_key_file_set_integer_list( cache, group, 
+			"level-width", tile_source->level_width, 
+			tile_source->level_count );
+		g_key_file_set_integer_list( cache, group, 
+			"level-height", tile_source->level_height, 
+			tile_source->level_count );
+	}
+	else {
+		(void) g_key_file_remove_key( cache, group, 
+			"level-width", NULL );
+		(void) g_key_file_remove_key( cache, group, 
+			"level-height", NULL );
 	}
 
+	tile_source_sniff_cache_trim( cache );
+	tile_source_sniff_cache_save( cache );
+
+	g_mutex_unlock( &tile_source_sniff_cache_lock );
+
+	g_free( group );
+}
+
+/* Find the page layout and pyramid structure. image is the result of a 
+ * plain open. If we find the image can be opened in toilet-roll mode, 
+ * return that image, since we'll often need it again.
+ */
+static VipsImage *
+tile_source_sniff( TileSource *tile_source, VipsImage *image, double *start )
+{
+	VipsImage *x;
+	VipsImage *toilet_roll;
+
 	/* For openslide, we can read out the level structure directly.
 	 */
 	if( vips_image_get_typeof( image, "openslide.level-count" ) ) {
@@ -1615,7 +4359,7 @@ tile_source_new_from_file( const char *filename )
 
 		/* Apply the zoom and build the pyramid.
 		 */
-		x = vips_image_new_from_file( filename,
+		x = vips_image_new_from_file( tile_source->filename,
 			"scale", tile_source->zoom,
 			NULL );
 		tile_source->width = x->Xsize;
@@ -1639,8 +4383,6 @@ tile_source_new_from_file( const char *filename )
 		}
 	}
 
-	VIPS_UNREF( image );
-
 	/* Can we open in toilet-roll mode? We need to test that n_pages and
 	 * page_size are sane too. 
 	 */
@@ -1648,20 +4390,40 @@ tile_source_new_from_file( const char *filename )
 	printf( "tile_source_new_from_source: test toilet-roll mode\n" );
 #endif /*DEBUG*/
 
-	/* Block error messages from eg. page-pyramidal TIFFs where pages
-	 * are not all the same size.
-	 */
 	tile_source->type = TILE_SOURCE_TYPE_TOILET_ROLL;
-	vips_error_freeze();
-	x = tile_source_open( tile_source, 0 );
-	vips_error_thaw();
+	if( tile_source->n_pages > MAX_TOILET_ROLL_PAGES ) {
+		/* Far too slow to open and check every page. If the whole 
+		 * strip will fit in our coordinates, lay the pages out 
+		 * virtually, using the size of the first page.
+		 */
+		tile_source->virtual_roll = (gint64) tile_source->n_pages * 
+			tile_source->height <= G_MAXINT / 2;
+		x = NULL;
+	}
+	else if( tile_source->n_pages == 1 &&
+		!vips_isprefix( "svg", tile_source->loader ) ) {
+		/* With just one page, the toilet-roll open is the same as
+		 * the metadata one. 
+		 */
+		x = image;
+		g_object_ref( x );
+	}
+	else {
+		/* Block error messages from eg. page-pyramidal TIFFs where 
+		 * pages are not all the same size.
+		 */
+		vips_error_freeze();
+		x = tile_source_open( tile_source, 0 );
+		vips_error_thaw();
+	}
+	toilet_roll = NULL;
 	if( x ) {
 		/* Toilet-roll mode worked. Check sanity of page height,
 		 * n_pages and Ysize too.
 		 */
 		if( tile_source->n_pages * tile_source->height != x->Ysize ||
 			tile_source->n_pages <= 0 ||
-			tile_source->n_pages > 10000 ) {
+			tile_source->n_pages > MAX_TOILET_ROLL_PAGES ) {
 #ifdef DEBUG
 			printf( "tile_source_new_from_source: "
 				"bad page layout\n" );
@@ -1672,14 +4434,22 @@ tile_source_new_from_file( const char *filename )
 			VIPS_FREE( tile_source->delay );
 			tile_source->n_delay = 0;
 		}
-		else
-			/* Everything looks good.
+		else {
+			/* Everything looks good. If we end up in 
+			 * toilet-roll mode, we can use this as the 
+			 * final image.
 			 */
 			tile_source->pages_same_size = TRUE;
+			toilet_roll = x;
+			g_object_ref( toilet_roll );
+		}
 
 		VIPS_UNREF( x );
 	}
 
+	tile_source_sniff_phase( tile_source, 
+		&tile_source->sniff_toilet_roll_time, start );
+
 	/* Back to plain multipage for the rest of the sniff period. For
 	 * example, subifd pyramid needs single page opening.
 	 *
@@ -1694,6 +4464,13 @@ tile_source_new_from_file( const char *filename )
 		tile_source->pages_same_size && 
 		tile_source->bands == 1;
 
+	/* Single-page JPEG and WebP can shrink on load, so we can make
+	 * levels from that.
+	 */
+	if( !tile_source->level_count &&
+		tile_source->n_pages == 1 ) 
+		tile_source_get_pyramid_shrink( tile_source );
+
 	/* Test for a subifd pyr first, since we can do that from just
 	 * one page.
 	 */
@@ -1704,15 +4481,92 @@ tile_source_new_from_file( const char *filename )
 			tile_source->subifd_pyramid = FALSE;
 	}
 
-	/* If that failed, try to read as a page pyramid.
+	/* If that failed, try to read as a page pyramid. Pages in a page 
+	 * pyramid must be different sizes.
 	 */
-	if( !tile_source->level_count ) {
+	if( !tile_source->level_count &&
+		!tile_source->pages_same_size &&
+		!tile_source->virtual_roll ) {
 		tile_source->page_pyramid = TRUE;
 		tile_source_get_pyramid_page( tile_source );
 		if( !tile_source->level_count )
 			tile_source->page_pyramid = FALSE;
 	}
 
+	tile_source_sniff_phase( tile_source, 
+		&tile_source->sniff_levels_time, start );
+
+	return( toilet_roll );
+}
+
+TileSource *
+tile_source_new_from_file( const char *filename )
+{
+	TileSource *tile_source = g_object_new( TILE_SOURCE_TYPE, NULL );
+
+	const char *loader;
+	VipsImage *image;
+	VipsImage *toilet_roll;
+	TileSourceMode mode;
+	double start;
+
+#ifdef DEBUG
+	printf( "tile_source_new_from_file: %s\n", filename );
+#endif /*DEBUG*/
+
+	start = g_timer_elapsed( tile_source->load_timer, NULL );
+
+	tile_source->filename = g_strdup( filename ); 
+
+	if( !(loader = vips_foreign_find_load( filename )) ) {
+		VIPS_UNREF( tile_source );
+		return( NULL );
+	}
+
+	/* vips_foreign_find_load() gives us eg.
+	 * "VipsForeignLoadNsgifFile", but we need "gifload", the
+	 * generic name.
+	 */
+	tile_source->loader = vips_nickname_find( g_type_from_name( loader ) );
+
+	/* A very basic open to fetch metadata. 
+	 */
+	if( !(image = vips_image_new_from_file( filename, NULL )) ) {
+		VIPS_UNREF( tile_source );
+		return( NULL );
+	}
+
+	if( tile_source_set_image( tile_source, image ) ) {
+		VIPS_UNREF( image );
+		VIPS_UNREF( tile_source );
+		return( NULL );
+	}
+
+	tile_source_sniff_phase( tile_source, 
+		&tile_source->sniff_header_time, &start );
+
+	/* Have we seen this file before? If not, we must sniff it.
+	 */
+	if( tile_source_sniff_cache_get( tile_source ) ) {
+		tile_source->sniff_cached = TRUE;
+
+		/* With just one page, the final open is the same as the 
+		 * metadata one.
+		 */
+		toilet_roll = NULL;
+		if( tile_source->pages_same_size &&
+			tile_source->n_pages == 1 &&
+			!vips_isprefix( "svg", tile_source->loader ) ) {
+			toilet_roll = image;
+			g_object_ref( toilet_roll );
+		}
+	}
+	else {
+		toilet_roll = tile_source_sniff( tile_source, image, &start );
+		tile_source_sniff_cache_set( tile_source );
+	}
+	VIPS_UNREF( image );
+
 	/* Sniffing is done ... set the image type.
 	 */
 	if( tile_source->pages_same_size )
@@ -1743,57 +4597,294 @@ tile_source_new_from_file( const char *filename )
 	tile_source_print( tile_source );
 #endif /*DEBUG*/
 
-	/* And now we can reopen in the correct mode.
+	/* And now we can reopen in the correct mode, unless we already have
+	 * the image from the toilet-roll test.
 	 */
-	if( !(image = tile_source_open( tile_source, 0 )) ) {
-		VIPS_UNREF( tile_source );
-		return( NULL );
+	if( tile_source->type == TILE_SOURCE_TYPE_TOILET_ROLL &&
+		toilet_roll ) 
+		image = toilet_roll;
+	else {
+		VIPS_UNREF( toilet_roll );
+		if( !(image = tile_source_open( tile_source, 0 )) ) {
+			VIPS_UNREF( tile_source );
+			return( NULL );
+		}
 	}
+	tile_source_sniff_phase( tile_source, 
+		&tile_source->sniff_open_time, &start );
+
 	g_assert( !tile_source->image );
 	g_assert( !tile_source->image_region );
 	tile_source->image = image;
 	tile_source->image_region = vips_region_new( tile_source->image );
 
-	/* image_region is used by the bg load thread.
+	/* image_region is used by the bg load thread.
+	 */
+	vips__region_no_ownership( tile_source->image_region );
+
+	g_object_set( tile_source, 
+		"mode", mode, 
+		NULL );
+
+	/* This will be set TRUE again at the end of the background
+	 * load. This will trigger tile_source_update_display() for us.
+	 */
+	g_object_set( tile_source, 
+		"loaded", FALSE, 
+		NULL );
+
+	tile_source_attach_progress( tile_source ); 
+
+	return( tile_source );
+}
+
+/* Call this some time after tile_source_new_from_file() or
+ * tile_source_new_from_source(), and once all callbacks have been 
+ * attached, to trigger a bg load.
+ */
+void
+tile_source_background_load( TileSource *tile_source )
+{
+	/* We ref this tile_source so it won't die before the
+	 * background load is done. The matching unref is at the end
+	 * of bg load.
+	 */
+	g_object_ref( tile_source );
+
+	tile_source->load_queue_time = 
+		g_timer_elapsed( tile_source->load_timer, NULL );
+	tile_source->load_serial = tile_source_load_serial++;
+	g_thread_pool_push( tile_source_background_load_pool, 
+		tile_source, NULL );
+}
+
+/* Loads with a higher priority run first, for example the focused window.
+ */
+void
+tile_source_set_load_priority( TileSource *tile_source, int priority )
+{
+	if( tile_source->load_priority != priority ) {
+		tile_source->load_priority = priority;
+
+		/* Resort the queue, if we might be on it.
+		 */
+		if( !tile_source->loaded )
+			g_thread_pool_set_sort_function( 
+				tile_source_background_load_pool,
+				tile_source_background_load_sort, NULL );
+	}
+}
+
+/* Set from the state of the window showing this tile_source. 
+ */
+void
+tile_source_set_priority( TileSource *tile_source, 
+	TileSourcePriority priority )
+{
+	if( tile_source->priority == priority )
+		return;
+
+#ifdef DEBUG
+	printf( "tile_source_set_priority: %d\n", priority );
+#endif /*DEBUG*/
+
+	tile_source->priority = priority;
+
+	if( priority == TILE_SOURCE_PRIORITY_HIDDEN ) {
+		/* Drop the pipeline, so any renders in progress for it stop.
+		 * tile_source_fill_tile() will rebuild it when we're 
+		 * painted again.
+		 */
+		VIPS_UNREF( tile_source->display );
+		VIPS_UNREF( tile_source->mask );
+		VIPS_UNREF( tile_source->rgb );
+		VIPS_UNREF( tile_source->rgb_region );
+		VIPS_UNREF( tile_source->mask_region );
+		VIPS_FREEF( vis_kernel_rgb_free, tile_source->remap );
+
+		/* Animations pause, since we ignore ticks while hidden.
+		 */
+		tile_source_frames_free( tile_source );
+		tile_source_warm_free( tile_source );
+	}
+	else {
+		/* A new sink_screen with the new priority. Tiles we have
+		 * already painted stay valid, so there's no need to 
+		 * signal tiles_changed.
+		 */
+		if( tile_source->display )
+			tile_source_update_display( tile_source );
+
+		/* Restart animation timing from the next tick.
+		 */
+		tile_source->frame_due = 0;
+	}
+}
+
+/* Advance any animation. Call this from the frame clock of the widget 
+ * displaying the image, with complete set if all the tiles for the current
+ * frame have been painted. 
+ *
+ * We hold a frame until its tiles are complete, or until it is a few frame
+ * delays late, and if we're running late, skip frames to catch up. A frame 
+ * we gave up waiting for counts as dropped.
+ */
+void
+tile_source_animation_tick( TileSource *tile_source, 
+	gint64 frame_time, gboolean complete )
+{
+	int n_pages = tile_source->n_pages;
+
+	gint64 due;
+	int page;
+	int n_dropped;
+	gboolean timed_out;
+
+	if( tile_source->mode != TILE_SOURCE_MODE_ANIMATED ||
+		n_pages < 2 ||
+		!tile_source->rgb ||
+		tile_source->priority == TILE_SOURCE_PRIORITY_HIDDEN ) 
+		return;
+
+	/* First tick, or restarting after a pause.
+	 */
+	if( !tile_source->frame_due ) {
+		tile_source->frame_due = frame_time + 
+			tile_source_get_delay( tile_source, tile_source->page );
+		tile_source->fps_start = frame_time;
+		tile_source->fps_frames = 0;
+		return;
+	}
+
+	if( frame_time < tile_source->frame_due )
+		return;
+
+	/* Don't stall forever on a frame that never completes, eg. a very 
+	 * slow page.
+	 */
+	timed_out = FALSE;
+	if( !complete ) {
+		if( frame_time < tile_source->frame_due + FRAME_TIMEOUT * 
+			tile_source_get_delay( tile_source, tile_source->page ) )
+			return;
+		timed_out = TRUE;
+	}
+
+	/* Skip any frames whose display time has already passed.
 	 */
-	vips__region_no_ownership( tile_source->image_region );
-
-	g_object_set( tile_source, 
-		"mode", mode, 
-		NULL );
+	page = (tile_source->page + 1) % n_pages;
+	due = tile_source->frame_due;
+	n_dropped = 0;
+	while( n_dropped < n_pages &&
+		frame_time >= due + tile_source_get_delay( tile_source, page ) ) {
+		due += tile_source_get_delay( tile_source, page );
+		page = (page + 1) % n_pages;
+		n_dropped += 1;
+	}
 
-	/* We ref this tile_source so it won't die before the
-	 * background load is done. The matching unref is at the end
-	 * of bg load.
+	/* Very late (perhaps the render was slow), just resync.
 	 */
-	g_object_ref( tile_source );
+	if( n_dropped == n_pages ) {
+		due = frame_time;
+		n_dropped = 0;
+	}
+	if( timed_out )
+		n_dropped += 1;
 
-	/* This will be set TRUE again at the end of the background
-	 * load. This will trigger tile_source_update_display() for us.
+	tile_source->frame_due = due + tile_source_get_delay( tile_source, page );
+	tile_source->n_frames_shown += 1;
+	tile_source->n_frames_dropped += n_dropped;
+
+	/* Update achieved fps about once a second.
 	 */
-	g_object_set( tile_source, 
-		"loaded", FALSE, 
+	tile_source->fps_frames += 1;
+	if( frame_time - tile_source->fps_start > G_USEC_PER_SEC ) {
+		tile_source->fps = tile_source->fps_frames * 
+			(double) G_USEC_PER_SEC / 
+			(frame_time - tile_source->fps_start);
+		tile_source->fps_start = frame_time;
+		tile_source->fps_frames = 0;
+	}
+
+	g_object_set( tile_source,
+		"page", page,
 		NULL );
+}
 
-	tile_source_attach_progress( tile_source ); 
+/* Stop any background load, for example when the window showing this
+ * tile_source closes. A queued load will never start, and a running load 
+ * is killed.
+ */
+void
+tile_source_cancel_load( TileSource *tile_source )
+{
+	if( !tile_source->loaded &&
+		!tile_source->load_cancelled ) {
+		tile_source->load_cancelled = TRUE;
+		if( tile_source->image )
+			vips_image_set_kill( tile_source->image, TRUE );
+	}
+}
 
-	return( tile_source );
+static void
+tile_source_new_from_file_thread( GTask *task, 
+	gpointer source_object, gpointer task_data, 
+	GCancellable *cancellable )
+{
+	const char *filename = (const char *) task_data;
+
+	TileSource *tile_source;
+
+	if( g_task_return_error_if_cancelled( task ) )
+		return;
+
+	if( !(tile_source = tile_source_new_from_file( filename )) ) {
+		g_task_return_new_error( task, 
+			G_IO_ERROR, G_IO_ERROR_FAILED,
+			"%s", vips_error_buffer() );
+		vips_error_clear();
+		return;
+	}
+
+	g_task_return_pointer( task, tile_source, g_object_unref );
 }
 
-/* Call this some time after tile_source_new_from_file() or
- * tile_source_new_from_source(), and once all callbacks have been 
- * attached, to trigger a bg load.
+/* Sniff and open in a worker thread, since it can be slow for things like 
+ * large PDFs or files on remote filesystems. Call 
+ * tile_source_new_from_file_finish() in the callback to get the 
+ * result.
+ *
+ * If cancellable is cancelled, the callback runs soon after with 
+ * G_IO_ERROR_CANCELLED, and any tile_source made later is discarded.
  */
 void
-tile_source_background_load( TileSource *tile_source )
+tile_source_new_from_file_async( const char *filename, 
+	GCancellable *cancellable,
+	GAsyncReadyCallback callback, gpointer user_data )
 {
-	g_thread_pool_push( tile_source_background_load_pool, 
-		tile_source, NULL );
+	GTask *task;
+
+	task = g_task_new( NULL, cancellable, callback, user_data );
+	g_task_set_source_tag( task, tile_source_new_from_file_async );
+	g_task_set_task_data( task, g_strdup( filename ), g_free );
+	g_task_set_return_on_cancel( task, TRUE );
+	g_task_run_in_thread( task, tile_source_new_from_file_thread );
+	g_object_unref( task );
+}
+
+TileSource *
+tile_source_new_from_file_finish( GAsyncResult *result, GError **error )
+{
+	g_return_val_if_fail( g_task_is_valid( result, NULL ), NULL );
+
+	return( g_task_propagate_pointer( G_TASK( result ), error ) );
 }
 
 int
 tile_source_fill_tile( TileSource *tile_source, Tile *tile ) 
 {
+	gint64 start = g_get_monotonic_time();
+
 #ifdef DEBUG_VERBOSE
 	printf( "tile_source_fill_tile: %d x %d\n",
 	     tile->region->valid.left, tile->region->valid.top ); 
@@ -1836,17 +4927,300 @@ tile_source_fill_tile( TileSource *tile_source, Tile *tile )
 	if( tile->valid ) {
 		tile_free_texture( tile );
 		tile_get_texture( tile );
+
+		if( tile_source->first_pixel_time < 0 )
+			tile_source->first_pixel_time = 
+				g_timer_elapsed( tile_source->load_timer, 
+					NULL );
 	}
 
+	tile_source->fill_time += 
+		(g_get_monotonic_time() - start) / (double) G_USEC_PER_SEC;
+
 	return( 0 );
 }
 
+/* Copy the display values (before scale, falsecolour, etc.) for a tile we've
+ * just filled, so it can be remapped later, or for statistics. NULL if the 
+ * pixels aren't available.
+ */
+VipsImage *
+tile_source_capture_tile( TileSource *tile_source, Tile *tile )
+{
+	VipsImage *display = tile_source->display;
+	VipsRect *rect = &tile->region->valid;
+
+	VipsRegion *region;
+	VipsImage *source;
+	int y;
+
+	if( !display ||
+		!tile->valid ||
+		tile_source->current_z != tile->z )
+		return( NULL );
+
+	/* The display image ends in sink_screen, so this will just copy from 
+	 * its cache.
+	 */
+	region = vips_region_new( display );
+	if( vips_region_prepare( region, rect ) ) {
+		VIPS_UNREF( region );
+		return( NULL );
+	}
+
+	source = vips_image_new_memory();
+	vips_image_init_fields( source, 
+		rect->width, rect->height, display->Bands, 
+		display->BandFmt, VIPS_CODING_NONE, display->Type, 
+		1.0, 1.0 );
+	if( vips_image_write_prepare( source ) ) {
+		VIPS_UNREF( source );
+		VIPS_UNREF( region );
+		return( NULL );
+	}
+
+	for( y = 0; y < rect->height; y++ )
+		memcpy( VIPS_IMAGE_ADDR( source, 0, y ),
+			VIPS_REGION_ADDR( region, rect->left, rect->top + y ),
+			VIPS_IMAGE_SIZEOF_LINE( source ) );
+
+	VIPS_UNREF( region );
+
+	return( source );
+}
+
+/* Remap the display values a tile kept with the current scale, offset etc.
+ * FALSE if we can't, and the tile must be fetched again.
+ */
+gboolean
+tile_source_remap_tile( TileSource *tile_source, Tile *tile )
+{
+	VipsImage *source = tile->source;
+	VipsRect *rect = &tile->region->valid;
+
+	if( !tile_source->remap ||
+		!tile_source->display ||
+		!source ||
+		source->Xsize != rect->width ||
+		source->Ysize != rect->height ||
+		source->Bands != tile_source->display->Bands ||
+		source->BandFmt != tile_source->display->BandFmt ||
+		tile->region->im->Bands != tile_source->rgb->Bands )
+		return( FALSE );
+
+	vis_kernel_rgb_map( tile_source->remap,
+		VIPS_IMAGE_ADDR( source, 0, 0 ),
+		VIPS_IMAGE_SIZEOF_LINE( source ),
+		VIPS_REGION_ADDR( tile->region, rect->left, rect->top ),
+		VIPS_REGION_LSKIP( tile->region ),
+		rect->width, rect->height );
+	tile_free_texture( tile );
+
+	return( TRUE );
+}
+
+/* A display control is being dragged. Changes to scale etc. are applied to
+ * coarse tiles first, and the rest are refined when the drag ends.
+ */
+void
+tile_source_set_dragging( TileSource *tile_source, gboolean dragging )
+{
+	if( tile_source->dragging == dragging )
+		return;
+
+	tile_source->dragging = dragging;
+
+	if( dragging ) {
+		tile_source->n_drag_updates = 0;
+		tile_source->n_drag_rebuilds = 0;
+	}
+	else {
+#ifdef DEBUG
+		printf( "tile_source_set_dragging: drag ended, "
+			"%d updates, %d pipeline rebuilds\n",
+			tile_source->n_drag_updates, 
+			tile_source->n_drag_rebuilds );
+#endif /*DEBUG*/
+
+		/* The settings are the same, this just asks the tile cache
+		 * to refine any tiles it put off remapping.
+		 */
+		if( tile_source->remap )
+			g_signal_emit( tile_source, 
+				tile_source_signals[SIG_VIS_CHANGED], 0 );
+	}
+}
+
+/* Change how a channel is shown in pages-as-bands mode.
+ */
+void
+tile_source_set_channel( TileSource *tile_source, 
+	int channel, VisKernelChannel *settings )
+{
+	gboolean selected;
+
+	if( !tile_source->channels ||
+		channel < 0 ||
+		channel >= tile_source->n_pages )
+		return;
+
+	selected = tile_source->channels[channel].selected;
+	tile_source->channels[channel] = *settings;
+
+	/* Only the selected pages are in the display image, so we need to 
+	 * rebuild it if that changes. Tint and window are just in rgb.
+	 */
+	if( tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS ) {
+		if( settings->selected != selected ) {
+			tile_source_update_display( tile_source );
+
+			/* The display has a different set of bands, so 
+			 * regions and the pixel probe must restart.
+			 */
+			tile_source_page_changed( tile_source );
+		}
+		else
+			tile_source_update_rgb( tile_source );
+		tile_source_tiles_changed( tile_source );
+	}
+}
+
+/* Set the number of columns for grid mode, perhaps from the window width.
+ */
+void
+tile_source_set_grid_columns( TileSource *tile_source, int columns )
+{
+	columns = VIPS_CLIP( 1, columns, VIPS_MAX( 1, tile_source->n_pages ) );
+	if( tile_source->grid_columns == columns )
+		return;
+
+	tile_source->grid_columns = columns;
+
+	if( tile_source->mode == TILE_SOURCE_MODE_GRID ) {
+		tile_source_set_display_size( tile_source );
+		tile_source_update_display( tile_source );
+		tile_source_changed( tile_source );
+	}
+}
+
+/* The page whose cell is at x, y (level 0 coordinates) in grid mode, or -1.
+ */
+int
+tile_source_grid_page( TileSource *tile_source, int x, int y )
+{
+	int column;
+	int row;
+	int page;
+
+	if( tile_source->mode != TILE_SOURCE_MODE_GRID ||
+		x < 0 ||
+		y < 0 )
+		return( -1 );
+
+	column = x / GRID_CELL_SIZE;
+	row = y / GRID_CELL_SIZE;
+	page = row * tile_source->grid_columns + column;
+	if( column >= tile_source->grid_columns ||
+		page >= tile_source->n_pages )
+		return( -1 );
+
+	return( page );
+}
+
+/* The area we last painted, in level 0 coordinates. Pipelines for nearby 
+ * pages render this area in the background.
+ */
+void
+tile_source_set_viewport( TileSource *tile_source, VipsRect *viewport )
+{
+	tile_source->viewport = *viewport;
+
+	/* Get the next page ready as soon as we start showing this one.
+	 */
+	if( !tile_source->warm_key )
+		tile_source_warm_queue( tile_source );
+}
+
 const char *
 tile_source_get_path( TileSource *tile_source )
 {
 	return( tile_source->filename );
 }
 
+/* A string that identifies the pixels we are currently generating, for the
+ * disc cache. It changes if the file is modified, or if the page, mode,
+ * layout, channels or visualisation changes. NULL if there's no file to 
+ * identify.
+ */
+char *
+tile_source_get_view_key( TileSource *tile_source )
+{
+	char str[1024];
+	VipsBuf buf = VIPS_BUF_STATIC( str );
+	char *file_key;
+	GChecksum *checksum;
+	char *key;
+
+	if( !tile_source->filename ||
+		!(file_key = disk_cache_file_key( tile_source->filename )) )
+		return( NULL );
+
+	vips_buf_appendf( &buf, "%s:mode=%d:page=%d:pyramid=%d", 
+		file_key, tile_source->mode, tile_source->page,
+		tile_source->pyramid_filename != NULL );
+	if( tile_source->active )
+		vips_buf_appendf( &buf, 
+			":scale=%g:offset=%g:falsecolour=%d:log=%d:icc=%d",
+			tile_source->scale, tile_source->offset,
+			tile_source->falsecolour, tile_source->log,
+			tile_source->icc );
+	if( tile_source->active &&
+		tile_source->icc &&
+		tile_source->display_profile )
+		vips_buf_appendf( &buf, ":profile=%s", 
+			tile_source->display_profile );
+	if( tile_source->mode == TILE_SOURCE_MODE_GRID )
+		vips_buf_appendf( &buf, ":columns=%d", 
+			tile_source->grid_columns );
+	g_free( file_key );
+
+	checksum = g_checksum_new( G_CHECKSUM_SHA1 );
+	g_checksum_update( checksum, 
+		(guchar *) vips_buf_all( &buf ), -1 );
+
+	/* There can be thousands of channels, so hash them one at a time.
+	 */
+	if( tile_source->mode == TILE_SOURCE_MODE_PAGES_AS_BANDS &&
+		tile_source->channels ) {
+		int page;
+
+		for( page = 0; page < tile_source->n_pages; page++ ) {
+			VisKernelChannel *channel = 
+				&tile_source->channels[page];
+
+			if( !channel->selected )
+				continue;
+
+			vips_buf_rewind( &buf );
+			vips_buf_appendf( &buf, 
+				":channel%d=%g,%g,%g:%g,%g", 
+				page, 
+				channel->tint[0], 
+				channel->tint[1], 
+				channel->tint[2], 
+				channel->low, 
+				channel->high );
+			g_checksum_update( checksum, 
+				(guchar *) vips_buf_all( &buf ), -1 );
+		}
+	}
+
+	key = g_strdup( g_checksum_get_string( checksum ) );
+	g_checksum_free( checksum );
+
+	return( key );
+}
+
 GFile *
 tile_source_get_file( TileSource *tile_source )
 {
@@ -1875,12 +5249,165 @@ tile_source_get_base_image( TileSource *tile_source )
 	return( tile_source->base );
 }
 
+/* TRUE if the display values are the image's own values laid out as in the
+ * image, so not arranged in a grid.
+ */
+gboolean
+tile_source_has_source_units( TileSource *tile_source )
+{
+	return( !tile_source_is_virtual( tile_source ) );
+}
+
+/* A copy of what we need to open the levels of the current page, for 
+ * example to compute statistics in the background. Make on the main thread,
+ * then use from any thread. Only for modes with source units.
+ */
+TileSourceLevels *
+tile_source_levels_new( TileSource *tile_source )
+{
+	TileSourceLevels *levels;
+
+	if( !tile_source_has_source_units( tile_source ) ) {
+		vips_error( "tile_source_levels_new", 
+			"%s", _( "not in image units" ) );
+		return( NULL );
+	}
+
+	if( !tile_source->loaded ||
+		!tile_source->image ) {
+		vips_error( "tile_source_levels_new", "%s", _( "not loaded" ) );
+		return( NULL );
+	}
+
+	levels = g_new0( TileSourceLevels, 1 );
+	tile_source_levels_init( tile_source, levels, tile_source->page );
+
+	return( levels );
+}
+
+void
+tile_source_levels_free( TileSourceLevels *levels )
+{
+	tile_source_levels_clear( levels );
+	g_free( levels );
+}
+
+/* The display values at level z. Level 0 is full resolution, and each level 
+ * halves the size. Unref the result when you're done.
+ */
+VipsImage *
+tile_source_levels_get( TileSourceLevels *levels, int z )
+{
+	VipsImage *image;
+	VipsImage *x;
+
+	if( z < 0 ||
+		(levels->display_width >> z) < 1 ||
+		(levels->display_height >> z) < 1 ) {
+		vips_error( "tile_source_levels_get", "%s", _( "no level" ) );
+		return( NULL );
+	}
+
+	if( !(image = tile_source_levels_open( levels, z )) )
+		return( NULL );
+
+	if( image->Type == VIPS_INTERPRETATION_HISTOGRAM &&
+		(image->Xsize == 1 || image->Ysize == 1) ) {
+		if( !(x = tile_source_plot_histogram( image )) ) {
+			VIPS_UNREF( image );
+			return( NULL ); 
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	if( z > 0 ) {
+		if( !(x = tile_source_subsample( image, 
+			levels->display_width, z )) ) {
+			VIPS_UNREF( image );
+			return( NULL ); 
+		}
+		VIPS_UNREF( image );
+		image = x;
+	}
+
+	if( vips_image_decode( image, &x ) ) {
+		VIPS_UNREF( image );
+		return( NULL );
+	}
+	VIPS_UNREF( image );
+
+	return( x );
+}
+
+/* The display values for the current page at level z, for example to 
+ * compute statistics. Only for modes with source units. Unref the result 
+ * when you're done.
+ */
+VipsImage *
+tile_source_get_level( TileSource *tile_source, int z )
+{
+	TileSourceLevels *levels;
+	VipsImage *image;
+
+	if( !(levels = tile_source_levels_new( tile_source )) )
+		return( NULL );
+	image = tile_source_levels_get( levels, z );
+	tile_source_levels_free( levels );
+
+	return( image );
+}
+
+/* The current page at level z as the tiles show it, for example to fill in
+ * the overview. Build on the main thread, then compute pixels from any 
+ * thread. Unref the result when you're done.
+ */
+VipsImage *
+tile_source_get_level_rgb( TileSource *tile_source, int z )
+{
+	VipsImage *image;
+	VipsImage *x;
+	TileSourceVis vis;
+	gboolean fused;
+	gboolean icc_lut;
+
+	if( !tile_source->loaded ||
+		z < 0 ||
+		(tile_source->display_width >> z) < 1 ||
+		(tile_source->display_height >> z) < 1 ) {
+		vips_error( "tile_source_get_level_rgb", 
+			"%s", _( "no level" ) );
+		return( NULL );
+	}
+
+	if( !(image = tile_source_build_display( tile_source, 
+		tile_source->page, z )) )
+		return( NULL );
+
+	tile_source_vis_get( tile_source, &vis );
+	x = tile_source_rgb_build( &vis, image, &fused, &icc_lut );
+	tile_source_vis_clear( &vis );
+	VIPS_UNREF( image );
+
+	return( x );
+}
+
+/* The mean of the display values in a (2 * radius + 1) square around a point
+ * in base image coordinates, clipped to the image.
+ */
 gboolean
 tile_source_get_pixel( TileSource *tile_source, int image_x, int image_y,
-	double **vector, int *n )
+	int radius, double **vector, int *n )
 {
+	VipsImage *context;
+	VipsImage **t;
+	VipsRect image;
+	VipsRect area;
+	int i;
+
 	if( !tile_source->loaded ||
-		!tile_source->image )
+		!tile_source->image ||
+		!tile_source->display )
 		return( FALSE );
 
 	/* x and y are in base image coordinates, so we need to scale by the
@@ -1900,9 +5427,43 @@ tile_source_get_pixel( TileSource *tile_source, int image_x, int image_y,
 	/* The ->display image is cached in a sink screen, so this will be 
 	 * reasonably quick, even for things like svg and pdf.
 	 */
-	if( vips_getpoint( tile_source->display, 
-		vector, n, image_x, image_y, NULL ) )
+	if( radius == 0 ) {
+		if( vips_getpoint( tile_source->display, 
+			vector, n, image_x, image_y, NULL ) )
+			return( FALSE );
+
+		return( TRUE );
+	}
+
+	image.left = 0;
+	image.top = 0;
+	image.width = tile_source->display->Xsize;
+	image.height = tile_source->display->Ysize;
+	area.left = image_x - radius;
+	area.top = image_y - radius;
+	area.width = 2 * radius + 1;
+	area.height = 2 * radius + 1;
+	vips_rect_intersectrect( &area, &image, &area );
+
+	/* Row 0 of stats is for all bands, then one row per band, with the 
+	 * mean in column 4.
+	 */
+	context = vips_image_new();
+	t = (VipsImage **) vips_object_local_array( VIPS_OBJECT( context ), 3 );
+	if( vips_crop( tile_source->display, &t[0], 
+			area.left, area.top, area.width, area.height, NULL ) ||
+		vips_image_decode( t[0], &t[1] ) ||
+		vips_stats( t[1], &t[2], NULL ) ||
+		vips_image_wio_input( t[2] ) ) {
+		g_object_unref( context );
 		return( FALSE );
+	}
+
+	*n = t[1]->Bands;
+	*vector = VIPS_ARRAY( NULL, *n, double );
+	for( i = 0; i < *n; i++ )
+		(*vector)[i] = *((double *) VIPS_IMAGE_ADDR( t[2], 4, i + 1 ));
+	g_object_unref( context );
 
 	return( TRUE );
 }
@@ -1918,6 +5479,7 @@ tile_source_duplicate( TileSource *tile_source )
 	gboolean falsecolour;
 	gboolean log;
 	gboolean icc;
+	char *display_profile;
 	gboolean active;
 
 	if( !(new_tile_source = 
@@ -1932,6 +5494,7 @@ tile_source_duplicate( TileSource *tile_source )
 		"falsecolour", &falsecolour,
 		"log", &log,
 		"icc", &icc,
+		"display-profile", &display_profile,
 		"active", &active,
 		NULL );
 
@@ -1943,8 +5506,116 @@ tile_source_duplicate( TileSource *tile_source )
 		"falsecolour", falsecolour,
 		"log", log,
 		"icc", icc,
+		"display-profile", display_profile,
 		"active", active,
 		NULL );
+	g_free( display_profile );
 
 	return( new_tile_source );
 }
+
+/* A line or two of statistics for the debug display.
+ */
+void
+tile_source_print_stats( TileSource *tile_source, VipsBuf *buf )
+{
+	if( tile_source->frames ) {
+		int n_frames;
+		int i;
+
+		n_frames = 0;
+		for( i = 0; i < tile_source->n_pages; i++ )
+			if( tile_source->frames[i] )
+				n_frames += 1;
+		vips_buf_appendf( buf, "frames: %d of %d cached, %.1f MB, "
+			"%d hits, %d misses\n",
+			n_frames, tile_source->n_pages,
+			tile_source->frame_bytes / (1024.0 * 1024.0),
+			tile_source->n_frame_hits,
+			tile_source->n_frame_misses );
+	}
+
+	if( tile_source->mode == TILE_SOURCE_MODE_ANIMATED )
+		vips_buf_appendf( buf, "animation: %.1f fps, %d frames shown, "
+			"%d dropped\n",
+			tile_source->fps,
+			tile_source->n_frames_shown,
+			tile_source->n_frames_dropped );
+
+	if( tile_source->n_warm_hits + tile_source->n_warm_misses > 0 )
+		vips_buf_appendf( buf, "page prefetch: %d hits, %d misses\n",
+			tile_source->n_warm_hits,
+			tile_source->n_warm_misses );
+
+	vips_buf_appendf( buf, "render: %s, %d tiles rendered, "
+		"%.2fs fetching tiles\n",
+		tile_source->priority == TILE_SOURCE_PRIORITY_FOCUSED ?
+			"focused" :
+		tile_source->priority == TILE_SOURCE_PRIORITY_VISIBLE ?
+			"visible" : "hidden",
+		g_atomic_int_get( &tile_source->n_tiles_rendered ),
+		tile_source->fill_time );
+
+	vips_buf_appendf( buf, "vis: %s",
+		tile_source->rgb_fused ? "fused kernel" : 
+		tile_source->rgb_icc_lut ? "icc lut" : "operation chain" );
+	if( tile_source->rgb_fused_rate > 0 )
+		vips_buf_appendf( buf, ", fused %.0f tiles/s, chain %.0f tiles/s",
+			tile_source->rgb_fused_rate,
+			tile_source->rgb_chain_rate );
+	vips_buf_appendf( buf, "\n" );
+
+	if( tile_source->n_drag_updates > 0 )
+		vips_buf_appendf( buf, "%s: %d updates, "
+			"%d pipeline rebuilds\n",
+			tile_source->dragging ? "drag" : "last drag",
+			tile_source->n_drag_updates,
+			tile_source->n_drag_rebuilds );
+
+	g_mutex_lock( &tile_source_load_lock );
+	vips_buf_appendf( buf, "loads: %d queued, %d running, %d done, "
+		"%d cancelled, mean wait %.2fs, mean load %.2fs\n",
+		g_thread_pool_unprocessed( tile_source_background_load_pool ),
+		tile_source_loads_running,
+		tile_source_loads_done,
+		tile_source_loads_cancelled,
+		tile_source_load_wait_time / 
+			VIPS_MAX( 1, tile_source_loads_done + 
+				tile_source_loads_cancelled ),
+		tile_source_load_run_time / 
+			VIPS_MAX( 1, tile_source_loads_done ) );
+	g_mutex_unlock( &tile_source_load_lock );
+
+	if( tile_source->sniff_cached )
+		vips_buf_appendf( buf, "sniff: header %.3fs, cached, "
+			"open %.3fs\n",
+			tile_source->sniff_header_time,
+			tile_source->sniff_open_time );
+	else
+		vips_buf_appendf( buf, "sniff: header %.3fs, "
+			"toilet-roll %.3fs, levels %.3fs, open %.3fs\n",
+			tile_source->sniff_header_time,
+			tile_source->sniff_toilet_roll_time,
+			tile_source->sniff_levels_time,
+			tile_source->sniff_open_time );
+	vips_buf_appendf( buf, "load: " );
+	if( tile_source->preview_time >= 0 )
+		vips_buf_appendf( buf, "preview %.2fs, ", 
+			tile_source->preview_time );
+	if( tile_source->first_pixel_time >= 0 )
+		vips_buf_appendf( buf, "first pixel %.2fs, ", 
+			tile_source->first_pixel_time );
+	if( tile_source->loaded_time >= 0 )
+		vips_buf_appendf( buf, "loaded %.2fs", 
+			tile_source->loaded_time );
+	else
+		vips_buf_appendf( buf, "loading" );
+	vips_buf_appendf( buf, "\n" );
+
+	if( tile_source->pyramid_build )
+		vips_buf_appendf( buf, "pyramid: building\n" );
+	else if( tile_source->pyramid_filename )
+		vips_buf_appendf( buf, "pyramid: %d levels, built in %.1fs\n",
+			tile_source->level_count, 
+			tile_source->pyramid_build_time );
+}
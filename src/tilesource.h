@@ -70,21 +70,77 @@ typedef enum _TileSourceType {
  * PAGES_AS_BANDS
  *
  *	Just like toilet roll, exccept that we chop the image into pages and
- *	bandjoin them all. Handy for OME-TIFF, which has a one-band image
- *	in each page.
+ *	bandjoin the selected ones. Handy for OME-TIFF, which has a one-band 
+ *	image in each page. The bands are tinted and summed to make the rgb 
+ *	image.
+ *
+ * GRID
+ *
+ *	A contact sheet: a thumbnail of each page, laid out in a grid. Pages
+ *	are only thumbnailed when their cell is painted.
  */
 typedef enum _TileSourceMode {
 	TILE_SOURCE_MODE_TOILET_ROLL,
 	TILE_SOURCE_MODE_MULTIPAGE,
 	TILE_SOURCE_MODE_ANIMATED,
 	TILE_SOURCE_MODE_PAGES_AS_BANDS,
+	TILE_SOURCE_MODE_GRID,
 	TILE_SOURCE_MODE_LAST
 } TileSourceMode;
 
+/* How much rendering effort a tile_source should get, set from the state of 
+ * the window showing it. This is passed to vips_sink_screen(), and libvips 
+ * renders tiles for higher priority pipelines first.
+ *
+ * HIDDEN
+ *
+ *	Minimised or unmapped. We drop the render pipeline, so any queued 
+ *	renders stop, and animations pause.
+ *
+ * PREFETCH
+ *
+ *	Not a window state. Pipelines for pages we are not showing yet use 
+ *	this, so they render after anything on screen in any window, but 
+ *	still render in visible windows which are not focused.
+ *
+ * VISIBLE
+ *
+ *	On screen, but not focused.
+ *
+ * FOCUSED
+ *
+ *	The window the user is working with.
+ */
+typedef enum _TileSourcePriority {
+	TILE_SOURCE_PRIORITY_HIDDEN,
+	TILE_SOURCE_PRIORITY_PREFETCH,
+	TILE_SOURCE_PRIORITY_VISIBLE,
+	TILE_SOURCE_PRIORITY_FOCUSED,
+	TILE_SOURCE_PRIORITY_LAST
+} TileSourcePriority;
+
 /* Max number of levels we allow in a pyramidal image.
  */
 #define MAX_LEVELS (256)
 
+/* Max number of pages near the current one we keep warm pipelines for.
+ */
+#define MAX_WARM (3)
+
+/* The size of each cell in grid mode, in pixels.
+ */
+#define GRID_CELL_SIZE (256)
+
+/* A display pipeline for a page we are not showing yet, but think we will 
+ * soon. display and mask are the outputs of vips_sink_screen(), so any tiles 
+ * we ask for render in the background and are ready when we switch.
+ */
+typedef struct _TileSourceWarm {
+	int page;
+	VipsImage *display;
+	VipsImage *mask;
+} TileSourceWarm;
+
 typedef struct _TileSource {
 	GObject parent_instance;
 
@@ -120,6 +176,11 @@ typedef struct _TileSource {
 	 */
 	gboolean page_pyramid;
 
+	/* No pyramid in the file, but the loader can decode at a reduced
+	 * size (JPEG, WebP), so we make levels from that.
+	 */
+	gboolean shrink_pyramid;
+
 	/* Basic image geometry. The tilecache pyramid is based on this.
 	 */
 	int width;
@@ -141,6 +202,19 @@ typedef struct _TileSource {
 	 */
 	gboolean all_mono;
 
+	/* Too many pages to open as one tall image. In toilet-roll mode we 
+	 * lay the pages out virtually, and only open the ones we need.
+	 */
+	gboolean virtual_roll;
+
+	/* The number of columns in grid mode.
+	 */
+	int grid_columns;
+
+	/* How to show each page in pages-as-bands mode, indexed by page.
+	 */
+	VisKernelChannel *channels;
+
 	/* For pyramidal formats, we need to read out the size of each level.
 	 * Largest level first.
 	 */
@@ -148,6 +222,76 @@ typedef struct _TileSource {
 	int level_width[MAX_LEVELS];
 	int level_height[MAX_LEVELS];
 
+	/* Large images with no pyramid get one built in the background, and
+	 * we switch to it when it's ready. Level 0 is still the original
+	 * image, levels 1 and up come from this TIFF.
+	 */
+	char *pyramid_filename;
+	VipsImage *pyramid_build;
+	double pyramid_build_time;
+
+	/* A small, quick-to-make version of the image we display, scaled up,
+	 * while the full image loads. NULL if there's no cheap preview.
+	 */
+	VipsImage *preview;
+
+	/* Render scheduling, and for stats, the number of tiles rendered and
+	 * the time spent in the main thread fetching tiles.
+	 */
+	TileSourcePriority priority;
+	int n_tiles_rendered;
+	double fill_time;
+
+	/* Set if the rgb image comes from the fused vis kernel or the cached
+	 * ICC LUT rather than a chain of libvips operations. In debug builds, 
+	 * we time the fast path and the chain on a sample tile, in tiles per 
+	 * second.
+	 */
+	gboolean rgb_fused;
+	gboolean rgb_icc_lut;
+	double rgb_fused_rate;
+	double rgb_chain_rate;
+
+	/* When rgb is fused, the same mapping for tiles in memory, so the
+	 * tile cache can remap the display values it holds after a change
+	 * to scale, offset, log or falsecolour.
+	 */
+	VisKernelRGB *remap;
+
+	/* Set while a display control is being dragged. Tiles are remapped at
+	 * coarse levels first, then refined when the drag ends. 
+	 *
+	 * vis_serial counts changes to the display settings. For stats, the 
+	 * number of settings changes and rgb pipeline rebuilds during the 
+	 * current (or last) drag.
+	 */
+	gboolean dragging;
+	int vis_serial;
+	int n_drag_updates;
+	int n_drag_rebuilds;
+
+	/* Background load scheduling. Higher priority loads start first,
+	 * and cancelled loads never set loaded.
+	 */
+	int load_priority;
+	gint64 load_serial;
+	double load_queue_time;
+	gboolean load_cancelled;
+
+	/* Times, in seconds, for each phase of the format sniff, and then
+	 * times from creation for the preview to be made, the first valid 
+	 * tile to be painted, and the load to finish. Negative for not yet.
+	 */
+	GTimer *load_timer;
+	gboolean sniff_cached;
+	double sniff_header_time;
+	double sniff_toilet_roll_time;
+	double sniff_levels_time;
+	double sniff_open_time;
+	double preview_time;
+	double first_pixel_time;
+	double loaded_time;
+
 	/* Display transform parameters.
 	 */
 	int page;
@@ -158,6 +302,10 @@ typedef struct _TileSource {
 	gboolean log;
 	gboolean icc;
 
+	/* Colour manage to this profile file, or NULL for sRGB.
+	 */
+	char *display_profile;
+
 	/* The size of the image with this view mode. So in toilet-roll mode
 	 * (for example), display_height is height * n_pages.
 	 */
@@ -181,9 +329,51 @@ typedef struct _TileSource {
 	VipsRegion *rgb_region;
 	VipsRegion *mask_region;
 
-	/* For animations, the timeout we use for page flip.
+	/* For animations, the frame clock time when we should next flip the 
+	 * page, or 0 to restart timing. For stats, frames shown and dropped,
+	 * and the fps we are achieving.
 	 */
-	guint page_flip_id;
+	gint64 frame_due;
+	int n_frames_shown;
+	int n_frames_dropped;
+	gint64 fps_start;
+	int fps_frames;
+	double fps;
+
+	/* For animations, frames rendered to memory ahead of the playhead,
+	 * indexed by page. frame_key records the display settings they were
+	 * made with. frame_generation changes when frames are thrown away,
+	 * so we can spot stale renders.
+	 *
+	 * frame_base is the toilet roll at the level frames are cropped 
+	 * from, opened on the main thread so renders never need the 
+	 * tile_source. frame_shown is set while display and rgb come from
+	 * a frame rather than a sink_screen.
+	 */
+	VipsImage **frames;
+	gboolean *frame_requested;
+	size_t frame_bytes;
+	char *frame_key;
+	int frame_generation;
+	VipsImage *frame_base;
+	int frame_width;
+	gboolean frame_shown;
+	VipsImage *frame_mask;
+	int n_frame_hits;
+	int n_frame_misses;
+
+	/* In multipage mode, pipelines for the pages either side of the 
+	 * current one, favouring the direction we've been moving in. 
+	 * warm_key records the display settings they were made with, 
+	 * viewport is the last area we painted, in level 0 coordinates.
+	 */
+	TileSourceWarm warm[MAX_WARM];
+	char *warm_key;
+	int page_direction;
+	guint warm_id;
+	VipsRect viewport;
+	int n_warm_hits;
+	int n_warm_misses;
 
 	/* TRUE when the image has fully loaded (ie. postload has fired) and we
 	 * can start looking at pixels.
@@ -211,6 +401,12 @@ typedef struct _TileSourceClass {
 	 */
 	void (*tiles_changed)( TileSource *tile_source );
 
+	/* Just the visualisation settings have changed, eg. scale. Tiles
+	 * which kept their display values can be remapped, the rest must be
+	 * fetched again.
+	 */
+	void (*vis_changed)( TileSource *tile_source );
+
 	/* A set of tiles on a certain level have new pixels now that a
 	 * background render has completed.
 	 */
@@ -225,18 +421,56 @@ typedef struct _TileSourceClass {
 GType tile_source_get_type( void );
 
 TileSource *tile_source_new_from_file( const char *filename );
+void tile_source_new_from_file_async( const char *filename, 
+	GCancellable *cancellable,
+	GAsyncReadyCallback callback, gpointer user_data );
+TileSource *tile_source_new_from_file_finish( GAsyncResult *result, 
+	GError **error );
 
 void tile_source_background_load( TileSource *tile_source );
+void tile_source_set_load_priority( TileSource *tile_source, int priority );
+void tile_source_cancel_load( TileSource *tile_source );
+void tile_source_set_priority( TileSource *tile_source, 
+	TileSourcePriority priority );
+void tile_source_animation_tick( TileSource *tile_source, 
+	gint64 frame_time, gboolean complete );
+
+void tile_source_sniff_cache_flush( void );
+
+void tile_source_set_pyramids_enabled( gboolean enabled );
+void tile_source_set_pyramids_max_bytes( gint64 max_bytes );
 
 int tile_source_fill_tile( TileSource *tile_source, Tile *tile );
+VipsImage *tile_source_capture_tile( TileSource *tile_source, Tile *tile );
+gboolean tile_source_remap_tile( TileSource *tile_source, Tile *tile );
+void tile_source_set_dragging( TileSource *tile_source, gboolean dragging );
+void tile_source_set_viewport( TileSource *tile_source, VipsRect *viewport );
+void tile_source_set_channel( TileSource *tile_source, 
+	int channel, VisKernelChannel *settings );
+void tile_source_set_grid_columns( TileSource *tile_source, int columns );
+int tile_source_grid_page( TileSource *tile_source, int x, int y );
 
 const char *tile_source_get_path( TileSource *tile_source );
+char *tile_source_get_view_key( TileSource *tile_source );
 GFile *tile_source_get_file( TileSource *tile_source );
 
 VipsImage *tile_source_get_image( TileSource *tile_source );
 VipsImage *tile_source_get_base_image( TileSource *tile_source );
+gboolean tile_source_has_source_units( TileSource *tile_source );
+VipsImage *tile_source_get_level( TileSource *tile_source, int z );
+
+/* Open levels of the current page from any thread.
+ */
+typedef struct _TileSourceLevels TileSourceLevels;
+
+TileSourceLevels *tile_source_levels_new( TileSource *tile_source );
+void tile_source_levels_free( TileSourceLevels *levels );
+VipsImage *tile_source_levels_get( TileSourceLevels *levels, int z );
+VipsImage *tile_source_get_level_rgb( TileSource *tile_source, int z );
 gboolean tile_source_get_pixel( TileSource *tile_source, 
-	int image_x, int image_y, double **vector, int *n );
+	int image_x, int image_y, int radius, double **vector, int *n );
 TileSource *tile_source_duplicate( TileSource *tile_source );
 
+void tile_source_print_stats( TileSource *tile_source, VipsBuf *buf );
+
 #endif /*__TILE_SOURCE_H*/
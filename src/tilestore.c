@@ -0,0 +1,483 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* A stored tile.
+ */
+typedef struct _TileStoreEntry {
+	/* Position in level coordinates, and the level.
+	 */
+	int z;
+	int left;
+	int top;
+
+	int width;
+	int height;
+	int bands;
+
+	/* The compressed pixels.
+	 */
+	VipsPel *data;
+	size_t length;
+
+	/* The display values, if the tile kept them, so it can still be 
+	 * remapped when it comes back. These are uncompressed, since they 
+	 * can be any format.
+	 */
+	VipsImage *source;
+
+	/* The store we belong to, and our link in the shared LRU queue.
+	 */
+	TileStore *tile_store;
+	GList *link;
+} TileStoreEntry;
+
+/* All stores share one LRU queue, oldest at the head, and one byte count, so
+ * the budget is for the whole process however many windows are open. Stores
+ * must only be used from the main thread.
+ */
+static GQueue tile_store_lru = G_QUEUE_INIT;
+static size_t tile_store_total_bytes = 0;
+
+/* The codec is modelled on QOI: each pixel is coded as a run of the previous
+ * pixel, a reference to a recently seen colour, a small difference from the
+ * previous pixel, or as a literal. It's very fast to encode and decode, and
+ * does well on the flat areas and smooth gradients that are common in
+ * slides and scientific images.
+ */
+#define OP_INDEX (0x00)
+#define OP_DIFF	(0x40)
+#define OP_LUMA	(0x80)
+#define OP_RUN (0xc0)
+#define OP_RGB (0xfe)
+#define OP_RGBA (0xff)
+#define OP_MASK (0xc0)
+
+/* A pixel, with the alpha set to 255 for RGB images.
+ */
+typedef union _TileStoreColour {
+	VipsPel c[4];
+	guint32 v;
+} TileStoreColour;
+
+#define COLOUR_HASH( C ) \
+	(((C).c[0] * 3 + (C).c[1] * 5 + (C).c[2] * 7 + (C).c[3] * 11) % 64)
+
+/* Compress width x height pixels at p, with lines lskip bytes apart. bands
+ * can be 3 or 4. Return a g_malloc()ed buffer and set length.
+ */
+VipsPel *
+tile_store_encode( VipsPel *p, size_t lskip,
+	int width, int height, int bands, size_t *length )
+{
+	/* Worst case is a tag byte plus all bands for every pixel.
+	 */
+	VipsPel *data = g_malloc( (size_t) width * height * (bands + 1) );
+
+	TileStoreColour index[64] = { { { 0 } } };
+	TileStoreColour prev = { { 0, 0, 0, 255 } };
+	TileStoreColour px = { { 0, 0, 0, 255 } };
+	size_t n;
+	int run;
+	int x, y;
+
+	n = 0;
+	run = 0;
+	for( y = 0; y < height; y++ ) {
+		VipsPel *line = p + y * lskip;
+
+		for( x = 0; x < width; x++ ) {
+			VipsPel *q = line + x * bands;
+
+			px.c[0] = q[0];
+			px.c[1] = q[1];
+			px.c[2] = q[2];
+			if( bands == 4 )
+				px.c[3] = q[3];
+
+			if( px.v == prev.v ) {
+				run += 1;
+				if( run == 62 ) {
+					data[n++] = OP_RUN | (run - 1);
+					run = 0;
+				}
+			}
+			else {
+				int hash = COLOUR_HASH( px );
+
+				if( run > 0 ) {
+					data[n++] = OP_RUN | (run - 1);
+					run = 0;
+				}
+
+				if( index[hash].v == px.v )
+					data[n++] = OP_INDEX | hash;
+				else if( px.c[3] == prev.c[3] ) {
+					signed char vr = px.c[0] - prev.c[0];
+					signed char vg = px.c[1] - prev.c[1];
+					signed char vb = px.c[2] - prev.c[2];
+					signed char vg_r = vr - vg;
+					signed char vg_b = vb - vg;
+
+					index[hash] = px;
+
+					if( vr > -3 && vr < 2 &&
+						vg > -3 && vg < 2 &&
+						vb > -3 && vb < 2 )
+						data[n++] = OP_DIFF |
+							(vr + 2) << 4 |
+							(vg + 2) << 2 |
+							(vb + 2);
+					else if( vg_r > -9 && vg_r < 8 &&
+						vg > -33 && vg < 32 &&
+						vg_b > -9 && vg_b < 8 ) {
+						data[n++] = OP_LUMA | (vg + 32);
+						data[n++] = (vg_r + 8) << 4 |
+							(vg_b + 8);
+					}
+					else {
+						data[n++] = OP_RGB;
+						data[n++] = px.c[0];
+						data[n++] = px.c[1];
+						data[n++] = px.c[2];
+					}
+				}
+				else {
+					index[hash] = px;
+
+					data[n++] = OP_RGBA;
+					data[n++] = px.c[0];
+					data[n++] = px.c[1];
+					data[n++] = px.c[2];
+					data[n++] = px.c[3];
+				}
+			}
+
+			prev = px;
+		}
+	}
+
+	if( run > 0 )
+		data[n++] = OP_RUN | (run - 1);
+
+	*length = n;
+
+	return( g_realloc( data, n ) );
+}
+
+/* Uncompress to width x height pixels at q, with lines lskip bytes apart.
+ * Return non-zero if the data is truncated or corrupt.
+ */
+int
+tile_store_decode( VipsPel *data, size_t length,
+	VipsPel *q, size_t lskip, int width, int height, int bands )
+{
+	TileStoreColour index[64] = { { { 0 } } };
+	TileStoreColour px = { { 0, 0, 0, 255 } };
+	size_t n;
+	int run;
+	int x, y;
+
+	n = 0;
+	run = 0;
+	for( y = 0; y < height; y++ ) {
+		VipsPel *line = q + y * lskip;
+
+		for( x = 0; x < width; x++ ) {
+			VipsPel *p = line + x * bands;
+
+			if( run > 0 )
+				run -= 1;
+			else {
+				int b1;
+
+				if( n >= length )
+					return( -1 );
+				b1 = data[n++];
+
+				if( b1 == OP_RGB ) {
+					if( n + 3 > length )
+						return( -1 );
+					px.c[0] = data[n++];
+					px.c[1] = data[n++];
+					px.c[2] = data[n++];
+				}
+				else if( b1 == OP_RGBA ) {
+					if( n + 4 > length )
+						return( -1 );
+					px.c[0] = data[n++];
+					px.c[1] = data[n++];
+					px.c[2] = data[n++];
+					px.c[3] = data[n++];
+				}
+				else if( (b1 & OP_MASK) == OP_INDEX )
+					px = index[b1];
+				else if( (b1 & OP_MASK) == OP_DIFF ) {
+					px.c[0] += ((b1 >> 4) & 0x03) - 2;
+					px.c[1] += ((b1 >> 2) & 0x03) - 2;
+					px.c[2] += (b1 & 0x03) - 2;
+				}
+				else if( (b1 & OP_MASK) == OP_LUMA ) {
+					int b2;
+					int vg;
+
+					if( n >= length )
+						return( -1 );
+					b2 = data[n++];
+					vg = (b1 & 0x3f) - 32;
+
+					px.c[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+					px.c[1] += vg;
+					px.c[2] += vg - 8 + (b2 & 0x0f);
+				}
+
+				/* Runs repeat the previous pixel, everything
+				 * else updates the index, as in the encoder.
+				 */
+				if( (b1 & OP_MASK) == OP_RUN &&
+					b1 != OP_RGB &&
+					b1 != OP_RGBA )
+					run = b1 & 0x3f;
+				else
+					index[COLOUR_HASH( px )] = px;
+			}
+
+			p[0] = px.c[0];
+			p[1] = px.c[1];
+			p[2] = px.c[2];
+			if( bands == 4 )
+				p[3] = px.c[3];
+		}
+	}
+
+	return( 0 );
+}
+
+static guint
+tile_store_hash( gconstpointer key )
+{
+	TileStoreEntry *entry = (TileStoreEntry *) key;
+
+	return( (guint) entry->left * 17 +
+		(guint) entry->top * 65537 +
+		(guint) entry->z );
+}
+
+static gboolean
+tile_store_equal( gconstpointer a, gconstpointer b )
+{
+	TileStoreEntry *e1 = (TileStoreEntry *) a;
+	TileStoreEntry *e2 = (TileStoreEntry *) b;
+
+	return( e1->z == e2->z &&
+		e1->left == e2->left &&
+		e1->top == e2->top );
+}
+
+TileStore *
+tile_store_new( size_t max_bytes )
+{
+	TileStore *tile_store = g_new0( TileStore, 1 );
+
+	tile_store->table = g_hash_table_new( tile_store_hash,
+		tile_store_equal );
+	tile_store->max_bytes = max_bytes;
+
+	return( tile_store );
+}
+
+static size_t
+tile_store_source_bytes( TileStoreEntry *entry )
+{
+	return( entry->source ? VIPS_IMAGE_SIZEOF_IMAGE( entry->source ) : 0 );
+}
+
+/* Everything an entry holds, for the budget.
+ */
+static size_t
+tile_store_entry_bytes( TileStoreEntry *entry )
+{
+	return( entry->length + tile_store_source_bytes( entry ) );
+}
+
+/* The same, uncompressed, for the compression ratio.
+ */
+static size_t
+tile_store_entry_raw_bytes( TileStoreEntry *entry )
+{
+	return( (size_t) entry->width * entry->height * entry->bands +
+		tile_store_source_bytes( entry ) );
+}
+
+static void
+tile_store_remove( TileStore *tile_store, TileStoreEntry *entry )
+{
+	size_t bytes = tile_store_entry_bytes( entry );
+
+	g_hash_table_remove( tile_store->table, entry );
+	g_queue_delete_link( &tile_store_lru, entry->link );
+
+	tile_store->bytes -= bytes;
+	tile_store_total_bytes -= bytes;
+	tile_store->raw_bytes -= tile_store_entry_raw_bytes( entry );
+
+	VIPS_FREE( entry->data );
+	VIPS_UNREF( entry->source );
+	g_free( entry );
+}
+
+void
+tile_store_clear( TileStore *tile_store )
+{
+	GList *entries;
+	GList *p;
+
+	entries = g_hash_table_get_keys( tile_store->table );
+	for( p = entries; p; p = p->next )
+		tile_store_remove( tile_store, (TileStoreEntry *) p->data );
+	g_list_free( entries );
+}
+
+void
+tile_store_free( TileStore *tile_store )
+{
+	tile_store_clear( tile_store );
+	VIPS_FREEF( g_hash_table_destroy, tile_store->table );
+	g_free( tile_store );
+}
+
+void
+tile_store_put( TileStore *tile_store, Tile *tile )
+{
+	VipsRect *valid = &tile->region->valid;
+
+	TileStoreEntry *entry;
+	TileStoreEntry *old;
+
+	if( !tile->valid ||
+		tile->stale ||
+		tile->region->im->BandFmt != VIPS_FORMAT_UCHAR ||
+		(tile->region->im->Bands != 3 &&
+		 tile->region->im->Bands != 4) )
+		return;
+
+	entry = g_new0( TileStoreEntry, 1 );
+	entry->z = tile->z;
+	entry->left = valid->left;
+	entry->top = valid->top;
+	entry->width = valid->width;
+	entry->height = valid->height;
+	entry->bands = tile->region->im->Bands;
+	entry->data = tile_store_encode(
+		VIPS_REGION_ADDR( tile->region, valid->left, valid->top ),
+		VIPS_REGION_LSKIP( tile->region ),
+		entry->width, entry->height, entry->bands,
+		&entry->length );
+	if( tile->source ) {
+		entry->source = tile->source;
+		g_object_ref( entry->source );
+	}
+
+	if( (old = g_hash_table_lookup( tile_store->table, entry )) )
+		tile_store_remove( tile_store, old );
+
+	g_hash_table_add( tile_store->table, entry );
+	g_queue_push_tail( &tile_store_lru, entry );
+	entry->link = g_queue_peek_tail_link( &tile_store_lru );
+	entry->tile_store = tile_store;
+
+	tile_store->bytes += tile_store_entry_bytes( entry );
+	tile_store_total_bytes += tile_store_entry_bytes( entry );
+	tile_store->raw_bytes += tile_store_entry_raw_bytes( entry );
+	tile_store->n_puts += 1;
+
+	/* Drop the oldest tiles from any store until we're back under 
+	 * budget.
+	 */
+	while( tile_store_total_bytes > tile_store->max_bytes &&
+		(old = g_queue_peek_head( &tile_store_lru )) ) {
+		old->tile_store->n_evictions += 1;
+		tile_store_remove( old->tile_store, old );
+	}
+
+#ifdef DEBUG
+	printf( "tile_store_put: z = %d, left = %d, top = %d, "
+		"%zd -> %zd bytes\n",
+		entry->z, entry->left, entry->top,
+		(size_t) entry->width * entry->height * entry->bands,
+		entry->length );
+#endif /*DEBUG*/
+}
+
+gboolean
+tile_store_get( TileStore *tile_store, Tile *tile )
+{
+	VipsRect *valid = &tile->region->valid;
+
+	TileStoreEntry key;
+	TileStoreEntry *entry;
+	int result;
+
+	key.z = tile->z;
+	key.left = valid->left;
+	key.top = valid->top;
+	if( !(entry = g_hash_table_lookup( tile_store->table, &key )) ||
+		entry->width != valid->width ||
+		entry->height != valid->height ||
+		entry->bands != tile->region->im->Bands ) {
+		tile_store->n_misses += 1;
+		return( FALSE );
+	}
+
+	result = tile_store_decode( entry->data, entry->length,
+		VIPS_REGION_ADDR( tile->region, valid->left, valid->top ),
+		VIPS_REGION_LSKIP( tile->region ),
+		entry->width, entry->height, entry->bands );
+
+	/* Hand the display values back too, if we have them.
+	 */
+	if( !result &&
+		entry->source ) {
+		VIPS_UNREF( tile->source );
+		tile->source = entry->source;
+		g_object_ref( tile->source );
+	}
+
+	/* The tile goes back into the main cache, so we don't need to keep a
+	 * copy.
+	 */
+	tile_store_remove( tile_store, entry );
+
+	if( result ) {
+		tile_store->n_misses += 1;
+		return( FALSE );
+	}
+
+	tile_store->n_hits += 1;
+
+	return( TRUE );
+}
+
+void
+tile_store_print_stats( TileStore *tile_store, VipsBuf *buf )
+{
+	int n_lookups = tile_store->n_hits + tile_store->n_misses;
+
+	vips_buf_appendf( buf, "tile store: %d tiles, %.1f MB "
+		"(%.1f MB all windows)",
+		g_hash_table_size( tile_store->table ),
+		tile_store->bytes / (1024.0 * 1024.0),
+		tile_store_total_bytes / (1024.0 * 1024.0) );
+	if( tile_store->bytes > 0 )
+		vips_buf_appendf( buf, ", compression %.1f:1",
+			(double) tile_store->raw_bytes / tile_store->bytes );
+	vips_buf_appendf( buf, "\n" );
+	vips_buf_appendf( buf, "tile store: %d hits, %d misses",
+		tile_store->n_hits, tile_store->n_misses );
+	if( n_lookups > 0 )
+		vips_buf_appendf( buf, " (%.0f%% hit rate)",
+			100.0 * tile_store->n_hits / n_lookups );
+	vips_buf_appendf( buf, ", %d evictions\n", tile_store->n_evictions );
+}
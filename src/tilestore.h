@@ -0,0 +1,64 @@
+/* A second-tier cache for tiles that have been evicted from TileCache.
+ */
+
+#ifndef __TILE_STORE_H
+#define __TILE_STORE_H
+
+/* Tiles are held compressed with a fast lossless codec, so we can keep many
+ * more of them in the same amount of memory.
+ */
+typedef struct _TileStore {
+	/* All the stored tiles, indexed by z and position. Keys and values
+	 * are the same TileStoreEntry.
+	 */
+	GHashTable *table;
+
+	/* Size of our compressed data, and the maximum size of the 
+	 * compressed data in all stores together, in bytes. The oldest tiles
+	 * in any store are dropped first.
+	 */
+	size_t bytes;
+	size_t max_bytes;
+
+	/* Uncompressed size of everything we hold, for the compression ratio.
+	 */
+	size_t raw_bytes;
+
+	/* Counters.
+	 */
+	int n_puts;
+	int n_hits;
+	int n_misses;
+	int n_evictions;
+
+} TileStore;
+
+TileStore *tile_store_new( size_t max_bytes );
+void tile_store_free( TileStore *tile_store );
+
+/* Drop all stored tiles, eg. after a change to falsecolour. Counters are
+ * kept.
+ */
+void tile_store_clear( TileStore *tile_store );
+
+/* Compress and keep the pixels from a valid tile, and a ref to its display 
+ * values, if it has them. Stale tiles are skipped, since their pixels are 
+ * from old display settings.
+ */
+void tile_store_put( TileStore *tile_store, Tile *tile );
+
+/* If we have this tile, uncompress into the tile region, set tile->source 
+ * if we kept the display values, remove it from the store and return TRUE.
+ */
+gboolean tile_store_get( TileStore *tile_store, Tile *tile );
+
+void tile_store_print_stats( TileStore *tile_store, VipsBuf *buf );
+
+/* The codec, handy for other tile caches.
+ */
+VipsPel *tile_store_encode( VipsPel *p, size_t lskip,
+	int width, int height, int bands, size_t *length );
+int tile_store_decode( VipsPel *data, size_t length,
+	VipsPel *q, size_t lskip, int width, int height, int bands );
+
+#endif /*__TILE_STORE_H*/
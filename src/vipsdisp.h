@@ -28,6 +28,11 @@
  */
 #define MAX_TILES (2 * (4096 / TILE_SIZE) * (2048 / TILE_SIZE))
 
+/* Memory budget for tiles evicted from the main cache, held compressed. This
+ * is shared by all windows.
+ */
+#define MAX_STORE_BYTES (256 * 1024 * 1024)
+
 /* We use various gtk4 features (filechooser, dialog) which are going away 
  * in gtk5.
  */
@@ -38,11 +43,18 @@ G_GNUC_BEGIN_IGNORE_DEPRECATIONS
 #include "vipsdispapp.h"
 #include "vipsdispmarshal.h"
 #include "tile.h"
+#include "tilestore.h"
+#include "diskcache.h"
+#include "viskernel.h"
+#include "histogram.h"
+#include "annotations.h"
 #include "tilesource.h"
 #include "tilecache.h"
 #include "imagedisplay.h"
+#include "roi.h"
 #include "imagewindow.h"
 #include "infobar.h"
+#include "navigator.h"
 #include "displaybar.h"
 #include "saveoptions.h"
 
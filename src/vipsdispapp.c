@@ -122,6 +122,7 @@ vipsdisp_app_startup( GApplication *app )
 	DISPLAYBAR_TYPE;
 	TSLIDER_TYPE;
 	INFOBAR_TYPE;
+	NAVIGATOR_TYPE;
 
 	g_action_map_add_action_entries( G_ACTION_MAP( app ),
 		app_entries, G_N_ELEMENTS( app_entries ),
@@ -161,6 +162,10 @@ vipsdisp_app_shutdown( GApplication *app )
 	while( (win = vipsdisp_app_win( VIPSDISP_APP( app ) )) ) 
 		gtk_window_destroy( GTK_WINDOW( win ) );
 
+	/* Write back any sniff cache changes we've been saving up.
+	 */
+	tile_source_sniff_cache_flush();
+
 	G_APPLICATION_CLASS( vipsdisp_app_parent_class )->shutdown( app );
 }
 
@@ -0,0 +1,1102 @@
+#include "vipsdisp.h"
+
+/*
+#define DEBUG
+ */
+
+/* State for a composite, owned by the output image.
+ */
+typedef struct _VisKernelComposite {
+	/* NULL-terminated, and we hold a ref to each one.
+	 */
+	VipsImage **in;
+	int n;
+
+	VisKernelChannel *channels;
+} VisKernelComposite;
+
+/* Per-thread state.
+ */
+typedef struct _VisKernelSeq {
+	VipsRegion **ir;
+
+	/* A line of RGB accumulators.
+	 */
+	double *acc;
+	int width;
+} VisKernelSeq;
+
+/* The power the log display uses, see tile_source_image_log().
+ */
+#define VIS_KERNEL_LOG_POWER (0.25)
+
+double
+vis_kernel_log( double v )
+{
+	const double scale = 255.0 / 
+		log10( 1.0 + pow( 255.0, VIS_KERNEL_LOG_POWER ) );
+
+	return( scale * log10( 1.0 + pow( v, VIS_KERNEL_LOG_POWER ) ) + 0.5 );
+}
+
+double
+vis_kernel_log_invert( double v )
+{
+	const double scale = 255.0 / 
+		log10( 1.0 + pow( 255.0, VIS_KERNEL_LOG_POWER ) );
+
+	return( pow( VIPS_MAX( 0.0, pow( 10.0, (v - 0.5) / scale ) - 1.0 ), 
+		1.0 / VIS_KERNEL_LOG_POWER ) );
+}
+
+double
+vis_kernel_format_max( VipsBandFormat format )
+{
+	switch( format ) {
+	case VIPS_FORMAT_UCHAR:
+		return( G_MAXUINT8 );
+
+	case VIPS_FORMAT_CHAR:
+		return( G_MAXINT8 );
+
+	case VIPS_FORMAT_USHORT:
+		return( G_MAXUINT16 );
+
+	case VIPS_FORMAT_SHORT:
+		return( G_MAXINT16 );
+
+	case VIPS_FORMAT_UINT:
+		return( G_MAXUINT32 );
+
+	case VIPS_FORMAT_INT:
+		return( G_MAXINT32 );
+
+	default:
+		/* Float images are usually 0 - 1.
+		 */
+		return( 1.0 );
+	}
+}
+
+static void
+vis_kernel_composite_free( VipsImage *image, VisKernelComposite *composite )
+{
+	int i;
+
+	for( i = 0; i < composite->n; i++ )
+		VIPS_UNREF( composite->in[i] );
+	VIPS_FREE( composite->in );
+	VIPS_FREE( composite->channels );
+	g_free( composite );
+}
+
+static void *
+vis_kernel_composite_start( VipsImage *out, void *a, void *b )
+{
+	VisKernelComposite *composite = (VisKernelComposite *) b;
+
+	VisKernelSeq *seq;
+
+	seq = g_new0( VisKernelSeq, 1 );
+	if( !(seq->ir = vips_start_many( out, composite->in, NULL )) ) {
+		g_free( seq );
+		return( NULL );
+	}
+
+	return( seq );
+}
+
+/* Window one channel, tint, and add to the accumulators.
+ */
+#define ACCUMULATE( TYPE ) { \
+	TYPE *p = (TYPE *) in; \
+	\
+	for( x = 0; x < width; x++ ) { \
+		double v = ((double) p[x] - low) * scale; \
+		\
+		v = VIPS_CLIP( 0.0, v, 1.0 ); \
+		acc[0] += v * tint[0]; \
+		acc[1] += v * tint[1]; \
+		acc[2] += v * tint[2]; \
+		acc += 3; \
+	} \
+}
+
+static int
+vis_kernel_composite_generate( VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop )
+{
+	VisKernelSeq *seq = (VisKernelSeq *) vseq;
+	VisKernelComposite *composite = (VisKernelComposite *) b;
+	VipsRect *r = &out_region->valid;
+	int width = r->width;
+
+	int i, x, y;
+
+	for( i = 0; i < composite->n; i++ )
+		if( vips_region_prepare( seq->ir[i], r ) )
+			return( -1 );
+
+	if( seq->width < width ) {
+		VIPS_FREE( seq->acc );
+		seq->acc = g_new( double, 3 * width );
+		seq->width = width;
+	}
+
+	for( y = 0; y < r->height; y++ ) {
+		VipsPel *q = VIPS_REGION_ADDR( out_region,
+			r->left, r->top + y );
+
+		memset( seq->acc, 0, 3 * width * sizeof( double ) );
+
+		for( i = 0; i < composite->n; i++ ) {
+			VisKernelChannel *channel = &composite->channels[i];
+			double *tint = channel->tint;
+			double low = channel->low;
+			double scale = 1.0 /
+				VIPS_MAX( 1e-10, channel->high - low );
+			VipsPel *in = VIPS_REGION_ADDR( seq->ir[i],
+				r->left, r->top + y );
+			double *acc = seq->acc;
+
+			switch( seq->ir[i]->im->BandFmt ) {
+			case VIPS_FORMAT_UCHAR:
+				ACCUMULATE( unsigned char );
+				break;
+
+			case VIPS_FORMAT_CHAR:
+				ACCUMULATE( signed char );
+				break;
+
+			case VIPS_FORMAT_USHORT:
+				ACCUMULATE( unsigned short );
+				break;
+
+			case VIPS_FORMAT_SHORT:
+				ACCUMULATE( signed short );
+				break;
+
+			case VIPS_FORMAT_UINT:
+				ACCUMULATE( unsigned int );
+				break;
+
+			case VIPS_FORMAT_INT:
+				ACCUMULATE( signed int );
+				break;
+
+			case VIPS_FORMAT_FLOAT:
+				ACCUMULATE( float );
+				break;
+
+			case VIPS_FORMAT_DOUBLE:
+				ACCUMULATE( double );
+				break;
+
+			default:
+				g_assert_not_reached();
+			}
+		}
+
+		for( x = 0; x < 3 * width; x++ )
+			q[x] = VIPS_CLIP( 0, seq->acc[x] * 255.0 + 0.5, 255 );
+	}
+
+	return( 0 );
+}
+
+static int
+vis_kernel_composite_stop( void *vseq, void *a, void *b )
+{
+	VisKernelSeq *seq = (VisKernelSeq *) vseq;
+
+	vips_stop_many( seq->ir, NULL, NULL );
+	VIPS_FREE( seq->acc );
+	g_free( seq );
+
+	return( 0 );
+}
+
+int
+vis_kernel_composite( VipsImage **in, VisKernelChannel *channels, int n,
+	VipsImage **out )
+{
+	VisKernelComposite *composite;
+	int i;
+
+	if( n < 1 ) {
+		vips_error( "vis_kernel_composite", "%s", _( "no channels" ) );
+		return( -1 );
+	}
+
+	composite = g_new0( VisKernelComposite, 1 );
+	composite->in = g_new0( VipsImage *, n + 1 );
+	composite->channels = g_new( VisKernelChannel, n );
+	memcpy( composite->channels, channels, n * sizeof( VisKernelChannel ) );
+
+	*out = vips_image_new();
+	g_signal_connect( *out, "close",
+		G_CALLBACK( vis_kernel_composite_free ), composite );
+
+	/* We need one band, real pixels. Complex images become their
+	 * modulus.
+	 */
+	for( i = 0; i < n; i++ ) {
+		VipsImage *x;
+
+		if( vips_image_get_coding( in[i] ) != VIPS_CODING_NONE ||
+			in[i]->Bands != 1 ) {
+			vips_error( "vis_kernel_composite",
+				"%s", _( "channels must be uncoded, one band" ) );
+			VIPS_UNREF( *out );
+			return( -1 );
+		}
+
+		if( vips_band_format_iscomplex( in[i]->BandFmt ) ) {
+			if( vips_abs( in[i], &x, NULL ) ) {
+				VIPS_UNREF( *out );
+				return( -1 );
+			}
+		}
+		else {
+			x = in[i];
+			g_object_ref( x );
+		}
+
+		composite->in[composite->n++] = x;
+	}
+
+	if( vips_image_pipeline_array( *out,
+		VIPS_DEMAND_STYLE_THINSTRIP, composite->in ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	(*out)->Bands = 3;
+	(*out)->BandFmt = VIPS_FORMAT_UCHAR;
+	(*out)->Type = VIPS_INTERPRETATION_sRGB;
+	(*out)->Coding = VIPS_CODING_NONE;
+
+	if( vips_image_generate( *out,
+		vis_kernel_composite_start,
+		vis_kernel_composite_generate,
+		vis_kernel_composite_stop,
+		composite->in, composite ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+struct _VisKernelRGB {
+	VisKernelMap map;
+
+	/* The source pixel format.
+	 */
+	VipsBandFormat format;
+	int bands;
+	int n_colour;
+	gboolean has_alpha;
+
+	/* 16-bit interpretations are shifted down to 8 bits at the end.
+	 */
+	double divide;
+
+	/* For 8- and 16-bit formats, the mapped value for every possible
+	 * input, indexed by value - lut_min.
+	 */
+	VipsPel *lut;
+	int lut_min;
+
+	/* If we're generating an image, we hold a ref to the input.
+	 */
+	VipsImage *in;
+};
+
+static VipsPel vis_kernel_falsecolour_table[256][3];
+
+static void *
+vis_kernel_falsecolour_init( void *data )
+{
+	VipsImage *context = vips_image_new();
+	VipsImage **t = (VipsImage **) 
+		vips_object_local_array( VIPS_OBJECT( context ), 2 );
+
+	void *mem;
+	size_t size;
+
+	/* Render the libvips falsecolour map once, so we match it exactly.
+	 */
+	if( vips_identity( &t[0], NULL ) ||
+		vips_falsecolour( t[0], &t[1], NULL ) ||
+		!(mem = vips_image_write_to_memory( t[1], &size )) ) {
+		g_object_unref( context );
+		return( GINT_TO_POINTER( -1 ) );
+	}
+	g_object_unref( context );
+
+	if( size != sizeof( vis_kernel_falsecolour_table ) ) {
+		g_free( mem );
+		vips_error( "vis_kernel_rgb", "%s", 
+			_( "unexpected falsecolour map" ) );
+		return( GINT_TO_POINTER( -1 ) );
+	}
+
+	memcpy( vis_kernel_falsecolour_table, mem, size );
+	g_free( mem );
+
+	return( GINT_TO_POINTER( 0 ) );
+}
+
+static int
+vis_kernel_n_colour( VipsImage *in )
+{
+	switch( in->Type ) {
+	case VIPS_INTERPRETATION_B_W:
+	case VIPS_INTERPRETATION_GREY16:
+		return( 1 );
+
+	case VIPS_INTERPRETATION_sRGB:
+	case VIPS_INTERPRETATION_RGB16:
+		return( 3 );
+
+	default:
+		return( 0 );
+	}
+}
+
+gboolean
+vis_kernel_rgb_supported( VipsImage *in )
+{
+	int n_colour = vis_kernel_n_colour( in );
+
+	return( vips_image_get_coding( in ) == VIPS_CODING_NONE &&
+		!vips_band_format_iscomplex( in->BandFmt ) &&
+		n_colour > 0 &&
+		in->Bands >= n_colour );
+}
+
+/* Map one source value to display uchar, exactly as the chain of libvips
+ * operations in tile_source_rgb_image() would.
+ */
+static VipsPel
+vis_kernel_rgb_value( VisKernelRGB *rgb, double v )
+{
+	if( rgb->map.log ) 
+		v = vis_kernel_log( v );
+
+	v = (v * rgb->map.scale + rgb->map.offset) / rgb->divide;
+
+	/* Written so that NaN goes to zero.
+	 */
+	return( v > 0.0 ? (v < 255.0 ? v : 255.0) : 0.0 );
+}
+
+/* Make the lookup table for 8- and 16-bit formats.
+ */
+static void
+vis_kernel_rgb_build_lut( VisKernelRGB *rgb )
+{
+	int min;
+	int max;
+	int i;
+
+	switch( rgb->format ) {
+	case VIPS_FORMAT_UCHAR:
+		min = 0;
+		max = G_MAXUINT8;
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		min = G_MININT8;
+		max = G_MAXINT8;
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		min = 0;
+		max = G_MAXUINT16;
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		min = G_MININT16;
+		max = G_MAXINT16;
+		break;
+
+	default:
+		return;
+	}
+
+	rgb->lut = g_new( VipsPel, max - min + 1 );
+	rgb->lut_min = min;
+	for( i = min; i <= max; i++ )
+		rgb->lut[i - min] = vis_kernel_rgb_value( rgb, i );
+}
+
+VisKernelRGB *
+vis_kernel_rgb_new( VipsImage *in, VisKernelMap *map )
+{
+	static GOnce falsecolour_once = G_ONCE_INIT;
+
+	VisKernelRGB *rgb;
+
+	if( !vis_kernel_rgb_supported( in ) ) {
+		vips_error( "vis_kernel_rgb", "%s", _( "unsupported image" ) );
+		return( NULL );
+	}
+
+	if( map->falsecolour &&
+		GPOINTER_TO_INT( g_once( &falsecolour_once,
+			vis_kernel_falsecolour_init, NULL ) ) ) 
+		return( NULL );
+
+	rgb = g_new0( VisKernelRGB, 1 );
+	rgb->map = *map;
+	rgb->format = in->BandFmt;
+	rgb->bands = in->Bands;
+	rgb->n_colour = vis_kernel_n_colour( in );
+	rgb->has_alpha = in->Bands > rgb->n_colour;
+	rgb->divide = in->Type == VIPS_INTERPRETATION_GREY16 ||
+		in->Type == VIPS_INTERPRETATION_RGB16 ? 256.0 : 1.0;
+	vis_kernel_rgb_build_lut( rgb );
+
+	return( rgb );
+}
+
+void
+vis_kernel_rgb_free( VisKernelRGB *rgb )
+{
+	VIPS_UNREF( rgb->in );
+	VIPS_FREE( rgb->lut );
+	g_free( rgb );
+}
+
+#define MAP_LUT( TYPE ) { \
+	TYPE *p = (TYPE *) in; \
+	\
+	for( x = 0; x < n; x++ ) \
+		line[x] = lut[(int) p[x] - lut_min]; \
+}
+
+/* No log, so just a multiply-add and a clip per value, which the compiler
+ * can vectorise.
+ */
+#define MAP_LINEAR( TYPE ) { \
+	TYPE *p = (TYPE *) in; \
+	\
+	for( x = 0; x < n; x++ ) { \
+		double v = p[x] * scale + offset; \
+		\
+		line[x] = v > 0.0 ? (v < 255.0 ? v : 255.0) : 0.0; \
+	} \
+}
+
+#define MAP_LOG( TYPE ) { \
+	TYPE *p = (TYPE *) in; \
+	\
+	for( x = 0; x < n; x++ ) \
+		line[x] = vis_kernel_rgb_value( rgb, p[x] ); \
+}
+
+#define MAP_FLOAT( TYPE ) { \
+	if( rgb->map.log ) \
+		MAP_LOG( TYPE ) \
+	else \
+		MAP_LINEAR( TYPE ) \
+}
+
+/* Alpha is not mapped, just clipped, like vips_cast().
+ */
+#define ALPHA( TYPE ) { \
+	TYPE *p = (TYPE *) in + rgb->n_colour; \
+	\
+	for( x = 0; x < width; x++ ) { \
+		double v = p[x * bands]; \
+		\
+		out[x * 4 + 3] = v > 0.0 ? (v < 255.0 ? v : 255.0) : 0.0; \
+	} \
+}
+
+void
+vis_kernel_rgb_map( VisKernelRGB *rgb, 
+	VipsPel *in, size_t in_lskip, VipsPel *out, size_t out_lskip, 
+	int width, int height )
+{
+	int bands = rgb->bands;
+	int n = width * bands;
+	int out_bands = rgb->has_alpha ? 4 : 3;
+	double scale = rgb->map.scale / rgb->divide;
+	double offset = rgb->map.offset / rgb->divide;
+	VipsPel *lut = rgb->lut;
+	int lut_min = rgb->lut_min;
+
+	VipsPel *line;
+	int x, y;
+
+	line = g_new( VipsPel, n );
+
+	for( y = 0; y < height; y++ ) {
+		/* Map every band of the line in a single pass.
+		 */
+		switch( rgb->format ) {
+		case VIPS_FORMAT_UCHAR:
+			MAP_LUT( unsigned char );
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			MAP_LUT( signed char );
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			MAP_LUT( unsigned short );
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			MAP_LUT( signed short );
+			break;
+
+		case VIPS_FORMAT_UINT:
+			MAP_FLOAT( unsigned int );
+			break;
+
+		case VIPS_FORMAT_INT:
+			MAP_FLOAT( signed int );
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			MAP_FLOAT( float );
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			MAP_FLOAT( double );
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+
+		/* Then expand to RGB.
+		 */
+		for( x = 0; x < width; x++ ) {
+			VipsPel *s = line + x * bands;
+			VipsPel *d = out + x * out_bands;
+
+			if( rgb->map.falsecolour ) {
+				VipsPel *c = vis_kernel_falsecolour_table[s[0]];
+
+				d[0] = c[0];
+				d[1] = c[1];
+				d[2] = c[2];
+			}
+			else if( rgb->n_colour == 1 ) {
+				d[0] = s[0];
+				d[1] = s[0];
+				d[2] = s[0];
+			}
+			else {
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+			}
+		}
+
+		if( rgb->has_alpha ) 
+			switch( rgb->format ) {
+			case VIPS_FORMAT_UCHAR:
+				ALPHA( unsigned char );
+				break;
+
+			case VIPS_FORMAT_CHAR:
+				ALPHA( signed char );
+				break;
+
+			case VIPS_FORMAT_USHORT:
+				ALPHA( unsigned short );
+				break;
+
+			case VIPS_FORMAT_SHORT:
+				ALPHA( signed short );
+				break;
+
+			case VIPS_FORMAT_UINT:
+				ALPHA( unsigned int );
+				break;
+
+			case VIPS_FORMAT_INT:
+				ALPHA( signed int );
+				break;
+
+			case VIPS_FORMAT_FLOAT:
+				ALPHA( float );
+				break;
+
+			case VIPS_FORMAT_DOUBLE:
+				ALPHA( double );
+				break;
+
+			default:
+				g_assert_not_reached();
+			}
+
+		in += in_lskip;
+		out += out_lskip;
+	}
+
+	g_free( line );
+}
+
+static void
+vis_kernel_rgb_close( VipsImage *image, VisKernelRGB *rgb )
+{
+	vis_kernel_rgb_free( rgb );
+}
+
+static int
+vis_kernel_rgb_generate( VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop )
+{
+	VipsRegion *ir = (VipsRegion *) vseq;
+	VisKernelRGB *rgb = (VisKernelRGB *) b;
+	VipsRect *r = &out_region->valid;
+
+	if( vips_region_prepare( ir, r ) )
+		return( -1 );
+
+	vis_kernel_rgb_map( rgb, 
+		VIPS_REGION_ADDR( ir, r->left, r->top ), 
+		VIPS_REGION_LSKIP( ir ),
+		VIPS_REGION_ADDR( out_region, r->left, r->top ),
+		VIPS_REGION_LSKIP( out_region ),
+		r->width, r->height );
+
+	return( 0 );
+}
+
+int
+vis_kernel_rgb( VipsImage *in, VisKernelMap *map, VipsImage **out )
+{
+	VisKernelRGB *rgb;
+
+	if( !(rgb = vis_kernel_rgb_new( in, map )) )
+		return( -1 );
+	rgb->in = in;
+	g_object_ref( in );
+
+	*out = vips_image_new();
+	g_signal_connect( *out, "close",
+		G_CALLBACK( vis_kernel_rgb_close ), rgb );
+
+	if( vips_image_pipelinev( *out,
+		VIPS_DEMAND_STYLE_THINSTRIP, in, NULL ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	(*out)->Bands = rgb->has_alpha ? 4 : 3;
+	(*out)->BandFmt = VIPS_FORMAT_UCHAR;
+	(*out)->Type = VIPS_INTERPRETATION_sRGB;
+
+	if( vips_image_generate( *out,
+		vips_start_one, vis_kernel_rgb_generate, vips_stop_one,
+		in, rgb ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+/* A colour transform sampled on a grid. These are shared between all images
+ * with the same embedded profile, interpretation and display profile.
+ */
+typedef struct _VisKernelIccLut {
+	int ref_count;
+
+	/* 3 for RGB, 4 for CMYK.
+	 */
+	int n_in;
+
+	/* Grid points along each axis, and size ** n_in RGB triples in 
+	 * 0 - 255, with the first axis varying slowest.
+	 */
+	int size;
+	float *table;
+} VisKernelIccLut;
+
+/* The usual grid sizes for RGB and CMYK device links.
+ */
+#define VIS_KERNEL_ICC_RGB_SIZE (33)
+#define VIS_KERNEL_ICC_CMYK_SIZE (17)
+
+/* Enough for several windows with different profiles.
+ */
+#define VIS_KERNEL_ICC_MAX_LUTS (16)
+
+static GMutex vis_kernel_icc_lock;
+static GHashTable *vis_kernel_icc_cache = NULL;
+static int vis_kernel_icc_n_builds = 0;
+static int vis_kernel_icc_n_hits = 0;
+
+static int
+vis_kernel_icc_n_in( VipsImage *in )
+{
+	switch( in->Type ) {
+	case VIPS_INTERPRETATION_sRGB:
+	case VIPS_INTERPRETATION_RGB:
+		return( 3 );
+
+	case VIPS_INTERPRETATION_CMYK:
+		return( 4 );
+
+	default:
+		return( 0 );
+	}
+}
+
+gboolean
+vis_kernel_icc_supported( VipsImage *in )
+{
+	int n_in = vis_kernel_icc_n_in( in );
+
+	return( vips_image_get_coding( in ) == VIPS_CODING_NONE &&
+		in->BandFmt == VIPS_FORMAT_UCHAR &&
+		n_in > 0 &&
+		(in->Bands == n_in || in->Bands == n_in + 1) );
+}
+
+static void
+vis_kernel_icc_lut_unref( VisKernelIccLut *lut )
+{
+	if( g_atomic_int_dec_and_test( &lut->ref_count ) ) {
+		VIPS_FREE( lut->table );
+		g_free( lut );
+	}
+}
+
+/* Run the transform the operation chain would use on every grid point. We 
+ * ask for 16 bits out so the interpolation has something to work with.
+ */
+static VisKernelIccLut *
+vis_kernel_icc_lut_build( VipsImage *in, const char *profile )
+{
+	int n_in = vis_kernel_icc_n_in( in );
+	int size = n_in == 4 ? 
+		VIS_KERNEL_ICC_CMYK_SIZE : VIS_KERNEL_ICC_RGB_SIZE;
+
+	VipsImage *context;
+	VipsImage **t;
+	VisKernelIccLut *lut;
+	int n_points;
+	VipsPel *grid;
+	float *mem;
+	size_t length;
+	double scale;
+	int i, a;
+
+	n_points = 1;
+	for( a = 0; a < n_in; a++ )
+		n_points *= size;
+
+	grid = g_new( VipsPel, n_points * n_in );
+	for( i = 0; i < n_points; i++ ) {
+		int n = i;
+
+		for( a = n_in - 1; a >= 0; a-- ) {
+			grid[i * n_in + a] = 
+				VIPS_RINT( (n % size) * 255.0 / (size - 1) );
+			n /= size;
+		}
+	}
+
+	context = vips_image_new();
+	t = (VipsImage **) vips_object_local_array( VIPS_OBJECT( context ), 4 );
+	if( !(t[0] = vips_image_new_from_memory( grid, n_points * n_in, 
+		n_points, 1, n_in, VIPS_FORMAT_UCHAR )) ||
+		vips_copy( t[0], &t[1], "interpretation", in->Type, NULL ) ) {
+		g_object_unref( context );
+		g_free( grid );
+		return( NULL );
+	}
+
+	if( vips_image_get_typeof( in, VIPS_META_ICC_NAME ) ) {
+		const void *data;
+
+		if( vips_image_get_blob( in, VIPS_META_ICC_NAME, 
+			&data, &length ) ) {
+			g_object_unref( context );
+			g_free( grid );
+			return( NULL );
+		}
+		vips_image_set_blob_copy( t[1], VIPS_META_ICC_NAME, 
+			data, length );
+	}
+
+	if( vips_icc_transform( t[1], &t[2], profile, "depth", 16, NULL ) ||
+		vips_cast( t[2], &t[3], VIPS_FORMAT_FLOAT, NULL ) ||
+		!(mem = vips_image_write_to_memory( t[3], &length )) ) {
+		g_object_unref( context );
+		g_free( grid );
+		return( NULL );
+	}
+	g_free( grid );
+
+	if( t[3]->Bands < 3 ) {
+		g_object_unref( context );
+		g_free( mem );
+		vips_error( "vis_kernel_icc", "%s", 
+			_( "display profile is not RGB" ) );
+		return( NULL );
+	}
+
+	lut = g_new0( VisKernelIccLut, 1 );
+	lut->ref_count = 1;
+	lut->n_in = n_in;
+	lut->size = size;
+	lut->table = g_new( float, n_points * 3 );
+	scale = 255.0 / vis_kernel_format_max( t[2]->BandFmt );
+	for( i = 0; i < n_points; i++ )
+		for( a = 0; a < 3; a++ )
+			lut->table[i * 3 + a] = 
+				mem[i * t[3]->Bands + a] * scale;
+
+	g_object_unref( context );
+	g_free( mem );
+
+#ifdef DEBUG
+	printf( "vis_kernel_icc_lut_build: %d points to %s\n", 
+		n_points, profile );
+#endif /*DEBUG*/
+
+	return( lut );
+}
+
+/* Find or make the LUT for an image, plus a ref for the caller.
+ */
+static VisKernelIccLut *
+vis_kernel_icc_lut_get( VipsImage *in, const char *profile )
+{
+	VisKernelIccLut *lut;
+	char *checksum;
+	char *key;
+
+	if( vips_image_get_typeof( in, VIPS_META_ICC_NAME ) ) {
+		const void *data;
+		size_t length;
+
+		if( vips_image_get_blob( in, VIPS_META_ICC_NAME, 
+			&data, &length ) )
+			return( NULL );
+		checksum = g_compute_checksum_for_data( G_CHECKSUM_SHA1, 
+			data, length );
+	}
+	else
+		checksum = g_strdup( "none" );
+	key = g_strdup_printf( "%s:%d:%s", checksum, in->Type, profile );
+	g_free( checksum );
+
+	g_mutex_lock( &vis_kernel_icc_lock );
+	if( !vis_kernel_icc_cache )
+		vis_kernel_icc_cache = g_hash_table_new_full( 
+			g_str_hash, g_str_equal, 
+			g_free, (GDestroyNotify) vis_kernel_icc_lut_unref );
+	if( (lut = g_hash_table_lookup( vis_kernel_icc_cache, key )) ) {
+		g_atomic_int_inc( &lut->ref_count );
+		vis_kernel_icc_n_hits += 1;
+		g_mutex_unlock( &vis_kernel_icc_lock );
+		g_free( key );
+
+		return( lut );
+	}
+	g_mutex_unlock( &vis_kernel_icc_lock );
+
+	/* Build outside the lock, it can take a moment.
+	 */
+	if( !(lut = vis_kernel_icc_lut_build( in, profile )) ) {
+		g_free( key );
+		return( NULL );
+	}
+
+	g_mutex_lock( &vis_kernel_icc_lock );
+	if( g_hash_table_size( vis_kernel_icc_cache ) >= 
+		VIS_KERNEL_ICC_MAX_LUTS )
+		g_hash_table_remove_all( vis_kernel_icc_cache );
+	g_atomic_int_inc( &lut->ref_count );
+	g_hash_table_replace( vis_kernel_icc_cache, key, lut );
+	vis_kernel_icc_n_builds += 1;
+	g_mutex_unlock( &vis_kernel_icc_lock );
+
+	return( lut );
+}
+
+/* State for an ICC transform, owned by the output image.
+ */
+typedef struct _VisKernelIcc {
+	VipsImage *in;
+	VisKernelIccLut *lut;
+	gboolean has_alpha;
+
+	/* For every input value, the table offset of the grid point below 
+	 * along each axis, and the weight of the grid point above.
+	 */
+	int offset[4][256];
+	float weight[256];
+
+	/* Table offsets of the corners of a grid cell.
+	 */
+	int n_corners;
+	int corner[16];
+} VisKernelIcc;
+
+static void
+vis_kernel_icc_close( VipsImage *image, VisKernelIcc *icc )
+{
+	VIPS_UNREF( icc->in );
+	VIPS_FREEF( vis_kernel_icc_lut_unref, icc->lut );
+	g_free( icc );
+}
+
+static int
+vis_kernel_icc_generate( VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop )
+{
+	VipsRegion *ir = (VipsRegion *) vseq;
+	VisKernelIcc *icc = (VisKernelIcc *) b;
+	VipsRect *r = &out_region->valid;
+	int n_in = icc->lut->n_in;
+	int in_bands = icc->in->Bands;
+	int out_bands = out_region->im->Bands;
+	float *table = icc->lut->table;
+
+	int x, y, i, c;
+
+	if( vips_region_prepare( ir, r ) )
+		return( -1 );
+
+	for( y = 0; y < r->height; y++ ) {
+		VipsPel *p = VIPS_REGION_ADDR( ir, r->left, r->top + y );
+		VipsPel *q = VIPS_REGION_ADDR( out_region, 
+			r->left, r->top + y );
+
+		for( x = 0; x < r->width; x++ ) {
+			float w[4];
+			int base;
+			float acc[3];
+
+			base = 0;
+			for( i = 0; i < n_in; i++ ) {
+				base += icc->offset[i][p[i]];
+				w[i] = icc->weight[p[i]];
+			}
+
+			/* Interpolate between the corners of the cell. For
+			 * CMYK that's linear in K between two trilinears.
+			 */
+			acc[0] = acc[1] = acc[2] = 0.0;
+			for( c = 0; c < icc->n_corners; c++ ) {
+				float *v = table + base + icc->corner[c];
+				float f = 1.0;
+
+				for( i = 0; i < n_in; i++ )
+					f *= (c >> i) & 1 ? w[i] : 1.0 - w[i];
+
+				acc[0] += f * v[0];
+				acc[1] += f * v[1];
+				acc[2] += f * v[2];
+			}
+
+			q[0] = acc[0] + 0.5;
+			q[1] = acc[1] + 0.5;
+			q[2] = acc[2] + 0.5;
+			if( icc->has_alpha )
+				q[3] = p[n_in];
+
+			p += in_bands;
+			q += out_bands;
+		}
+	}
+
+	return( 0 );
+}
+
+int
+vis_kernel_icc( VipsImage *in, const char *profile, VipsImage **out )
+{
+	VisKernelIcc *icc;
+	int stride[4];
+	int size;
+	int n_in;
+	int i, v, c;
+
+	if( !vis_kernel_icc_supported( in ) ) {
+		vips_error( "vis_kernel_icc", "%s", _( "unsupported image" ) );
+		return( -1 );
+	}
+
+	icc = g_new0( VisKernelIcc, 1 );
+	if( !(icc->lut = vis_kernel_icc_lut_get( in, profile )) ) {
+		g_free( icc );
+		return( -1 );
+	}
+	icc->in = in;
+	g_object_ref( in );
+
+	n_in = icc->lut->n_in;
+	size = icc->lut->size;
+	icc->has_alpha = in->Bands > n_in;
+
+	stride[n_in - 1] = 3;
+	for( i = n_in - 2; i >= 0; i-- )
+		stride[i] = stride[i + 1] * size;
+
+	for( v = 0; v < 256; v++ ) {
+		double f = v * (size - 1) / 255.0;
+		int j = VIPS_MIN( (int) f, size - 2 );
+
+		for( i = 0; i < n_in; i++ )
+			icc->offset[i][v] = j * stride[i];
+		icc->weight[v] = f - j;
+	}
+
+	icc->n_corners = 1 << n_in;
+	for( c = 0; c < icc->n_corners; c++ ) {
+		icc->corner[c] = 0;
+		for( i = 0; i < n_in; i++ )
+			if( (c >> i) & 1 )
+				icc->corner[c] += stride[i];
+	}
+
+	*out = vips_image_new();
+	g_signal_connect( *out, "close",
+		G_CALLBACK( vis_kernel_icc_close ), icc );
+
+	if( vips_image_pipelinev( *out,
+		VIPS_DEMAND_STYLE_THINSTRIP, in, NULL ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	(*out)->Bands = icc->has_alpha ? 4 : 3;
+	(*out)->BandFmt = VIPS_FORMAT_UCHAR;
+	(*out)->Type = VIPS_INTERPRETATION_sRGB;
+
+	if( vips_image_generate( *out,
+		vips_start_one, vis_kernel_icc_generate, vips_stop_one,
+		in, icc ) ) {
+		VIPS_UNREF( *out );
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+void
+vis_kernel_print_stats( VipsBuf *buf )
+{
+	g_mutex_lock( &vis_kernel_icc_lock );
+	if( vis_kernel_icc_n_builds > 0 )
+		vips_buf_appendf( buf, "icc luts: %d cached, "
+			"%d builds, %d hits\n",
+			g_hash_table_size( vis_kernel_icc_cache ),
+			vis_kernel_icc_n_builds,
+			vis_kernel_icc_n_hits );
+	g_mutex_unlock( &vis_kernel_icc_lock );
+}
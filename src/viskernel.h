@@ -0,0 +1,78 @@
+/* Fused visualisation kernels: several display operations done in a single
+ * pass over the pixels.
+ */
+
+#ifndef __VIS_KERNEL_H
+#define __VIS_KERNEL_H
+
+/* How to show one channel in a composite. Values from low to high are mapped
+ * to 0 - 1, then multiplied by tint, an RGB colour in 0 - 1.
+ */
+typedef struct _VisKernelChannel {
+	gboolean selected;
+	double tint[3];
+	double low;
+	double high;
+} VisKernelChannel;
+
+/* Map a value as the log display does, and back again.
+ */
+double vis_kernel_log( double v );
+double vis_kernel_log_invert( double v );
+
+/* The natural maximum value for a band format, eg. 255 for uchar.
+ */
+double vis_kernel_format_max( VipsBandFormat format );
+
+/* Window, tint and sum n one-band images to make a uchar sRGB image.
+ * Only these inputs are computed, so cost is proportional to n.
+ */
+int vis_kernel_composite( VipsImage **in, VisKernelChannel *channels, int n,
+	VipsImage **out );
+
+/* Display settings for vis_kernel_rgb().
+ */
+typedef struct _VisKernelMap {
+	double scale;
+	double offset;
+	gboolean log;
+	gboolean falsecolour;
+} VisKernelMap;
+
+/* TRUE if vis_kernel_rgb() can handle this image: uncoded, real, and tagged 
+ * as B_W, GREY16, sRGB or RGB16, with an optional alpha.
+ */
+gboolean vis_kernel_rgb_supported( VipsImage *in );
+
+/* Log, scale and offset, cast, expand to RGB and falsecolour in a single 
+ * pass to make a uchar sRGB(A) image. 8- and 16-bit images go via a lookup 
+ * table.
+ */
+int vis_kernel_rgb( VipsImage *in, VisKernelMap *map, VipsImage **out );
+
+/* The same mapping for pixels in memory, for example to remap a tile when the 
+ * display settings change. in is only used for the pixel format.
+ */
+typedef struct _VisKernelRGB VisKernelRGB;
+
+VisKernelRGB *vis_kernel_rgb_new( VipsImage *in, VisKernelMap *map );
+void vis_kernel_rgb_free( VisKernelRGB *rgb );
+void vis_kernel_rgb_map( VisKernelRGB *rgb, 
+	VipsPel *in, size_t in_lskip, VipsPel *out, size_t out_lskip, 
+	int width, int height );
+
+/* TRUE if vis_kernel_icc() can handle this image: uchar sRGB, RGB or CMYK, 
+ * with an optional alpha.
+ */
+gboolean vis_kernel_icc_supported( VipsImage *in );
+
+/* Colour manage to profile (eg. "srgb", or the filename of a monitor 
+ * profile) using a sampled version of the transform, cached per embedded 
+ * profile. The result is uchar sRGB(A) and matches vips_icc_transform() to 
+ * within a level or so.
+ */
+int vis_kernel_icc( VipsImage *in, const char *profile, VipsImage **out );
+
+void vis_kernel_print_stats( VipsBuf *buf );
+
+#endif /*__VIS_KERNEL_H*/